@@ -192,14 +192,21 @@ void FiffRawViewModel::initFiffData(QIODevice& p_IODevice)
     int start = m_iFiffCursorBegin;
     m_iSamplesPerBlock = m_pFiffInfo->sfreq;
 
+    // blocks are read through the cache, which reads ahead in scroll direction in the background
+    m_pBlockCache = FiffRawBlockCache::SPtr::create(*m_pFiffIO->m_qlistRaw[0],
+                                                    m_iSamplesPerBlock,
+                                                    256 * 1024 * 1024,
+                                                    m_iPreloadBufferSize);
+
     // for some reason the read_raw_segment function works with inclusive upper bound
     int end = start + (m_iSamplesPerBlock * m_iTotalBlockCount) - 1;
 
     // read in all blocks, use the already prepared list m_lData
-    if(m_pFiffIO->m_qlistRaw[0]->read_raw_segment(data,
-                                                  times,
-                                                  start,
-                                                  end)) {
+    if(m_pBlockCache->read_raw_segment(data,
+                                       times,
+                                       start,
+                                       end,
+                                       1)) {
         // qDebug() << "[FiffRawmodel::loadFiffData] Successfully read a block ";
     } else {
         qWarning() << "[FiffRawViewModel::loadFiffData] Could not read samples " << start << " to " << end;
@@ -482,7 +489,7 @@ int FiffRawViewModel::loadEarlierBlocks(qint32 numBlocks)
     // read data, use the already prepared list m_lNewData
     QElapsedTimer timer;
     timer.start();
-    if(m_pFiffIO->m_qlistRaw[0]->read_raw_segment(data, times, start, end)) {
+    if(m_pBlockCache->read_raw_segment(data, times, start, end, -1)) {
         // qDebug() << "[FiffRawViewModel::loadFiffData] Successfully read a block ";
     } else {
         qWarning() << "[FiffRawViewModel::loadEarlierBlocks] Could not read block ";
@@ -540,7 +547,7 @@ int FiffRawViewModel::loadLaterBlocks(qint32 numBlocks)
     // read data, use the already prepaired list m_lNewData
     QElapsedTimer timer;
     timer.start();
-    if(m_pFiffIO->m_qlistRaw[0]->read_raw_segment(data, times, start, end)) {
+    if(m_pBlockCache->read_raw_segment(data, times, start, end, 1)) {
         // qDebug() << "[FiffRawViewModel::loadFiffData] Successfully read a block ";
     } else {
         qWarning() << "[FiffRawViewModel::loadLaterBlocks] Could not read block ";
@@ -635,6 +642,17 @@ FIFFLIB::FiffInfo* FiffRawViewModel::getFiffInfo() const
 
 //=============================================================================================================
 
+FiffRawBlockCache::Statistics FiffRawViewModel::getBlockCacheStatistics() const
+{
+    if(!m_pBlockCache) {
+        return FiffRawBlockCache::Statistics();
+    }
+
+    return m_pBlockCache->statistics();
+}
+
+//=============================================================================================================
+
 void FiffRawViewModel::setScaling(const QMap< qint32,float >& p_qMapChScaling)
 {
     beginResetModel();
@@ -675,6 +693,11 @@ void FiffRawViewModel::setWindowSize(const int& iNumSeconds,
     m_iPreloadBufferSize = m_iVisibleWindowSize;
     m_iTotalBlockCount = m_iVisibleWindowSize + 2 * m_iPreloadBufferSize;
 
+    // read ahead as far as the new preload buffer reaches
+    if(m_pBlockCache) {
+        m_pBlockCache->setReadAhead(m_iPreloadBufferSize);
+    }
+
     //reload data to accomodate new size
     updateDisplayData();
 
@@ -719,10 +742,11 @@ void FiffRawViewModel::updateDisplayData()
     int end = start + (m_iSamplesPerBlock * m_iTotalBlockCount) - 1;
 
     // read in all blocks, use the already prepared list m_lData
-    if(m_pFiffIO->m_qlistRaw[0]->read_raw_segment(data,
-                                                  times,
-                                                  start,
-                                                  end)) {
+    if(m_pBlockCache->read_raw_segment(data,
+                                       times,
+                                       start,
+                                       end,
+                                       1)) {
         // qDebug() << "[FiffRawmodel::loadFiffData] Successfully read a block ";
     } else {
         qWarning() << "[FiffRawViewModel::loadFiffData] Could not read samples " << start << " to " << end;
@@ -49,6 +49,7 @@
 
 #include <fiff/fiff_ch_info.h>
 #include <fiff/fiff_io.h>
+#include <fiff/fiff_raw_block_cache.h>
 
 //=============================================================================================================
 // QT INCLUDES
@@ -300,6 +301,14 @@ public:
      */
     FIFFLIB::FiffInfo* getFiffInfo() const;
 
+    //=========================================================================================================
+    /**
+     * Returns the hit, miss and prefetch counters of the block cache the data are read through.
+     *
+     * @return the block cache counters.
+     */
+    FIFFLIB::FiffRawBlockCache::Statistics getBlockCacheStatistics() const;
+
     //=========================================================================================================
     /**
      * Returns the kind of channel at the given row index
@@ -525,6 +534,7 @@ private:
 
     // fiff stuff
     QSharedPointer<FIFFLIB::FiffIO>     m_pFiffIO;              /**< Fiff IO */
+    FIFFLIB::FiffRawBlockCache::SPtr    m_pBlockCache;          /**< Block cache the raw data are read through */
     QSharedPointer<FIFFLIB::FiffInfo>   m_pFiffInfo;            /**< Fiff info of whole fiff file */
     QList<FIFFLIB::FiffChInfo>          m_ChannelInfoList;      /**< List of FiffChInfo objects that holds the corresponding channels information */
 
@@ -124,7 +124,7 @@ void FiffProducer::run()
     //
 
     fiff_int_t first, last;
-    MatrixXd data;
+    MatrixXf data;
     MatrixXd times;
 
     first = from;
@@ -158,7 +158,7 @@ void FiffProducer::run()
             printf("error during read_raw_segment\n");
         }
 
-        MatrixXf tmp = data.cast<float>();//(inv_calsMat*data).cast<float>();
+        MatrixXf tmp = data;
 
         if(t_bRestart)
         {
@@ -175,12 +175,10 @@ void FiffProducer::run()
                 printf("error during read_raw_segment\n");
             }
 
-            MatrixXf tmp2 = data.cast<float>();//(inv_calsMat*data).cast<float>();
-
-            MatrixXf tmp3(tmp.rows(), tmp.cols()+tmp2.cols());
+            MatrixXf tmp3(tmp.rows(), tmp.cols()+data.cols());
 
             tmp3.block(0,0,tmp.rows(),tmp.cols()) = tmp;
-            tmp3.block(0,tmp.cols(),tmp.rows(),tmp2.cols()) = tmp2;
+            tmp3.block(0,tmp.cols(),tmp.rows(),data.cols()) = data;
 
             tmp = tmp3;
 
@@ -182,7 +182,8 @@ void FiffSimulatorProducer::run()
             if(kind == FIFF_DATA_BUFFER) {
                 to += matData.cols();
                 from += matData.cols();
-                while(!m_pFiffSimulator->m_pCircularBuffer->push(matData) && !isInterruptionRequested()) {
+                // matData is read anew for every buffer, hand it over without copying
+                while(!m_pFiffSimulator->m_pCircularBuffer->push(std::move(matData)) && !isInterruptionRequested()) {
                     //Do nothing until the circular buffer is ready to accept new data again
                 }
             } else if(FIFF_DATA_BUFFER == FIFF_BLOCK_END) {
@@ -288,14 +288,10 @@ void NeuronalConnectivity::updateSource(SCMEASLIB::Measurement::SPtr pMeasuremen
                                                                            pRTSE->getValue()[i]->data.cols() - iZeroIdx));
         }
 
-        //Pop data from buffer
-        if(m_connectivitySettings.size() >= m_iNumberAverages) {
-            m_pRtConnectivity->restart();
-            m_connectivitySettings.removeFirst(m_connectivitySettings.size()-m_iNumberAverages);
-        }
-
+        // Hand the new trials to the worker, which keeps the sliding window of the last m_iNumberAverages trials
         m_timer.restart();
-        m_pRtConnectivity->append(m_connectivitySettings);
+        m_pRtConnectivity->appendIncremental(m_connectivitySettings, m_iNumberAverages);
+        m_connectivitySettings.clearAllData();
     }
 }
 
@@ -357,14 +353,10 @@ void NeuronalConnectivity::updateRTMSA(SCMEASLIB::Measurement::SPtr pMeasurement
                 m_connectivitySettings.append(data);
             }
 
-            //Pop data from buffer
-            if(m_connectivitySettings.size() > m_iNumberAverages) {
-                m_pRtConnectivity->restart();
-                m_connectivitySettings.removeFirst(m_connectivitySettings.size()-m_iNumberAverages);
-            }
-
+            // Hand the new trials to the worker, which keeps the sliding window of the last m_iNumberAverages trials
             m_timer.restart();
-            m_pRtConnectivity->append(m_connectivitySettings);
+            m_pRtConnectivity->appendIncremental(m_connectivitySettings, m_iNumberAverages);
+            m_connectivitySettings.clearAllData();
         }
     }
 }
@@ -440,14 +432,10 @@ void NeuronalConnectivity::updateRTEV(SCMEASLIB::Measurement::SPtr pMeasurement)
 
                     m_connectivitySettings.append(data);
 
-                    //Pop data from buffer
-                    if(m_connectivitySettings.size() > m_iNumberAverages) {
-                        m_pRtConnectivity->restart();
-                        m_connectivitySettings.removeFirst(m_connectivitySettings.size()-m_iNumberAverages);
-                    }
-
+                    // Hand the new trials to the worker, which keeps the sliding window of the last m_iNumberAverages trials
                     m_timer.restart();
-                    m_pRtConnectivity->append(m_connectivitySettings);
+                    m_pRtConnectivity->appendIncremental(m_connectivitySettings, m_iNumberAverages);
+                    m_connectivitySettings.clearAllData();
 
                     break;
                 }
@@ -542,8 +530,7 @@ void NeuronalConnectivity::run()
 void NeuronalConnectivity::onNewConnectivityResultAvailable(const QList<Network>& connectivityResults,
                                                             const ConnectivitySettings& connectivitySettings)
 {
-    m_connectivitySettings = connectivitySettings;
-    m_connectivitySettings.setConnectivityMethods(m_sConnectivityMethods);
+    Q_UNUSED(connectivitySettings);
 
     for(int i = 0; i < connectivityResults.size(); ++i) {
         m_pCircularBuffer->push(connectivityResults.at(i));
@@ -560,9 +547,9 @@ void NeuronalConnectivity::onMetricChanged(const QString& sMetric)
 
     m_sConnectivityMethods = QStringList() << sMetric;
     m_connectivitySettings.setConnectivityMethods(m_sConnectivityMethods);
+    // Derive the new metric from the trials the worker already holds
     if(m_pRtConnectivity && this->isRunning()) {
-        m_pRtConnectivity->restart();
-        m_pRtConnectivity->append(m_connectivitySettings);
+        m_pRtConnectivity->appendIncremental(m_connectivitySettings, m_iNumberAverages);
     }
 }
 
@@ -589,6 +576,7 @@ void NeuronalConnectivity::onTriggerTypeChanged(const QString& triggerType)
 {
     if(triggerType != m_sAvrType) {
         m_connectivitySettings.clearAllData();
+        m_pRtConnectivity->restart();
         m_sAvrType = triggerType;
     }
 }
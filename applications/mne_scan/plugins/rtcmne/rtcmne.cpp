@@ -541,6 +541,7 @@ void RtcMne::updateInvOp(const MNEInverseOperator& invOp)
     double lambda2 = 1.0 / pow(snr, 2); //ToDo estimate lambda using covariance
 
     m_pMinimumNorm = MinimumNorm::SPtr(new MinimumNorm(m_invOp, lambda2, m_sMethod));
+    m_pMinimumNorm->setUseFactoredKernel(true);
 
     //Set up the inverse according to the parameters
     // Use 1 nave here because in case of evoked data as input the minimum norm will always be updated when the source estimate is calculated (see run method).
@@ -559,6 +560,7 @@ void RtcMne::onMethodChanged(const QString& method)
         double snr = 1.0;
         double lambda2 = 1.0 / pow(snr, 2); //ToDo estimate lambda using covariance
         m_pMinimumNorm = MinimumNorm::SPtr(new MinimumNorm(m_invOp, lambda2, m_sMethod));
+        m_pMinimumNorm->setUseFactoredKernel(true);
 
         // Set up the inverse according to the parameters.
         // Use 1 nave here because in case of evoked data as input the minimum norm will always be updated when the source estimate is calculated (see run method).
@@ -42,12 +42,14 @@
 
 #include <disp/viewers/projectsettingsview.h>
 #include <scMeas/realtimemultisamplearray.h>
-#include <fiff/fiff_stream.h>
+#include <fiff/fiff_raw_stream_writer.h>
 
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
 
+#include <QDebug>
+
 //=============================================================================================================
 // EIGEN INCLUDES
 //=============================================================================================================
@@ -72,7 +74,6 @@ WriteToFile::WriteToFile()
 : m_bWriteToFile(false)
 , m_bUseRecordTimer(false)
 , m_iBlinkStatus(0)
-, m_iSplitCount(0)
 , m_iRecordingMSeconds(5*60*1000)
 , m_pCircularBuffer(CircularBuffer_Matrix_double::SPtr(new CircularBuffer_Matrix_double(40)))
 {
@@ -269,27 +270,15 @@ void WriteToFile::initPluginControlWidgets()
 void WriteToFile::run()
 {
     MatrixXd matData;
-    qint32 size = 0;
 
     while(!isInterruptionRequested()) {
         if(m_pCircularBuffer) {
             //pop matrix
             if(m_pCircularBuffer->pop(matData)) {
-                //Write raw data to fif file
+                //Hand the raw data to the writer, the file is written and split in its own thread
                 m_mutex.lock();
-                if(m_bWriteToFile) {
-                    size += matData.rows()*matData.cols() * 4;
-
-                    if(size > MAX_DATA_LEN) {
-                        size = 0;
-                        this->splitRecordingFile();
-                    }
-
-                    if(m_pOutfid) {
-                        m_pOutfid->write_raw_buffer(matData);
-                    }
-                } else {
-                    size = 0;
+                if(m_bWriteToFile && m_pWriter) {
+                    m_pWriter->write_raw_buffer(matData);
                 }
                 m_mutex.unlock();
             }
@@ -335,11 +324,15 @@ void WriteToFile::toggleRecordingFile()
     //Setup writing to file
     if(m_bWriteToFile) {
         m_mutex.lock();
-        m_pOutfid->finish_writing_raw();
+        m_pWriter->finish();
+        FiffRawStreamWriter::Statistics stats = m_pWriter->statistics();
+        qInfo() << "[WriteToFile::toggleRecordingFile] Wrote" << stats.iSamples << "samples to" << stats.iFiles << "file(s)."
+                << "Max. queued staging buffers:" << stats.iMaxQueued << "Stalls:" << stats.iStalls << "(" << stats.iStallMs << "ms)"
+                << "Max. flush:" << stats.iMaxFlushMs << "ms";
+        m_pWriter.clear();
         m_mutex.unlock();
 
         m_bWriteToFile = false;
-        m_iSplitCount = 0;
 
         //Stop record timer
         m_pRecordTimer->stop();
@@ -347,8 +340,6 @@ void WriteToFile::toggleRecordingFile()
         m_pActionRecordFile->setIcon(QIcon(":/images/record.png"));
         m_pUpdateTimeInfoTimer->stop();
     } else {
-        m_iSplitCount = 0;
-
         if(!m_pFiffInfo) {
             QMessageBox msgBox;
             msgBox.setText("FiffInfo missing!");
@@ -369,8 +360,7 @@ void WriteToFile::toggleRecordingFile()
         }
 
         //Initiate the stream for writing to the fif file
-        m_qFileOut.setFileName(m_sRecordFileName);
-        if(m_qFileOut.exists()) {
+        if(QFile::exists(m_sRecordFileName)) {
             QMessageBox msgBox;
             msgBox.setText("The file you want to write already exists.");
             msgBox.setInformativeText("Do you want to overwrite this file?");
@@ -387,14 +377,23 @@ void WriteToFile::toggleRecordingFile()
             m_pFiffInfo->projs[i].active = false;
         }
 
-        //Start/Prepare writing process. Actual writing is done in run() method.
+        //Start/Prepare writing process. The data is handed to the writer in the run() method.
         m_mutex.lock();
-        RowVectorXd cals;
-        m_pOutfid = FiffStream::start_writing_raw(m_qFileOut,
-                                                  *m_pFiffInfo,
-                                                  cals);
-        fiff_int_t first = 0;
-        m_pOutfid->write_int(FIFF_FIRST_SAMPLE, &first);
+        m_pWriter = FiffRawStreamWriter::SPtr(new FiffRawStreamWriter(m_sRecordFileName,
+                                                                      *m_pFiffInfo,
+                                                                      FIFFT_FLOAT,
+                                                                      0,
+                                                                      MAX_DATA_LEN));
+        if(!m_pWriter->start()) {
+            m_pWriter.clear();
+            m_mutex.unlock();
+
+            QMessageBox msgBox;
+            msgBox.setText("The file could not be created.");
+            msgBox.setWindowFlags(Qt::WindowStaysOnTopHint);
+            msgBox.exec();
+            return;
+        }
         m_mutex.unlock();
 
         m_bWriteToFile = true;
@@ -412,42 +411,6 @@ void WriteToFile::toggleRecordingFile()
 
 //=============================================================================================================
 
-void WriteToFile::splitRecordingFile()
-{
-    //qDebug() << "Split recording file";
-    ++m_iSplitCount;
-    QString nextFileName = m_sRecordFileName.remove("_raw.fif");
-    nextFileName += QString("-%1_raw.fif").arg(m_iSplitCount);
-
-    //Write the link to the next file
-    qint32 data;
-    m_pOutfid->start_block(FIFFB_REF);
-    data = FIFFV_ROLE_NEXT_FILE;
-    m_pOutfid->write_int(FIFF_REF_ROLE,&data);
-    m_pOutfid->write_string(FIFF_REF_FILE_NAME, nextFileName);
-    m_pOutfid->write_id(FIFF_REF_FILE_ID);//ToDo meas_id
-    data = m_iSplitCount - 1;
-    m_pOutfid->write_int(FIFF_REF_FILE_NUM, &data);
-    m_pOutfid->end_block(FIFFB_REF);
-
-    //finish file
-    m_pOutfid->finish_writing_raw();
-
-    //start next file
-    m_qFileOut.setFileName(nextFileName);
-    RowVectorXd cals;
-    MatrixXi sel;
-    m_pOutfid = FiffStream::start_writing_raw(m_qFileOut,
-                                              *m_pFiffInfo,
-                                              cals,
-                                              sel,
-                                              false);
-    fiff_int_t first = 0;
-    m_pOutfid->write_int(FIFF_FIRST_SAMPLE, &first);
-}
-
-//=============================================================================================================
-
 void WriteToFile::changeRecordingButton()
 {
     if(m_iBlinkStatus == 0) {
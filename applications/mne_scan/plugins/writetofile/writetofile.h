@@ -65,7 +65,7 @@
 
 namespace FIFFLIB{
     class FiffInfo;
-    class FiffStream;
+    class FiffRawStreamWriter;
 }
 
 namespace SCMEASLIB{
@@ -175,12 +175,6 @@ private:
      */
     void toggleRecordingFile();
 
-    //=========================================================================================================
-    /**
-     * Determines current file. And starts a new one.
-     */
-    void splitRecordingFile();
-
     //=========================================================================================================
     /**
      * change recording button.
@@ -191,19 +185,17 @@ private:
     bool                                    m_bUseRecordTimer;              /**< Flag whether to use data recording timer.*/
 
     qint16                                  m_iBlinkStatus;                 /**< The blink status of the recording button.*/
-    qint32                                  m_iSplitCount;                  /**< File split count */
     int                                     m_iRecordingMSeconds;           /**< Recording length in mseconds.*/
 
     QMutex                                  m_mutex;                        /**< The threads mutex.*/
 
     QSharedPointer<FIFFLIB::FiffInfo>       m_pFiffInfo;                    /**< Fiff measurement info.*/
-    QSharedPointer<FIFFLIB::FiffStream>     m_pOutfid;                      /**< FiffStream to write to.*/
+    QSharedPointer<FIFFLIB::FiffRawStreamWriter>    m_pWriter;              /**< Writes and splits the recording files in the background.*/
 
     QSharedPointer<QTimer>                  m_pUpdateTimeInfoTimer;         /**< timer to control remaining time. */
     QSharedPointer<QTimer>                  m_pBlinkingRecordButtonTimer;   /**< timer to control blinking recording button. */
     QSharedPointer<QTimer>                  m_pRecordTimer;                 /**< timer to control recording time. */
 
-    QFile                                   m_qFileOut;                     /**< QFile for writing to fif file.*/
     QString                                 m_sRecordFileName;              /**< Current record file. */
     QTime                                   m_recordingStartedTime;         /**< The time when the recording started.*/
 
@@ -0,0 +1,321 @@
+//=============================================================================================================
+/**
+ * @file     main.cpp
+ * @author   Lorenz Esch <lesch@mgh.harvard.edu>
+ * @version  dev
+ * @date     April, 2020
+ *
+ * @section  LICENSE
+ *
+ * Copyright (C) 2020, Lorenz Esch. All rights reserved.
+ *
+ * the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+ *       following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ *       the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *     * Neither the name of MNE-CPP authors nor the names of its contributors may be used
+ *       to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @brief    Example comparing the lock-free CircularBuffer with the former semaphore based implementation at real-time block rates
+ *
+ */
+
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include <utils/generics/circularbuffer.h>
+#include <utils/generics/applicationlogger.h>
+
+#include <algorithm>
+#include <vector>
+
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtCore/QCoreApplication>
+#include <QDebug>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QSemaphore>
+#include <QtConcurrent>
+
+//=============================================================================================================
+// EIGEN INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace IOBUFFER;
+using namespace UTILSLIB;
+using namespace Eigen;
+
+//=============================================================================================================
+/**
+ * The former semaphore based circular buffer, kept here as the baseline.
+ */
+template<typename _Tp>
+class SemaphoreCircularBuffer
+{
+public:
+    explicit SemaphoreCircularBuffer(unsigned int uiMaxNumElements)
+    : m_uiMaxNumElements(uiMaxNumElements)
+    , m_pBuffer(new _Tp[m_uiMaxNumElements])
+    , m_iCurrentReadIndex(-1)
+    , m_iCurrentWriteIndex(-1)
+    , m_freeElements(m_uiMaxNumElements)
+    , m_usedElements(0)
+    , m_iTimeout(1000)
+    {
+    }
+
+    ~SemaphoreCircularBuffer()
+    {
+        delete [] m_pBuffer;
+    }
+
+    bool push(const _Tp& newElement)
+    {
+        if(m_freeElements.tryAcquire(1, m_iTimeout)) {
+            m_pBuffer[mapIndex(m_iCurrentWriteIndex)] = newElement;
+            m_usedElements.release(1);
+            return true;
+        }
+        return false;
+    }
+
+    bool pop(_Tp& element)
+    {
+        if(m_usedElements.tryAcquire(1, m_iTimeout)) {
+            element = m_pBuffer[mapIndex(m_iCurrentReadIndex)];
+            m_freeElements.release(1);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    unsigned int mapIndex(int& index)
+    {
+        int aux = index;
+        return index = ++aux % m_uiMaxNumElements;
+    }
+
+    unsigned int    m_uiMaxNumElements;
+    _Tp*            m_pBuffer;
+    int             m_iCurrentReadIndex;
+    int             m_iCurrentWriteIndex;
+    QSemaphore      m_freeElements;
+    QSemaphore      m_usedElements;
+    int             m_iTimeout;
+};
+
+//=============================================================================================================
+// DEFINE GLOBAL METHODS
+//=============================================================================================================
+
+/**
+ * Result of one benchmark run.
+ */
+struct Result {
+    qint64 iNsecs = 0;              /**< Elapsed time in ns. */
+    double dMeanLatencyUs = 0.0;    /**< Mean time between the start of a push and the end of its pop in us. */
+    double dP99LatencyUs = 0.0;     /**< 99th percentile of the latency in us. */
+    double dMaxLatencyUs = 0.0;     /**< Maximal latency in us. */
+    qint64 iBlocks = 0;             /**< Number of transferred blocks. */
+};
+
+//=============================================================================================================
+/**
+ * Pushes the same block in a tight loop or at a fixed block rate from a second thread and pops it in the calling
+ * thread. The block index is stored in the first coefficient to measure the latency of every block.
+ *
+ * @param[in] push       Pushes a block, returns false on timeout.
+ * @param[in] pop        Pops a block, returns false on timeout.
+ */
+template<typename PushFunction, typename PopFunction>
+Result runBenchmark(PushFunction push,
+                    PopFunction pop,
+                    int iRows,
+                    int iCols,
+                    int iBlocks,
+                    double dBlockRate)
+{
+    std::vector<qint64> vPushTime(iBlocks, 0);
+    std::vector<qint64> vLatency(iBlocks, 0);
+    const qint64 iIntervalNs = dBlockRate > 0.0 ? (qint64)(1.0e9 / dBlockRate) : 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QFuture<void> producer = QtConcurrent::run([&]() {
+        MatrixXd matBlock = MatrixXd::Random(iRows, iCols);
+        for(int i = 0; i < iBlocks; ++i) {
+            if(iIntervalNs > 0) {
+                while(timer.nsecsElapsed() < i * iIntervalNs) {
+                    // Busy wait to keep the block rate exact
+                }
+            }
+            if(matBlock.rows() != iRows || matBlock.cols() != iCols) {
+                matBlock = MatrixXd::Random(iRows, iCols);
+            }
+            matBlock(0,0) = i;
+            vPushTime[i] = timer.nsecsElapsed();
+            while(!push(matBlock)) {
+            }
+        }
+    });
+
+    MatrixXd matData;
+    for(int i = 0; i < iBlocks; ++i) {
+        while(!pop(matData)) {
+        }
+        const int iBlock = (int)matData(0,0);
+        vLatency[iBlock] = timer.nsecsElapsed() - vPushTime[iBlock];
+    }
+
+    producer.waitForFinished();
+
+    Result result;
+    result.iNsecs = timer.nsecsElapsed();
+    result.iBlocks = iBlocks;
+
+    std::sort(vLatency.begin(), vLatency.end());
+    qint64 iSum = 0;
+    for(qint64 iLatency : vLatency) {
+        iSum += iLatency;
+    }
+    result.dMeanLatencyUs = iSum * 1.0e-3 / iBlocks;
+    result.dP99LatencyUs = vLatency[std::min(iBlocks - 1, (int)(0.99 * iBlocks))] * 1.0e-3;
+    result.dMaxLatencyUs = vLatency.back() * 1.0e-3;
+
+    return result;
+}
+
+//=============================================================================================================
+/**
+ * Prints one result line.
+ */
+void printResult(const QString& sName, const Result& result)
+{
+    qInfo("%-45s %10.2f ms %12.0f blocks/s %10.2f us mean %10.2f us p99 %10.2f us max",
+          sName.toUtf8().constData(),
+          result.iNsecs * 1.0e-6,
+          result.iBlocks / (result.iNsecs * 1.0e-9),
+          result.dMeanLatencyUs,
+          result.dP99LatencyUs,
+          result.dMaxLatencyUs);
+}
+
+//=============================================================================================================
+/**
+ * Runs all buffer variants for one block rate, 0 means as fast as possible.
+ */
+void benchmarkRate(int iRows, int iCols, int iBlocks, double dBlockRate, int iBufferSize)
+{
+    if(dBlockRate > 0.0) {
+        qInfo("\n%d x %d blocks at %.0f blocks/s", iRows, iCols, dBlockRate);
+    } else {
+        qInfo("\n%d x %d blocks, unthrottled", iRows, iCols);
+    }
+
+    {
+        SemaphoreCircularBuffer<MatrixXd> buffer(iBufferSize);
+        printResult("semaphore, copy (before)",
+                    runBenchmark([&](MatrixXd& mat) { return buffer.push(mat); },
+                                 [&](MatrixXd& mat) { return buffer.pop(mat); },
+                                 iRows, iCols, iBlocks, dBlockRate));
+    }
+
+    {
+        CircularBuffer_Matrix_double buffer(iBufferSize);
+        printResult("lock-free, copy in",
+                    runBenchmark([&](MatrixXd& mat) { return buffer.push(mat); },
+                                 [&](MatrixXd& mat) { return buffer.pop(mat); },
+                                 iRows, iCols, iBlocks, dBlockRate));
+    }
+
+    {
+        CircularBuffer_Matrix_double buffer(iBufferSize, MatrixXd::Zero(iRows, iCols));
+        printResult("lock-free, move in, preallocated slots",
+                    runBenchmark([&](MatrixXd& mat) { return buffer.push(std::move(mat)); },
+                                 [&](MatrixXd& mat) { return buffer.pop(mat); },
+                                 iRows, iCols, iBlocks, dBlockRate));
+    }
+
+    {
+        CircularBuffer_Matrix_double buffer(iBufferSize, MatrixXd::Zero(iRows, iCols));
+        buffer.setSpinCount(0);
+        printResult("lock-free, move in, no spinning",
+                    runBenchmark([&](MatrixXd& mat) { return buffer.push(std::move(mat)); },
+                                 [&](MatrixXd& mat) { return buffer.pop(mat); },
+                                 iRows, iCols, iBlocks, dBlockRate));
+    }
+}
+
+//=============================================================================================================
+// MAIN
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+ * The function main marks the entry point of the program.
+ * By default, main has the storage class extern.
+ *
+ * @param [in] argc (argument count) is an integer that indicates how many arguments were entered on the command line when the program was started.
+ * @param [in] argv (argument vector) is an array of pointers to arrays of character objects. The array objects are null-terminated strings, representing the arguments that were entered on the command line when the program was started.
+ * @return the value that was set to exit() (which is 0 if exit() is called via quit()).
+ */
+int main(int argc, char *argv[])
+{
+    qInstallMessageHandler(ApplicationLogger::customLogWriter);
+    QCoreApplication app(argc, argv);
+
+    // Command Line Parser
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Circular Buffer Performance Example");
+    parser.addHelpOption();
+
+    QCommandLineOption channelsOption("channels", "Number of <channels> per block.", "channels", "400");
+    QCommandLineOption samplesOption("samples", "Number of <samples> per block.", "samples", "20");
+    QCommandLineOption blocksOption("blocks", "Number of <blocks> per run.", "blocks", "5000");
+    QCommandLineOption bufferOption("buffer", "Number of <elements> of the buffers.", "elements", "40");
+
+    parser.addOption(channelsOption);
+    parser.addOption(samplesOption);
+    parser.addOption(blocksOption);
+    parser.addOption(bufferOption);
+
+    parser.process(app);
+
+    int iRows = std::max(1, parser.value(channelsOption).toInt());
+    int iCols = std::max(1, parser.value(samplesOption).toInt());
+    int iBlocks = std::max(1, parser.value(blocksOption).toInt());
+    int iBufferSize = std::max(1, parser.value(bufferOption).toInt());
+
+    //
+    // Block rates of typical acquisitions, e.g. 20 samples at 1, 5 and 20 kHz, and the maximal throughput
+    //
+    benchmarkRate(iRows, iCols, iBlocks, 50.0 * 20 / iCols, iBufferSize);
+    benchmarkRate(iRows, iCols, iBlocks, 250.0 * 20 / iCols, iBufferSize);
+    benchmarkRate(iRows, iCols, iBlocks, 1000.0 * 20 / iCols, iBufferSize);
+    benchmarkRate(iRows, iCols, iBlocks, 0.0, iBufferSize);
+
+    return 0;
+}
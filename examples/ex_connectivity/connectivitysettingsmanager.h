@@ -280,10 +280,11 @@ public:
                 m_pEpochSignalCoursePlot->show();
             }
 
-            if(iRowNumber < m_settings.at(iTrialNumber).vecTapSpectra.size()) {
-                Eigen::RowVectorXd plotVec = m_settings.at(iTrialNumber).vecTapSpectra.at(iRowNumber).cwiseAbs().row(0);
-                Eigen::Map<Eigen::VectorXd> v1(plotVec.data(), plotVec.size());
-                Eigen::VectorXd temp =v1;
+            // Plot the first taper of the row. The spectra of all tapers are stored next to each other.
+            int iNTapers = m_settings.getTapers().first.rows();
+
+            if(iNTapers > 0 && iRowNumber * iNTapers < m_settings.at(iTrialNumber).matTapSpectra.cols()) {
+                Eigen::VectorXd temp = m_settings.at(iTrialNumber).matTapSpectra.col(iRowNumber * iNTapers).cwiseAbs();
                 if(!m_pSpectrumPlot) {
                     m_pSpectrumPlot = new DISPLIB::Plot(temp);
                 } else {
@@ -60,6 +60,7 @@
 #include <QDateTime>
 #include <QDir>
 #include <QCoreApplication>
+#include <QCommandLineParser>
 #include <QHostInfo>
 #include <QElapsedTimer>
 #include <QThreadPool>
@@ -118,6 +119,102 @@ void customMessageHandler(QtMsgType type, const QMessageLogContext &context, con
     }
 }
 
+//=============================================================================================================
+/**
+ * Computes the CSD of the first trial with one taper-weighted product per pair of rows, the way the metrics did
+ * before the CSD was computed as one Hermitian rank-k update per frequency bin. Used as reference by the CSD
+ * scaling benchmark.
+ *
+ * @param[in] connectivitySettings   The connectivity settings holding the tapered spectra of the first trial.
+ *
+ * @return The CSD per row.
+ */
+QVector<QPair<int,MatrixXcd> > computeCsdPairwise(const ConnectivitySettings& connectivitySettings)
+{
+    const MatrixXcd& matTapSpectra = connectivitySettings.at(0).matTapSpectra;
+    const QPair<MatrixXd, VectorXd>& tapers = connectivitySettings.getTapers();
+
+    int iNRows = connectivitySettings.at(0).matData.rows();
+    int iNTapers = tapers.first.rows();
+    int iBinStart = AbstractMetric::m_iNumberBinStart;
+    int iBinAmount = AbstractMetric::m_iNumberBinAmount;
+
+    double denomCSD = tapers.second.cwiseAbs2().sum() / 2.0;
+
+    QVector<QPair<int,MatrixXcd> > vecPairCsd;
+    MatrixXcd matCsd(iNRows, iBinAmount);
+
+    for (int i = 0; i < iNRows; ++i) {
+        for (int j = i; j < iNRows; ++j) {
+            matCsd.row(j) = matTapSpectra.block(iBinStart,i*iNTapers,iBinAmount,iNTapers).cwiseProduct(matTapSpectra.block(iBinStart,j*iNTapers,iBinAmount,iNTapers).conjugate()).rowwise().sum().transpose() / denomCSD;
+        }
+
+        vecPairCsd.append(QPair<int,MatrixXcd>(i,matCsd));
+    }
+
+    return vecPairCsd;
+}
+
+//=============================================================================================================
+/**
+ * Measures how the spectral connectivity estimation scales with the number of channels/sources. For each channel
+ * count the tapered spectra, the selected metric (CSD tensor and final network) and, for small channel counts,
+ * the former pairwise CSD computation are timed on random data.
+ *
+ * @param[in] sMethod                The connectivity metric to time.
+ * @param[in] iNumberBins            The number of CSD frequency bins.
+ * @param[in] iNumberSamples         The number of samples per trial.
+ * @param[in] iNumberTrials          The number of trials.
+ * @param[in] iMaxPairwiseChannels   The maximum number of channels for which the pairwise CSD is timed.
+ */
+void benchmarkCsdScaling(const QString& sMethod,
+                         int iNumberBins,
+                         int iNumberSamples,
+                         int iNumberTrials,
+                         int iMaxPairwiseChannels)
+{
+    QList<int> lNumberChannels = QList<int>() << 60 << 125 << 250 << 500 << 1000 << 2000 << 4000 << 8000;
+
+    AbstractMetric::m_bStorageModeIsActive = false;
+    AbstractMetric::m_iNumberBinStart = 8;
+    AbstractMetric::m_iNumberBinAmount = iNumberBins;
+
+    QElapsedTimer timer;
+
+    printf("CSD scaling: %s, %d bins, %d samples, %d trials\n", sMethod.toLatin1().data(), iNumberBins, iNumberSamples, iNumberTrials);
+    printf("channels\tspectra [ms]\t%s [ms]\tpairwise CSD [ms]\n", sMethod.toLatin1().data());
+
+    for(int k = 0; k < lNumberChannels.size(); ++k) {
+        ConnectivitySettings connectivitySettings;
+        connectivitySettings.setSamplingFrequency(1000);
+        connectivitySettings.setFFTSize(iNumberSamples);
+        connectivitySettings.setConnectivityMethods(QStringList() << sMethod);
+
+        for(int l = 0; l < iNumberTrials; ++l) {
+            connectivitySettings.append(MatrixXd::Random(lNumberChannels.at(k), iNumberSamples));
+        }
+
+        timer.start();
+        connectivitySettings.computeTaperedSpectra();
+        qint64 iTimeSpectra = timer.elapsed();
+
+        // The pairwise reference reuses the tapered spectra, which are released by the metric afterwards
+        qint64 iTimePairwise = -1;
+
+        if(lNumberChannels.at(k) <= iMaxPairwiseChannels) {
+            timer.restart();
+            computeCsdPairwise(connectivitySettings);
+            iTimePairwise = timer.elapsed();
+        }
+
+        timer.restart();
+        Connectivity::calculate(connectivitySettings);
+        qint64 iTimeMetric = timer.elapsed();
+
+        printf("%d\t%lld\t%lld\t%lld\n", lNumberChannels.at(k), iTimeSpectra, iTimeMetric, iTimePairwise);
+    }
+}
+
 //=============================================================================================================
 // MAIN
 //=============================================================================================================
@@ -137,6 +234,38 @@ int main(int argc, char *argv[])
     Q_INIT_RESOURCE(disp3d);
     #endif
 
+    QCoreApplication a(argc, argv);
+
+    // Command Line Parser
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Connectivity Performance Example");
+    parser.addHelpOption();
+
+    QCommandLineOption csdScalingOption("csdScaling", "Only run the CSD scaling benchmark (60 to 8000 channels on random data). The packed CSD tensors need about 2 GB per bin at 8000 channels.");
+    QCommandLineOption csdMethodOption("csdMethod", "The connectivity <method> timed by the CSD scaling benchmark, i.e. 'COH', 'PLV' or 'WPLI'.", "method", "WPLI");
+    QCommandLineOption csdBinsOption("csdBins", "The number of CSD frequency <bins> used by the CSD scaling benchmark.", "bins", "1");
+    QCommandLineOption csdSamplesOption("csdSamples", "The number of <samples> per trial used by the CSD scaling benchmark.", "samples", "1000");
+    QCommandLineOption csdTrialsOption("csdTrials", "The number of <trials> used by the CSD scaling benchmark.", "trials", "1");
+    QCommandLineOption csdPairwiseOption("csdPairwiseMax", "The maximum number of <channels> for which the pairwise CSD is timed as reference.", "channels", "1000");
+
+    parser.addOption(csdScalingOption);
+    parser.addOption(csdMethodOption);
+    parser.addOption(csdBinsOption);
+    parser.addOption(csdSamplesOption);
+    parser.addOption(csdTrialsOption);
+    parser.addOption(csdPairwiseOption);
+
+    parser.process(a);
+
+    if(parser.isSet(csdScalingOption)) {
+        benchmarkCsdScaling(parser.value(csdMethodOption),
+                            parser.value(csdBinsOption).toInt(),
+                            parser.value(csdSamplesOption).toInt(),
+                            parser.value(csdTrialsOption).toInt(),
+                            parser.value(csdPairwiseOption).toInt());
+        return 0;
+    }
+
     qInstallMessageHandler(customMessageHandler);
 
 //    printf("globalInstance()->maxThreadCount(): %d\n",QThreadPool::globalInstance()->maxThreadCount());
@@ -0,0 +1,305 @@
+//=============================================================================================================
+/**
+ * @file     main.cpp
+ * @author   Lorenz Esch <lesch@mgh.harvard.edu>
+ * @version  dev
+ * @date     April, 2020
+ *
+ * @section  LICENSE
+ *
+ * Copyright (C) 2020, Lorenz Esch. All rights reserved.
+ *
+ * the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+ *       following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ *       the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *     * Neither the name of MNE-CPP authors nor the names of its contributors may be used
+ *       to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @brief    Example measuring the time and the allocations needed to read the tags of a forward solution and a raw file
+ *
+ */
+
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include <fiff/fiff.h>
+#include <mne/mne.h>
+#include <utils/generics/applicationlogger.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtCore/QCoreApplication>
+#include <QDebug>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+using namespace MNELIB;
+using namespace UTILSLIB;
+
+//=============================================================================================================
+// ALLOCATION COUNTER
+//=============================================================================================================
+
+/**
+ * Counts all allocations made through operator new. The tag data itself is allocated by QByteArray with malloc and
+ * is counted separately. Note that on Windows only the allocations of this executable are seen.
+ */
+static std::atomic<qint64> s_iNumAllocations(0);
+
+void* operator new(std::size_t size)
+{
+    ++s_iNumAllocations;
+    if(void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+//=============================================================================================================
+// DEFINE GLOBAL METHODS
+//=============================================================================================================
+
+/**
+ * Result of one benchmark run.
+ */
+struct Result {
+    qint64 iNsecs = 0;              /**< Elapsed time in ns. */
+    qint64 iObjectAllocs = 0;       /**< Allocations made through operator new. */
+    qint64 iBufferAllocs = 0;       /**< Allocations of tag data. */
+    qint64 iTags = 0;               /**< Number of read tags. */
+};
+
+//=============================================================================================================
+/**
+ * The implementation of FiffStream::read_tag before the reused tags were introduced, kept here as the reference:
+ * a new tag and a new buffer for every read. The byte order conversion is shared with the current implementation,
+ * i.e. the comparison isolates the allocations.
+ */
+bool readTagBaseline(FiffStream::SPtr& pStream, FiffTag::SPtr& p_pTag, fiff_long_t pos)
+{
+    if (pos >= 0) {
+        pStream->device()->seek(pos);
+    }
+
+    p_pTag = FiffTag::SPtr(new FiffTag());
+
+    *pStream >> p_pTag->kind;
+    *pStream >> p_pTag->type;
+    qint32 size;
+    *pStream >> size;
+    p_pTag->resize(size);
+    *pStream >> p_pTag->next;
+
+    int endian = pStream->byteOrder() == QDataStream::LittleEndian ? FIFFV_LITTLE_ENDIAN : FIFFV_BIG_ENDIAN;
+
+    if (p_pTag->size() > 0) {
+        pStream->readRawData(p_pTag->data(), p_pTag->size());
+        FiffTag::convert_tag_data(p_pTag, endian, FIFFV_NATIVE_ENDIAN);
+    }
+
+    if (p_pTag->next != FIFFV_NEXT_SEQ) {
+        pStream->device()->seek(p_pTag->next);
+    }
+
+    return true;
+}
+
+//=============================================================================================================
+/**
+ * Reads all tags of the stream the way the baseline did, every tag into a newly allocated tag.
+ */
+Result readWithNewTags(FiffStream::SPtr& pStream, int iRepetitions)
+{
+    Result result;
+    const qint64 iAllocsBefore = s_iNumAllocations;
+    QElapsedTimer timer;
+    timer.start();
+
+    for(int r = 0; r < iRepetitions; ++r) {
+        for(const FiffDirEntry::SPtr& pEnt : pStream->dir()) {
+            if(pEnt->kind == -1) {
+                continue;
+            }
+
+            FiffTag::SPtr t_pTag;
+            readTagBaseline(pStream, t_pTag, pEnt->pos);
+            if(t_pTag->size() > 0) {
+                ++result.iBufferAllocs;
+            }
+            ++result.iTags;
+        }
+    }
+
+    result.iNsecs = timer.nsecsElapsed();
+    result.iObjectAllocs = s_iNumAllocations - iAllocsBefore;
+
+    return result;
+}
+
+//=============================================================================================================
+/**
+ * Reads all tags of the stream into one reused tag.
+ */
+Result readWithReusedTag(FiffStream::SPtr& pStream, int iRepetitions)
+{
+    Result result;
+    const qint64 iAllocsBefore = s_iNumAllocations;
+    QElapsedTimer timer;
+    timer.start();
+
+    FiffTag t_tag;
+    for(int r = 0; r < iRepetitions; ++r) {
+        for(const FiffDirEntry::SPtr& pEnt : pStream->dir()) {
+            if(pEnt->kind == -1) {
+                continue;
+            }
+
+            const int iCapacity = t_tag.capacity();
+            pStream->read_tag(t_tag, pEnt->pos);
+            if(t_tag.capacity() != iCapacity) {
+                ++result.iBufferAllocs;
+            }
+            ++result.iTags;
+        }
+    }
+
+    result.iNsecs = timer.nsecsElapsed();
+    result.iObjectAllocs = s_iNumAllocations - iAllocsBefore;
+
+    return result;
+}
+
+//=============================================================================================================
+/**
+ * Prints one result line.
+ */
+void printResult(const QString& sName, const Result& result)
+{
+    qInfo("%-40s %8lld tags %10.2f ms %10lld object allocations %10lld buffer allocations",
+          sName.toUtf8().constData(),
+          result.iTags,
+          result.iNsecs * 1.0e-6,
+          result.iObjectAllocs,
+          result.iBufferAllocs);
+}
+
+//=============================================================================================================
+/**
+ * Benchmarks the tag reading of one file.
+ */
+void benchmarkFile(const QString& sFileName, int iRepetitions)
+{
+    QFile file(sFileName);
+    FiffStream::SPtr pStream(new FiffStream(&file));
+    if(!pStream->open()) {
+        qWarning() << "Could not open" << sFileName;
+        return;
+    }
+
+    qInfo() << "\n" << sFileName << "-" << pStream->dir().size() << "directory entries," << iRepetitions << "repetitions";
+
+    // Warm up the file cache
+    readWithReusedTag(pStream, 1);
+
+    printResult("new tag per read (baseline)", readWithNewTags(pStream, iRepetitions));
+    printResult("reused tag (after)", readWithReusedTag(pStream, iRepetitions));
+
+    pStream->close();
+}
+
+//=============================================================================================================
+// MAIN
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+ * The function main marks the entry point of the program.
+ * By default, main has the storage class extern.
+ *
+ * @param [in] argc (argument count) is an integer that indicates how many arguments were entered on the command line when the program was started.
+ * @param [in] argv (argument vector) is an array of pointers to arrays of character objects. The array objects are null-terminated strings, representing the arguments that were entered on the command line when the program was started.
+ * @return the value that was set to exit() (which is 0 if exit() is called via quit()).
+ */
+int main(int argc, char *argv[])
+{
+    qInstallMessageHandler(ApplicationLogger::customLogWriter);
+    QCoreApplication app(argc, argv);
+
+    // Command Line Parser
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Read Tag Performance Example");
+    parser.addHelpOption();
+
+    QCommandLineOption fwdFileOption("fwd", "Path to the forward solution <file>.", "file", QCoreApplication::applicationDirPath() + "/MNE-sample-data/MEG/sample/sample_audvis-meg-eeg-oct-6-fwd.fif");
+    QCommandLineOption rawFileOption("raw", "Path to the raw <file>.", "file", QCoreApplication::applicationDirPath() + "/MNE-sample-data/MEG/sample/sample_audvis_raw.fif");
+    QCommandLineOption repetitionsOption("repetitions", "Number of <repetitions>.", "repetitions", "5");
+
+    parser.addOption(fwdFileOption);
+    parser.addOption(rawFileOption);
+    parser.addOption(repetitionsOption);
+
+    parser.process(app);
+
+    int iRepetitions = std::max(1, parser.value(repetitionsOption).toInt());
+
+    //
+    // Reading every tag of the files
+    //
+    benchmarkFile(parser.value(fwdFileOption), iRepetitions);
+    benchmarkFile(parser.value(rawFileOption), iRepetitions);
+
+    //
+    // Reading the files the usual way with the current readers, which read into reused tags. There is no baseline
+    // column here: the baseline readers are not part of the library anymore.
+    //
+    qInfo() << "\nComplete reads (current readers)";
+
+    QElapsedTimer timer;
+    qint64 iAllocsBefore = s_iNumAllocations;
+    timer.start();
+    for(int r = 0; r < iRepetitions; ++r) {
+        QFile t_fileFwd(parser.value(fwdFileOption));
+        MNEForwardSolution t_Fwd(t_fileFwd);
+    }
+    qInfo("%-40s %10.2f ms %10lld object allocations", "MNEForwardSolution", timer.nsecsElapsed() * 1.0e-6 / iRepetitions, (s_iNumAllocations - iAllocsBefore) / iRepetitions);
+
+    iAllocsBefore = s_iNumAllocations;
+    timer.restart();
+    for(int r = 0; r < iRepetitions; ++r) {
+        QFile t_fileRaw(parser.value(rawFileOption));
+        FiffRawData raw(t_fileRaw);
+    }
+    qInfo("%-40s %10.2f ms %10lld object allocations", "FiffRawData setup", timer.nsecsElapsed() * 1.0e-6 / iRepetitions, (s_iNumAllocations - iAllocsBefore) / iRepetitions);
+
+    return 0;
+}
@@ -48,6 +48,7 @@ TEMPLATE = subdirs
 
 SUBDIRS += \
     ex_cancel_noise \
+    ex_circular_buffer_performance \
     ex_evoked_grad_amp \
     ex_fiff_io \
     ex_find_evoked \
@@ -59,6 +60,7 @@ SUBDIRS += \
     ex_read_evoked \
     ex_read_fwd \
     ex_read_raw \
+    ex_read_tag_performance \
     ex_read_write_raw \
 
 !contains(MNECPP_CONFIG, minimalVersion) {
@@ -127,6 +127,12 @@ QList<Network> Connectivity::calculate(ConnectivitySettings& connectivitySetting
         results.append(DebiasedSquaredWeightedPhaseLagIndex::calculate(connectivitySettings));
     }
 
+    // The tapered spectra are computed by the first spectral metric and shared by all following ones.
+    // Do not store them to save memory.
+    if(!AbstractMetric::m_bStorageModeIsActive) {
+        connectivitySettings.clearTaperedSpectra();
+    }
+
     qWarning() << "Total" << timer.elapsed();
     qDebug() << "Connectivity::calculateMultiMethods - Calculated"<< lMethods <<"for" << connectivitySettings.size() << "trials in"<< timer.elapsed() << "msecs.";
 
@@ -42,6 +42,8 @@
 #include <fs/surfaceset.h>
 #include <fiff/fiff_info.h>
 
+#include <utils/spectral.h>
+
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
@@ -49,11 +51,21 @@
 #include <QCommandLineParser>
 #include <QElapsedTimer>
 #include <QDebug>
+#include <QtConcurrent>
+#include <QThread>
 
 //=============================================================================================================
 // EIGEN INCLUDES
 //=============================================================================================================
 
+#include <unsupported/Eigen/FFT>
+
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <functional>
+
 //=============================================================================================================
 // USED NAMESPACES
 //=============================================================================================================
@@ -63,6 +75,7 @@ using namespace MNELIB;
 using namespace Eigen;
 using namespace FIFFLIB;
 using namespace FSLIB;
+using namespace UTILSLIB;
 
 //=============================================================================================================
 // DEFINE GLOBAL METHODS
@@ -93,23 +106,108 @@ void ConnectivitySettings::clearAllData()
 //*******************************************************************************************************
 
 void ConnectivitySettings::clearIntermediateData() 
+{
+    clearTaperedSpectra();
+    clearIntermediateMetricData();
+}
+
+//*******************************************************************************************************
+
+void ConnectivitySettings::clearIntermediateMetricData()
 {
     for (int i = 0; i < m_trialData.size(); ++i) {
-        m_trialData[i].matPsd.resize(0,0);
-        m_trialData[i].vecPairCsd.clear();
-        m_trialData[i].vecTapSpectra.clear();
-        m_trialData[i].vecPairCsdNormalized.clear();
-        m_trialData[i].vecPairCsdImagSign.clear();
-        m_trialData[i].vecPairCsdImagAbs.clear();
-        m_trialData[i].vecPairCsdImagSqrd.clear();
+        m_trialData[i].matCsd.resize(0,0);
+        m_trialData[i].matCsdNormalized.resize(0,0);
+        m_trialData[i].matCsdImagSign.resize(0,0);
+        m_trialData[i].matCsdImagAbs.resize(0,0);
+        m_trialData[i].matCsdImagSqrd.resize(0,0);
     }
 
-    m_intermediateSumData.matPsdSum.resize(0,0);
-    m_intermediateSumData.vecPairCsdSum.clear();
-    m_intermediateSumData.vecPairCsdNormalizedSum.clear();
-    m_intermediateSumData.vecPairCsdImagSignSum.clear();
-    m_intermediateSumData.vecPairCsdImagAbsSum.clear();
-    m_intermediateSumData.vecPairCsdImagSqrdSum.clear();
+    m_intermediateSumData.matCsdSum.resize(0,0);
+    m_intermediateSumData.matCsdNormalizedSum.resize(0,0);
+    m_intermediateSumData.matCsdImagSignSum.resize(0,0);
+    m_intermediateSumData.matCsdImagAbsSum.resize(0,0);
+    m_intermediateSumData.matCsdImagSqrdSum.resize(0,0);
+}
+
+//*******************************************************************************************************
+
+void ConnectivitySettings::clearTaperedSpectra()
+{
+    for (int i = 0; i < m_trialData.size(); ++i) {
+        m_trialData[i].matTapSpectra.resize(0,0);
+    }
+}
+
+//*******************************************************************************************************
+
+void ConnectivitySettings::computeTaperedSpectra()
+{
+    if(m_trialData.isEmpty()) {
+        return;
+    }
+
+    int iNRows = m_trialData.first().matData.rows();
+    int iSignalLength = m_trialData.first().matData.cols();
+
+    // Generate the tapers once per signal length and window type
+    if(m_tapers.first.cols() != iSignalLength) {
+        m_tapers = Spectral::generateTapers(iSignalLength, m_sWindowType);
+    }
+
+    int iNTapers = m_tapers.first.rows();
+    int iNFreqs = int(floor(m_iNfft / 2.0)) + 1;
+
+    // Collect and allocate all trials which do not hold valid spectra yet. This is done in the calling thread
+    // so that the trial list is detached before the workers write to it.
+    QVector<IntermediateTrialData*> vecPending;
+
+    for (int i = 0; i < m_trialData.size(); ++i) {
+        if(m_trialData.at(i).matTapSpectra.rows() != iNFreqs ||
+           m_trialData.at(i).matTapSpectra.cols() != iNRows * iNTapers) {
+            IntermediateTrialData& trialData = m_trialData[i];
+            trialData.matTapSpectra.resize(iNFreqs, iNRows * iNTapers);
+            vecPending.append(&trialData);
+        }
+    }
+
+    if(vecPending.isEmpty()) {
+        return;
+    }
+
+    #ifdef EIGEN_FFTW_DEFAULT
+        fftw_make_planner_thread_safe();
+    #endif
+
+    // Split the rows of all pending trials into one chunk per thread. The last chunk is computed in the calling thread.
+    int iNJobs = vecPending.size() * iNRows;
+    int iNChunks = qBound(1, QThread::idealThreadCount(), iNJobs);
+    int iStep = (iNJobs + iNChunks - 1) / iNChunks;
+
+    QVector<QFuture<void> > vecThreads;
+
+    for(int iBegin = 0; iBegin < iNJobs - iStep; iBegin += iStep) {
+        vecThreads.append(QtConcurrent::run(std::bind(&ConnectivitySettings::computeTaperedSpectraChunk,
+                                                      this,
+                                                      std::cref(vecPending),
+                                                      iBegin,
+                                                      iBegin + iStep)));
+    }
+
+    computeTaperedSpectraChunk(vecPending,
+                               vecThreads.size() * iStep,
+                               iNJobs);
+
+    for(QFuture<void>& future : vecThreads) {
+        future.waitForFinished();
+    }
+}
+
+//*******************************************************************************************************
+
+const QPair<MatrixXd, VectorXd>& ConnectivitySettings::getTapers() const
+{
+    return m_tapers;
 }
 
 //*******************************************************************************************************
@@ -179,27 +277,22 @@ void ConnectivitySettings::removeFirst(int iAmount)
 
     // Substract influence of trials from overall summed up intermediate data and remove from data list
     for (int j = 0; j < iAmount; ++j) {
-        for (int i = 0; i < m_trialData.first().matData.rows(); ++i) {
-            if(i < m_intermediateSumData.vecPairCsdSum.size() && (m_intermediateSumData.vecPairCsdSum.size() == m_trialData.first().vecPairCsd.size())) {
-                m_intermediateSumData.vecPairCsdSum[i].second -= m_trialData.first().vecPairCsd.at(i).second;
-            }
-            if(i < m_intermediateSumData.vecPairCsdNormalizedSum.size() && (m_intermediateSumData.vecPairCsdNormalizedSum.size() == m_trialData.first().vecPairCsdNormalized.size())) {
-                m_intermediateSumData.vecPairCsdNormalizedSum[i].second -= m_trialData.first().vecPairCsdNormalized.at(i).second;
-            }
-            if(i < m_intermediateSumData.vecPairCsdImagSignSum.size() && (m_intermediateSumData.vecPairCsdImagSignSum.size() == m_trialData.first().vecPairCsdImagSign.size())) {
-                m_intermediateSumData.vecPairCsdImagSignSum[i].second -= m_trialData.first().vecPairCsdImagSign.at(i).second;
-            }
-            if(i < m_intermediateSumData.vecPairCsdImagAbsSum.size() && (m_intermediateSumData.vecPairCsdImagAbsSum.size() == m_trialData.first().vecPairCsdImagAbs.size())) {
-                m_intermediateSumData.vecPairCsdImagAbsSum[i].second -= m_trialData.first().vecPairCsdImagAbs.at(i).second;
-            }
-            if(i < m_intermediateSumData.vecPairCsdImagSqrdSum.size() && (m_intermediateSumData.vecPairCsdImagSqrdSum.size() == m_trialData.first().vecPairCsdImagSqrd.size())) {
-                m_intermediateSumData.vecPairCsdImagSqrdSum[i].second -= m_trialData.first().vecPairCsdImagSqrd.at(i).second;
-            }
-        }
+        const IntermediateTrialData& trialData = m_trialData.first();
 
-        if(m_intermediateSumData.matPsdSum.rows() == m_trialData.first().matPsd.rows() &&
-           m_intermediateSumData.matPsdSum.cols() == m_trialData.first().matPsd.cols() ) {
-            m_intermediateSumData.matPsdSum -= m_trialData.first().matPsd;
+        if(m_intermediateSumData.matCsdSum.size() != 0 && m_intermediateSumData.matCsdSum.size() == trialData.matCsd.size()) {
+            m_intermediateSumData.matCsdSum -= trialData.matCsd;
+        }
+        if(m_intermediateSumData.matCsdNormalizedSum.size() != 0 && m_intermediateSumData.matCsdNormalizedSum.size() == trialData.matCsdNormalized.size()) {
+            m_intermediateSumData.matCsdNormalizedSum -= trialData.matCsdNormalized;
+        }
+        if(m_intermediateSumData.matCsdImagSignSum.size() != 0 && m_intermediateSumData.matCsdImagSignSum.size() == trialData.matCsdImagSign.size()) {
+            m_intermediateSumData.matCsdImagSignSum -= trialData.matCsdImagSign;
+        }
+        if(m_intermediateSumData.matCsdImagAbsSum.size() != 0 && m_intermediateSumData.matCsdImagAbsSum.size() == trialData.matCsdImagAbs.size()) {
+            m_intermediateSumData.matCsdImagAbsSum -= trialData.matCsdImagAbs;
+        }
+        if(m_intermediateSumData.matCsdImagSqrdSum.size() != 0 && m_intermediateSumData.matCsdImagSqrdSum.size() == trialData.matCsdImagSqrd.size()) {
+            m_intermediateSumData.matCsdImagSqrdSum -= trialData.matCsdImagSqrd;
         }
 
         m_trialData.removeFirst();
@@ -230,27 +323,22 @@ void ConnectivitySettings::removeLast(int iAmount)
 
     // Substract influence of trials from overall summed up intermediate data and remove from data list
     for (int j = 0; j < iAmount; ++j) {
-        for (int i = 0; i < m_trialData.last().matData.rows(); ++i) {
-            if(i < m_intermediateSumData.vecPairCsdSum.size() && (m_intermediateSumData.vecPairCsdSum.size() == m_trialData.last().vecPairCsd.size())) {
-                m_intermediateSumData.vecPairCsdSum[i].second -= m_trialData.last().vecPairCsd.at(i).second;
-            }
-            if(i < m_intermediateSumData.vecPairCsdNormalizedSum.size() && (m_intermediateSumData.vecPairCsdNormalizedSum.size() == m_trialData.last().vecPairCsdNormalized.size())) {
-                m_intermediateSumData.vecPairCsdNormalizedSum[i].second -= m_trialData.last().vecPairCsdNormalized.at(i).second;
-            }
-            if(i < m_intermediateSumData.vecPairCsdImagSignSum.size() && (m_intermediateSumData.vecPairCsdImagSignSum.size() == m_trialData.last().vecPairCsdImagSign.size())) {
-                m_intermediateSumData.vecPairCsdImagSignSum[i].second -= m_trialData.last().vecPairCsdImagSign.at(i).second;
-            }
-            if(i < m_intermediateSumData.vecPairCsdImagAbsSum.size() && (m_intermediateSumData.vecPairCsdImagAbsSum.size() == m_trialData.last().vecPairCsdImagAbs.size())) {
-                m_intermediateSumData.vecPairCsdImagAbsSum[i].second -= m_trialData.last().vecPairCsdImagAbs.at(i).second;
-            }
-            if(i < m_intermediateSumData.vecPairCsdImagSqrdSum.size() && (m_intermediateSumData.vecPairCsdImagSqrdSum.size() == m_trialData.last().vecPairCsdImagSqrd.size())) {
-                m_intermediateSumData.vecPairCsdImagSqrdSum[i].second -= m_trialData.last().vecPairCsdImagSqrd.at(i).second;
-            }
-        }
+        const IntermediateTrialData& trialData = m_trialData.last();
 
-        if(m_intermediateSumData.matPsdSum.rows() == m_trialData.last().matPsd.rows() &&
-           m_intermediateSumData.matPsdSum.cols() == m_trialData.last().matPsd.cols() ) {
-            m_intermediateSumData.matPsdSum -= m_trialData.last().matPsd;
+        if(m_intermediateSumData.matCsdSum.size() != 0 && m_intermediateSumData.matCsdSum.size() == trialData.matCsd.size()) {
+            m_intermediateSumData.matCsdSum -= trialData.matCsd;
+        }
+        if(m_intermediateSumData.matCsdNormalizedSum.size() != 0 && m_intermediateSumData.matCsdNormalizedSum.size() == trialData.matCsdNormalized.size()) {
+            m_intermediateSumData.matCsdNormalizedSum -= trialData.matCsdNormalized;
+        }
+        if(m_intermediateSumData.matCsdImagSignSum.size() != 0 && m_intermediateSumData.matCsdImagSignSum.size() == trialData.matCsdImagSign.size()) {
+            m_intermediateSumData.matCsdImagSignSum -= trialData.matCsdImagSign;
+        }
+        if(m_intermediateSumData.matCsdImagAbsSum.size() != 0 && m_intermediateSumData.matCsdImagAbsSum.size() == trialData.matCsdImagAbs.size()) {
+            m_intermediateSumData.matCsdImagAbsSum -= trialData.matCsdImagAbs;
+        }
+        if(m_intermediateSumData.matCsdImagSqrdSum.size() != 0 && m_intermediateSumData.matCsdImagSqrdSum.size() == trialData.matCsdImagSqrd.size()) {
+            m_intermediateSumData.matCsdImagSqrdSum -= trialData.matCsdImagSqrd;
         }
 
         m_trialData.removeLast();
@@ -328,6 +416,7 @@ void ConnectivitySettings::setWindowType(const QString& sWindowType)
     clearIntermediateData();
 
     m_sWindowType = sWindowType;
+    m_tapers = QPair<MatrixXd, VectorXd>();
 }
 
 //*******************************************************************************************************
@@ -416,3 +505,42 @@ ConnectivitySettings::IntermediateSumData& ConnectivitySettings::getIntermediate
 {
     return m_intermediateSumData;
 }
+
+//*******************************************************************************************************
+
+void ConnectivitySettings::computeTaperedSpectraChunk(const QVector<IntermediateTrialData*>& vecTrials,
+                                                      int iBegin,
+                                                      int iEnd) const
+{
+    if(iBegin >= iEnd) {
+        return;
+    }
+
+    int iNRows = vecTrials.first()->matData.rows();
+    int iSignalLength = vecTrials.first()->matData.cols();
+    int iNTapers = m_tapers.first.rows();
+
+    FFT<double> fft;
+    fft.SetFlag(fft.HalfSpectrum);
+
+    // The input buffer is zero padded once. Signals longer than the FFT length are truncated by the FFT.
+    RowVectorXd vecInputFFT = RowVectorXd::Zero(qMax(m_iNfft, iSignalLength));
+    RowVectorXd rowData;
+    RowVectorXcd vecTmpFreq;
+
+    for(int k = iBegin; k < iEnd; ++k) {
+        IntermediateTrialData* pTrialData = vecTrials.at(k / iNRows);
+        int i = k % iNRows;
+
+        // Substract mean
+        rowData.array() = pTrialData->matData.row(i).array() - pTrialData->matData.row(i).mean();
+
+        for(int j = 0; j < iNTapers; ++j) {
+            vecInputFFT.head(iSignalLength) = rowData.cwiseProduct(m_tapers.first.row(j));
+
+            // FFT for freq domain returning the half spectrum and multiply taper weights
+            fft.fwd(vecTmpFreq, vecInputFFT, m_iNfft);
+            pTrialData->matTapSpectra.col(i * iNTapers + j) = vecTmpFreq.transpose() * m_tapers.second(j);
+        }
+    }
+}
@@ -49,6 +49,7 @@
 #include <QSharedPointer>
 #include <QStringList>
 #include <QVector>
+#include <QPair>
 
 //=============================================================================================================
 // EIGEN INCLUDES
@@ -95,24 +96,28 @@ public:
     typedef QSharedPointer<ConnectivitySettings> SPtr;            /**< Shared pointer type for ConnectivitySettings. */
     typedef QSharedPointer<const ConnectivitySettings> ConstSPtr; /**< Const shared pointer type for ConnectivitySettings. */
 
+    /**
+     * The cross-spectral densities are stored as packed tensors of size pairs x bins, with pairs = rows*(rows+1)/2.
+     * Column f holds the lower triangle of the Hermitian CSD matrix of frequency bin f. The pairs (i,j) with
+     * j >= i follow each other for every i, in the order of Network::getDensePairIndex, so the tensors have the
+     * layout of the dense network edges and all edges starting at node i are contiguous in memory.
+     */
     struct IntermediateTrialData {
         Eigen::MatrixXd     matData;
-        Eigen::MatrixXd     matPsd;
-        QVector<Eigen::MatrixXcd>               vecTapSpectra;
-        QVector<QPair<int,Eigen::MatrixXcd> >   vecPairCsd;
-        QVector<QPair<int,Eigen::MatrixXcd> >   vecPairCsdNormalized;
-        QVector<QPair<int,Eigen::MatrixXd> >    vecPairCsdImagSign;
-        QVector<QPair<int,Eigen::MatrixXd> >    vecPairCsdImagAbs;
-        QVector<QPair<int,Eigen::MatrixXd> >    vecPairCsdImagSqrd;
+        Eigen::MatrixXcd    matTapSpectra;      /**< The tapered spectra of all rows (freqs x rows*tapers). Column i*tapers+j holds taper j of row i. */
+        Eigen::MatrixXcd    matCsd;             /**< The CSD tensor. */
+        Eigen::MatrixXcd    matCsdNormalized;   /**< The CSD tensor normalized by its magnitude. */
+        Eigen::MatrixXd     matCsdImagSign;     /**< The sign of the imaginary part of the CSD tensor. */
+        Eigen::MatrixXd     matCsdImagAbs;      /**< The magnitude of the imaginary part of the CSD tensor. */
+        Eigen::MatrixXd     matCsdImagSqrd;     /**< The squared imaginary part of the CSD tensor. */
     };
 
     struct IntermediateSumData {
-        Eigen::MatrixXd     matPsdSum;
-        QVector<QPair<int,Eigen::MatrixXcd> >   vecPairCsdSum;
-        QVector<QPair<int,Eigen::MatrixXcd> >   vecPairCsdNormalizedSum;
-        QVector<QPair<int,Eigen::MatrixXd> >    vecPairCsdImagSignSum;
-        QVector<QPair<int,Eigen::MatrixXd> >    vecPairCsdImagAbsSum;
-        QVector<QPair<int,Eigen::MatrixXd> >    vecPairCsdImagSqrdSum;
+        Eigen::MatrixXcd    matCsdSum;
+        Eigen::MatrixXcd    matCsdNormalizedSum;
+        Eigen::MatrixXd     matCsdImagSignSum;
+        Eigen::MatrixXd     matCsdImagAbsSum;
+        Eigen::MatrixXd     matCsdImagSqrdSum;
     };
 
     //=========================================================================================================
@@ -123,8 +128,42 @@ public:
 
     void clearAllData();
 
+    //=========================================================================================================
+    /**
+     * Clears all intermediate data, including the cached tapered spectra.
+     */
     void clearIntermediateData();
 
+    //=========================================================================================================
+    /**
+     * Clears the intermediate data produced by the metrics (PSD, CSD and their sums) but keeps the cached
+     * tapered spectra, so that several metrics can be computed on the same spectra.
+     */
+    void clearIntermediateMetricData();
+
+    //=========================================================================================================
+    /**
+     * Clears the cached tapered spectra of all trials.
+     */
+    void clearTaperedSpectra();
+
+    //=========================================================================================================
+    /**
+     * Computes the tapered spectra of all rows for every trial which does not hold valid spectra yet. All
+     * pending rows of all trials are split into chunks which are transformed in parallel. The result is
+     * stored per trial in IntermediateTrialData::matTapSpectra and shared by all spectral metrics.
+     */
+    void computeTaperedSpectra();
+
+    //=========================================================================================================
+    /**
+     * Returns the tapers (taper matrix and weights) used to compute the tapered spectra. The tapers are
+     * generated for the current signal length and window type by computeTaperedSpectra().
+     *
+     * @return The tapers.
+     */
+    const QPair<Eigen::MatrixXd, Eigen::VectorXd>& getTapers() const;
+
     void append(const QList<Eigen::MatrixXd>& matInputData);
 
     void append(const Eigen::MatrixXd& matInputData);
@@ -172,6 +211,18 @@ public:
     IntermediateSumData& getIntermediateSumData();
 
 protected:
+    //=========================================================================================================
+    /**
+     * Computes the tapered spectra for a range of (trial, row) jobs. This function gets called in parallel.
+     *
+     * @param[in] vecTrials      The trials to compute the spectra for.
+     * @param[in] iBegin         The first job. Job k refers to row k % rows of trial k / rows.
+     * @param[in] iEnd           The job after the last one.
+     */
+    void computeTaperedSpectraChunk(const QVector<IntermediateTrialData*>& vecTrials,
+                                    int iBegin,
+                                    int iEnd) const;
+
     QStringList                     m_sConnectivityMethods;         /**< The connectivity methods. */
     QString                         m_sWindowType;                  /**< The window type used to compute tapered spectra. */
 
@@ -181,6 +232,8 @@ protected:
 
     Eigen::MatrixX3f                m_matNodePositions;             /**< The node position in 3D space. */
 
+    QPair<Eigen::MatrixXd, Eigen::VectorXd> m_tapers;              /**< The tapers used to compute the tapered spectra. */
+
     IntermediateSumData             m_intermediateSumData;          /**< The intermediate sum data holds data calculated over all trials as a whole. */
     QList<IntermediateTrialData>    m_trialData;                    /**< The trial data holds the actual and intermediate data calcualted for each trial. */
 };
@@ -37,11 +37,15 @@
 //=============================================================================================================
 
 #include "abstractmetric.h"
+#include "network/network.h"
 
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
 
+#include <QtConcurrent>
+#include <QThread>
+
 //=============================================================================================================
 // EIGEN INCLUDES
 //=============================================================================================================
@@ -51,11 +55,41 @@
 //=============================================================================================================
 
 using namespace CONNECTIVITYLIB;
+using namespace Eigen;
 
 //=============================================================================================================
 // DEFINE GLOBAL METHODS
 //=============================================================================================================
 
+template<typename T>
+static void addSum(T& matSum,
+                   const T& matPartialSum)
+{
+    if(matPartialSum.size() == 0) {
+        return;
+    }
+
+    if(matSum.size() == 0) {
+        matSum = matPartialSum;
+    } else {
+        matSum += matPartialSum;
+    }
+}
+
+//=============================================================================================================
+
+static void addSumData(ConnectivitySettings::IntermediateSumData& sumData,
+                       const ConnectivitySettings::IntermediateSumData& partialSumData)
+{
+    addSum(sumData.matCsdSum, partialSumData.matCsdSum);
+    addSum(sumData.matCsdNormalizedSum, partialSumData.matCsdNormalizedSum);
+    addSum(sumData.matCsdImagSignSum, partialSumData.matCsdImagSignSum);
+    addSum(sumData.matCsdImagAbsSum, partialSumData.matCsdImagAbsSum);
+    addSum(sumData.matCsdImagSqrdSum, partialSumData.matCsdImagSqrdSum);
+}
+
+//=============================================================================================================
+
 bool AbstractMetric::m_bStorageModeIsActive = false;
 int AbstractMetric::m_iNumberBinStart = -1;
 int AbstractMetric::m_iNumberBinAmount = -1;
@@ -68,3 +102,141 @@ AbstractMetric::AbstractMetric()
 {
 }
 
+//=============================================================================================================
+
+void AbstractMetric::computeTrials(ConnectivitySettings& connectivitySettings,
+                                  const std::function<void(ConnectivitySettings::IntermediateTrialData&, ConnectivitySettings::IntermediateSumData&)>& computeTrial)
+{
+    QList<ConnectivitySettings::IntermediateTrialData>& lTrialData = connectivitySettings.getTrialData();
+
+    int iNTrials = lTrialData.size();
+
+    if(iNTrials == 0) {
+        return;
+    }
+
+    // Resolve the trial addresses up front, so that the workers never touch the (implicitly shared) list itself
+    QVector<ConnectivitySettings::IntermediateTrialData*> vecTrials(iNTrials);
+
+    for(int i = 0; i < iNTrials; ++i) {
+        vecTrials[i] = &lTrialData[i];
+    }
+
+    int iNChunks = qBound(1, QThread::idealThreadCount(), iNTrials);
+
+    QVector<ConnectivitySettings::IntermediateSumData> vecPartialSums(iNChunks);
+    ConnectivitySettings::IntermediateSumData* pPartialSums = vecPartialSums.data();
+
+    std::function<void(int, int, int)> computeChunk = [&](int iChunk, int iBegin, int iEnd) {
+        for(int i = iBegin; i < iEnd; ++i) {
+            computeTrial(*vecTrials.at(i), pPartialSums[iChunk]);
+        }
+    };
+
+    // Compute the chunks. The last chunk is computed in this thread.
+    QVector<QFuture<void> > vecThreads;
+    int iBegin = 0;
+
+    for(int i = 0; i < iNChunks; ++i) {
+        int iEnd = iBegin + iNTrials / iNChunks + (i < iNTrials % iNChunks ? 1 : 0);
+
+        if(i == iNChunks - 1) {
+            computeChunk(i, iBegin, iEnd);
+        } else {
+            vecThreads.append(QtConcurrent::run(computeChunk, i, iBegin, iEnd));
+        }
+
+        iBegin = iEnd;
+    }
+
+    for(int i = 0; i < vecThreads.size(); ++i) {
+        vecThreads[i].waitForFinished();
+    }
+
+    // Tree reduction of the partial sums. All pairs of one level are added in parallel.
+    for(int iStride = 1; iStride < iNChunks; iStride *= 2) {
+        vecThreads.clear();
+
+        for(int i = 0; i + iStride < iNChunks; i += 2 * iStride) {
+            vecThreads.append(QtConcurrent::run(addSumData,
+                                                std::ref(pPartialSums[i]),
+                                                std::cref(pPartialSums[i + iStride])));
+        }
+
+        for(int i = 0; i < vecThreads.size(); ++i) {
+            vecThreads[i].waitForFinished();
+        }
+    }
+
+    addSumData(connectivitySettings.getIntermediateSumData(), pPartialSums[0]);
+}
+
+//=============================================================================================================
+
+void AbstractMetric::computeCsd(ConnectivitySettings::IntermediateTrialData& inputData,
+                                int iNfft,
+                                const QPair<MatrixXd, VectorXd>& tapers)
+{
+    int iNRows = inputData.matData.rows();
+    int iNTapers = tapers.first.rows();
+    int iNFreqs = int(floor(iNfft / 2.0)) + 1;
+
+    bool bNfftEven = false;
+    if (iNfft % 2 == 0){
+        bNfftEven = true;
+    }
+
+    double denomCSD = tapers.second.cwiseAbs2().sum() / 2.0;
+
+    // Repack the selected bins so that the spectra of all rows and tapers of one bin are contiguous. Column f
+    // viewed as a tapers x rows matrix equals X^T of bin f.
+    MatrixXcd matBinSpectra = inputData.matTapSpectra.middleRows(m_iNumberBinStart, m_iNumberBinAmount).transpose();
+
+    MatrixXcd matBinCsd(iNRows, iNRows);
+    inputData.matCsd.resize((iNRows * (iNRows + 1)) / 2, m_iNumberBinAmount);
+
+    for (int f = 0; f < m_iNumberBinAmount; ++f) {
+        Map<const MatrixXcd> matSpectraT(matBinSpectra.col(f).data(), iNTapers, iNRows);
+
+        double dScaling = 1.0 / denomCSD;
+
+        // Divide first and last element by 2 due to half spectrum
+        if(m_iNumberBinStart + f == 0) {
+            dScaling /= 2.0;
+        }
+
+        if(bNfftEven && m_iNumberBinStart + f == iNFreqs - 1) {
+            dScaling /= 2.0;
+        }
+
+        // conj(X) X^T is the transposed CSD, i.e. entry (j,i) holds sum_t X(i,t) conj(X(j,t))
+        matBinCsd.setZero();
+        matBinCsd.selfadjointView<Lower>().rankUpdate(matSpectraT.adjoint(), dScaling);
+
+        // Pack the lower triangle. Column i holds the pairs (i,j) with j >= i.
+        for (int i = 0; i < iNRows; ++i) {
+            inputData.matCsd.col(f).segment(Network::getDensePairIndex(i, i, iNRows), iNRows - i) = matBinCsd.col(i).tail(iNRows - i);
+        }
+    }
+}
+
+//=============================================================================================================
+
+void AbstractMetric::setDenseEdgeWeights(Network& finalNetwork,
+                                         const MatrixXd& matTensor)
+{
+    if(matTensor.rows() == 0) {
+        return;
+    }
+
+    // The tensor has the pair layout of the dense network edges
+    finalNetwork.setDenseEdgeWeights(matTensor);
+}
+
+//=============================================================================================================
+
+int AbstractMetric::getNumberRows(int iNumberPairs)
+{
+    // Solve n(n+1)/2 = iNumberPairs for n
+    return int(std::lround((std::sqrt(8.0 * iNumberPairs + 1.0) - 1.0) / 2.0));
+}
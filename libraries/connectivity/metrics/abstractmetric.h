@@ -40,6 +40,7 @@
 //=============================================================================================================
 
 #include "../connectivity_global.h"
+#include "../connectivitysettings.h"
 
 //=============================================================================================================
 // QT INCLUDES
@@ -54,6 +55,12 @@
 
 #include <Eigen/Core>
 
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <functional>
+
 //=============================================================================================================
 // FORWARD DECLARATIONS
 //=============================================================================================================
@@ -68,6 +75,8 @@ namespace CONNECTIVITYLIB {
 // CONNECTIVITYLIB FORWARD DECLARATIONS
 //=============================================================================================================
 
+class Network;
+
 //=============================================================================================================
 /**
  * This class provides basic functionalities for all implemented metrics.
@@ -92,6 +101,55 @@ public:
     static int      m_iNumberBinAmount;
 
 protected:
+    //=========================================================================================================
+    /**
+     * Computes the intermediate data of all trials in parallel. The trials are split into one chunk per thread and
+     * each chunk adds its trials to its own partial sums, so the workers never contend for a lock. The partial sums
+     * are then combined by a parallel pairwise (tree) reduction and added to the intermediate sum data of the
+     * connectivity settings.
+     *
+     * @param[in, out]   connectivitySettings    The input data and parameters.
+     * @param[in]        computeTrial            Computes one trial and adds it to the given partial sums.
+     */
+    static void computeTrials(ConnectivitySettings& connectivitySettings,
+                              const std::function<void(ConnectivitySettings::IntermediateTrialData&, ConnectivitySettings::IntermediateSumData&)>& computeTrial);
+
+    //=========================================================================================================
+    /**
+     * Computes the CSD tensor of a trial from its tapered spectra and stores it in inputData.matCsd. For each
+     * frequency bin the tapered spectra of all rows are packed into one contiguous rows x tapers matrix X, so that
+     * the CSD of that bin is obtained by a single Hermitian rank-k update X X^H instead of rows^2 pairwise products.
+     * Only the lower triangle of each bin is kept. Only the bins selected by m_iNumberBinStart and
+     * m_iNumberBinAmount are computed.
+     *
+     * @param[in, out]   inputData   The trial data. The tapered spectra must have been computed already.
+     * @param[in]        iNfft       The FFT length.
+     * @param[in]        tapers      The taper information.
+     */
+    static void computeCsd(ConnectivitySettings::IntermediateTrialData& inputData,
+                           int iNfft,
+                           const QPair<Eigen::MatrixXd, Eigen::VectorXd>& tapers);
+
+    //=========================================================================================================
+    /**
+     * Stores a tensor with the layout of the CSD tensor (see ConnectivitySettings::IntermediateTrialData) in the
+     * dense edges of the network. The dense edges must have been initialized already.
+     *
+     * @param[out]   finalNetwork    The network.
+     * @param[in]    matTensor       The tensor holding the final edge weights.
+     */
+    static void setDenseEdgeWeights(Network& finalNetwork,
+                                    const Eigen::MatrixXd& matTensor);
+
+    //=========================================================================================================
+    /**
+     * Returns the number of rows (nodes) of a CSD tensor with the given number of pairs.
+     *
+     * @param[in]    iNumberPairs    The number of rows of the tensor, i.e. node pairs including self pairs.
+     *
+     * @return The number of rows of the input data.
+     */
+    static int getNumberRows(int iNumberPairs);
 };
 
 //=============================================================================================================
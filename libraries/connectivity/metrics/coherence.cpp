@@ -90,7 +90,7 @@ Network Coherence::calculate(ConnectivitySettings& connectivitySettings)
     }
 
     if(AbstractMetric::m_bStorageModeIsActive == false) {
-        connectivitySettings.clearIntermediateData();
+        connectivitySettings.clearIntermediateMetricData();
     }
 
     finalNetwork.setSamplingFrequency(connectivitySettings.getSamplingFrequency());
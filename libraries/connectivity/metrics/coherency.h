@@ -53,7 +53,6 @@
 //=============================================================================================================
 
 #include <QSharedPointer>
-#include <QMutex>
 
 //=============================================================================================================
 // EIGEN INCLUDES
@@ -119,38 +118,30 @@ public:
 private:
     //=========================================================================================================
     /**
-     * Computes the coherency values. This function gets called in parallel.
+     * Computes the coherency values. This function gets called in parallel with per-thread partial sums.
      *
      * @param[in]    inputData           The input data.
-     * @param[out]   matPsdSum           The sum of all PSD matrices for each trial.
-     * @param[out]   vecPairCsdSum       The sum of all CSD matrices for each trial.
-     * @param[in]    mutex               The mutex used to safely access matPsdSum and vecPairCsdSum.
-     * @param[in]    iNRows              The number of rows.
-     * @param[in]    iNFreqs             The number of frequenciy bins.
+     * @param[out]   sumData             The partial sums the trial is added to.
      * @param[in]    iNfft               The FFT length.
      * @param[in]    tapers              The taper information.
      */
     static void compute(ConnectivitySettings::IntermediateTrialData& inputData,
-                        Eigen::MatrixXd& matPsdSum,
-                        QVector<QPair<int,Eigen::MatrixXcd> >& vecPairCsdSum,
-                        QMutex& mutex,
-                        int iNRows,
-                        int iNFreqs,
+                        ConnectivitySettings::IntermediateSumData& sumData,
                         int iNfft,
                         const QPair<Eigen::MatrixXd, Eigen::VectorXd>& tapers);
 
     //=========================================================================================================
     /**
-     * Computes the PSD and CSD. This function gets called in parallel.
+     * Computes the coherency from the summed CSD tensor and stores it in the dense edges of the network. The PSD
+     * of a row is its self pair in the CSD tensor.
+     *
+     * @param[out]   finalNetwork    The resulting network.
+     * @param[in]    matCsdSum       The sum of all CSD tensors for each trial.
      */
-    static void computePSDCSDAbs(QMutex& mutex,
-                                 Network& finalNetwork,
-                                 const QPair<int,Eigen::MatrixXcd>& pairInput,
-                                 const Eigen::MatrixXd& matPsdSum);
-    static void computePSDCSDImag(QMutex& mutex,
-                                  Network& finalNetwork,
-                                  const QPair<int,Eigen::MatrixXcd>& pairInput,
-                                  const Eigen::MatrixXd& matPsdSum);
+    static void computePSDCSDAbs(Network& finalNetwork,
+                                 const Eigen::MatrixXcd& matCsdSum);
+    static void computePSDCSDImag(Network& finalNetwork,
+                                  const Eigen::MatrixXcd& matCsdSum);
 };
 
 //=============================================================================================================
@@ -134,23 +134,15 @@ Network Correlation::calculate(ConnectivitySettings& connectivitySettings)
 //    qWarning() << "ComputeSpectraPSDCSD" << iTime;
 //    timer.restart();
 
-    //Add edges to network
-    MatrixXd matWeight(1,1);
-    QSharedPointer<NetworkEdge> pEdge;
-    int j;
+    //Add edges to network. Each edge holds a single weight.
+    finalNetwork.initDenseEdges(1);
 
     for(int i = 0; i < matDist.rows(); ++i) {
-        for(j = i; j < matDist.cols(); ++j) {
-            matWeight << matDist(i,j);
-
-            pEdge = QSharedPointer<NetworkEdge>(new NetworkEdge(i, j, matWeight));
-
-            finalNetwork.getNodeAt(i)->append(pEdge);
-            finalNetwork.getNodeAt(j)->append(pEdge);
-            finalNetwork.append(pEdge);
-        }
+        finalNetwork.setDenseEdgeWeights(i, matDist.row(i).transpose());
     }
 
+    finalNetwork.updateDenseEdges();
+
 //    iTime = timer.elapsed();
 //    qWarning() << "Compute" << iTime;
 //    timer.restart();
@@ -41,8 +41,6 @@
 #include "network/networkedge.h"
 #include "network/network.h"
 
-#include <utils/spectral.h>
-
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
@@ -62,7 +60,6 @@
 
 using namespace CONNECTIVITYLIB;
 using namespace Eigen;
-using namespace UTILSLIB;
 
 //=============================================================================================================
 // DEFINE GLOBAL METHODS
@@ -96,7 +93,7 @@ Network CrossCorrelation::calculate(ConnectivitySettings& connectivitySettings)
     }
 
     if(AbstractMetric::m_bStorageModeIsActive == false) {
-        connectivitySettings.clearIntermediateData();
+        connectivitySettings.clearIntermediateMetricData();
     }
 
     finalNetwork.setSamplingFrequency(connectivitySettings.getSamplingFrequency());
@@ -117,11 +114,11 @@ Network CrossCorrelation::calculate(ConnectivitySettings& connectivitySettings)
         finalNetwork.append(NetworkNode::SPtr(new NetworkNode(i, rowVert)));
     }
 
-    // Generate tapers
-    int iSignalLength = connectivitySettings.at(0).matData.cols();
     int iNfft = connectivitySettings.getFFTSize();
 
-    QPair<MatrixXd, VectorXd> tapers = Spectral::generateTapers(iSignalLength, connectivitySettings.getWindowType());
+    // Compute the tapered spectra once. They are shared with all other metrics.
+    connectivitySettings.computeTaperedSpectra();
+    const QPair<MatrixXd, VectorXd>& tapers = connectivitySettings.getTapers();
 
     // Compute the cross correlation in parallel
     QMutex mutex;
@@ -150,23 +147,15 @@ Network CrossCorrelation::calculate(ConnectivitySettings& connectivitySettings)
 //    qWarning() << "ComputeSpectraPSDCSD" << iTime;
 //    timer.restart();
 
-    //Add edges to network
-    MatrixXd matWeight(1,1);
-    QSharedPointer<NetworkEdge> pEdge;
-    int j;
+    //Add edges to network. Each edge holds a single weight.
+    finalNetwork.initDenseEdges(1);
 
     for(int i = 0; i < matDist.rows(); ++i) {
-        for(j = i; j < matDist.cols(); ++j) {
-            matWeight << matDist(i,j);
-
-            pEdge = QSharedPointer<NetworkEdge>(new NetworkEdge(i, j, matWeight));
-
-            finalNetwork.getNodeAt(i)->append(pEdge);
-            finalNetwork.getNodeAt(j)->append(pEdge);
-            finalNetwork.append(pEdge);
-        }
+        finalNetwork.setDenseEdgeWeights(i, matDist.row(i).transpose());
     }
 
+    finalNetwork.updateDenseEdges();
+
 //    iTime = timer.elapsed();
 //    qWarning() << "Compute" << iTime;
 //    timer.restart();
@@ -186,8 +175,7 @@ void CrossCorrelation::compute(ConnectivitySettings::IntermediateTrialData& inpu
 //    qint64 iTime = 0;
 //    timer.start();
 
-    // Calculate tapered spectra if not available already
-    RowVectorXd vecInputFFT, rowData;
+    RowVectorXd vecInputFFT;
     RowVectorXcd vecResultFreq;
 
     FFT<double> fft;
@@ -196,34 +184,9 @@ void CrossCorrelation::compute(ConnectivitySettings::IntermediateTrialData& inpu
     int i, j;
     int iNRows = inputData.matData.rows();
 
-    // Calculate tapered spectra if not available already
-    // This code was copied and changed modified Utils/Spectra since we do not want to call the function due to time loss.
-    if(inputData.vecTapSpectra.isEmpty()) {
-        int iNFreqs = int(floor(iNfft / 2.0)) + 1;
-        MatrixXcd matTapSpectrum(tapers.first.rows(), iNFreqs);
-
-        for (i = 0; i < iNRows; ++i) {
-            // Substract mean
-            rowData.array() = inputData.matData.row(i).array() - inputData.matData.row(i).mean();
-
-            // Calculate tapered spectra
-            for(j = 0; j < tapers.first.rows(); j++) {
-                // Zero padd if necessary. The zero padding in Eigen's FFT is only working for column vectors.
-                if (rowData.cols() < iNfft) {
-                    vecInputFFT.setZero(iNfft);
-                    vecInputFFT.block(0,0,1,rowData.cols()) = rowData.cwiseProduct(tapers.first.row(j));;
-                } else {
-                    vecInputFFT = rowData.cwiseProduct(tapers.first.row(j));
-                }
-
-                // FFT for freq domain returning the half spectrum and multiply taper weights
-                fft.fwd(vecResultFreq, vecInputFFT, iNfft);
-                matTapSpectrum.row(j) = vecResultFreq * tapers.second(j);
-            }
-
-            inputData.vecTapSpectra.append(matTapSpectrum);
-        }
-    }
+    // The tapered spectra were computed by ConnectivitySettings and are shared by all metrics
+    int iNTapers = tapers.first.rows();
+    const MatrixXcd& matTapSpectra = inputData.matTapSpectra;
 
 //    iTime = timer.elapsed();
 //    qDebug() << QThread::currentThreadId() << "CrossCorrelation::compute timer - Tapered spectra:" << iTime;
@@ -236,11 +199,11 @@ void CrossCorrelation::compute(ConnectivitySettings::IntermediateTrialData& inpu
     int idx = 0;
     double denom = tapers.second.sum();
 
-    for(i = 0; i < inputData.vecTapSpectra.size(); ++i) {
-        vecResultFreq = inputData.vecTapSpectra.at(i).colwise().sum() / denom;
+    for(i = 0; i < iNRows; ++i) {
+        vecResultFreq = matTapSpectra.middleCols(i*iNTapers,iNTapers).rowwise().sum().transpose() / denom;
 
-        for(j = i; j < inputData.vecTapSpectra.size(); ++j) {
-            vecResultXCor = vecResultFreq.cwiseProduct(inputData.vecTapSpectra.at(j).colwise().sum() / denom);
+        for(j = i; j < iNRows; ++j) {
+            vecResultXCor = vecResultFreq.cwiseProduct(matTapSpectra.middleCols(j*iNTapers,iNTapers).rowwise().sum().transpose() / denom);
 
             fft.inv(vecInputFFT, vecResultXCor, iNfft);
 
@@ -269,8 +232,4 @@ void CrossCorrelation::compute(ConnectivitySettings::IntermediateTrialData& inpu
 //    iTime = timer.elapsed();
 //    qDebug() << QThread::currentThreadId() << "CrossCorrelation::compute timer - Summing up matDist:" << iTime;
 //    timer.restart();
-
-    if(!m_bStorageModeIsActive) {
-        inputData.vecTapSpectra.clear();
-    }
 }
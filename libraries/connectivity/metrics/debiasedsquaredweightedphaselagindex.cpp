@@ -45,8 +45,6 @@
 #include "network/networkedge.h"
 #include "network/network.h"
 
-#include <utils/spectral.h>
-
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
@@ -58,15 +56,12 @@
 // EIGEN INCLUDES
 //=============================================================================================================
 
-#include <unsupported/Eigen/FFT>
-
 //=============================================================================================================
 // USED NAMESPACES
 //=============================================================================================================
 
 using namespace CONNECTIVITYLIB;
 using namespace Eigen;
-using namespace UTILSLIB;
 
 //=============================================================================================================
 // DEFINE GLOBAL METHODS
@@ -96,15 +91,11 @@ Network DebiasedSquaredWeightedPhaseLagIndex::calculate(ConnectivitySettings& co
     }
 
     if(AbstractMetric::m_bStorageModeIsActive == false) {
-        connectivitySettings.clearIntermediateData();
+        connectivitySettings.clearIntermediateMetricData();
     }
 
     finalNetwork.setSamplingFrequency(connectivitySettings.getSamplingFrequency());
 
-    #ifdef EIGEN_FFTW_DEFAULT
-        fftw_make_planner_thread_safe();
-    #endif
-
     //Create nodes
     int rows = connectivitySettings.at(0).matData.rows();
     RowVectorXf rowVert = RowVectorXf::Zero(3);
@@ -121,15 +112,13 @@ Network DebiasedSquaredWeightedPhaseLagIndex::calculate(ConnectivitySettings& co
         finalNetwork.append(NetworkNode::SPtr(new NetworkNode(i, rowVert)));
     }
 
-    // Check that iNfft >= signal length
-    int iSignalLength = connectivitySettings.at(0).matData.cols();
     int iNfft = connectivitySettings.getFFTSize();
 
-    // Generate tapers
-    QPair<MatrixXd, VectorXd> tapers = Spectral::generateTapers(iSignalLength, connectivitySettings.getWindowType());
+    // Compute the tapered spectra once. They are shared with all other metrics.
+    connectivitySettings.computeTaperedSpectra();
+    const QPair<MatrixXd, VectorXd>& tapers = connectivitySettings.getTapers();
 
     // Initialize
-    int iNRows = connectivitySettings.at(0).matData.rows();
     int iNFreqs = int(floor(iNfft / 2.0)) + 1;
 
     // Check if start and bin amount need to be reset to full spectrum
@@ -147,18 +136,12 @@ Network DebiasedSquaredWeightedPhaseLagIndex::calculate(ConnectivitySettings& co
     finalNetwork.setFFTSize(iNFreqs);
     finalNetwork.setUsedFreqBins(AbstractMetric::m_iNumberBinAmount);
 
-    QMutex mutex;
-
-    std::function<void(ConnectivitySettings::IntermediateTrialData&)> computeLambda = [&](ConnectivitySettings::IntermediateTrialData& inputData) {
-        return compute(inputData,
-                       connectivitySettings.getIntermediateSumData().vecPairCsdSum,
-                       connectivitySettings.getIntermediateSumData().vecPairCsdImagAbsSum,
-                       connectivitySettings.getIntermediateSumData().vecPairCsdImagSqrdSum,
-                       mutex,
-                       iNRows,
-                       iNFreqs,
-                       iNfft,
-                       tapers);
+    std::function<void(ConnectivitySettings::IntermediateTrialData&, ConnectivitySettings::IntermediateSumData&)> computeLambda = [&](ConnectivitySettings::IntermediateTrialData& inputData,
+                                                                                                                                      ConnectivitySettings::IntermediateSumData& sumData) {
+        compute(inputData,
+                sumData,
+                iNfft,
+                tapers);
     };
 
 //    iTime = timer.elapsed();
@@ -166,9 +149,8 @@ Network DebiasedSquaredWeightedPhaseLagIndex::calculate(ConnectivitySettings& co
 //    timer.restart();
 
     // Compute DSWPLI in parallel for all trials
-    QFuture<void> result = QtConcurrent::map(connectivitySettings.getTrialData(),
-                                             computeLambda);
-    result.waitForFinished();
+    computeTrials(connectivitySettings,
+                  computeLambda);
 
 //    iTime = timer.elapsed();
 //    qWarning() << "ComputeSpectraPSDCSD" << iTime;
@@ -188,147 +170,55 @@ Network DebiasedSquaredWeightedPhaseLagIndex::calculate(ConnectivitySettings& co
 //=============================================================================================================
 
 void DebiasedSquaredWeightedPhaseLagIndex::compute(ConnectivitySettings::IntermediateTrialData& inputData,
-                                                   QVector<QPair<int,MatrixXcd> >& vecPairCsdSum,
-                                                   QVector<QPair<int,MatrixXd> >& vecPairCsdImagAbsSum,
-                                                   QVector<QPair<int,MatrixXd> >& vecPairCsdImagSqrdSum,
-                                                   QMutex& mutex,
-                                                   int iNRows,
-                                                   int iNFreqs,
+                                                   ConnectivitySettings::IntermediateSumData& sumData,
                                                    int iNfft,
                                                    const QPair<MatrixXd, VectorXd>& tapers)
 {
-    if(inputData.vecPairCsd.size() == iNRows &&
-       inputData.vecPairCsdImagSqrd.size() == iNRows &&
-       inputData.vecPairCsdImagAbs.size() == iNRows) {
-        //qDebug() << "DebiasedSquaredWeightedPhaseLagIndex::compute - vecPairCsd, vecPairCsdImagSqrd and vecPairCsdImagAbs were already computed for this trial.";
+    if(inputData.matCsd.size() != 0 &&
+       inputData.matCsdImagAbs.size() != 0 &&
+       inputData.matCsdImagSqrd.size() != 0) {
+        //qDebug() << "DebiasedSquaredWeightedPhaseLagIndex::compute - matCsd, matCsdImagAbs and matCsdImagSqrd were already computed for this trial.";
         return;
     }
 
-    int i,j;
-
-    // Calculate tapered spectra if not available already
-    // This code was copied and changed modified Utils/Spectra since we do not want to call the function due to time loss.
-    if(inputData.vecTapSpectra.isEmpty()) {
-        RowVectorXd vecInputFFT, rowData;
-        RowVectorXcd vecTmpFreq;
-
-        MatrixXcd matTapSpectrum(tapers.first.rows(), iNFreqs);
-
-        FFT<double> fft;
-        fft.SetFlag(fft.HalfSpectrum);
-
-        for (i = 0; i < iNRows; ++i) {
-            // Substract mean
-            rowData.array() = inputData.matData.row(i).array() - inputData.matData.row(i).mean();
-
-            // Calculate tapered spectra if not available already
-            for(j = 0; j < tapers.first.rows(); j++) {
-                // Zero padd if necessary. The zero padding in Eigen's FFT is only working for column vectors.
-                if (rowData.cols() < iNfft) {
-                    vecInputFFT.setZero(iNfft);
-                    vecInputFFT.block(0,0,1,rowData.cols()) = rowData.cwiseProduct(tapers.first.row(j));;
-                } else {
-                    vecInputFFT = rowData.cwiseProduct(tapers.first.row(j));
-                }
-
-                // FFT for freq domain returning the half spectrum and multiply taper weights
-                fft.fwd(vecTmpFreq, vecInputFFT, iNfft);
-                matTapSpectrum.row(j) = vecTmpFreq * tapers.second(j);
-            }
+    // Compute the CSD tensor by one rank-k update per frequency bin
+    if(inputData.matCsd.size() == 0) {
+        computeCsd(inputData,
+                   iNfft,
+                   tapers);
 
-            inputData.vecTapSpectra.append(matTapSpectrum);
+        if(sumData.matCsdSum.size() == 0) {
+            sumData.matCsdSum = inputData.matCsd;
+        } else {
+            sumData.matCsdSum += inputData.matCsd;
         }
     }
 
-    // Compute CSD
-    if(inputData.vecPairCsd.isEmpty()) {
-        MatrixXcd matCsd(iNRows, m_iNumberBinAmount);
-
-        bool bNfftEven = false;
-        if (iNfft % 2 == 0){
-            bNfftEven = true;
-        }
-
-        double denomCSD = sqrt(tapers.second.cwiseAbs2().sum()) * sqrt(tapers.second.cwiseAbs2().sum()) / 2.0;
-
-        for (i = 0; i < iNRows; ++i) {
-            for (j = i; j < iNRows; ++j) {
-                // Compute CSD (average over tapers if necessary)
-                matCsd.row(j) = inputData.vecTapSpectra.at(i).block(0,m_iNumberBinStart,inputData.vecTapSpectra.at(i).rows(),m_iNumberBinAmount).cwiseProduct(inputData.vecTapSpectra.at(j).block(0,m_iNumberBinStart,inputData.vecTapSpectra.at(j).rows(),m_iNumberBinAmount).conjugate()).colwise().sum() / denomCSD;
-
-                // Divide first and last element by 2 due to half spectrum
-                if(m_iNumberBinStart == 0) {
-                    matCsd.row(j)(0) /= 2.0;
-                }
-
-                if(bNfftEven && m_iNumberBinStart + m_iNumberBinAmount >= iNFreqs) {
-                    matCsd.row(j).tail(1) /= 2.0;
-                }
-            }
-
-            inputData.vecPairCsd.append(QPair<int,MatrixXcd>(i,matCsd));
-            inputData.vecPairCsdImagSqrd.append(QPair<int,MatrixXd>(i,matCsd.imag().array().square()));
-            inputData.vecPairCsdImagAbs.append(QPair<int,MatrixXd>(i,matCsd.imag().cwiseAbs()));
-        }
-
-        mutex.lock();
+    if(inputData.matCsdImagAbs.size() == 0) {
+        inputData.matCsdImagAbs = inputData.matCsd.imag().cwiseAbs();
 
-        if(vecPairCsdSum.isEmpty()) {
-            vecPairCsdSum = inputData.vecPairCsd;
-            vecPairCsdImagSqrdSum = inputData.vecPairCsdImagSqrd;
-            vecPairCsdImagAbsSum = inputData.vecPairCsdImagAbs;
+        if(sumData.matCsdImagAbsSum.size() == 0) {
+            sumData.matCsdImagAbsSum = inputData.matCsdImagAbs;
         } else {
-            for (int j = 0; j < vecPairCsdSum.size(); ++j) {
-                vecPairCsdSum[j].second += inputData.vecPairCsd.at(j).second;
-                vecPairCsdImagSqrdSum[j].second += inputData.vecPairCsdImagSqrd.at(j).second;
-                vecPairCsdImagAbsSum[j].second += inputData.vecPairCsdImagAbs.at(j).second;
-            }
+            sumData.matCsdImagAbsSum += inputData.matCsdImagAbs;
         }
+    }
 
-        mutex.unlock();
-    } else {
-        if(inputData.vecPairCsdImagSqrd.isEmpty()) {
-            for (i = 0; i < inputData.vecPairCsd.size(); ++i) {
-                inputData.vecPairCsdImagSqrd.append(QPair<int,MatrixXd>(i,inputData.vecPairCsd.at(i).second.imag().array().square()));
-            }
-
-            mutex.lock();
-
-            if(vecPairCsdImagSqrdSum.isEmpty()) {
-                vecPairCsdImagSqrdSum = inputData.vecPairCsdImagSqrd;
-            } else {
-                for (int j = 0; j < vecPairCsdSum.size(); ++j) {
-                    vecPairCsdImagSqrdSum[j].second += inputData.vecPairCsdImagSqrd.at(j).second;
-                }
-            }
-
-            mutex.unlock();
-        }
-
-        if(inputData.vecPairCsdImagAbs.isEmpty()) {
-            for (i = 0; i < inputData.vecPairCsd.size(); ++i) {
-                inputData.vecPairCsdImagAbs.append(QPair<int,MatrixXd>(i,inputData.vecPairCsd.at(i).second.imag().cwiseAbs()));
-            }
-
-            mutex.lock();
-
-            if(vecPairCsdImagAbsSum.isEmpty()) {
-                vecPairCsdImagAbsSum = inputData.vecPairCsdImagAbs;
-            } else {
-                for (int j = 0; j < vecPairCsdSum.size(); ++j) {
-                    vecPairCsdImagAbsSum[j].second += inputData.vecPairCsdImagAbs.at(j).second;
-                }
-            }
+    if(inputData.matCsdImagSqrd.size() == 0) {
+        inputData.matCsdImagSqrd = inputData.matCsd.imag().array().square();
 
-            mutex.unlock();
+        if(sumData.matCsdImagSqrdSum.size() == 0) {
+            sumData.matCsdImagSqrdSum = inputData.matCsdImagSqrd;
+        } else {
+            sumData.matCsdImagSqrdSum += inputData.matCsdImagSqrd;
         }
     }
 
+    //Do not store data to save memory
     if(!m_bStorageModeIsActive) {
-        inputData.vecPairCsd.clear();
-        inputData.vecTapSpectra.clear();
-        inputData.vecPairCsdImagAbs.clear();
-        inputData.vecPairCsdImagSqrd.clear();
+        inputData.matCsd.resize(0,0);
+        inputData.matCsdImagAbs.resize(0,0);
+        inputData.matCsdImagSqrd.resize(0,0);
     }
 }
 
@@ -337,33 +227,20 @@ void DebiasedSquaredWeightedPhaseLagIndex::compute(ConnectivitySettings::Interme
 void DebiasedSquaredWeightedPhaseLagIndex::computeDSWPLI(ConnectivitySettings &connectivitySettings,
                                                          Network& finalNetwork)
 {
-    // Compute final DSWPLI and create Network
-    MatrixXd matNom, matDenom;
-    MatrixXd matWeight;
-    QSharedPointer<NetworkEdge> pEdge;
-    int j;
-
-    for (int i = 0; i < connectivitySettings.at(0).matData.rows(); ++i) {
-
-        matNom = connectivitySettings.getIntermediateSumData().vecPairCsdSum.at(i).second.imag().array().square();
-        matNom -= connectivitySettings.getIntermediateSumData().vecPairCsdImagSqrdSum.at(i).second;
+    // Compute final DSWPLI for all pairs and bins at once and store it in the dense edges of the network
+    const ConnectivitySettings::IntermediateSumData& sumData = connectivitySettings.getIntermediateSumData();
 
-        matDenom = connectivitySettings.getIntermediateSumData().vecPairCsdImagAbsSum.at(i).second.array().square();
-        matDenom -= connectivitySettings.getIntermediateSumData().vecPairCsdImagSqrdSum.at(i).second;
+    MatrixXd matNom = sumData.matCsdSum.imag().array().square();
+    matNom -= sumData.matCsdImagSqrdSum;
 
-        matDenom = (matDenom.array() == 0.).select(INFINITY, matDenom);
-        matDenom = matNom.cwiseQuotient(matDenom);
+    MatrixXd matDenom = sumData.matCsdImagAbsSum.array().square();
+    matDenom -= sumData.matCsdImagSqrdSum;
 
-        for(j = i; j < connectivitySettings.at(0).matData.rows(); ++j) {
-            matWeight = matDenom.row(j).transpose();
+    matDenom = (matDenom.array() == 0.).select(INFINITY, matDenom);
+    matDenom = matNom.cwiseQuotient(matDenom);
 
-            pEdge = QSharedPointer<NetworkEdge>(new NetworkEdge(i, j, matWeight));
-
-            finalNetwork.getNodeAt(i)->append(pEdge);
-            finalNetwork.getNodeAt(j)->append(pEdge);
-            finalNetwork.append(pEdge);
-        }
-
-    }
+    finalNetwork.initDenseEdges(AbstractMetric::m_iNumberBinAmount);
+    setDenseEdgeWeights(finalNetwork, matDenom);
+    finalNetwork.updateDenseEdges();
 }
 
@@ -89,7 +89,7 @@ Network ImagCoherence::calculate(ConnectivitySettings& connectivitySettings)
     }
 
     if(AbstractMetric::m_bStorageModeIsActive == false) {
-        connectivitySettings.clearIntermediateData();
+        connectivitySettings.clearIntermediateMetricData();
     }
 
     finalNetwork.setSamplingFrequency(connectivitySettings.getSamplingFrequency());
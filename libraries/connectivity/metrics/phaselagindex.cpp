@@ -45,8 +45,6 @@
 #include "network/networkedge.h"
 #include "network/network.h"
 
-#include <utils/spectral.h>
-
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
@@ -58,15 +56,12 @@
 // EIGEN INCLUDES
 //=============================================================================================================
 
-#include <unsupported/Eigen/FFT>
-
 //=============================================================================================================
 // USED NAMESPACES
 //=============================================================================================================
 
 using namespace CONNECTIVITYLIB;
 using namespace Eigen;
-using namespace UTILSLIB;
 
 //=============================================================================================================
 // DEFINE GLOBAL METHODS
@@ -96,15 +91,11 @@ Network PhaseLagIndex::calculate(ConnectivitySettings& connectivitySettings)
     }
 
     if(AbstractMetric::m_bStorageModeIsActive == false) {
-        connectivitySettings.clearIntermediateData();
+        connectivitySettings.clearIntermediateMetricData();
     }
 
     finalNetwork.setSamplingFrequency(connectivitySettings.getSamplingFrequency());
 
-    #ifdef EIGEN_FFTW_DEFAULT
-        fftw_make_planner_thread_safe();
-    #endif
-
     //Create nodes
     int iNRows = connectivitySettings.at(0).matData.rows();
     RowVectorXf rowVert = RowVectorXf::Zero(3);
@@ -120,12 +111,11 @@ Network PhaseLagIndex::calculate(ConnectivitySettings& connectivitySettings)
         finalNetwork.append(NetworkNode::SPtr(new NetworkNode(i, rowVert)));
     }
 
-    // Check that iNfft >= signal length
-    int iSignalLength = connectivitySettings.at(0).matData.cols();
     int iNfft = connectivitySettings.getFFTSize();
 
-    // Generate tapers
-    QPair<MatrixXd, VectorXd> tapers = Spectral::generateTapers(iSignalLength, connectivitySettings.getWindowType());
+    // Compute the tapered spectra once. They are shared with all other metrics.
+    connectivitySettings.computeTaperedSpectra();
+    const QPair<MatrixXd, VectorXd>& tapers = connectivitySettings.getTapers();
 
     // Initialize
     int iNFreqs = int(floor(iNfft / 2.0)) + 1;
@@ -145,15 +135,10 @@ Network PhaseLagIndex::calculate(ConnectivitySettings& connectivitySettings)
     finalNetwork.setFFTSize(iNFreqs);
     finalNetwork.setUsedFreqBins(AbstractMetric::m_iNumberBinAmount);
 
-    QMutex mutex;
-
-    std::function<void(ConnectivitySettings::IntermediateTrialData&)> computeLambda = [&](ConnectivitySettings::IntermediateTrialData& inputData) {
+    std::function<void(ConnectivitySettings::IntermediateTrialData&, ConnectivitySettings::IntermediateSumData&)> computeLambda = [&](ConnectivitySettings::IntermediateTrialData& inputData,
+                                                                                                                                      ConnectivitySettings::IntermediateSumData& sumData) {
         compute(inputData,
-                connectivitySettings.getIntermediateSumData().vecPairCsdSum,
-                connectivitySettings.getIntermediateSumData().vecPairCsdImagSignSum,
-                mutex,
-                iNRows,
-                iNFreqs,
+                sumData,
                 iNfft,
                 tapers);
     };
@@ -163,9 +148,8 @@ Network PhaseLagIndex::calculate(ConnectivitySettings& connectivitySettings)
 //    timer.restart();
 
     // Compute DSWPLV in parallel for all trials
-    QFuture<void> result = QtConcurrent::map(connectivitySettings.getTrialData(),
-                                             computeLambda);
-    result.waitForFinished();
+    computeTrials(connectivitySettings,
+                  computeLambda);
 
 //    iTime = timer.elapsed();
 //    qWarning() << "ComputeSpectraPSDCSD" << iTime;
@@ -185,122 +169,43 @@ Network PhaseLagIndex::calculate(ConnectivitySettings& connectivitySettings)
 //=============================================================================================================
 
 void PhaseLagIndex::compute(ConnectivitySettings::IntermediateTrialData& inputData,
-                            QVector<QPair<int,MatrixXcd> >& vecPairCsdSum,
-                            QVector<QPair<int,MatrixXd> >& vecPairCsdImagSignSum,
-                            QMutex& mutex,
-                            int iNRows,
-                            int iNFreqs,
+                            ConnectivitySettings::IntermediateSumData& sumData,
                             int iNfft,
                             const QPair<MatrixXd, VectorXd>& tapers)
 {
-    if(inputData.vecPairCsdImagSign.size() == iNRows) {
-        //qDebug() << "PhaseLagIndex::compute - vecPairCsdImagSign was already computed for this trial.";
+    if(inputData.matCsd.size() != 0 &&
+       inputData.matCsdImagSign.size() != 0) {
+        //qDebug() << "PhaseLagIndex::compute - matCsd and matCsdImagSign were already computed for this trial.";
         return;
     }
 
-    int i,j;
-
-    // Calculate tapered spectra if not available already
-    // This code was copied and changed modified Utils/Spectra since we do not want to call the function due to time loss.
-    if(inputData.vecTapSpectra.isEmpty()) {
-        RowVectorXd vecInputFFT, rowData;
-        RowVectorXcd vecTmpFreq;
-
-        MatrixXcd matTapSpectrum(tapers.first.rows(), iNFreqs);
-
-        FFT<double> fft;
-        fft.SetFlag(fft.HalfSpectrum);
-
-        for (i = 0; i < iNRows; ++i) {
-            // Substract mean
-            rowData.array() = inputData.matData.row(i).array() - inputData.matData.row(i).mean();
+    // Compute the CSD tensor by one rank-k update per frequency bin
+    if(inputData.matCsd.size() == 0) {
+        computeCsd(inputData,
+                   iNfft,
+                   tapers);
 
-            // Calculate tapered spectra
-            for(j = 0; j < tapers.first.rows(); j++) {
-                // Zero padd if necessary. The zero padding in Eigen's FFT is only working for column vectors.
-                if (rowData.cols() < iNfft) {
-                    vecInputFFT.setZero(iNfft);
-                    vecInputFFT.block(0,0,1,rowData.cols()) = rowData.cwiseProduct(tapers.first.row(j));;
-                } else {
-                    vecInputFFT = rowData.cwiseProduct(tapers.first.row(j));
-                }
-
-                // FFT for freq domain returning the half spectrum and multiply taper weights
-                fft.fwd(vecTmpFreq, vecInputFFT, iNfft);
-                matTapSpectrum.row(j) = vecTmpFreq * tapers.second(j);
-            }
-
-            inputData.vecTapSpectra.append(matTapSpectrum);
+        if(sumData.matCsdSum.size() == 0) {
+            sumData.matCsdSum = inputData.matCsd;
+        } else {
+            sumData.matCsdSum += inputData.matCsd;
         }
     }
 
-    // Compute CSD
-    if(inputData.vecPairCsd.isEmpty()) {
-        MatrixXcd matCsd = MatrixXcd(iNRows, m_iNumberBinAmount);
-
-        double denomCSD = sqrt(tapers.second.cwiseAbs2().sum()) * sqrt(tapers.second.cwiseAbs2().sum()) / 2.0;
-
-        bool bNfftEven = false;
-        if (iNfft % 2 == 0){
-            bNfftEven = true;
-        }
-
-        for (i = 0; i < iNRows; ++i) {
-            for (j = i; j < iNRows; ++j) {
-                // Compute CSD (average over tapers if necessary)
-                matCsd.row(j) = inputData.vecTapSpectra.at(i).block(0,m_iNumberBinStart,inputData.vecTapSpectra.at(i).rows(),m_iNumberBinAmount).cwiseProduct(inputData.vecTapSpectra.at(j).block(0,m_iNumberBinStart,inputData.vecTapSpectra.at(j).rows(),m_iNumberBinAmount).conjugate()).colwise().sum() / denomCSD;
+    if(inputData.matCsdImagSign.size() == 0) {
+        inputData.matCsdImagSign = inputData.matCsd.imag().cwiseSign();
 
-                // Divide first and last element by 2 due to half spectrum
-                if(m_iNumberBinStart == 0) {
-                    matCsd.row(j)(0) /= 2.0;
-                }
-
-                if(bNfftEven && m_iNumberBinStart + m_iNumberBinAmount >= iNFreqs) {
-                    matCsd.row(j).tail(1) /= 2.0;
-                }
-            }
-
-            inputData.vecPairCsd.append(QPair<int,MatrixXcd>(i,matCsd));
-            inputData.vecPairCsdImagSign.append(QPair<int,MatrixXd>(i,matCsd.imag().cwiseSign()));
-        }
-
-        mutex.lock();
-
-        if(vecPairCsdSum.isEmpty()) {
-            vecPairCsdSum = inputData.vecPairCsd;
-            vecPairCsdImagSignSum = inputData.vecPairCsdImagSign;
+        if(sumData.matCsdImagSignSum.size() == 0) {
+            sumData.matCsdImagSignSum = inputData.matCsdImagSign;
         } else {
-            for (int j = 0; j < vecPairCsdSum.size(); ++j) {
-                vecPairCsdSum[j].second += inputData.vecPairCsd.at(j).second;
-                vecPairCsdImagSignSum[j].second += inputData.vecPairCsdImagSign.at(j).second;
-            }
-        }
-
-        mutex.unlock();
-    } else {
-        if(inputData.vecPairCsdImagSign.isEmpty()) {
-            for (i = 0; i < inputData.vecPairCsd.size(); ++i) {
-                inputData.vecPairCsdImagSign.append(QPair<int,MatrixXd>(i,inputData.vecPairCsd.at(i).second.imag().cwiseSign()));
-            }
-
-            mutex.lock();
-
-            if(vecPairCsdImagSignSum.isEmpty()) {
-                vecPairCsdImagSignSum = inputData.vecPairCsdImagSign;
-            } else {
-                for (int j = 0; j < vecPairCsdImagSignSum.size(); ++j) {
-                    vecPairCsdImagSignSum[j].second += inputData.vecPairCsdImagSign.at(j).second;
-                }
-            }
-
-            mutex.unlock();
+            sumData.matCsdImagSignSum += inputData.matCsdImagSign;
         }
     }
 
+    //Do not store data to save memory
     if(!m_bStorageModeIsActive) {
-        inputData.vecPairCsd.clear();
-        inputData.vecTapSpectra.clear();
-        inputData.vecPairCsdImagSign.clear();
+        inputData.matCsd.resize(0,0);
+        inputData.matCsdImagSign.resize(0,0);
     }
 }
 
@@ -309,24 +214,11 @@ void PhaseLagIndex::compute(ConnectivitySettings::IntermediateTrialData& inputDa
 void PhaseLagIndex::computePLI(ConnectivitySettings &connectivitySettings,
                                Network& finalNetwork)
 {
-    // Compute final PLI and create Network
-    MatrixXd matNom;
-    MatrixXd matWeight;
-    QSharedPointer<NetworkEdge> pEdge;
-    int j;
-
-    for (int i = 0; i < connectivitySettings.getIntermediateSumData().vecPairCsdImagSignSum.size(); ++i) {
-        matNom = connectivitySettings.getIntermediateSumData().vecPairCsdImagSignSum.at(i).second.cwiseAbs() / connectivitySettings.size();
-
-        for(j = i; j < matNom.rows(); ++j) {
-            matWeight = matNom.row(j).transpose();
+    // Compute final PLI for all pairs and bins at once and store it in the dense edges of the network
+    MatrixXd matNom = connectivitySettings.getIntermediateSumData().matCsdImagSignSum.cwiseAbs() / connectivitySettings.size();
 
-            pEdge = QSharedPointer<NetworkEdge>(new NetworkEdge(i, j, matWeight));
-
-            finalNetwork.getNodeAt(i)->append(pEdge);
-            finalNetwork.getNodeAt(j)->append(pEdge);
-            finalNetwork.append(pEdge);
-        }
-    }
+    finalNetwork.initDenseEdges(AbstractMetric::m_iNumberBinAmount);
+    setDenseEdgeWeights(finalNetwork, matNom);
+    finalNetwork.updateDenseEdges();
 }
 
@@ -45,8 +45,6 @@
 #include "network/networkedge.h"
 #include "network/network.h"
 
-#include <utils/spectral.h>
-
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
@@ -58,15 +56,12 @@
 // EIGEN INCLUDES
 //=============================================================================================================
 
-#include <unsupported/Eigen/FFT>
-
 //=============================================================================================================
 // USED NAMESPACES
 //=============================================================================================================
 
 using namespace CONNECTIVITYLIB;
 using namespace Eigen;
-using namespace UTILSLIB;
 
 //=============================================================================================================
 // DEFINE GLOBAL METHODS
@@ -96,15 +91,11 @@ Network PhaseLockingValue::calculate(ConnectivitySettings& connectivitySettings)
     }
 
     if(AbstractMetric::m_bStorageModeIsActive == false) {
-        connectivitySettings.clearIntermediateData();
+        connectivitySettings.clearIntermediateMetricData();
     }
 
     finalNetwork.setSamplingFrequency(connectivitySettings.getSamplingFrequency());
 
-    #ifdef EIGEN_FFTW_DEFAULT
-        fftw_make_planner_thread_safe();
-    #endif
-
     //Create nodes
     int iNRows = connectivitySettings.at(0).matData.rows();
     RowVectorXf rowVert = RowVectorXf::Zero(3);
@@ -121,12 +112,11 @@ Network PhaseLockingValue::calculate(ConnectivitySettings& connectivitySettings)
         finalNetwork.append(NetworkNode::SPtr(new NetworkNode(i, rowVert)));
     }
 
-    // Check that iNfft >= signal length
-    int iSignalLength = connectivitySettings.at(0).matData.cols();
     int iNfft = connectivitySettings.getFFTSize();
 
-    // Generate tapers
-    QPair<MatrixXd, VectorXd> tapers = Spectral::generateTapers(iSignalLength, connectivitySettings.getWindowType());
+    // Compute the tapered spectra once. They are shared with all other metrics.
+    connectivitySettings.computeTaperedSpectra();
+    const QPair<MatrixXd, VectorXd>& tapers = connectivitySettings.getTapers();
 
     // Initialize
     int iNFreqs = int(floor(iNfft / 2.0)) + 1;
@@ -146,15 +136,10 @@ Network PhaseLockingValue::calculate(ConnectivitySettings& connectivitySettings)
     finalNetwork.setFFTSize(iNFreqs);
     finalNetwork.setUsedFreqBins(AbstractMetric::m_iNumberBinAmount);
 
-    QMutex mutex;
-
-    std::function<void(ConnectivitySettings::IntermediateTrialData&)> computeLambda = [&](ConnectivitySettings::IntermediateTrialData& inputData) {
+    std::function<void(ConnectivitySettings::IntermediateTrialData&, ConnectivitySettings::IntermediateSumData&)> computeLambda = [&](ConnectivitySettings::IntermediateTrialData& inputData,
+                                                                                                                                      ConnectivitySettings::IntermediateSumData& sumData) {
         compute(inputData,
-                connectivitySettings.getIntermediateSumData().vecPairCsdSum,
-                connectivitySettings.getIntermediateSumData().vecPairCsdNormalizedSum,
-                mutex,
-                iNRows,
-                iNFreqs,
+                sumData,
                 iNfft,
                 tapers);
     };
@@ -164,9 +149,8 @@ Network PhaseLockingValue::calculate(ConnectivitySettings& connectivitySettings)
 //    timer.restart();
 
     // Compute PLV in parallel for all trials
-    QFuture<void> result = QtConcurrent::map(connectivitySettings.getTrialData(),
-                                             computeLambda);
-    result.waitForFinished();
+    computeTrials(connectivitySettings,
+                  computeLambda);
 
 //    iTime = timer.elapsed();
 //    qWarning() << "ComputeSpectraPSDCSD" << iTime;
@@ -186,122 +170,43 @@ Network PhaseLockingValue::calculate(ConnectivitySettings& connectivitySettings)
 //=============================================================================================================
 
 void PhaseLockingValue::compute(ConnectivitySettings::IntermediateTrialData& inputData,
-                                QVector<QPair<int,Eigen::MatrixXcd> >& vecPairCsdSum,
-                                QVector<QPair<int,MatrixXcd> >& vecPairCsdNormalizedSum,
-                                QMutex& mutex,
-                                int iNRows,
-                                int iNFreqs,
+                                ConnectivitySettings::IntermediateSumData& sumData,
                                 int iNfft,
                                 const QPair<MatrixXd, VectorXd>& tapers)
 {
-    if(inputData.vecPairCsdNormalized.size() == iNRows) {
-        //qDebug() << "PhaseLockingValue::compute - vecPairCsdNormalized was already computed for this trial.";
+    if(inputData.matCsd.size() != 0 &&
+       inputData.matCsdNormalized.size() != 0) {
+        //qDebug() << "PhaseLockingValue::compute - matCsd and matCsdNormalized were already computed for this trial.";
         return;
     }
 
-    int i,j;
-
-    // Calculate tapered spectra if not available already
-    // This code was copied and changed modified Utils/Spectra since we do not want to call the function due to time loss.
-    if(inputData.vecTapSpectra.isEmpty()) {
-        RowVectorXd vecInputFFT, rowData;
-        RowVectorXcd vecTmpFreq;
-
-        MatrixXcd matTapSpectrum(tapers.first.rows(), iNFreqs);
-
-        FFT<double> fft;
-        fft.SetFlag(fft.HalfSpectrum);
-
-        for (i = 0; i < iNRows; ++i) {
-            // Substract mean
-            rowData.array() = inputData.matData.row(i).array() - inputData.matData.row(i).mean();
+    // Compute the CSD tensor by one rank-k update per frequency bin
+    if(inputData.matCsd.size() == 0) {
+        computeCsd(inputData,
+                   iNfft,
+                   tapers);
 
-            // Calculate tapered spectra if not available already
-            for(j = 0; j < tapers.first.rows(); j++) {
-                // Zero padd if necessary. The zero padding in Eigen's FFT is only working for column vectors.
-                if (rowData.cols() < iNfft) {
-                    vecInputFFT.setZero(iNfft);
-                    vecInputFFT.block(0,0,1,rowData.cols()) = rowData.cwiseProduct(tapers.first.row(j));;
-                } else {
-                    vecInputFFT = rowData.cwiseProduct(tapers.first.row(j));
-                }
-
-                // FFT for freq domain returning the half spectrum and multiply taper weights
-                fft.fwd(vecTmpFreq, vecInputFFT, iNfft);
-                matTapSpectrum.row(j) = vecTmpFreq * tapers.second(j);
-            }
-
-            inputData.vecTapSpectra.append(matTapSpectrum);
+        if(sumData.matCsdSum.size() == 0) {
+            sumData.matCsdSum = inputData.matCsd;
+        } else {
+            sumData.matCsdSum += inputData.matCsd;
         }
     }
 
-    // Compute CSD
-    if(inputData.vecPairCsd.isEmpty()) {
-        MatrixXcd matCsd = MatrixXcd(iNRows, m_iNumberBinAmount);
-
-        bool bNfftEven = false;
-        if (iNfft % 2 == 0){
-            bNfftEven = true;
-        }
-
-        double denomCSD = sqrt(tapers.second.cwiseAbs2().sum()) * sqrt(tapers.second.cwiseAbs2().sum()) / 2.0;
-
-        for (i = 0; i < iNRows; ++i) {
-            for (j = i; j < iNRows; ++j) {
-                // Compute CSD (average over tapers if necessary)
-                matCsd.row(j) = inputData.vecTapSpectra.at(i).block(0,m_iNumberBinStart,inputData.vecTapSpectra.at(i).rows(),m_iNumberBinAmount).cwiseProduct(inputData.vecTapSpectra.at(j).block(0,m_iNumberBinStart,inputData.vecTapSpectra.at(j).rows(),m_iNumberBinAmount).conjugate()).colwise().sum() / denomCSD;
+    if(inputData.matCsdNormalized.size() == 0) {
+        inputData.matCsdNormalized = inputData.matCsd.cwiseQuotient(inputData.matCsd.cwiseAbs());
 
-                // Divide first and last element by 2 due to half spectrum
-                if(m_iNumberBinStart == 0) {
-                    matCsd.row(j)(0) /= 2.0;
-                }
-
-                if(bNfftEven && m_iNumberBinStart + m_iNumberBinAmount >= iNFreqs) {
-                    matCsd.row(j).tail(1) /= 2.0;
-                }
-            }
-
-            inputData.vecPairCsd.append(QPair<int,MatrixXcd>(i,matCsd));
-            inputData.vecPairCsdNormalized.append(QPair<int,MatrixXcd>(i,matCsd.cwiseQuotient(matCsd.cwiseAbs())));
-        }
-
-        mutex.lock();
-
-        if(vecPairCsdSum.isEmpty()) {
-            vecPairCsdSum = inputData.vecPairCsd;
-            vecPairCsdNormalizedSum = inputData.vecPairCsdNormalized;
+        if(sumData.matCsdNormalizedSum.size() == 0) {
+            sumData.matCsdNormalizedSum = inputData.matCsdNormalized;
         } else {
-            for (int j = 0; j < vecPairCsdSum.size(); ++j) {
-                vecPairCsdSum[j].second += inputData.vecPairCsd.at(j).second;
-                vecPairCsdNormalizedSum[j].second += inputData.vecPairCsdNormalized.at(j).second;
-            }
-        }
-
-        mutex.unlock();
-    } else {
-        if(inputData.vecPairCsdNormalized.isEmpty()) {
-            for (i = 0; i < iNRows; ++i) {
-                inputData.vecPairCsdNormalized.append(QPair<int,MatrixXcd>(i,inputData.vecPairCsd.at(i).second.cwiseQuotient(inputData.vecPairCsd.at(i).second.cwiseAbs())));
-            }
-
-            mutex.lock();
-
-            if(vecPairCsdNormalizedSum.isEmpty()) {
-                vecPairCsdNormalizedSum = inputData.vecPairCsdNormalized;
-            } else {
-                for (int j = 0; j < vecPairCsdNormalizedSum.size(); ++j) {
-                    vecPairCsdNormalizedSum[j].second += inputData.vecPairCsdNormalized.at(j).second;
-                }
-            }
-
-            mutex.unlock();
+            sumData.matCsdNormalizedSum += inputData.matCsdNormalized;
         }
     }
 
+    //Do not store data to save memory
     if(!m_bStorageModeIsActive) {
-        inputData.vecPairCsd.clear();
-        inputData.vecTapSpectra.clear();
-        inputData.vecPairCsdNormalized.clear();
+        inputData.matCsd.resize(0,0);
+        inputData.matCsdNormalized.resize(0,0);
     }
 }
 
@@ -310,23 +215,10 @@ void PhaseLockingValue::compute(ConnectivitySettings::IntermediateTrialData& inp
 void PhaseLockingValue::computePLV(ConnectivitySettings &connectivitySettings,
                                    Network& finalNetwork)
 {
-    // Compute final PLV and create Network
-    MatrixXd matNom;
-    MatrixXd matWeight;
-    QSharedPointer<NetworkEdge> pEdge;
-    int j;
-
-    for (int i = 0; i < connectivitySettings.at(0).matData.rows(); ++i) {
-        matNom = connectivitySettings.getIntermediateSumData().vecPairCsdNormalizedSum.at(i).second.cwiseAbs() / connectivitySettings.size();
-
-        for(j = i; j < connectivitySettings.at(0).matData.rows(); ++j) {
-            matWeight = matNom.row(j).transpose();
+    // Compute final PLV for all pairs and bins at once and store it in the dense edges of the network
+    MatrixXd matNom = connectivitySettings.getIntermediateSumData().matCsdNormalizedSum.cwiseAbs() / connectivitySettings.size();
 
-            pEdge = QSharedPointer<NetworkEdge>(new NetworkEdge(i, j, matWeight));
-
-            finalNetwork.getNodeAt(i)->append(pEdge);
-            finalNetwork.getNodeAt(j)->append(pEdge);
-            finalNetwork.append(pEdge);
-        }
-    }
+    finalNetwork.initDenseEdges(AbstractMetric::m_iNumberBinAmount);
+    setDenseEdgeWeights(finalNetwork, matNom);
+    finalNetwork.updateDenseEdges();
 }
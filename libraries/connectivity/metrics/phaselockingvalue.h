@@ -53,7 +53,6 @@
 //=============================================================================================================
 
 #include <QSharedPointer>
-#include <QMutex>
 
 //=============================================================================================================
 // EIGEN INCLUDES
@@ -109,23 +108,15 @@ public:
 protected:
     //=========================================================================================================
     /**
-     * Computes the PLV values. This function gets called in parallel.
+     * Computes the PLV values. This function gets called in parallel with per-thread partial sums.
      *
      * @param[in] inputData                  The input data.
-     * @param[out]vecPairCsdSum              The sum of all CSD matrices for each trial.
-     * @param[out]vecPairCsdNormalizedSum    The sum of all normalized CSD matrices for each trial.
-     * @param[in] mutex                      The mutex used to safely access vecPairCsdSum.
-     * @param[in] iNRows                     The number of rows.
-     * @param[in] iNFreqs                    The number of frequenciy bins.
+     * @param[out]sumData                    The partial sums the trial is added to.
      * @param[in] iNfft                      The FFT length.
      * @param[in] tapers                     The taper information.
      */
     static void compute(ConnectivitySettings::IntermediateTrialData& inputData,
-                        QVector<QPair<int,Eigen::MatrixXcd> >& vecPairCsdSum,
-                        QVector<QPair<int,Eigen::MatrixXcd> >& vecPairCsdNormalizedSum,
-                        QMutex& mutex,
-                        int iNRows,
-                        int iNFreqs,
+                        ConnectivitySettings::IntermediateSumData& sumData,
                         int iNfft,
                         const QPair<Eigen::MatrixXd, Eigen::VectorXd>& tapers);
 
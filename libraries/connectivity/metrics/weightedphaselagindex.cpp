@@ -45,8 +45,6 @@
 #include "network/networkedge.h"
 #include "network/network.h"
 
-#include <utils/spectral.h>
-
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
@@ -58,15 +56,12 @@
 // EIGEN INCLUDES
 //=============================================================================================================
 
-#include <unsupported/Eigen/FFT>
-
 //=============================================================================================================
 // USED NAMESPACES
 //=============================================================================================================
 
 using namespace CONNECTIVITYLIB;
 using namespace Eigen;
-using namespace UTILSLIB;
 
 //=============================================================================================================
 // DEFINE GLOBAL METHODS
@@ -97,15 +92,11 @@ Network WeightedPhaseLagIndex::calculate(ConnectivitySettings& connectivitySetti
     }
 
     if(AbstractMetric::m_bStorageModeIsActive == false) {
-        connectivitySettings.clearIntermediateData();
+        connectivitySettings.clearIntermediateMetricData();
     }
 
     finalNetwork.setSamplingFrequency(connectivitySettings.getSamplingFrequency());
 
-    #ifdef EIGEN_FFTW_DEFAULT
-        fftw_make_planner_thread_safe();
-    #endif
-
     //Create nodes
     int rows = connectivitySettings.at(0).matData.rows();
     RowVectorXf rowVert = RowVectorXf::Zero(3);
@@ -122,15 +113,13 @@ Network WeightedPhaseLagIndex::calculate(ConnectivitySettings& connectivitySetti
         finalNetwork.append(NetworkNode::SPtr(new NetworkNode(i, rowVert)));
     }
 
-    // Check that iNfft >= signal length
-    int iSignalLength = connectivitySettings.at(0).matData.cols();
     int iNfft = connectivitySettings.getFFTSize();
 
-    // Generate tapers
-    QPair<MatrixXd, VectorXd> tapers = Spectral::generateTapers(iSignalLength, connectivitySettings.getWindowType());
+    // Compute the tapered spectra once. They are shared with all other metrics.
+    connectivitySettings.computeTaperedSpectra();
+    const QPair<MatrixXd, VectorXd>& tapers = connectivitySettings.getTapers();
 
     // Initialize
-    int iNRows = connectivitySettings.at(0).matData.rows();
     int iNFreqs = int(floor(iNfft / 2.0)) + 1;
 
     // Check if start and bin amount need to be reset to full spectrum
@@ -148,15 +137,10 @@ Network WeightedPhaseLagIndex::calculate(ConnectivitySettings& connectivitySetti
     finalNetwork.setFFTSize(iNFreqs);
     finalNetwork.setUsedFreqBins(AbstractMetric::m_iNumberBinAmount);
 
-    QMutex mutex;
-
-    std::function<void(ConnectivitySettings::IntermediateTrialData&)> computeLambda = [&](ConnectivitySettings::IntermediateTrialData& inputData) {
+    std::function<void(ConnectivitySettings::IntermediateTrialData&, ConnectivitySettings::IntermediateSumData&)> computeLambda = [&](ConnectivitySettings::IntermediateTrialData& inputData,
+                                                                                                                                      ConnectivitySettings::IntermediateSumData& sumData) {
         compute(inputData,
-                connectivitySettings.getIntermediateSumData().vecPairCsdSum,
-                connectivitySettings.getIntermediateSumData().vecPairCsdImagAbsSum,
-                mutex,
-                iNRows,
-                iNFreqs,
+                sumData,
                 iNfft,
                 tapers);
     };
@@ -166,9 +150,8 @@ Network WeightedPhaseLagIndex::calculate(ConnectivitySettings& connectivitySetti
 //    timer.restart();
 
     // Compute WPLI in parallel for all trials
-    QFuture<void> result = QtConcurrent::map(connectivitySettings.getTrialData(),
-                                             computeLambda);
-    result.waitForFinished();
+    computeTrials(connectivitySettings,
+                  computeLambda);
 
 //    iTime = timer.elapsed();
 //    qWarning() << "ComputeSpectraPSDCSD" << iTime;
@@ -188,142 +171,43 @@ Network WeightedPhaseLagIndex::calculate(ConnectivitySettings& connectivitySetti
 //=============================================================================================================
 
 void WeightedPhaseLagIndex::compute(ConnectivitySettings::IntermediateTrialData& inputData,
-                                    QVector<QPair<int,MatrixXcd> >& vecPairCsdSum,
-                                    QVector<QPair<int,MatrixXd> >& vecPairCsdImagAbsSum,
-                                    QMutex& mutex,
-                                    int iNRows,
-                                    int iNFreqs,
+                                    ConnectivitySettings::IntermediateSumData& sumData,
                                     int iNfft,
                                     const QPair<MatrixXd, VectorXd>& tapers)
 {
-//    QElapsedTimer timer;
-//    qint64 iTime = 0;
-//    timer.start();
-
-    if(inputData.vecPairCsd.size() == iNRows &&
-       inputData.vecPairCsdImagAbs.size() == iNRows ) {
-        //qDebug() << "WeightedPhaseLagIndex::compute - vecPairCsd and vecPairCsdImagAbs were already computed for this trial.";
+    if(inputData.matCsd.size() != 0 &&
+       inputData.matCsdImagAbs.size() != 0) {
+        //qDebug() << "WeightedPhaseLagIndex::compute - matCsd and matCsdImagAbs were already computed for this trial.";
         return;
     }
 
-    int i,j;
-
-    // Calculate tapered spectra if not available already
-    // This code was copied and changed modified Utils/Spectra since we do not want to call the function due to time loss.
-    if(inputData.vecTapSpectra.size() != iNRows) {
-        inputData.vecTapSpectra.clear();
+    // Compute the CSD tensor by one rank-k update per frequency bin
+    if(inputData.matCsd.size() == 0) {
+        computeCsd(inputData,
+                   iNfft,
+                   tapers);
 
-        RowVectorXd vecInputFFT, rowData;
-        RowVectorXcd vecTmpFreq;
-
-        MatrixXcd matTapSpectrum(tapers.first.rows(), iNFreqs);
-
-        FFT<double> fft;
-        fft.SetFlag(fft.HalfSpectrum);
-
-        for (i = 0; i < iNRows; ++i) {
-            // Substract mean
-            rowData.array() = inputData.matData.row(i).array() - inputData.matData.row(i).mean();
-
-            // Calculate tapered spectra if not available already
-            for(j = 0; j < tapers.first.rows(); j++) {
-                // Zero padd if necessary. The zero padding in Eigen's FFT is only working for column vectors.
-                if (rowData.cols() < iNfft) {
-                    vecInputFFT.setZero(iNfft);
-                    vecInputFFT.block(0,0,1,rowData.cols()) = rowData.cwiseProduct(tapers.first.row(j));;
-                } else {
-                    vecInputFFT = rowData.cwiseProduct(tapers.first.row(j));
-                }
-
-                // FFT for freq domain returning the half spectrum and multiply taper weights
-                fft.fwd(vecTmpFreq, vecInputFFT, iNfft);
-                matTapSpectrum.row(j) = vecTmpFreq * tapers.second(j);
-            }
-
-            inputData.vecTapSpectra.append(matTapSpectrum);
+        if(sumData.matCsdSum.size() == 0) {
+            sumData.matCsdSum = inputData.matCsd;
+        } else {
+            sumData.matCsdSum += inputData.matCsd;
         }
-
-//        iTime = timer.elapsed();
-//        qWarning() << "WeightedPhaseLagIndex::compute timer - Compute spectra:" << iTime;
-//        timer.restart();
     }
 
-    // Compute CSD
-    if(inputData.vecPairCsd.isEmpty()) {
-        double denomCSD = sqrt(tapers.second.cwiseAbs2().sum()) * sqrt(tapers.second.cwiseAbs2().sum()) / 2.0;
-        bool bNfftEven = false;
-        if (iNfft % 2 == 0){
-            bNfftEven = true;
-        }
-
-        MatrixXcd matCsd = MatrixXcd(iNRows, m_iNumberBinAmount);
-
-        for (i = 0; i < iNRows; ++i) {
-            for (j = i; j < iNRows; ++j) {
-                // Compute CSD (average over tapers if necessary)
-                matCsd.row(j) = inputData.vecTapSpectra.at(i).block(0,m_iNumberBinStart,inputData.vecTapSpectra.at(i).rows(),m_iNumberBinAmount).cwiseProduct(inputData.vecTapSpectra.at(j).block(0,m_iNumberBinStart,inputData.vecTapSpectra.at(j).rows(),m_iNumberBinAmount).conjugate()).colwise().sum() / denomCSD;
-
-                // Divide first and last element by 2 due to half spectrum
-                if(m_iNumberBinStart == 0) {
-                    matCsd.row(j)(0) /= 2.0;
-                }
-
-                if(bNfftEven && m_iNumberBinStart + m_iNumberBinAmount >= iNFreqs) {
-                    matCsd.row(j).tail(1) /= 2.0;
-                }
-            }
-
-            inputData.vecPairCsd.append(QPair<int,MatrixXcd>(i,matCsd));
-            inputData.vecPairCsdImagAbs.append(QPair<int,MatrixXd>(i,matCsd.imag().cwiseAbs()));
-        }
-
-//        iTime = timer.elapsed();
-//        qWarning() << "WeightedPhaseLagIndex::compute timer - Compute CSD and Imag CSD:" << iTime;
-//        timer.restart();
+    if(inputData.matCsdImagAbs.size() == 0) {
+        inputData.matCsdImagAbs = inputData.matCsd.imag().cwiseAbs();
 
-        mutex.lock();
-
-        if(vecPairCsdSum.isEmpty()) {
-            vecPairCsdSum = inputData.vecPairCsd;
-            vecPairCsdImagAbsSum = inputData.vecPairCsdImagAbs;
+        if(sumData.matCsdImagAbsSum.size() == 0) {
+            sumData.matCsdImagAbsSum = inputData.matCsdImagAbs;
         } else {
-            for (int j = 0; j < vecPairCsdSum.size(); ++j) {
-                vecPairCsdSum[j].second += inputData.vecPairCsd.at(j).second;
-                vecPairCsdImagAbsSum[j].second += inputData.vecPairCsdImagAbs.at(j).second;
-            }
-        }
-
-        mutex.unlock();
-
-//        iTime = timer.elapsed();
-//        qWarning() << "WeightedPhaseLagIndex::compute timer - Add CSD to sum:" << iTime;
-//        timer.restart();
-    } else {
-        if (inputData.vecPairCsdImagAbs.isEmpty()) {
-            inputData.vecPairCsdImagAbs.clear();
-            for (i = 0; i < inputData.vecPairCsd.size(); ++i) {
-                inputData.vecPairCsdImagAbs.append(QPair<int,MatrixXd>(i,inputData.vecPairCsd.at(i).second.imag().cwiseAbs()));
-            }
-
-            mutex.lock();
-
-            if(vecPairCsdImagAbsSum.isEmpty()) {
-                vecPairCsdImagAbsSum = inputData.vecPairCsdImagAbs;
-            } else {
-                for (int j = 0; j < vecPairCsdImagAbsSum.size(); ++j) {
-                    vecPairCsdImagAbsSum[j].second += inputData.vecPairCsdImagAbs.at(j).second;
-                }
-            }
-
-            mutex.unlock();
+            sumData.matCsdImagAbsSum += inputData.matCsdImagAbs;
         }
     }
 
     //Do not store data to save memory
     if(!m_bStorageModeIsActive) {
-        inputData.vecPairCsd.clear();
-        inputData.vecPairCsdImagAbs.clear();
-        inputData.vecTapSpectra.clear();
+        inputData.matCsd.resize(0,0);
+        inputData.matCsdImagAbs.resize(0,0);
     }
 }
 
@@ -332,27 +216,14 @@ void WeightedPhaseLagIndex::compute(ConnectivitySettings::IntermediateTrialData&
 void WeightedPhaseLagIndex::computeWPLI(ConnectivitySettings &connectivitySettings,
                                         Network& finalNetwork)
 {
-    // Compute final WPLI and create Network
-    MatrixXd matDenom, matNom;
-    MatrixXd matWeight;
-    QSharedPointer<NetworkEdge> pEdge;
-    int j;
-
-    for (int i = 0; i < connectivitySettings.getIntermediateSumData().vecPairCsdSum.size(); ++i) {
-        matDenom = connectivitySettings.getIntermediateSumData().vecPairCsdImagAbsSum.at(i).second;
-        matDenom = (matDenom.array() == 0.).select(INFINITY, matDenom);
+    // Compute final WPLI for all pairs and bins at once and store it in the dense edges of the network
+    MatrixXd matDenom = connectivitySettings.getIntermediateSumData().matCsdImagAbsSum;
+    matDenom = (matDenom.array() == 0.).select(INFINITY, matDenom);
 
-        matNom = connectivitySettings.getIntermediateSumData().vecPairCsdSum.at(i).second.imag().cwiseAbs().cwiseQuotient(matDenom);
+    MatrixXd matNom = connectivitySettings.getIntermediateSumData().matCsdSum.imag().cwiseAbs().cwiseQuotient(matDenom);
 
-        for(j = i; j < matNom.rows(); ++j) {
-            matWeight = matNom.row(j).transpose();
-
-            pEdge = QSharedPointer<NetworkEdge>(new NetworkEdge(i, j, matWeight));
-
-            finalNetwork.getNodeAt(i)->append(pEdge);
-            finalNetwork.getNodeAt(j)->append(pEdge);
-            finalNetwork.append(pEdge);
-        }
-    }
+    finalNetwork.initDenseEdges(AbstractMetric::m_iNumberBinAmount);
+    setDenseEdgeWeights(finalNetwork, matNom);
+    finalNetwork.updateDenseEdges();
 }
 
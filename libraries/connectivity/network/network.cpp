@@ -45,6 +45,7 @@
 #include <utils/spectral.h>
 
 #include <limits>
+#include <algorithm>
 
 //=============================================================================================================
 // QT INCLUDES
@@ -81,6 +82,9 @@ Network::Network(const QString& sConnectivityMethod,
 , m_fSFreq(0.0f)
 , m_iFFTSize(128)
 , m_iNumberFreqBins(0)
+, m_minMaxDenseFreqBins(QPair<int,int>(-1,-1))
+, m_iNumberDenseNodes(0)
+, m_bDenseEdgesPending(false)
 {
     qRegisterMetaType<CONNECTIVITYLIB::Network>("CONNECTIVITYLIB::Network");
     qRegisterMetaType<CONNECTIVITYLIB::Network::SPtr>("CONNECTIVITYLIB::Network::SPtr");
@@ -90,8 +94,67 @@ Network::Network(const QString& sConnectivityMethod,
 
 //=============================================================================================================
 
+Network::Network(const Network& other)
+{
+    *this = other;
+}
+
+//=============================================================================================================
+
+Network& Network::operator=(const Network& other)
+{
+    if(this == &other) {
+        return *this;
+    }
+
+    // The lists of the other network might be created lazily by another thread at the same time
+    QMutexLocker locker(&other.m_mutexDenseEdges);
+
+    m_lFullEdges = other.m_lFullEdges;
+    m_lThresholdedEdges = other.m_lThresholdedEdges;
+    m_lNodes = other.m_lNodes;
+    m_matDenseEdgeWeights = other.m_matDenseEdgeWeights;
+    m_vecDenseWeights = other.m_vecDenseWeights;
+    m_minMaxDenseFreqBins = other.m_minMaxDenseFreqBins;
+    m_iNumberDenseNodes = other.m_iNumberDenseNodes;
+    m_bDenseEdgesPending = other.m_bDenseEdgesPending;
+    m_matDistMatrix = other.m_matDistMatrix;
+    m_sConnectivityMethod = other.m_sConnectivityMethod;
+    m_minMaxFullWeights = other.m_minMaxFullWeights;
+    m_minMaxThresholdedWeights = other.m_minMaxThresholdedWeights;
+    m_minMaxFrequency = other.m_minMaxFrequency;
+    m_dThreshold = other.m_dThreshold;
+    m_fSFreq = other.m_fSFreq;
+    m_iNumberFreqBins = other.m_iNumberFreqBins;
+    m_iFFTSize = other.m_iFFTSize;
+    m_visualizationInfo = other.m_visualizationInfo;
+
+    return *this;
+}
+
+//=============================================================================================================
+
 MatrixXd Network::getFullConnectivityMatrix(bool bGetMirroredVersion) const
 {
+    if(isDense()) {
+        int iNumberNodes = m_iNumberDenseNodes;
+        MatrixXd matDist = MatrixXd::Zero(iNumberNodes, iNumberNodes);
+
+        for(int i = 0; i < iNumberNodes; ++i) {
+            int iOffset = getDensePairIndex(i, i, iNumberNodes);
+
+            for(int j = i + 1; j < iNumberNodes; ++j) {
+                matDist(i,j) = m_vecDenseWeights(iOffset + j - i);
+
+                if(bGetMirroredVersion) {
+                    matDist(j,i) = matDist(i,j);
+                }
+            }
+        }
+
+        return matDist;
+    }
+
     MatrixXd matDist(m_lNodes.size(), m_lNodes.size());
     matDist.setZero();
 
@@ -116,6 +179,27 @@ MatrixXd Network::getFullConnectivityMatrix(bool bGetMirroredVersion) const
 
 MatrixXd Network::getThresholdedConnectivityMatrix(bool bGetMirroredVersion) const
 {
+    if(isDense()) {
+        int iNumberNodes = m_iNumberDenseNodes;
+        MatrixXd matDist = MatrixXd::Zero(iNumberNodes, iNumberNodes);
+
+        for(int i = 0; i < iNumberNodes; ++i) {
+            int iOffset = getDensePairIndex(i, i, iNumberNodes);
+
+            for(int j = i + 1; j < iNumberNodes; ++j) {
+                if(fabs(m_vecDenseWeights(iOffset + j - i)) >= m_dThreshold) {
+                    matDist(i,j) = m_vecDenseWeights(iOffset + j - i);
+
+                    if(bGetMirroredVersion) {
+                        matDist(j,i) = matDist(i,j);
+                    }
+                }
+            }
+        }
+
+        return matDist;
+    }
+
     MatrixXd matDist(m_lNodes.size(), m_lNodes.size());
     matDist.setZero();
 
@@ -140,6 +224,8 @@ MatrixXd Network::getThresholdedConnectivityMatrix(bool bGetMirroredVersion) con
 
 const QList<NetworkEdge::SPtr>& Network::getFullEdges() const
 {
+    materializeDenseEdges();
+
     return m_lFullEdges;
 }
 
@@ -147,6 +233,8 @@ const QList<NetworkEdge::SPtr>& Network::getFullEdges() const
 
 const QList<NetworkEdge::SPtr>& Network::getThresholdedEdges() const
 {
+    materializeDenseEdges();
+
     return m_lThresholdedEdges;
 }
 
@@ -154,6 +242,8 @@ const QList<NetworkEdge::SPtr>& Network::getThresholdedEdges() const
 
 const QList<NetworkNode::SPtr>& Network::getNodes() const
 {
+    materializeDenseEdges();
+
     return m_lNodes;
 }
 
@@ -161,6 +251,8 @@ const QList<NetworkNode::SPtr>& Network::getNodes() const
 
 NetworkNode::SPtr Network::getNodeAt(int i)
 {
+    materializeDenseEdges();
+
     return m_lNodes.at(i);
 }
 
@@ -168,6 +260,8 @@ NetworkNode::SPtr Network::getNodeAt(int i)
 
 qint16 Network::getFullDistribution() const
 {
+    materializeDenseEdges();
+
     qint16 distribution = 0;
 
     for(int i = 0; i < m_lNodes.size(); ++i) {
@@ -181,6 +275,8 @@ qint16 Network::getFullDistribution() const
 
 qint16 Network::getThresholdedDistribution() const
 {
+    materializeDenseEdges();
+
     qint16 distribution = 0;
 
     for(int i = 0; i < m_lNodes.size(); ++i) {
@@ -222,6 +318,8 @@ QPair<double, double> Network::getMinMaxThresholdedWeights() const
 
 QPair<int,int> Network::getMinMaxFullDegrees() const
 {
+    materializeDenseEdges();
+
     int maxDegree = 0;
     int minDegree = 1000000;
 
@@ -240,6 +338,8 @@ QPair<int,int> Network::getMinMaxFullDegrees() const
 
 QPair<int,int> Network::getMinMaxThresholdedDegrees() const
 {
+    materializeDenseEdges();
+
     int maxDegree = 0;
     int minDegree = 1000000;
 
@@ -258,6 +358,8 @@ QPair<int,int> Network::getMinMaxThresholdedDegrees() const
 
 QPair<int,int> Network::getMinMaxFullIndegrees() const
 {
+    materializeDenseEdges();
+
     int maxDegree = 0;
     int minDegree = 1000000;
 
@@ -276,6 +378,8 @@ QPair<int,int> Network::getMinMaxFullIndegrees() const
 
 QPair<int,int> Network::getMinMaxThresholdedIndegrees() const
 {
+    materializeDenseEdges();
+
     int maxDegree = 0;
     int minDegree = 1000000;
 
@@ -294,6 +398,8 @@ QPair<int,int> Network::getMinMaxThresholdedIndegrees() const
 
 QPair<int,int> Network::getMinMaxFullOutdegrees() const
 {
+    materializeDenseEdges();
+
     int maxDegree = 0;
     int minDegree = 1000000;
 
@@ -312,6 +418,8 @@ QPair<int,int> Network::getMinMaxFullOutdegrees() const
 
 QPair<int,int> Network::getMinMaxThresholdedOutdegrees() const
 {
+    materializeDenseEdges();
+
     int maxDegree = 0;
     int minDegree = 1000000;
 
@@ -333,6 +441,8 @@ void Network::setThreshold(double dThreshold)
     m_dThreshold = dThreshold;
     m_lThresholdedEdges.clear();
 
+    // Dense networks are thresholded on the fly. Only already created edge objects need to be updated.
+
     for(int i = 0; i < m_lFullEdges.size(); ++i) {
         if(fabs(m_lFullEdges.at(i)->getWeight()) >= m_dThreshold) {
             m_lFullEdges.at(i)->setActive(true);
@@ -388,6 +498,19 @@ void Network::setFrequencyRange(float fLowerFreq, float fUpperFreq)
     // Update the min max values
     m_minMaxFullWeights = QPair<double,double>(std::numeric_limits<double>::max(),0.0);
 
+    if(isDense()) {
+        m_minMaxDenseFreqBins = QPair<int,int>(iLowerBin,iUpperBin);
+        updateDenseAveragedWeights();
+        updateDenseMinMaxWeights();
+
+        // Keep already created edge objects in sync
+        for(int i = 0; i < m_lFullEdges.size(); ++i) {
+            m_lFullEdges.at(i)->setFrequencyBins(m_minMaxDenseFreqBins);
+        }
+
+        return;
+    }
+
     for(int i = 0; i < m_lFullEdges.size(); ++i) {
         m_lFullEdges.at(i)->setFrequencyBins(QPair<int,int>(iLowerBin,iUpperBin));
 
@@ -410,6 +533,13 @@ const QPair<float,float>& Network::getFrequencyRange() const
 
 void Network::append(NetworkEdge::SPtr newEdge)
 {
+    // Appending single edges turns a dense network into a regular one
+    if(isDense()) {
+        materializeDenseEdges();
+        m_matDenseEdgeWeights.resize(0,0);
+        m_vecDenseWeights.resize(0);
+    }
+
     if(newEdge->getEndNodeID() != newEdge->getStartNodeID()) {
         double dEdgeWeight = newEdge->getWeight();
         if(dEdgeWeight < m_minMaxFullWeights.first) {
@@ -437,7 +567,15 @@ void Network::append(NetworkNode::SPtr newNode)
 
 bool Network::isEmpty() const
 {
-    if(m_lFullEdges.isEmpty() || m_lNodes.isEmpty()) {
+    if(isDense()) {
+        return m_iNumberDenseNodes < 2;
+    }
+
+    if(m_lNodes.isEmpty()) {
+        return true;
+    }
+
+    if(m_lFullEdges.isEmpty()) {
         return true;
     }
 
@@ -454,6 +592,10 @@ void Network::normalize()
         return;
     }
 
+    if(isDense()) {
+        m_vecDenseWeights /= m_minMaxFullWeights.second;
+    }
+
     for(int i = 0; i < m_lFullEdges.size(); ++i) {
         m_lFullEdges.at(i)->setWeight(m_lFullEdges.at(i)->getWeight()/m_minMaxFullWeights.second);
     }
@@ -521,3 +663,174 @@ int Network::getFFTSize()
     return m_iFFTSize;
 }
 
+//=============================================================================================================
+
+void Network::initDenseEdges(int iNumberFreqBins)
+{
+    int iNumberNodes = m_lNodes.size();
+
+    m_lFullEdges.clear();
+    m_lThresholdedEdges.clear();
+
+    m_matDenseEdgeWeights = MatrixXd::Zero((iNumberNodes * (iNumberNodes + 1)) / 2, qMax(iNumberFreqBins, 1));
+    m_vecDenseWeights = VectorXd::Zero(m_matDenseEdgeWeights.rows());
+    m_iNumberDenseNodes = iNumberNodes;
+    m_bDenseEdgesPending = true;
+}
+
+//=============================================================================================================
+
+void Network::setDenseEdgeWeights(int iStartNodeID,
+                                  const MatrixXd& matWeights)
+{
+    int iNumberNodes = m_lNodes.size();
+
+    if(iStartNodeID < 0 || iStartNodeID >= iNumberNodes ||
+       matWeights.rows() != iNumberNodes || matWeights.cols() != m_matDenseEdgeWeights.cols()) {
+        qDebug() << "Network::setDenseEdgeWeights - Dimensions do not match the dense edge storage. Returning.";
+        return;
+    }
+
+    // The edges starting at the same node are stored in consecutive rows
+    m_matDenseEdgeWeights.middleRows(getDensePairIndex(iStartNodeID, iStartNodeID, iNumberNodes), iNumberNodes - iStartNodeID) = matWeights.bottomRows(iNumberNodes - iStartNodeID);
+}
+
+//=============================================================================================================
+
+void Network::setDenseEdgeWeights(const MatrixXd& matWeights)
+{
+    if(matWeights.rows() != m_matDenseEdgeWeights.rows() || matWeights.cols() != m_matDenseEdgeWeights.cols()) {
+        qDebug() << "Network::setDenseEdgeWeights - Dimensions do not match the dense edge storage. Returning.";
+        return;
+    }
+
+    m_matDenseEdgeWeights = matWeights;
+}
+
+//=============================================================================================================
+
+void Network::updateDenseEdges()
+{
+    if(!isDense()) {
+        return;
+    }
+
+    updateDenseAveragedWeights();
+    updateDenseMinMaxWeights();
+
+    m_lFullEdges.clear();
+    m_lThresholdedEdges.clear();
+    m_bDenseEdgesPending = true;
+}
+
+//=============================================================================================================
+
+bool Network::isDense() const
+{
+    return m_matDenseEdgeWeights.rows() > 0;
+}
+
+//=============================================================================================================
+
+bool Network::isDenseEdgesPending() const
+{
+    QMutexLocker locker(&m_mutexDenseEdges);
+
+    return m_bDenseEdgesPending;
+}
+
+//=============================================================================================================
+
+const MatrixXd& Network::getDenseEdgeWeights() const
+{
+    return m_matDenseEdgeWeights;
+}
+
+//=============================================================================================================
+
+void Network::updateDenseAveragedWeights()
+{
+    int iStartWeightBin = m_minMaxDenseFreqBins.first;
+    int iEndWeightBin = m_minMaxDenseFreqBins.second;
+
+    if(iEndWeightBin < iStartWeightBin || iStartWeightBin < -1 || iEndWeightBin < -1 ) {
+        return;
+    }
+
+    int cols = m_matDenseEdgeWeights.cols();
+
+    if ((iEndWeightBin == -1 && iStartWeightBin == -1) ) {
+        m_vecDenseWeights = m_matDenseEdgeWeights.rowwise().mean();
+    } else if(iStartWeightBin < cols) {
+        int iNumberBins = iEndWeightBin < cols ? iEndWeightBin-iStartWeightBin+1 : cols-iStartWeightBin;
+        m_vecDenseWeights = m_matDenseEdgeWeights.middleCols(iStartWeightBin, iNumberBins).rowwise().mean();
+    }
+}
+
+//=============================================================================================================
+
+void Network::updateDenseMinMaxWeights()
+{
+    m_minMaxFullWeights = QPair<double,double>(std::numeric_limits<double>::max(),0.0);
+
+    int iNumberNodes = m_lNodes.size();
+
+    // The weight range is taken over the absolute weights, like the thresholding. Self connections are not part of it.
+    for(int i = 0; i < iNumberNodes - 1; ++i) {
+        int iOffset = getDensePairIndex(i, i + 1, iNumberNodes);
+        int iNumberEdges = iNumberNodes - i - 1;
+
+        m_minMaxFullWeights.first = std::min(m_minMaxFullWeights.first, m_vecDenseWeights.segment(iOffset, iNumberEdges).cwiseAbs().minCoeff());
+        m_minMaxFullWeights.second = std::max(m_minMaxFullWeights.second, m_vecDenseWeights.segment(iOffset, iNumberEdges).cwiseAbs().maxCoeff());
+    }
+}
+
+//=============================================================================================================
+
+void Network::materializeDenseEdges() const
+{
+    QMutexLocker locker(&m_mutexDenseEdges);
+
+    if(!m_bDenseEdgesPending) {
+        return;
+    }
+
+    int iNumberNodes = m_lNodes.size();
+
+    for(int i = 0; i < iNumberNodes; ++i) {
+        m_lNodes[i] = NetworkNode::SPtr(new NetworkNode(m_lNodes.at(i)->getId(), m_lNodes.at(i)->getVert()));
+    }
+
+    m_lFullEdges.clear();
+    m_lThresholdedEdges.clear();
+
+    NetworkEdge::SPtr pEdge;
+    int iPair = 0;
+
+    for(int i = 0; i < iNumberNodes; ++i) {
+        for(int j = i; j < iNumberNodes; ++j, ++iPair) {
+            pEdge = NetworkEdge::SPtr(new NetworkEdge(i,
+                                                      j,
+                                                      m_matDenseEdgeWeights.row(iPair).transpose(),
+                                                      true,
+                                                      m_minMaxDenseFreqBins.first,
+                                                      m_minMaxDenseFreqBins.second));
+            pEdge->setWeight(m_vecDenseWeights(iPair));
+
+            m_lNodes.at(i)->append(pEdge);
+            m_lNodes.at(j)->append(pEdge);
+
+            if(i != j) {
+                m_lFullEdges << pEdge;
+
+                if(fabs(pEdge->getWeight()) >= m_dThreshold) {
+                    m_lThresholdedEdges << pEdge;
+                } else {
+                    pEdge->setActive(false);
+                }
+            }
+        }
+    }
+
+    m_bDenseEdgesPending = false;
+}
@@ -46,6 +46,7 @@
 //=============================================================================================================
 
 #include <QSharedPointer>
+#include <QMutex>
 
 //=============================================================================================================
 // EIGEN INCLUDES
@@ -101,6 +102,24 @@ public:
     explicit Network(const QString& sConnectivityMethod = "Unknown",
                      double dThreshold = 0.0);
 
+    //=========================================================================================================
+    /**
+     * Copy constructor.
+     *
+     * @param[in] other      The network to copy.
+     */
+    Network(const Network& other);
+
+    //=========================================================================================================
+    /**
+     * Assignment operator.
+     *
+     * @param[in] other      The network to copy.
+     *
+     * @return   This network.
+     */
+    Network& operator=(const Network& other);
+
     //=========================================================================================================
     /**
      * Returns the full connectivity matrix for this network structure.
@@ -314,6 +333,80 @@ public:
      */
     void append(QSharedPointer<NetworkNode> newNode);
 
+    //=========================================================================================================
+    /**
+     * Switches the network to the dense edge storage and allocates zero weights for all node pairs of the upper
+     * triangle (including the diagonal). All nodes need to be appended before calling this function. Edge objects
+     * are only created on demand, e.g., when calling getFullEdges() or getNodes().
+     *
+     * @param[in] iNumberFreqBins    The number of frequency bins stored per edge.
+     */
+    void initDenseEdges(int iNumberFreqBins);
+
+    //=========================================================================================================
+    /**
+     * Sets the dense edge weights of all edges starting at a node. Different start nodes can be set in parallel.
+     *
+     * @param[in] iStartNodeID       The start node id. Row j (j >= iStartNodeID) of matWeights holds the edge (iStartNodeID, j).
+     * @param[in] matWeights         The weights (nodes x frequency bins). Rows smaller than iStartNodeID are ignored.
+     */
+    void setDenseEdgeWeights(int iStartNodeID,
+                             const Eigen::MatrixXd& matWeights);
+
+    //=========================================================================================================
+    /**
+     * Sets the dense edge weights of all edges.
+     *
+     * @param[in] matWeights         The weights (pairs x frequency bins) in the order of getDensePairIndex().
+     */
+    void setDenseEdgeWeights(const Eigen::MatrixXd& matWeights);
+
+    //=========================================================================================================
+    /**
+     * Updates the averaged weights, the minimum and maximum weights and the thresholding after the dense edge weights
+     * were set. Already created edge objects are dropped and created anew on demand.
+     */
+    void updateDenseEdges();
+
+    //=========================================================================================================
+    /**
+     * Returns whether this network stores its edges in the dense representation.
+     *
+     * @return   Whether the network is dense.
+     */
+    bool isDense() const;
+
+    //=========================================================================================================
+    /**
+     * Returns whether the edge and node objects of this dense network still need to be created from the dense edge
+     * weights.
+     *
+     * @return   Whether the edge objects are pending.
+     */
+    bool isDenseEdgesPending() const;
+
+    //=========================================================================================================
+    /**
+     * Returns the dense edge weights (pairs x frequency bins). Use getDensePairIndex() to look up the row of an edge.
+     *
+     * @return   The dense edge weights.
+     */
+    const Eigen::MatrixXd& getDenseEdgeWeights() const;
+
+    //=========================================================================================================
+    /**
+     * Returns the row of the edge (iStartNodeID, iEndNodeID) in the dense upper-triangular edge storage.
+     *
+     * @param[in] iStartNodeID       The start node id.
+     * @param[in] iEndNodeID         The end node id. Needs to be greater or equal to iStartNodeID.
+     * @param[in] iNumberNodes       The number of nodes.
+     *
+     * @return   The pair index.
+     */
+    static inline int getDensePairIndex(int iStartNodeID,
+                                        int iEndNodeID,
+                                        int iNumberNodes);
+
     //=========================================================================================================
     /**
      * Returns whether the Network is empty by checking the number of nodes and edges.
@@ -393,10 +486,38 @@ public:
     int getFFTSize();
 
 protected:
-    QList<QSharedPointer<NetworkEdge> >     m_lFullEdges;               /**< List with all edges of the network.*/
-    QList<QSharedPointer<NetworkEdge> >     m_lThresholdedEdges;        /**< List with all the active (thresholded) edges of the network.*/
+    //=========================================================================================================
+    /**
+     * Averages the dense edge weights between the currently set frequency bins.
+     */
+    void updateDenseAveragedWeights();
+
+    //=========================================================================================================
+    /**
+     * Sets the minimum and maximum weights to the range of the absolute averaged dense edge weights.
+     */
+    void updateDenseMinMaxWeights();
+
+    //=========================================================================================================
+    /**
+     * Creates the edge objects from the dense edge weights, if this was not done yet. The nodes are recreated so that
+     * copies of this network, which share the node objects, do not get the edges appended twice. Concurrent calls
+     * on the same network are serialized, the first one creates the objects.
+     */
+    void materializeDenseEdges() const;
+
+    // The lists are mutable since they are lazily created from the dense edge weights
+    mutable QList<QSharedPointer<NetworkEdge> >     m_lFullEdges;       /**< List with all edges of the network.*/
+    mutable QList<QSharedPointer<NetworkEdge> >     m_lThresholdedEdges;/**< List with all the active (thresholded) edges of the network.*/
 
-    QList<QSharedPointer<NetworkNode> >     m_lNodes;                   /**< List with all nodes of the network.*/
+    mutable QList<QSharedPointer<NetworkNode> >     m_lNodes;           /**< List with all nodes of the network.*/
+
+    Eigen::MatrixXd                         m_matDenseEdgeWeights;      /**< The dense edge weights (pairs x frequency bins) of the upper triangle including the diagonal. Empty if the edges are stored as objects only.*/
+    Eigen::VectorXd                         m_vecDenseWeights;          /**< The averaged weight of each dense edge.*/
+    QPair<int,int>                          m_minMaxDenseFreqBins;      /**< The lower/upper bin to average the dense edge weights from/to. Default is -1 which means an average over all weights.*/
+    int                                     m_iNumberDenseNodes;        /**< The number of nodes of the dense edge weights. The const getters use it instead of the lazily recreated node list.*/
+    mutable bool                            m_bDenseEdgesPending;       /**< Whether the edge objects still need to be created from the dense edge weights.*/
+    mutable QMutex                          m_mutexDenseEdges;          /**< Guards the lazy creation of the edge objects.*/
 
     Eigen::MatrixXd                         m_matDistMatrix;            /**< The distance matrix.*/
 
@@ -417,6 +538,14 @@ protected:
 //=============================================================================================================
 // INLINE DEFINITIONS
 //=============================================================================================================
+
+inline int Network::getDensePairIndex(int iStartNodeID,
+                                      int iEndNodeID,
+                                      int iNumberNodes)
+{
+    return iStartNodeID * iNumberNodes - (iStartNodeID * (iStartNodeID - 1)) / 2 + (iEndNodeID - iStartNodeID);
+}
+
 } // namespace CONNECTIVITYLIB
 
 #ifndef metatype_networks
@@ -214,6 +214,9 @@ void FilterDesignView::setFilterParameters(double hp,
     if(designMethod == 1) {
         ui->m_comboBox_designMethod->setCurrentText("Cosine");
     }
+    if(designMethod == 3) {
+        ui->m_comboBox_designMethod->setCurrentText("Butterworth");
+    }
 
     ui->m_doubleSpinBox_transitionband->setValue(transition);
 
@@ -231,6 +234,13 @@ FilterData FilterDesignView::getCurrentFilter()
 
 //=============================================================================================================
 
+void FilterDesignView::setDesignMethod(FilterData::DesignMethod designMethod)
+{
+    ui->m_comboBox_designMethod->setCurrentText(FilterData::getStringForDesignMethod(designMethod));
+}
+
+//=============================================================================================================
+
 QString FilterDesignView::getChannelType()
 {
     return ui->m_comboBox_filterApplyTo->currentText();
@@ -415,6 +425,11 @@ void FilterDesignView::changeStateSpinBoxes(int currentIndex)
             ui->m_spinBox_filterTaps->setVisible(true);
             ui->m_label_filterTaps->setVisible(true);
             break;
+
+        case 2: //Butterworth, the taps define the length of the impulse response used for plotting and display filtering
+            ui->m_spinBox_filterTaps->setVisible(true);
+            ui->m_label_filterTaps->setVisible(true);
+            break;
     }
 
     //Change visibility of spin boxes depending on filter type
@@ -508,6 +523,10 @@ void FilterDesignView::filterParametersChanged()
         dMethod = FilterData::Cosine;
     }
 
+    if(ui->m_comboBox_designMethod->currentText() == "Butterworth") {
+        dMethod = FilterData::Butterworth;
+    }
+
     //Generate filters
     //Note: Always use "User Design" as filter name for user designed filters, which are stored in the model. This needs to be done because there only should be one filter in this model which holds the user designed filter.
     //Otherwise everytime a filter is designed a new filter would be added to this model -> too much storage consumption.
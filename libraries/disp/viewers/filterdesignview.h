@@ -170,6 +170,14 @@ public:
      */
     UTILSLIB::FilterData getCurrentFilter();
 
+    //=========================================================================================================
+    /**
+     * Sets the filter design method, e.g. FilterData::Butterworth for a low latency IIR filter.
+     *
+     * @param[in] designMethod       The filter design method.
+     */
+    void setDesignMethod(UTILSLIB::FilterData::DesignMethod designMethod);
+
     //=========================================================================================================
     /**
      * Returns the current channel type which is to be filtered.
@@ -91,6 +91,19 @@ FilterSettingsView::FilterSettingsView(const QString& sSettingsPath,
 
     topLayout->addWidget(m_pCheckBox, 0, 0);
 
+    //Add low latency mode, which switches to a causal IIR filter without the delay of the linear phase FIR filters
+    m_pCheckBoxLowLatency = new QCheckBox("Low latency (IIR)");
+    m_pCheckBoxLowLatency->setToolTip("Use a Butterworth IIR filter instead of a linear phase FIR filter. This avoids the delay of half the filter length, but distorts the phase.");
+    m_pCheckBoxLowLatency->setChecked(m_pFilterView->getCurrentFilter().m_designMethod == UTILSLIB::FilterData::Butterworth);
+
+    connect(m_pCheckBoxLowLatency.data(), &QCheckBox::toggled,
+            this, &FilterSettingsView::onLowLatencyChanged);
+
+    connect(m_pFilterView.data(), &FilterDesignView::filterChanged,
+            this, &FilterSettingsView::onFilterChanged);
+
+    topLayout->addWidget(m_pCheckBoxLowLatency, 1, 0);
+
     //Add push button for filter options
     QPushButton* pShowFilterOptions = new QPushButton();
     pShowFilterOptions->setText("Filter options");
@@ -98,7 +111,7 @@ FilterSettingsView::FilterSettingsView(const QString& sSettingsPath,
     connect(pShowFilterOptions, &QPushButton::clicked,
             this, &FilterSettingsView::onShowFilterView);
 
-    topLayout->addWidget(pShowFilterOptions, 1, 0);
+    topLayout->addWidget(pShowFilterOptions, 2, 0);
 
     //Find Filter tab and add current layout
     this->setLayout(topLayout);
@@ -173,3 +186,19 @@ void FilterSettingsView::onFilterActivationChanged()
 
     saveSettings(m_sSettingsPath);
 }
+
+//=============================================================================================================
+
+void FilterSettingsView::onLowLatencyChanged(bool bLowLatency)
+{
+    m_pFilterView->setDesignMethod(bLowLatency ? UTILSLIB::FilterData::Butterworth : UTILSLIB::FilterData::Cosine);
+}
+
+//=============================================================================================================
+
+void FilterSettingsView::onFilterChanged(const UTILSLIB::FilterData& filterData)
+{
+    m_pCheckBoxLowLatency->blockSignals(true);
+    m_pCheckBoxLowLatency->setChecked(filterData.m_designMethod == UTILSLIB::FilterData::Butterworth);
+    m_pCheckBoxLowLatency->blockSignals(false);
+}
@@ -140,11 +140,28 @@ protected:
      */
     void onFilterActivationChanged();
 
+    //=========================================================================================================
+    /**
+     * Whenever the low latency (IIR) mode was toggled by the user
+     *
+     * @param[in] bLowLatency        whether to use a Butterworth IIR filter instead of a linear phase FIR filter.
+     */
+    void onLowLatencyChanged(bool bLowLatency);
+
+    //=========================================================================================================
+    /**
+     * Whenever the filter changed in the filter view
+     *
+     * @param[in] filterData         the new filter.
+     */
+    void onFilterChanged(const UTILSLIB::FilterData& filterData);
+
     QString                                 m_sSettingsPath;                /**< The settings path to store the GUI settings to. */
 
     QSharedPointer<FilterDesignView>        m_pFilterView;                  /**< The filter view. */
 
     QPointer<QCheckBox>                     m_pCheckBox;                    /**< The filter activation check box. */
+    QPointer<QCheckBox>                     m_pCheckBoxLowLatency;          /**< The low latency (IIR) check box. */
 
 signals:
     void filterActivationChanged(bool activated);
@@ -55,6 +55,8 @@
 #include "fiff_ctf_comp.h"
 #include "fiff_info.h"
 #include "fiff_raw_data.h"
+#include "fiff_raw_block_cache.h"
+#include "fiff_raw_stream_writer.h"
 #include "fiff_raw_dir.h"
 #include "fiff_stream.h"
 #include "fiff_evoked_set.h"
@@ -76,6 +76,8 @@ SOURCES += fiff.cpp \
     fiff_proj.cpp \
     fiff_named_matrix.cpp \
     fiff_raw_data.cpp \
+    fiff_raw_block_cache.cpp \
+    fiff_raw_stream_writer.cpp \
     fiff_ctf_comp.cpp \
     fiff_id.cpp \
     fiff_info.cpp \
@@ -111,6 +113,8 @@ HEADERS += fiff.h \
     fiff_ctf_comp.h \
     fiff_info.h \
     fiff_raw_data.h \
+    fiff_raw_block_cache.h \
+    fiff_raw_stream_writer.h \
     fiff_dir_entry.h \
     fiff_raw_dir.h \
     fiff_dig_point.h \
@@ -206,6 +206,22 @@ bool FiffDirNode::find_tag(FiffStream* p_pStream, fiff_int_t findkind, FiffTag::
 
 //=============================================================================================================
 
+bool FiffDirNode::find_tag(FiffStream* p_pStream, fiff_int_t findkind, FiffTag& p_Tag) const
+{
+    for (qint32 p = 0; p < this->nent(); ++p)
+    {
+        if (this->dir[p]->kind == findkind)
+        {
+            p_pStream->read_tag(p_Tag,this->dir[p]->pos);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//=============================================================================================================
+
 bool FiffDirNode::has_tag(fiff_int_t findkind)
 {
     for(qint32 p = 0; p < this->nent(); ++p)
@@ -170,6 +170,32 @@ public:
      */
     bool find_tag(FiffStream* p_pStream, fiff_int_t findkind, QSharedPointer<FiffTag>& p_pTag) const;
 
+    //=========================================================================================================
+    /**
+     * Founds a tag of a given kind within a tree, and reads it from file into a caller owned tag, whose memory is
+     * reused (see FiffStream::read_tag).
+     *
+     * @param[in] p_pStream the opened fif file
+     * @param[in] findkind the kind which should be found
+     * @param[out] p_Tag the found tag
+     *
+     * @return true if found, false otherwise
+     */
+    inline bool find_tag(QSharedPointer<FiffStream>& p_pStream, fiff_int_t findkind, FiffTag& p_Tag) const;
+
+    //=========================================================================================================
+    /**
+     * Founds a tag of a given kind within a tree, and reads it from file into a caller owned tag, whose memory is
+     * reused (see FiffStream::read_tag).
+     *
+     * @param[in] p_pStream the opened fif file
+     * @param[in] findkind the kind which should be found
+     * @param[out] p_Tag the found tag
+     *
+     * @return true if found, false otherwise
+     */
+    bool find_tag(FiffStream* p_pStream, fiff_int_t findkind, FiffTag& p_Tag) const;
+
     //=========================================================================================================
     /**
      * Definition of the has_tag function in fiff_read_named_matrix.m
@@ -282,6 +308,13 @@ inline bool FiffDirNode::find_tag(QSharedPointer<FiffStream> &p_pStream, fiff_in
 {
     return find_tag(p_pStream.data(), findkind, p_pTag);
 }
+
+//=============================================================================================================
+
+inline bool FiffDirNode::find_tag(QSharedPointer<FiffStream> &p_pStream, fiff_int_t findkind, FiffTag &p_Tag) const
+{
+    return find_tag(p_pStream.data(), findkind, p_Tag);
+}
 } // NAMESPACE
 
 #endif // FIFF_DIR_NODE_H
@@ -0,0 +1,481 @@
+//=============================================================================================================
+/**
+ * @file     fiff_raw_block_cache.cpp
+ * @author   Lorenz Esch <lesch@mgh.harvard.edu>
+ * @version  dev
+ * @date     April, 2020
+ *
+ * @section  LICENSE
+ *
+ * Copyright (C) 2020, Lorenz Esch. All rights reserved.
+ *
+ * the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+ *       following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ *       the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *     * Neither the name of MNE-CPP authors nor the names of its contributors may be used
+ *       to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @brief    Definition of the FiffRawBlockCache Class.
+ *
+ */
+
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_raw_block_cache.h"
+
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QFile>
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QDebug>
+
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+using namespace Eigen;
+
+//=============================================================================================================
+// DEFINE NAMESPACE FIFFLIB
+//=============================================================================================================
+
+namespace FIFFLIB
+{
+
+//=============================================================================================================
+/**
+ * Reads one block in the background and hands it to the cache.
+ */
+class FiffRawBlockReadTask : public QRunnable
+{
+public:
+    FiffRawBlockReadTask(FiffRawBlockCache* pCache, qint32 iBlock)
+    : m_pCache(pCache)
+    , m_iBlock(iBlock)
+    {
+        m_timer.start();
+    }
+
+    void run() override
+    {
+        FiffRawBlockCache::Block pBlock = m_pCache->readBlock(m_iBlock);
+        m_pCache->finishPrefetch(m_iBlock, pBlock, m_timer.elapsed());
+    }
+
+private:
+    FiffRawBlockCache*  m_pCache;   /**< The cache the block belongs to. */
+    qint32              m_iBlock;   /**< The block index. */
+    QElapsedTimer       m_timer;    /**< Started when the read was scheduled. */
+};
+
+} // NAMESPACE
+
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+FiffRawBlockCache::FiffRawBlockCache(const FiffRawData& raw,
+                                     qint32 iSamplesPerBlock,
+                                     qint64 iMemoryBudget,
+                                     qint32 iReadAhead,
+                                     qint32 iNumThreads)
+: m_iSamplesPerBlock(std::max(1, iSamplesPerBlock))
+, m_iMemoryBudget(iMemoryBudget)
+, m_iReadAhead(std::max(0, iReadAhead))
+, m_iUseCounter(0)
+, m_iBytes(0)
+, m_statistics()
+, m_iPrefetchMsSum(0)
+, m_iReadNsSum(0)
+, m_iReads(0)
+, m_iNumReaders(0)
+, m_iMaxReaders(1)
+{
+    m_threadPool.setMaxThreadCount(std::max(1, iNumThreads));
+    setRawData(raw);
+}
+
+//=============================================================================================================
+
+FiffRawBlockCache::~FiffRawBlockCache()
+{
+    m_threadPool.clear();
+    m_threadPool.waitForDone();
+}
+
+//=============================================================================================================
+
+void FiffRawBlockCache::setRawData(const FiffRawData& raw)
+{
+    clear();
+
+    QMutexLocker locker(&m_readerMutex);
+
+    m_raw = raw;
+
+    //
+    //   Devices which are not plain files (buffers, sockets, ...) cannot be opened a second time, all reads
+    //   share the one device then
+    //
+    QFile* pFile = m_raw.file ? qobject_cast<QFile*>(m_raw.file->device()) : Q_NULLPTR;
+    m_sFileName = pFile ? pFile->fileName() : QString();
+    m_iMaxReaders = m_sFileName.isEmpty() ? 1 : m_threadPool.maxThreadCount() + 1;
+}
+
+//=============================================================================================================
+
+FiffRawBlockCache::Block FiffRawBlockCache::block(qint32 iBlock)
+{
+    if(iBlock < 0 || iBlock >= blockCount()) {
+        return Block();
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        bool bWaited = false;
+        while(m_setPending.contains(iBlock)) {
+            bWaited = true;
+            m_blockFinished.wait(&m_mutex);
+        }
+
+        QHash<qint32, Entry>::iterator it = m_hashBlocks.find(iBlock);
+        if(it != m_hashBlocks.end()) {
+            it->iLastUsed = ++m_iUseCounter;
+            if(bWaited) {
+                ++m_statistics.iPendingHits;
+            } else {
+                ++m_statistics.iHits;
+            }
+            return it->pBlock;
+        }
+
+        ++m_statistics.iMisses;
+        m_setPending.insert(iBlock);
+    }
+
+    Block pBlock = readBlock(iBlock);
+
+    QMutexLocker locker(&m_mutex);
+    m_setPending.remove(iBlock);
+    if(pBlock) {
+        insertBlock(iBlock, pBlock);
+    }
+    m_blockFinished.wakeAll();
+
+    return pBlock;
+}
+
+//=============================================================================================================
+
+bool FiffRawBlockCache::read_raw_segment(MatrixXd& data,
+                                         MatrixXd& times,
+                                         fiff_int_t from,
+                                         fiff_int_t to,
+                                         qint32 iDirection)
+{
+    from = std::max(from, m_raw.first_samp);
+    to = std::min(to, m_raw.last_samp);
+
+    if(from > to) {
+        qWarning() << "[FiffRawBlockCache::read_raw_segment] No data in this range" << from << "..." << to;
+        return false;
+    }
+
+    const qint32 iFirstBlock = blockIndex(from);
+    const qint32 iLastBlock = blockIndex(to);
+
+    // Let the reader threads work on the rest of the segment while the first block is read here
+    prefetch(iFirstBlock + 1, iLastBlock - iFirstBlock);
+
+    qint32 dest = 0;
+    for(qint32 b = iFirstBlock; b <= iLastBlock; ++b) {
+        Block pBlock = block(b);
+        if(!pBlock) {
+            qWarning() << "[FiffRawBlockCache::read_raw_segment] Could not read block" << b;
+            return false;
+        }
+
+        if(b == iFirstBlock) {
+            data.resize(pBlock->first.rows(), to - from + 1);
+            times.resize(1, to - from + 1);
+        }
+
+        const fiff_int_t blockFirst = m_raw.first_samp + b * m_iSamplesPerBlock;
+        const qint32 iOffset = std::max(from, blockFirst) - blockFirst;
+        const qint32 iNumSamples = std::min(to, blockFirst + (fiff_int_t)pBlock->first.cols() - 1) - blockFirst - iOffset + 1;
+
+        data.block(0, dest, data.rows(), iNumSamples) = pBlock->first.block(0, iOffset, data.rows(), iNumSamples);
+        times.block(0, dest, 1, iNumSamples) = pBlock->second.block(0, iOffset, 1, iNumSamples);
+        dest += iNumSamples;
+    }
+
+    // The read-ahead can be changed from another thread, see setReadAhead()
+    qint32 iReadAhead;
+    {
+        QMutexLocker locker(&m_mutex);
+        iReadAhead = m_iReadAhead;
+    }
+
+    if(iDirection > 0) {
+        prefetch(iLastBlock + 1, iReadAhead);
+    } else if(iDirection < 0) {
+        prefetch(iFirstBlock - iReadAhead, iReadAhead);
+    }
+
+    return true;
+}
+
+//=============================================================================================================
+
+void FiffRawBlockCache::prefetch(qint32 iFirstBlock,
+                                 qint32 iNumBlocks)
+{
+    const qint32 iEnd = std::min(iFirstBlock + iNumBlocks, blockCount());
+
+    QMutexLocker locker(&m_mutex);
+
+    for(qint32 b = std::max(0, iFirstBlock); b < iEnd; ++b) {
+        if(m_hashBlocks.contains(b) || m_setPending.contains(b)) {
+            continue;
+        }
+
+        m_setPending.insert(b);
+        m_threadPool.start(new FiffRawBlockReadTask(this, b));
+    }
+}
+
+//=============================================================================================================
+
+void FiffRawBlockCache::clear()
+{
+    // Drop the reads which did not start yet and wait for the running ones
+    m_threadPool.clear();
+    m_threadPool.waitForDone();
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_hashBlocks.clear();
+        m_setPending.clear();
+        m_iBytes = 0;
+        m_blockFinished.wakeAll();
+    }
+
+    QMutexLocker locker(&m_readerMutex);
+    m_iNumReaders -= m_lFreeReaders.size();
+    m_lFreeReaders.clear();
+}
+
+//=============================================================================================================
+
+qint32 FiffRawBlockCache::blockIndex(fiff_int_t iSample) const
+{
+    return (iSample - m_raw.first_samp) / m_iSamplesPerBlock;
+}
+
+//=============================================================================================================
+
+qint32 FiffRawBlockCache::blockCount() const
+{
+    if(m_raw.first_samp < 0 || m_raw.last_samp < m_raw.first_samp) {
+        return 0;
+    }
+
+    return blockIndex(m_raw.last_samp) + 1;
+}
+
+//=============================================================================================================
+
+FiffRawBlockCache::Statistics FiffRawBlockCache::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    Statistics statistics = m_statistics;
+    statistics.dMeanPrefetchMs = m_statistics.iPrefetched > 0 ? (double)m_iPrefetchMsSum / (double)m_statistics.iPrefetched : 0.0;
+    statistics.dMeanReadMs = m_iReads > 0 ? (double)m_iReadNsSum / (double)m_iReads * 1.0e-6 : 0.0;
+    statistics.iBlocks = m_hashBlocks.size();
+    statistics.iBytes = m_iBytes;
+
+    return statistics;
+}
+
+//=============================================================================================================
+
+void FiffRawBlockCache::resetStatistics()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_statistics = Statistics();
+    m_iPrefetchMsSum = 0;
+    m_iReadNsSum = 0;
+    m_iReads = 0;
+}
+
+//=============================================================================================================
+
+void FiffRawBlockCache::setMemoryBudget(qint64 iMemoryBudget)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_iMemoryBudget = iMemoryBudget;
+    evict();
+}
+
+//=============================================================================================================
+
+void FiffRawBlockCache::setReadAhead(qint32 iReadAhead)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_iReadAhead = std::max(0, iReadAhead);
+}
+
+//=============================================================================================================
+
+FiffRawBlockCache::Block FiffRawBlockCache::readBlock(qint32 iBlock)
+{
+    const fiff_int_t from = m_raw.first_samp + iBlock * m_iSamplesPerBlock;
+    const fiff_int_t to = std::min(from + m_iSamplesPerBlock - 1, m_raw.last_samp);
+
+    QSharedPointer<Reader> pReader = acquireReader();
+    if(!pReader) {
+        return Block();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QSharedPointer<QPair<MatrixXd, MatrixXd> > pBlock = QSharedPointer<QPair<MatrixXd, MatrixXd> >::create();
+    bool bSuccess = pReader->raw.read_raw_segment(pBlock->first, pBlock->second, from, to);
+
+    const qint64 iReadNs = timer.nsecsElapsed();
+
+    releaseReader(pReader);
+
+    QMutexLocker locker(&m_mutex);
+    m_iReadNsSum += iReadNs;
+    ++m_iReads;
+
+    if(!bSuccess) {
+        return Block();
+    }
+
+    return pBlock;
+}
+
+//=============================================================================================================
+
+void FiffRawBlockCache::finishPrefetch(qint32 iBlock,
+                                       const Block& pBlock,
+                                       qint64 iLatencyMs)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_setPending.remove(iBlock);
+
+    if(pBlock) {
+        insertBlock(iBlock, pBlock);
+
+        ++m_statistics.iPrefetched;
+        m_iPrefetchMsSum += iLatencyMs;
+        m_statistics.iMaxPrefetchMs = std::max(m_statistics.iMaxPrefetchMs, iLatencyMs);
+    }
+
+    m_blockFinished.wakeAll();
+}
+
+//=============================================================================================================
+
+void FiffRawBlockCache::insertBlock(qint32 iBlock,
+                                    const Block& pBlock)
+{
+    Entry entry;
+    entry.pBlock = pBlock;
+    entry.iLastUsed = ++m_iUseCounter;
+
+    m_hashBlocks.insert(iBlock, entry);
+    m_iBytes += (pBlock->first.size() + pBlock->second.size()) * (qint64)sizeof(double);
+
+    evict();
+}
+
+//=============================================================================================================
+
+void FiffRawBlockCache::evict()
+{
+    while(m_iBytes > m_iMemoryBudget && !m_hashBlocks.isEmpty()) {
+        QHash<qint32, Entry>::iterator itOldest = m_hashBlocks.begin();
+        for(QHash<qint32, Entry>::iterator it = m_hashBlocks.begin(); it != m_hashBlocks.end(); ++it) {
+            if(it->iLastUsed < itOldest->iLastUsed) {
+                itOldest = it;
+            }
+        }
+
+        m_iBytes -= (itOldest->pBlock->first.size() + itOldest->pBlock->second.size()) * (qint64)sizeof(double);
+        m_hashBlocks.erase(itOldest);
+        ++m_statistics.iEvicted;
+    }
+}
+
+//=============================================================================================================
+
+QSharedPointer<FiffRawBlockCache::Reader> FiffRawBlockCache::acquireReader()
+{
+    QMutexLocker locker(&m_readerMutex);
+
+    while(m_lFreeReaders.isEmpty() && m_iNumReaders >= m_iMaxReaders) {
+        m_readerReleased.wait(&m_readerMutex);
+    }
+
+    if(!m_lFreeReaders.isEmpty()) {
+        return m_lFreeReaders.takeLast();
+    }
+
+    QSharedPointer<Reader> pReader = QSharedPointer<Reader>::create();
+    pReader->raw = m_raw;
+
+    if(!m_sFileName.isEmpty()) {
+        pReader->pFile = QSharedPointer<QFile>::create(m_sFileName);
+        if(!pReader->pFile->open(QIODevice::ReadOnly)) {
+            qWarning() << "[FiffRawBlockCache::acquireReader] Could not open" << m_sFileName;
+            return QSharedPointer<Reader>();
+        }
+
+        FiffStream::SPtr pStream(new FiffStream(pReader->pFile.data()));
+        pStream->setByteOrder(m_raw.file->byteOrder());
+        pReader->raw.file = pStream;
+    }
+
+    ++m_iNumReaders;
+
+    return pReader;
+}
+
+//=============================================================================================================
+
+void FiffRawBlockCache::releaseReader(const QSharedPointer<Reader>& pReader)
+{
+    QMutexLocker locker(&m_readerMutex);
+
+    m_lFreeReaders.append(pReader);
+    m_readerReleased.wakeOne();
+}
@@ -0,0 +1,349 @@
+//=============================================================================================================
+/**
+ * @file     fiff_raw_block_cache.h
+ * @author   Lorenz Esch <lesch@mgh.harvard.edu>
+ * @version  dev
+ * @date     April, 2020
+ *
+ * @section  LICENSE
+ *
+ * Copyright (C) 2020, Lorenz Esch. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ * the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+ *       following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ *       the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *     * Neither the name of MNE-CPP authors nor the names of its contributors may be used
+ *       to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @brief    FiffRawBlockCache class declaration.
+ *
+ */
+
+#ifndef FIFF_RAW_BLOCK_CACHE_H
+#define FIFF_RAW_BLOCK_CACHE_H
+
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_global.h"
+#include "fiff_raw_data.h"
+
+//=============================================================================================================
+// EIGEN INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QSharedPointer>
+#include <QPair>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+
+//=============================================================================================================
+// FORWARD DECLARATIONS
+//=============================================================================================================
+
+class QFile;
+
+//=============================================================================================================
+// DEFINE NAMESPACE FIFFLIB
+//=============================================================================================================
+
+namespace FIFFLIB
+{
+
+//=============================================================================================================
+// FIFFLIB FORWARD DECLARATIONS
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+ * Caches raw data in blocks of a fixed number of samples. Blocks are kept until the memory budget is exceeded, the
+ * least recently used blocks are evicted first. Blocks ahead of the last request in scroll direction are read by a
+ * small thread pool in the background, every reader thread works on its own file handle.
+ *
+ * The cache works on a copy of the raw data. Call setRawData() after changing the projectors or compensators of the
+ * original raw data. The cache can be used from several threads, setRawData() and clear() must not be called while
+ * other threads read.
+ *
+ * @brief LRU block cache with read-ahead for FIFF raw data.
+ */
+class FIFFSHARED_EXPORT FiffRawBlockCache
+{
+public:
+    typedef QSharedPointer<FiffRawBlockCache> SPtr;                         /**< Shared pointer type for FiffRawBlockCache. */
+    typedef QSharedPointer<const FiffRawBlockCache> ConstSPtr;              /**< Const shared pointer type for FiffRawBlockCache. */
+    typedef QSharedPointer<const QPair<Eigen::MatrixXd, Eigen::MatrixXd> > Block;   /**< Data and times of one block. */
+
+    //=========================================================================================================
+    /**
+     * Hit, miss and prefetch counters of the cache.
+     */
+    struct Statistics {
+        qint64 iHits;               /**< Blocks which were found in the cache. */
+        qint64 iPendingHits;        /**< Blocks which were being prefetched when requested, the request waited for them. */
+        qint64 iMisses;             /**< Blocks which had to be read on request. */
+        qint64 iPrefetched;         /**< Blocks which were read ahead. */
+        qint64 iEvicted;            /**< Blocks which were evicted to stay within the memory budget. */
+        double dMeanPrefetchMs;     /**< Mean time between scheduling and finishing a read ahead in ms. */
+        qint64 iMaxPrefetchMs;      /**< Maximal time between scheduling and finishing a read ahead in ms. */
+        double dMeanReadMs;         /**< Mean time to read one block from disk in ms. */
+        qint32 iBlocks;             /**< Blocks currently held. */
+        qint64 iBytes;              /**< Memory currently held in bytes. */
+    };
+
+    //=========================================================================================================
+    /**
+     * Constructs a block cache for the given raw data.
+     *
+     * @param[in] raw                The raw data to read from.
+     * @param[in] iSamplesPerBlock   Number of samples per block.
+     * @param[in] iMemoryBudget      Maximal memory held by the cached blocks in bytes.
+     * @param[in] iReadAhead         Number of blocks which are read ahead in scroll direction.
+     * @param[in] iNumThreads        Number of reader threads.
+     */
+    FiffRawBlockCache(const FiffRawData& raw,
+                      qint32 iSamplesPerBlock,
+                      qint64 iMemoryBudget = 256 * 1024 * 1024,
+                      qint32 iReadAhead = 4,
+                      qint32 iNumThreads = 2);
+
+    //=========================================================================================================
+    /**
+     * Destroys the block cache. Waits for all pending reads to finish.
+     */
+    ~FiffRawBlockCache();
+
+    //=========================================================================================================
+    /**
+     * Returns the block with the given index. Blocks which are not cached are read in the calling thread, blocks
+     * which are currently read ahead are waited for.
+     *
+     * @param[in] iBlock     The block index, block 0 starts at the first sample of the raw data.
+     *
+     * @return the block, null if the block could not be read.
+     */
+    Block block(qint32 iBlock);
+
+    //=========================================================================================================
+    /**
+     * Reads a raw data segment from the cached blocks. The blocks which are covered by the segment are read if
+     * necessary, afterwards the following blocks in scroll direction are read ahead.
+     *
+     * @param[out] data      returns the data matrix (channels x samples).
+     * @param[out] times     returns the time values corresponding to the samples.
+     * @param[in] from       first sample to include.
+     * @param[in] to         last sample to include.
+     * @param[in] iDirection scroll direction used for the read ahead, -1 backwards, 1 forwards, 0 none.
+     *
+     * @return true if succeeded, false otherwise.
+     */
+    bool read_raw_segment(Eigen::MatrixXd& data,
+                          Eigen::MatrixXd& times,
+                          fiff_int_t from,
+                          fiff_int_t to,
+                          qint32 iDirection = 0);
+
+    //=========================================================================================================
+    /**
+     * Schedules the given blocks to be read in the background, if they are neither cached nor pending.
+     *
+     * @param[in] iFirstBlock    The first block index.
+     * @param[in] iNumBlocks     The number of blocks.
+     */
+    void prefetch(qint32 iFirstBlock,
+                  qint32 iNumBlocks);
+
+    //=========================================================================================================
+    /**
+     * Drops all cached blocks and reader handles. Pending reads are waited for.
+     */
+    void clear();
+
+    //=========================================================================================================
+    /**
+     * Replaces the raw data the blocks are read from and drops all cached blocks.
+     *
+     * @param[in] raw    The raw data to read from.
+     */
+    void setRawData(const FiffRawData& raw);
+
+    //=========================================================================================================
+    /**
+     * Returns the index of the block which holds the given sample.
+     *
+     * @param[in] iSample    The absolute sample.
+     *
+     * @return the block index.
+     */
+    qint32 blockIndex(fiff_int_t iSample) const;
+
+    //=========================================================================================================
+    /**
+     * Returns the number of blocks of the raw data.
+     *
+     * @return the number of blocks.
+     */
+    qint32 blockCount() const;
+
+    //=========================================================================================================
+    /**
+     * Returns the hit, miss and prefetch counters.
+     *
+     * @return the counters.
+     */
+    Statistics statistics() const;
+
+    //=========================================================================================================
+    /**
+     * Resets the hit, miss and prefetch counters.
+     */
+    void resetStatistics();
+
+    //=========================================================================================================
+    /**
+     * Sets the memory budget. Blocks are evicted right away if the cache holds more than the new budget.
+     *
+     * @param[in] iMemoryBudget      Maximal memory held by the cached blocks in bytes.
+     */
+    void setMemoryBudget(qint64 iMemoryBudget);
+
+    //=========================================================================================================
+    /**
+     * Sets the number of blocks which are read ahead in scroll direction.
+     *
+     * @param[in] iReadAhead     Number of blocks.
+     */
+    void setReadAhead(qint32 iReadAhead);
+
+private:
+    friend class FiffRawBlockReadTask;
+
+    //=========================================================================================================
+    /**
+     * A raw data copy with its own file handle, so that several threads can read at the same time.
+     */
+    struct Reader {
+        QSharedPointer<QFile> pFile;    /**< The file handle, null if the original device is shared. */
+        FiffRawData raw;                /**< The raw data reading from pFile. */
+    };
+
+    //=========================================================================================================
+    /**
+     * A cached block.
+     */
+    struct Entry {
+        Block pBlock;       /**< The block. */
+        qint64 iLastUsed;   /**< Use stamp for the LRU eviction. */
+    };
+
+    //=========================================================================================================
+    /**
+     * Reads a block from disk. Thread safe.
+     *
+     * @param[in] iBlock     The block index.
+     *
+     * @return the block, null if the block could not be read.
+     */
+    Block readBlock(qint32 iBlock);
+
+    //=========================================================================================================
+    /**
+     * Stores a block which was read and wakes up all waiting requests. Called by the reader threads.
+     *
+     * @param[in] iBlock         The block index.
+     * @param[in] pBlock         The block, null if it could not be read.
+     * @param[in] iLatencyMs     Time between scheduling and finishing the read in ms.
+     */
+    void finishPrefetch(qint32 iBlock,
+                        const Block& pBlock,
+                        qint64 iLatencyMs);
+
+    //=========================================================================================================
+    /**
+     * Inserts a block and evicts the least recently used blocks until the memory budget is met. Must be called
+     * with m_mutex locked.
+     *
+     * @param[in] iBlock     The block index.
+     * @param[in] pBlock     The block.
+     */
+    void insertBlock(qint32 iBlock,
+                     const Block& pBlock);
+
+    //=========================================================================================================
+    /**
+     * Evicts the least recently used blocks until the memory budget is met. Must be called with m_mutex locked.
+     */
+    void evict();
+
+    //=========================================================================================================
+    /**
+     * Takes a free reader or creates a new one.
+     *
+     * @return the reader.
+     */
+    QSharedPointer<Reader> acquireReader();
+
+    //=========================================================================================================
+    /**
+     * Returns a reader to the free list.
+     *
+     * @param[in] pReader    The reader.
+     */
+    void releaseReader(const QSharedPointer<Reader>& pReader);
+
+    FiffRawData                     m_raw;                  /**< The raw data the readers are copied from. */
+    QString                         m_sFileName;            /**< The file name, empty if the raw data is not read from a file. */
+    qint32                          m_iSamplesPerBlock;     /**< Number of samples per block. */
+    qint64                          m_iMemoryBudget;        /**< Maximal memory held by the cached blocks in bytes. */
+    qint32                          m_iReadAhead;           /**< Number of blocks which are read ahead. */
+
+    mutable QMutex                  m_mutex;                /**< Guards the blocks, the pending set, the counters and the read-ahead. */
+    QWaitCondition                  m_blockFinished;        /**< Signaled whenever a pending block was stored. */
+    QHash<qint32, Entry>            m_hashBlocks;           /**< The cached blocks. */
+    QSet<qint32>                    m_setPending;           /**< Blocks which are read in the background. */
+    qint64                          m_iUseCounter;          /**< Use stamp of the last access. */
+    qint64                          m_iBytes;               /**< Memory held by the cached blocks in bytes. */
+    Statistics                      m_statistics;           /**< Counters. */
+    qint64                          m_iPrefetchMsSum;       /**< Sum of all read ahead latencies in ms. */
+    qint64                          m_iReadNsSum;           /**< Sum of all block read times in ns. */
+    qint64                          m_iReads;               /**< Number of block reads. */
+
+    QMutex                          m_readerMutex;          /**< Guards the reader free list. */
+    QWaitCondition                  m_readerReleased;       /**< Signaled whenever a reader is returned. */
+    QList<QSharedPointer<Reader> >  m_lFreeReaders;         /**< Readers which are not in use. */
+    qint32                          m_iNumReaders;          /**< Readers created so far. */
+    qint32                          m_iMaxReaders;          /**< Maximal number of readers. */
+
+    QThreadPool                     m_threadPool;           /**< The reader threads. */
+};
+
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+} // NAMESPACE
+
+#endif // FIFF_RAW_BLOCK_CACHE_H
@@ -43,6 +43,18 @@
 #include "fiff_stream.h"
 #include "cstdlib"
 
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QDebug>
+#include <QFile>
+#include <QtEndian>
+
 //=============================================================================================================
 // USED NAMESPACES
 //=============================================================================================================
@@ -50,6 +62,173 @@
 using namespace FIFFLIB;
 using namespace Eigen;
 
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+/**
+ * Reads one on-disk sample of type T.
+ */
+template<typename T, bool BigEndian>
+static inline T raw_sample(const char* p)
+{
+    return BigEndian ? qFromBigEndian<T>(p) : qFromLittleEndian<T>(p);
+}
+
+template<>
+inline float raw_sample<float, true>(const char* p)
+{
+    quint32 bits = qFromBigEndian<quint32>(p);
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+template<>
+inline float raw_sample<float, false>(const char* p)
+{
+    quint32 bits = qFromLittleEndian<quint32>(p);
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+//=============================================================================================================
+/**
+ * Compares two matrices of possibly different sizes.
+ */
+template<typename Derived>
+static inline bool equal_matrices(const MatrixBase<Derived>& a, const MatrixBase<Derived>& b)
+{
+    return a.rows() == b.rows() && a.cols() == b.cols() && (a.size() == 0 || a == b);
+}
+
+//=============================================================================================================
+/**
+ * Decodes the channels sel of the samples first_pick ... first_pick+picksamp-1 of a raw buffer (nchan x nsamp,
+ * column major) straight into the column major destination pDest. If pCals is set, every channel is multiplied
+ * with its calibration factor.
+ */
+template<typename T, bool BigEndian, typename Scalar>
+static void decode_raw_samples(const char* pBuffer,
+                               fiff_int_t nchan,
+                               fiff_int_t first_pick,
+                               fiff_int_t picksamp,
+                               const RowVectorXi& sel,
+                               const Scalar* pCals,
+                               Scalar* pDest)
+{
+    const qint32 nrow = sel.size();
+
+    for(qint32 c = 0; c < picksamp; ++c) {
+        const char* pSample = pBuffer + ((qint64)(first_pick + c) * nchan) * sizeof(T);
+        Scalar* pColumn = pDest + (qint64)c * nrow;
+
+        for(qint32 r = 0; r < nrow; ++r) {
+            const qint32 ch = sel[r];
+            pColumn[r] = static_cast<Scalar>(raw_sample<T, BigEndian>(pSample + ch * sizeof(T)));
+            if(pCals)
+                pColumn[r] *= pCals[ch];
+        }
+    }
+}
+
+//=============================================================================================================
+/**
+ * Decodes n contiguous samples with the vectorized FiffTag kernels. 16 bit integer output is only possible for
+ * 16 bit integer buffers and is never calibrated.
+ */
+template<typename Scalar>
+static inline bool decode_contiguous_samples(const char* pSrc,
+                                             fiff_int_t type,
+                                             bool bSwap,
+                                             qint64 n,
+                                             const Scalar* pCals,
+                                             Scalar* pDest)
+{
+    return FiffTag::decode_samples(pSrc, type, bSwap, n, pCals, pDest);
+}
+
+static inline bool decode_contiguous_samples(const char* pSrc,
+                                             fiff_int_t type,
+                                             bool bSwap,
+                                             qint64 n,
+                                             const qint16* pCals,
+                                             qint16* pDest)
+{
+    Q_UNUSED(pCals)
+    return FiffTag::decode_samples(pSrc, type, bSwap, n, pDest);
+}
+
+//=============================================================================================================
+/**
+ * Decodes the samples first_pick ... first_pick+picksamp-1 of a raw buffer (nchan x nsamp, column major) into the
+ * column major destination pDest. Without a selection the columns are contiguous and are handed to the
+ * vectorized FiffTag kernels, which swap, convert and calibrate in one pass. Selections are gathered by
+ * decode_raw_samples. 16 bit integer output is only possible for 16 bit integer buffers.
+ *
+ * @return false if the data type is not supported.
+ */
+template<typename Scalar>
+static bool decode_raw_buffer(fiff_int_t type,
+                              const char* pBuffer,
+                              bool bBigEndian,
+                              fiff_int_t nchan,
+                              fiff_int_t first_pick,
+                              fiff_int_t picksamp,
+                              const RowVectorXi& sel,
+                              const Scalar* pCals,
+                              Scalar* pDest)
+{
+    if(sel.size() == 0) {
+        const bool bSwap = bBigEndian != (Q_BYTE_ORDER == Q_BIG_ENDIAN);
+        const qint64 iSampleSize = (type == FIFFT_DAU_PACK16 || type == FIFFT_SHORT) ? 2 : 4;
+        const char* pSrc = pBuffer + (qint64)first_pick * nchan * iSampleSize;
+
+        if(!pCals)
+            return decode_contiguous_samples(pSrc, type, bSwap, (qint64)picksamp * nchan, pCals, pDest);
+
+        for(qint32 c = 0; c < picksamp; ++c) {
+            if(!decode_contiguous_samples(pSrc + (qint64)c * nchan * iSampleSize,
+                                          type,
+                                          bSwap,
+                                          nchan,
+                                          pCals,
+                                          pDest + (qint64)c * nchan))
+                return false;
+        }
+        return true;
+    }
+
+    switch(type) {
+        case FIFFT_DAU_PACK16:
+        case FIFFT_SHORT:
+            if(bBigEndian)
+                decode_raw_samples<qint16, true>(pBuffer, nchan, first_pick, picksamp, sel, pCals, pDest);
+            else
+                decode_raw_samples<qint16, false>(pBuffer, nchan, first_pick, picksamp, sel, pCals, pDest);
+            return true;
+        case FIFFT_INT:
+            if(std::is_integral<Scalar>::value)
+                return false;
+            if(bBigEndian)
+                decode_raw_samples<qint32, true>(pBuffer, nchan, first_pick, picksamp, sel, pCals, pDest);
+            else
+                decode_raw_samples<qint32, false>(pBuffer, nchan, first_pick, picksamp, sel, pCals, pDest);
+            return true;
+        case FIFFT_FLOAT:
+            if(std::is_integral<Scalar>::value)
+                return false;
+            if(bBigEndian)
+                decode_raw_samples<float, true>(pBuffer, nchan, first_pick, picksamp, sel, pCals, pDest);
+            else
+                decode_raw_samples<float, false>(pBuffer, nchan, first_pick, picksamp, sel, pCals, pDest);
+            return true;
+        default:
+            return false;
+    }
+}
+
 //=============================================================================================================
 // DEFINE MEMBER METHODS
 //=============================================================================================================
@@ -57,6 +236,9 @@ using namespace Eigen;
 FiffRawData::FiffRawData()
 : first_samp(-1)
 , last_samp(-1)
+, m_bMultValid(false)
+, m_iMultVersion(0)
+, m_iMultCompKind(-1)
 {
 }
 
@@ -65,6 +247,9 @@ FiffRawData::FiffRawData()
 FiffRawData::FiffRawData(QIODevice &p_IODevice)
 : first_samp(-1)
 , last_samp(-1)
+, m_bMultValid(false)
+, m_iMultVersion(0)
+, m_iMultCompKind(-1)
 {
     //setup FiffRawData object
     if(!FiffStream::setup_read_raw(p_IODevice, *this))
@@ -80,6 +265,9 @@ FiffRawData::FiffRawData(QIODevice &p_IODevice)
 FiffRawData::FiffRawData(QIODevice &p_IODevice, bool b_littleEndian)
 : first_samp(-1)
 , last_samp(-1)
+, m_bMultValid(false)
+, m_iMultVersion(0)
+, m_iMultCompKind(-1)
 {
     //setup FiffRawData object
     if(!FiffStream::setup_read_raw(p_IODevice, *this, false, b_littleEndian))
@@ -101,6 +289,9 @@ FiffRawData::FiffRawData(const FiffRawData &p_FiffRawData)
 , rawdir(p_FiffRawData.rawdir)
 , proj(p_FiffRawData.proj)
 , comp(p_FiffRawData.comp)
+, m_bMultValid(false)
+, m_iMultVersion(0)
+, m_iMultCompKind(-1)
 {
 }
 
@@ -121,11 +312,11 @@ void FiffRawData::clear()
     rawdir.clear();
     proj = MatrixXd();
     comp.clear();
+    m_bMultValid = false;
 }
 
 //=============================================================================================================
-#include <QElapsedTimer>
-#include <QDebug>
+
 bool FiffRawData::read_raw_segment(MatrixXd& data,
                                    MatrixXd& times,
                                    fiff_int_t from,
@@ -133,345 +324,154 @@ bool FiffRawData::read_raw_segment(MatrixXd& data,
                                    const RowVectorXi& sel,
                                    bool do_debug) const
 {
-    bool projAvailable = true;
+    return read_raw_segment_impl(data, times, (SparseMatrix<double>*)Q_NULLPTR, from, to, sel, true, do_debug);
+}
 
-    if (this->proj.size() == 0) {
-        //qDebug() << "FiffRawData::read_raw_segment - No projectors setup. Consider calling MNE::setup_compensators.";
-        projAvailable = false;
-    }
+//=============================================================================================================
 
-    if(from == -1)
-        from = this->first_samp;
-    if(to == -1)
-        to = this->last_samp;
-    //
-    //  Initial checks
-    //
-    if(from < this->first_samp)
-        from = this->first_samp;
-    if(to > this->last_samp)
-        to = this->last_samp;
-    //
-    if(from > to)
+bool FiffRawData::read_raw_segment(MatrixXd& data,
+                                   MatrixXd& times,
+                                   SparseMatrix<double>& multSegment,
+                                   fiff_int_t from,
+                                   fiff_int_t to,
+                                   const RowVectorXi& sel,
+                                   bool do_debug) const
+{
+    return read_raw_segment_impl(data, times, &multSegment, from, to, sel, true, do_debug);
+}
+
+//=============================================================================================================
+
+bool FiffRawData::read_raw_segment(MatrixXf& data,
+                                   MatrixXd& times,
+                                   fiff_int_t from,
+                                   fiff_int_t to,
+                                   const RowVectorXi& sel,
+                                   bool do_debug) const
+{
+    return read_raw_segment_impl(data, times, (SparseMatrix<double>*)Q_NULLPTR, from, to, sel, true, do_debug);
+}
+
+//=============================================================================================================
+
+bool FiffRawData::read_raw_segment(MatrixDau16& data,
+                                   RowVectorXd& dataCals,
+                                   MatrixXd& times,
+                                   fiff_int_t from,
+                                   fiff_int_t to,
+                                   const RowVectorXi& sel) const
+{
+    if (this->proj.size() > 0 || this->comp.kind != -1)
     {
-        printf("No data in this range %d ... %d  =  %9.3f ... %9.3f secs...", from, to, ((float)from)/this->info.sfreq, ((float)to)/this->info.sfreq);
+        printf("Projectors or compensators are set up, which cannot be applied to the stored integers. Read floating point data instead.\n");
         return false;
     }
-    //printf("Reading %d ... %d  =  %9.3f ... %9.3f secs...", from, to, ((float)from)/this->info.sfreq, ((float)to)/this->info.sfreq);
-    //
-    //  Initialize the data and calibration vector
-    //
-    qint32 nchan = this->info.nchan;
-    qint32 dest  = 0;//1;
-    qint32 i, k, r;
-
-    typedef Eigen::Triplet<double> T;
-    std::vector<T> tripletList;
-    tripletList.reserve(nchan);
-    for(i = 0; i < nchan; ++i)
-        tripletList.push_back(T(i, i, this->cals[i]));
 
-    SparseMatrix<double> cal(nchan, nchan);
-    cal.setFromTriplets(tripletList.begin(), tripletList.end());
-//    cal.makeCompressed();
+    if (!read_raw_segment_impl(data, times, (SparseMatrix<double>*)Q_NULLPTR, from, to, sel, false, false))
+        return false;
 
-    MatrixXd mult_full;
-    //
     if (sel.size() == 0)
     {
-        data = MatrixXd(nchan, to-from+1);
-//            data->setZero();
-        if (projAvailable || this->comp.kind != -1)
-        {
-            if (!projAvailable)
-                mult_full = this->comp.data->data*cal;
-            else if (this->comp.kind == -1)
-                mult_full = this->proj*cal;
-            else
-                mult_full = this->proj*this->comp.data->data*cal;
-        }
+        dataCals = this->cals;
     }
     else
     {
-        data = MatrixXd(sel.size(),to-from+1);
-//            data->setZero();
+        dataCals.resize(sel.size());
+        for (qint32 i = 0; i < sel.size(); ++i)
+            dataCals[i] = this->cals[sel[i]];
+    }
 
-        MatrixXd selVect(sel.size(), nchan);
+    return true;
+}
 
-        selVect.setZero();
+//=============================================================================================================
 
-        if (!projAvailable && this->comp.kind == -1)
-        {
-            tripletList.clear();
-            tripletList.reserve(sel.size());
-            for(i = 0; i < sel.size(); ++i)
-                tripletList.push_back(T(i, i, this->cals[sel[i]]));
-            cal = SparseMatrix<double>(sel.size(), sel.size());
-            cal.setFromTriplets(tripletList.begin(), tripletList.end());
-        }
-        else
-        {
-            if (!projAvailable)
-            {
-                qDebug() << "This has to be debugged! #1";
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->comp.data->data.block(sel[i],0,1,nchan);
-                mult_full = selVect*cal;
-            }
-            else if (this->comp.kind == -1)
-            {
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->proj.block(sel[i],0,1,nchan);
+void FiffRawData::update_mult(const RowVectorXi& sel) const
+{
+    const bool compAvailable = this->comp.kind != -1;
+
+    if (m_bMultValid
+        && m_iMultCompKind == this->comp.kind
+        && equal_matrices(m_vecMultSel, sel)
+        && equal_matrices(m_vecMultCals, this->cals)
+        && equal_matrices(m_matMultProj, this->proj)
+        && (!compAvailable || equal_matrices(m_matMultComp, this->comp.data->data)))
+        return;
 
-                mult_full = selVect*cal;
-            }
-            else
-            {
-                qDebug() << "This has to be debugged! #3";
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->proj.block(sel[i],0,1,nchan);
+    const qint32 nchan = this->info.nchan;
+    const qint32 nrow = sel.size() > 0 ? sel.size() : nchan;
+    qint32 i;
 
-                mult_full = selVect*this->comp.data->data*cal;
-            }
-        }
+    //
+    //   Calibration restricted to the selection
+    //
+    typedef Eigen::Triplet<double> T;
+    std::vector<T> tripletList;
+    tripletList.reserve(nrow);
+    for (i = 0; i < nrow; ++i) {
+        const qint32 ch = sel.size() > 0 ? sel[i] : i;
+        tripletList.push_back(T(i, i, this->cals[ch]));
     }
+    m_matCal = SparseMatrix<double>(nrow, nrow);
+    m_matCal.setFromTriplets(tripletList.begin(), tripletList.end());
 
     //
-    // Make mult sparse
+    //   Selected rows of proj * comp * cal. Picking the rows first keeps the products small.
     //
-    tripletList.clear();
-    tripletList.reserve(mult_full.rows()*mult_full.cols());
-    for(i = 0; i < mult_full.rows(); ++i)
-        for(k = 0; k < mult_full.cols(); ++k)
-            if(mult_full(i,k) != 0)
-                tripletList.push_back(T(i, k, mult_full(i,k)));
-
-    SparseMatrix<double> mult(mult_full.rows(),mult_full.cols());
-    if(tripletList.size() > 0)
-        mult.setFromTriplets(tripletList.begin(), tripletList.end());
-//    mult.makeCompressed();
+    m_matMult = SparseMatrix<double>();
+    m_matMultDense = MatrixXd();
 
-    FiffStream::SPtr fid;
-    if (!this->file->device()->isOpen())
+    if (this->proj.size() > 0 || compAvailable)
     {
-        if (!this->file->device()->open(QIODevice::ReadOnly))
-        {
-            printf("Cannot open file %s",this->info.filename.toUtf8().constData());
+        const MatrixXd& matFirst = this->proj.size() > 0 ? this->proj : this->comp.data->data;
+        MatrixXd matSel;
+        if (sel.size() > 0) {
+            matSel.resize(nrow, matFirst.cols());
+            for (i = 0; i < nrow; ++i)
+                matSel.row(i) = matFirst.row(sel[i]);
+        } else {
+            matSel = matFirst;
         }
-        fid = this->file;
-    }
-    else
-    {
-        fid = this->file;
-    }
 
-    MatrixXd one, newData, tmp_data;
-    FiffRawDir thisRawDir;
-    FiffTag::SPtr t_pTag;
-    fiff_int_t first_pick, last_pick, picksamp;
-    for(k = 0; k < this->rawdir.size(); ++k)
-    {
-        thisRawDir = this->rawdir[k];
-        //
-        //  Do we need this buffer
-        //
-        if (thisRawDir.last > from)
-        {
-            if (thisRawDir.ent->kind == -1)
-            {
-                //
-                //  Take the easy route: skip is translated to zeros
-                //
-                if(do_debug)
-                    printf("S");
-                if (sel.cols() <= 0)
-                    one.resize(nchan,thisRawDir.nsamp);
-                else
-                    one.resize(sel.cols(),thisRawDir.nsamp);
-
-                one.setZero();
-            }
-            else
-            {
-                fid->read_tag(t_pTag, thisRawDir.ent->pos);
-                //
-                //   Depending on the state of the projection and selection
-                //   we proceed a little bit differently
-                //
-                if (mult.cols() == 0)
-                {
-                    if (sel.cols() == 0)
-                    {
-                        if (t_pTag->type == FIFFT_DAU_PACK16)
-                            one = cal*(Map< MatrixDau16 >( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else if(t_pTag->type == FIFFT_INT)
-                            one = cal*(Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else if(t_pTag->type == FIFFT_FLOAT)
-                            one = cal*(Map< MatrixXf >( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else if(t_pTag->type == FIFFT_SHORT)
-                            one = cal*(Map< MatrixShort >( t_pTag->toShort(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else
-                            printf("Data Storage Format not known yet [1]!! Type: %d\n", t_pTag->type);
-                    }
-                    else
-                    {
-                        //ToDo find a faster solution for this!! --> make cal and mul sparse like in MATLAB
-                        newData.resize(sel.cols(), thisRawDir.nsamp); //ToDo this can be done much faster, without newData
-
-                        if (t_pTag->type == FIFFT_DAU_PACK16)
-                        {
-                            tmp_data = (Map< MatrixDau16 > ( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else if(t_pTag->type == FIFFT_INT)
-                        {
-                            tmp_data = (Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else if(t_pTag->type == FIFFT_FLOAT)
-                        {
-                            tmp_data = (Map< MatrixXf > ( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else if(t_pTag->type == FIFFT_SHORT)
-                        {
-                            tmp_data = (Map< MatrixShort > ( t_pTag->toShort(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else
-                        {
-                            printf("Data Storage Format not known yet [2]!! Type: %d\n", t_pTag->type);
-                        }
-
-                        one = cal*newData;
-                    }
-                }
-                else
-                {
-                    if (t_pTag->type == FIFFT_DAU_PACK16)
-                        one = mult*(Map< MatrixDau16 >( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else if(t_pTag->type == FIFFT_INT)
-                        one = mult*(Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else if(t_pTag->type == FIFFT_FLOAT)
-                        one = mult*(Map< MatrixXf >( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else
-                        printf("Data Storage Format not known yet [3]!! Type: %d\n", t_pTag->type);
-                }
-            }
-            //
-            //  The picking logic is a bit complicated
-            //
-            if (to >= thisRawDir.last && from <= thisRawDir.first)
-            {
-                //
-                //  We need the whole buffer
-                //
-                first_pick = 0;//1;
-                last_pick  = thisRawDir.nsamp - 1;
-                if (do_debug)
-                    printf("W");
-            }
-            else if (from > thisRawDir.first)
-            {
-                first_pick = from - thisRawDir.first;// + 1;
-                if(to < thisRawDir.last)
-                {
-                    //
-                    //  Something from the middle
-                    //
-//                    qDebug() << "This needs to be debugged!";
-                    last_pick = thisRawDir.nsamp + to - thisRawDir.last - 1;//is this alright?
-                    if (do_debug)
-                        printf("M");
-                }
-                else
-                {
-                    //
-                    //  From the middle to the end
-                    //
-                    last_pick = thisRawDir.nsamp - 1;
-                    if (do_debug)
-                        printf("E");
-                }
-            }
-            else
-            {
-                //
-                //  From the beginning to the middle
-                //
-                first_pick = 0;//1;
-                last_pick  = to - thisRawDir.first;// + 1;
-                if (do_debug)
-                    printf("B");
-            }
-            //
-            //  Now we are ready to pick
-            //
-            picksamp = last_pick - first_pick + 1;
+        if (this->proj.size() > 0 && compAvailable)
+            matSel = matSel * this->comp.data->data;
 
-            if(do_debug)
-            {
-                qDebug() << "first_pick: " << first_pick;
-                qDebug() << "last_pick: " << last_pick;
-                qDebug() << "picksamp: " << picksamp;
-            }
+        matSel = matSel * this->cals.asDiagonal();
 
-            if (picksamp > 0)
-            {
-//                    for(r = 0; r < data->rows(); ++r)
-//                        for(c = 0; c < picksamp; ++c)
-//                            (*data)(r,dest + c) = one(r,first_pick + c);
-                data.block(0,dest,data.rows(),picksamp) = one.block(0, first_pick, data.rows(), picksamp);
+        m_matMult = matSel.sparseView();
+        m_matMult.makeCompressed();
 
-                dest += picksamp;
-            }
-        }
         //
-        //  Done?
+        //   SSP operators are mostly non-zero, a dense product is considerably faster in this case
         //
-        if (thisRawDir.last >= to)
-        {
-            printf(" [done]\n");
-            break;
-        }
-    }
-
-    if (!this->file->device()->isOpen()) {
-        this->file->device()->close();
+        if (m_matMult.nonZeros() > 0.25 * (double)m_matMult.rows() * (double)m_matMult.cols())
+            m_matMultDense = matSel;
     }
-
-    times = MatrixXd(1, to-from+1);
-
-    for (i = 0; i < times.cols(); ++i)
-        times(0, i) = ((float)(from+i)) / this->info.sfreq;
-
-    return true;
+    m_matMultFloat = m_matMult.cast<float>();
+    m_matMultDenseFloat = m_matMultDense.cast<float>();
+
+    m_matMultProj = this->proj;
+    m_matMultComp = compAvailable ? this->comp.data->data : MatrixXd();
+    m_iMultCompKind = this->comp.kind;
+    m_vecMultCals = this->cals;
+    m_vecMultSel = sel;
+    m_bMultValid = true;
+    ++m_iMultVersion;
 }
 
 //=============================================================================================================
 
-bool FiffRawData::read_raw_segment(MatrixXd& data,
-                                   MatrixXd& times,
-                                   SparseMatrix<double>& multSegment,
-                                   fiff_int_t from,
-                                   fiff_int_t to,
-                                   const RowVectorXi& sel,
-                                   bool do_debug) const
+template<typename Scalar>
+bool FiffRawData::read_raw_segment_impl(Matrix<Scalar, Dynamic, Dynamic>& data,
+                                        MatrixXd& times,
+                                        SparseMatrix<double>* pMultSegment,
+                                        fiff_int_t from,
+                                        fiff_int_t to,
+                                        const RowVectorXi& sel,
+                                        bool do_calibrate,
+                                        bool do_debug) const
 {
-    bool projAvailable = true;
-
-    if (this->proj.size() == 0) {
-        //qInfo() << "FiffRawData::read_raw_segment - No projectors setup. Consider calling MNE::setup_compensators.";
-        projAvailable = false;
-    }
+    typedef Matrix<Scalar, Dynamic, Dynamic> MatrixScalar;
 
     if(from == -1)
         from = this->first_samp;
@@ -487,7 +487,7 @@ bool FiffRawData::read_raw_segment(MatrixXd& data,
     //
     if(from > to)
     {
-        printf("No data in this range\n");
+        printf("No data in this range %d ... %d  =  %9.3f ... %9.3f secs...", from, to, ((float)from)/this->info.sfreq, ((float)to)/this->info.sfreq);
         return false;
     }
     //printf("Reading %d ... %d  =  %9.3f ... %9.3f secs...", from, to, ((float)from)/this->info.sfreq, ((float)to)/this->info.sfreq);
@@ -496,95 +496,16 @@ bool FiffRawData::read_raw_segment(MatrixXd& data,
     //
     qint32 nchan = this->info.nchan;
     qint32 dest  = 0;//1;
-    qint32 i, k, r;
+    qint32 i, k;
 
-    typedef Eigen::Triplet<double> T;
-    std::vector<T> tripletList;
-    tripletList.reserve(nchan);
-    for(i = 0; i < nchan; ++i)
-        tripletList.push_back(T(i, i, this->cals[i]));
-
-    SparseMatrix<double> cal(nchan, nchan);
-    cal.setFromTriplets(tripletList.begin(), tripletList.end());
-//    cal.makeCompressed();
+    data = MatrixScalar(sel.size() == 0 ? nchan : sel.size(), to-from+1);
 
-    MatrixXd mult_full;
     //
-    if (sel.size() == 0)
-    {
-        data = MatrixXd(nchan, to-from+1);
-//            data->setZero();
-        if (projAvailable || this->comp.kind != -1)
-        {
-            if (!projAvailable)
-                mult_full = this->comp.data->data*cal;
-            else if (this->comp.kind == -1)
-                mult_full = this->proj*cal;
-            else
-                mult_full = this->proj*this->comp.data->data*cal;
-        }
-    }
-    else
-    {
-        data = MatrixXd(sel.size(),to-from+1);
-//            data->setZero();
-
-        MatrixXd selVect(sel.size(), nchan);
-
-        selVect.setZero();
-
-        if (!projAvailable && this->comp.kind == -1)
-        {
-            tripletList.clear();
-            tripletList.reserve(sel.size());
-            for(i = 0; i < sel.size(); ++i)
-                tripletList.push_back(T(i, i, this->cals[sel[i]]));
-            cal = SparseMatrix<double>(sel.size(), sel.size());
-            cal.setFromTriplets(tripletList.begin(), tripletList.end());
-        }
-        else
-        {
-            if (!projAvailable)
-            {
-                qDebug() << "This has to be debugged! #1";
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->comp.data->data.block(sel[i],0,1,nchan);
-                mult_full = selVect*cal;
-            }
-            else if (this->comp.kind == -1)
-            {
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->proj.block(sel[i],0,1,nchan);
-
-                mult_full = selVect*cal;
-            }
-            else
-            {
-                qDebug() << "This has to be debugged! #3";
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->proj.block(sel[i],0,1,nchan);
-
-                mult_full = selVect*this->comp.data->data*cal;
-            }
-        }
-    }
-
-    //
-    // Make mult sparse
-    //
-    tripletList.clear();
-    tripletList.reserve(mult_full.rows()*mult_full.cols());
-    for(i = 0; i < mult_full.rows(); ++i)
-        for(k = 0; k < mult_full.cols(); ++k)
-            if(mult_full(i,k) != 0)
-                tripletList.push_back(T(i, k, mult_full(i,k)));
-
-    SparseMatrix<double> mult(mult_full.rows(),mult_full.cols());
-    if(tripletList.size() > 0)
-        mult.setFromTriplets(tripletList.begin(), tripletList.end());
-//    mult.makeCompressed();
-
+    //   The multiplication matrix is only rebuilt if proj, comp, cals or the selection changed since the last read
     //
+    if (do_calibrate)
+        update_mult(sel);
+    const bool bApplyMult = do_calibrate && this->m_matMult.cols() > 0;
 
     FiffStream::SPtr fid;
     if (!this->file->device()->isOpen())
@@ -600,107 +521,48 @@ bool FiffRawData::read_raw_segment(MatrixXd& data,
         fid = this->file;
     }
 
-    MatrixXd one;
+    //
+    //   Map the whole file once, the buffers are decoded straight from the mapped pages. Devices which cannot be
+    //   mapped (sockets, buffers, ...) fall back to reading every buffer into one reused byte array.
+    //
+    QFile* pFile = qobject_cast<QFile*>(fid->device());
+    uchar* pMapped = Q_NULLPTR;
+    qint64 iMappedSize = 0;
+    if(pFile) {
+        iMappedSize = pFile->size();
+        pMapped = pFile->map(0, iMappedSize);
+    }
+    QByteArray bufferData;
+    bool bBigEndian = fid->byteOrder() == QDataStream::BigEndian;
+
+    //
+    //   Calibration factors and multiplication matrix in the output precision. Scratch for the compensated /
+    //   projected case, sized once for the largest buffer
+    //
+    Matrix<Scalar, 1, Dynamic> vecCals;
+    if(do_calibrate)
+        vecCals = this->cals.cast<Scalar>();
+
+    const SparseMatrix<Scalar>& multScalar = this->mult((const Scalar*)Q_NULLPTR);
+    const MatrixScalar& multDenseScalar = this->multDense((const Scalar*)Q_NULLPTR);
+    MatrixScalar matRaw;
+    if(bApplyMult) {
+        qint32 iMaxSamp = 0;
+        for(k = 0; k < this->rawdir.size(); ++k)
+            iMaxSamp = std::max(iMaxSamp, this->rawdir[k].nsamp);
+        matRaw.resize(nchan, iMaxSamp);
+    }
+
+    bool bSuccess = true;
     fiff_int_t first_pick, last_pick, picksamp;
     for(k = 0; k < this->rawdir.size(); ++k)
     {
-        FiffRawDir thisRawDir = this->rawdir[k];
+        const FiffRawDir& thisRawDir = this->rawdir[k];
         //
         //  Do we need this buffer
         //
         if (thisRawDir.last > from)
         {
-            if (thisRawDir.ent->kind == -1)
-            {
-                //
-                //  Take the easy route: skip is translated to zeros
-                //
-                if(do_debug)
-                    printf("S");
-                if (sel.cols() <= 0)
-                    one.resize(nchan,thisRawDir.nsamp);
-                else
-                    one.resize(sel.cols(),thisRawDir.nsamp);
-
-                one.setZero();
-            }
-            else
-            {
-                FiffTag::SPtr t_pTag;
-                fid->read_tag(t_pTag, thisRawDir.ent->pos);
-                //
-                //   Depending on the state of the projection and selection
-                //   we proceed a little bit differently
-                //
-                if (mult.cols() == 0)
-                {
-                    if (sel.cols() == 0)
-                    {
-                        if (t_pTag->type == FIFFT_DAU_PACK16)
-                            one = cal*(Map< MatrixDau16 >( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else if(t_pTag->type == FIFFT_INT)
-                            one = cal*(Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else if(t_pTag->type == FIFFT_FLOAT)
-                            one = cal*(Map< MatrixXf >( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else if(t_pTag->type == FIFFT_SHORT)
-                            one = cal*(Map< MatrixShort >( t_pTag->toShort(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else
-                            printf("Data Storage Format not known yet [1]!! Type: %d\n", t_pTag->type);
-                    }
-                    else
-                    {
-
-                        //ToDo find a faster solution for this!! --> make cal and mul sparse like in MATLAB
-                        MatrixXd newData(sel.cols(), thisRawDir.nsamp); //ToDo this can be done much faster, without newData
-
-                        if (t_pTag->type == FIFFT_DAU_PACK16)
-                        {
-                            MatrixXd tmp_data = (Map< MatrixDau16 > ( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else if(t_pTag->type == FIFFT_INT)
-                        {
-                            MatrixXd tmp_data = (Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else if(t_pTag->type == FIFFT_FLOAT)
-                        {
-                            MatrixXd tmp_data = (Map< MatrixXf > ( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else if(t_pTag->type == FIFFT_SHORT)
-                        {
-                            MatrixXd tmp_data = (Map< MatrixShort > ( t_pTag->toShort(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else
-                        {
-                            printf("Data Storage Format not known yet [2]!! Type: %d\n", t_pTag->type);
-                        }
-
-                        one = cal*newData;
-                    }
-                }
-                else
-                {
-                    if (t_pTag->type == FIFFT_DAU_PACK16)
-                        one = mult*(Map< MatrixDau16 >( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else if(t_pTag->type == FIFFT_INT)
-                        one = mult*(Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else if(t_pTag->type == FIFFT_FLOAT)
-                        one = mult*(Map< MatrixXf >( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else
-                        printf("Data Storage Format not known yet [3]!! Type: %d\n", t_pTag->type);
-                }
-            }
             //
             //  The picking logic is a bit complicated
             //
@@ -722,7 +584,6 @@ bool FiffRawData::read_raw_segment(MatrixXd& data,
                     //
                     //  Something from the middle
                     //
-//                    qDebug() << "This needs to be debugged!";
                     last_pick = thisRawDir.nsamp + to - thisRawDir.last - 1;//is this alright?
                     if (do_debug)
                         printf("M");
@@ -761,10 +622,95 @@ bool FiffRawData::read_raw_segment(MatrixXd& data,
 
             if (picksamp > 0)
             {
-//                    for(r = 0; r < data->rows(); ++r)
-//                        for(c = 0; c < picksamp; ++c)
-//                            (*data)(r,dest + c) = one(r,first_pick + c);
-                data.block(0,dest,data.rows(),picksamp) = one.block(0, first_pick, data.rows(), picksamp);
+                if (!thisRawDir.ent || thisRawDir.ent->kind == -1)
+                {
+                    //
+                    //  Take the easy route: skip is translated to zeros
+                    //
+                    if(do_debug)
+                        printf("S");
+                    data.block(0,dest,data.rows(),picksamp).setZero();
+                }
+                else
+                {
+                    //
+                    //  Locate the buffer payload
+                    //
+                    const char* pBuffer = Q_NULLPTR;
+                    fiff_long_t payloadPos = (fiff_long_t)thisRawDir.ent->pos + FIFFC_DATA_OFFSET;
+
+                    if (pMapped)
+                    {
+                        if (payloadPos + thisRawDir.ent->size > iMappedSize)
+                        {
+                            printf("Raw data buffer %d exceeds the file size\n", k);
+                            bSuccess = false;
+                            break;
+                        }
+                        pBuffer = reinterpret_cast<const char*>(pMapped) + payloadPos;
+                    }
+                    else
+                    {
+                        bufferData.resize(thisRawDir.ent->size);
+                        fid->device()->seek(payloadPos);
+                        if (fid->readRawData(bufferData.data(), thisRawDir.ent->size) != thisRawDir.ent->size)
+                        {
+                            printf("Could not read raw data buffer %d\n", k);
+                            bSuccess = false;
+                            break;
+                        }
+                        pBuffer = bufferData.constData();
+                    }
+
+                    //
+                    //   Depending on the state of the projection and selection
+                    //   we proceed a little bit differently
+                    //
+                    if (!bApplyMult)
+                    {
+                        //
+                        //   Calibrate the picked channels on the fly, straight into the output
+                        //
+                        if (!decode_raw_buffer(thisRawDir.ent->type,
+                                               pBuffer,
+                                               bBigEndian,
+                                               nchan,
+                                               first_pick,
+                                               picksamp,
+                                               sel,
+                                               do_calibrate ? vecCals.data() : Q_NULLPTR,
+                                               data.data() + (qint64)dest*data.rows()))
+                        {
+                            printf("Data Storage Format not known yet [1]!! Type: %d\n", thisRawDir.ent->type);
+                            bSuccess = false;
+                            break;
+                        }
+                    }
+                    else
+                    {
+                        //
+                        //   Decode all channels of the picked samples and apply the multiplication matrix
+                        //
+                        if (!decode_raw_buffer(thisRawDir.ent->type,
+                                               pBuffer,
+                                               bBigEndian,
+                                               nchan,
+                                               first_pick,
+                                               picksamp,
+                                               defaultRowVectorXi,
+                                               (const Scalar*)Q_NULLPTR,
+                                               matRaw.data()))
+                        {
+                            printf("Data Storage Format not known yet [3]!! Type: %d\n", thisRawDir.ent->type);
+                            bSuccess = false;
+                            break;
+                        }
+                        if (multDenseScalar.size() > 0)
+                            data.block(0,dest,data.rows(),picksamp).noalias() = multDenseScalar * matRaw.leftCols(picksamp);
+                        else
+                            data.block(0,dest,data.rows(),picksamp).noalias() = multScalar * matRaw.leftCols(picksamp);
+                    }
+                }
 
                 dest += picksamp;
             }
@@ -779,10 +725,20 @@ bool FiffRawData::read_raw_segment(MatrixXd& data,
         }
     }
 
-    if(mult.cols()==0)
-        multSegment = cal;
-    else
-        multSegment = mult;
+    if (pMapped)
+        pFile->unmap(pMapped);
+
+    if(!bSuccess)
+        return false;
+
+    if (pMultSegment) {
+        if (!do_calibrate)
+            pMultSegment->resize(0, 0);
+        else if (bApplyMult)
+            *pMultSegment = this->m_matMult;
+        else
+            *pMultSegment = this->m_matCal;
+    }
 
     if (!this->file->device()->isOpen()) {
         this->file->device()->close();
@@ -172,6 +172,48 @@ public:
                           const Eigen::RowVectorXi& sel = defaultRowVectorXi,
                           bool do_debug = false) const;
 
+    //=========================================================================================================
+    /**
+     * Read a specific raw data segment in single precision. Calibration, compensation and projection are applied
+     * in single precision, which halves the memory needed for long segments.
+     *
+     * @param[out] data      returns the data matrix (channels x samples)
+     * @param[out] times     returns the time values corresponding to the samples
+     * @param[in] from       first sample to include. If omitted, defaults to the first sample in data (optional)
+     * @param[in] to         last sample to include. If omitted, defaults to the last sample in data (optional)
+     * @param[in] sel        channel selection vector (optional)
+     *
+     * @return true if succeeded, false otherwise
+     */
+    bool read_raw_segment(Eigen::MatrixXf& data,
+                          Eigen::MatrixXd& times,
+                          fiff_int_t from = -1,
+                          fiff_int_t to = -1,
+                          const Eigen::RowVectorXi& sel = defaultRowVectorXi,
+                          bool do_debug = false) const;
+
+    //=========================================================================================================
+    /**
+     * Read a specific raw data segment as stored in the file, i.e. as uncalibrated 16 bit integers. The calibrated
+     * data are dataCals.asDiagonal() * data. Only possible for files with 16 bit integer buffers and if no
+     * projectors or compensators are set up.
+     *
+     * @param[out] data      returns the uncalibrated data matrix (channels x samples)
+     * @param[out] dataCals  returns the calibration factors of the rows of data
+     * @param[out] times     returns the time values corresponding to the samples
+     * @param[in] from       first sample to include. If omitted, defaults to the first sample in data (optional)
+     * @param[in] to         last sample to include. If omitted, defaults to the last sample in data (optional)
+     * @param[in] sel        channel selection vector (optional)
+     *
+     * @return true if succeeded, false otherwise
+     */
+    bool read_raw_segment(MatrixDau16& data,
+                          Eigen::RowVectorXd& dataCals,
+                          Eigen::MatrixXd& times,
+                          fiff_int_t from = -1,
+                          fiff_int_t to = -1,
+                          const Eigen::RowVectorXi& sel = defaultRowVectorXi) const;
+
     //=========================================================================================================
     /**
      * ### MNE toolbox root function ###: Definition of the fiff_read_raw_segment function
@@ -192,6 +234,69 @@ public:
                                 float to,
                                 const Eigen::RowVectorXi& sel = defaultRowVectorXi) const;
 
+    //=========================================================================================================
+    /**
+     * Returns the version of the cached multiplication matrix (calibration, compensator and projector restricted
+     * to the channel selection). The version is incremented every time the matrix has to be rebuilt because proj,
+     * comp, cals or the channel selection changed between two reads.
+     *
+     * @return the version of the cached multiplication matrix
+     */
+    inline qint32 multVersion() const
+    {
+        return m_iMultVersion;
+    }
+
+private:
+    //=========================================================================================================
+    /**
+     * Rebuilds the cached multiplication matrix for the given channel selection, if proj, comp, cals or the
+     * selection differ from the ones the cached matrix was built for. Not thread safe, concurrent readers have to
+     * use their own copy of the raw data.
+     *
+     * @param[in] sel    channel selection vector
+     */
+    void update_mult(const Eigen::RowVectorXi& sel) const;
+
+    //=========================================================================================================
+    /**
+     * Returns the cached multiplication matrices in the precision given by the type of the (unused) pointer.
+     * Stored integers are never multiplied, other precisions get empty matrices.
+     */
+    const Eigen::SparseMatrix<double>& mult(const double*) const { return m_matMult; }
+    const Eigen::SparseMatrix<float>& mult(const float*) const { return m_matMultFloat; }
+    const Eigen::MatrixXd& multDense(const double*) const { return m_matMultDense; }
+    const Eigen::MatrixXf& multDense(const float*) const { return m_matMultDenseFloat; }
+    template<typename Scalar>
+    const Eigen::SparseMatrix<Scalar>& mult(const Scalar*) const { static const Eigen::SparseMatrix<Scalar> empty; return empty; }
+    template<typename Scalar>
+    const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& multDense(const Scalar*) const { static const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> empty; return empty; }
+
+    //=========================================================================================================
+    /**
+     * Reads a raw data segment into a matrix of the given precision. Implements all read_raw_segment variants.
+     *
+     * @param[out] data          returns the data matrix (channels x samples)
+     * @param[out] times         returns the time values corresponding to the samples
+     * @param[out] pMultSegment  returns the used multiplication matrix (compensator,projection,calibration) if set
+     * @param[in] from           first sample to include
+     * @param[in] to             last sample to include
+     * @param[in] sel            channel selection vector
+     * @param[in] do_calibrate   whether to apply the calibration factors
+     * @param[in] do_debug       whether to print debug information
+     *
+     * @return true if succeeded, false otherwise
+     */
+    template<typename Scalar>
+    bool read_raw_segment_impl(Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>& data,
+                               Eigen::MatrixXd& times,
+                               Eigen::SparseMatrix<double>* pMultSegment,
+                               fiff_int_t from,
+                               fiff_int_t to,
+                               const Eigen::RowVectorXi& sel,
+                               bool do_calibrate,
+                               bool do_debug) const;
+
 public:
     FiffStream::SPtr file;      /**< replaces fid */
     FiffInfo info;              /**< Fiff measurement information */
@@ -202,6 +307,19 @@ public:
     Eigen::MatrixXd proj;       /**< SSP operator to apply to the data. */
     FiffCtfComp comp;           /**< Compensator. */
 
+private:
+    mutable bool m_bMultValid;                          /**< Whether the cached multiplication matrix is valid. */
+    mutable qint32 m_iMultVersion;                      /**< Version of the cached multiplication matrix. */
+    mutable Eigen::SparseMatrix<double> m_matCal;       /**< Cached calibration matrix restricted to the selection. */
+    mutable Eigen::SparseMatrix<double> m_matMult;      /**< Cached multiplication matrix, empty if only calibration is applied. */
+    mutable Eigen::MatrixXd m_matMultDense;             /**< Dense copy of m_matMult, set if m_matMult is mostly non-zero. */
+    mutable Eigen::SparseMatrix<float> m_matMultFloat;  /**< Single precision copy of m_matMult. */
+    mutable Eigen::MatrixXf m_matMultDenseFloat;        /**< Single precision copy of m_matMultDense. */
+    mutable Eigen::MatrixXd m_matMultProj;              /**< Projector m_matMult was built for. */
+    mutable Eigen::MatrixXd m_matMultComp;              /**< Compensator data m_matMult was built for. */
+    mutable fiff_int_t m_iMultCompKind;                 /**< Compensator kind m_matMult was built for. */
+    mutable Eigen::RowVectorXd m_vecMultCals;           /**< Calibration factors m_matMult was built for. */
+    mutable Eigen::RowVectorXi m_vecMultSel;            /**< Channel selection m_matMult was built for. */
 
 };
 } // NAMESPACE
@@ -0,0 +1,652 @@
+//=============================================================================================================
+/**
+ * @file     fiff_raw_stream_writer.cpp
+ * @author   Lorenz Esch <lesch@mgh.harvard.edu>
+ * @version  dev
+ * @date     April, 2020
+ *
+ * @section  LICENSE
+ *
+ * Copyright (C) 2020, Lorenz Esch. All rights reserved.
+ *
+ * the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+ *       following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ *       the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *     * Neither the name of MNE-CPP authors nor the names of its contributors may be used
+ *       to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @brief    FiffRawStreamWriter class definition.
+ *
+ */
+
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_raw_stream_writer.h"
+#include "fiff_stream.h"
+#include "fiff_tag.h"
+
+#include <cstring>
+#include <limits>
+
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QFile>
+#include <QByteArray>
+#include <QFileInfo>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <QDebug>
+
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+using namespace Eigen;
+
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+/**
+ * Space kept free at the end of every file for the reference to the next file and the closing tags.
+ */
+static const qint64 s_iSplitReserve = 64 * 1024;
+
+/**
+ * File system block size, the I/O thread writes whole blocks at block aligned file offsets.
+ */
+static const qint64 s_iBlockSize = 4096;
+
+/**
+ * Space kept free at the end of every staging buffer for the padding tag.
+ */
+static const qint64 s_iPadReserve = s_iBlockSize + FIFFC_DATA_OFFSET;
+
+//=============================================================================================================
+// DEFINE NAMESPACE FIFFLIB
+//=============================================================================================================
+
+namespace FIFFLIB
+{
+
+//=============================================================================================================
+/**
+ * The I/O thread of a FiffRawStreamWriter.
+ */
+class FiffRawStreamWriterThread : public QThread
+{
+public:
+    FiffRawStreamWriterThread(FiffRawStreamWriter* pWriter)
+    : m_pWriter(pWriter)
+    {
+    }
+
+protected:
+    void run() override
+    {
+        m_pWriter->run();
+    }
+
+private:
+    FiffRawStreamWriter*    m_pWriter;  /**< The writer the thread works for. */
+};
+
+} // NAMESPACE
+
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+FiffRawStreamWriter::StagingBuffer::StagingBuffer()
+: pData(Q_NULLPTR)
+, iCapacity(0)
+, iUsed(0)
+, iSamples(0)
+{
+}
+
+//=============================================================================================================
+
+FiffRawStreamWriter::StagingBuffer::~StagingBuffer()
+{
+    qFreeAligned(pData);
+}
+
+//=============================================================================================================
+
+void FiffRawStreamWriter::StagingBuffer::reserve(qint64 iMinCapacity)
+{
+    if(iMinCapacity <= iCapacity) {
+        return;
+    }
+
+    qFreeAligned(pData);
+    iCapacity = (iMinCapacity + s_iBlockSize - 1) / s_iBlockSize * s_iBlockSize;
+    pData = static_cast<char*>(qMallocAligned(iCapacity, s_iBlockSize));
+    Q_CHECK_PTR(pData);
+}
+
+//=============================================================================================================
+
+FiffRawStreamWriter::FiffRawStreamWriter(const QString& sFileName,
+                                         const FiffInfo& info,
+                                         fiff_int_t iDataType,
+                                         fiff_int_t iFirstSample,
+                                         qint64 iMaxFileSize,
+                                         qint64 iStagingSize,
+                                         qint32 iMaxStagingBuffers)
+: m_sFileName(sFileName)
+, m_info(info)
+, m_iDataType(iDataType)
+, m_iFirstSample(iFirstSample)
+, m_iMaxFileSize(iMaxFileSize)
+, m_iStagingSize(iStagingSize)
+, m_iMaxStagingBuffers(qMax(2, iMaxStagingBuffers))
+, m_bRunning(false)
+, m_bFinish(false)
+, m_bError(false)
+, m_iFlushMsSum(0)
+, m_iSamplesWritten(0)
+, m_iSamplesInFile(0)
+{
+    memset(&m_statistics, 0, sizeof(Statistics));
+}
+
+//=============================================================================================================
+
+FiffRawStreamWriter::~FiffRawStreamWriter()
+{
+    if(m_bRunning) {
+        finish();
+    }
+}
+
+//=============================================================================================================
+
+bool FiffRawStreamWriter::start()
+{
+    if(m_bRunning) {
+        qWarning() << "[FiffRawStreamWriter::start] The writer is already running.";
+        return false;
+    }
+
+    if(m_iDataType != FIFFT_FLOAT && m_iDataType != FIFFT_DAU_PACK16) {
+        qWarning() << "[FiffRawStreamWriter::start] Data type" << m_iDataType << "is not supported.";
+        return false;
+    }
+
+    memset(&m_statistics, 0, sizeof(Statistics));
+    m_iFlushMsSum = 0;
+    m_iSamplesWritten = 0;
+    m_lFileNames.clear();
+    m_lQueued.clear();
+    m_lFree.clear();
+    m_bFinish = false;
+    m_bError = false;
+
+    if(!openFile(m_sFileName)) {
+        return false;
+    }
+
+    //
+    //   Floats are written with the range reset to 1.0, 16 bit integers keep the range
+    //
+    m_vecCals.resize(m_info.nchan);
+    for(qint32 k = 0; k < m_info.nchan; ++k) {
+        m_vecCals[k] = m_info.chs[k].cal;
+        if(m_iDataType == FIFFT_DAU_PACK16) {
+            m_vecCals[k] *= m_info.chs[k].range;
+        }
+    }
+
+    //
+    //   Double buffering, further staging buffers are allocated on demand
+    //
+    for(qint32 i = 0; i < 2; ++i) {
+        StagingBufferSPtr pBuffer(new StagingBuffer);
+        pBuffer->reserve(m_iStagingSize);
+        m_lFree.append(pBuffer);
+    }
+    m_pCurrent = m_lFree.takeFirst();
+    m_statistics.iStagingBuffers = 2;
+
+    m_bRunning = true;
+    m_pThread = QSharedPointer<FiffRawStreamWriterThread>(new FiffRawStreamWriterThread(this));
+    m_pThread->start();
+
+    return true;
+}
+
+//=============================================================================================================
+
+bool FiffRawStreamWriter::write_raw_buffer(const MatrixXd& buf,
+                                           const RowVectorXd& cals)
+{
+    if (buf.rows() != cals.cols()) {
+        qWarning("buffer and calibration sizes do not match\n");
+        return false;
+    }
+
+    return stageBuffer(buf, &cals);
+}
+
+//=============================================================================================================
+
+bool FiffRawStreamWriter::write_raw_buffer(const MatrixXd& buf)
+{
+    return stageBuffer(buf, Q_NULLPTR);
+}
+
+//=============================================================================================================
+
+bool FiffRawStreamWriter::finish()
+{
+    if(!m_bRunning) {
+        return false;
+    }
+
+    m_mutex.lock();
+    if(m_pCurrent->iUsed > 0) {
+        m_lQueued.append(m_pCurrent);
+    }
+    m_pCurrent.clear();
+    m_bFinish = true;
+    m_bufferQueued.wakeAll();
+    m_mutex.unlock();
+
+    m_pThread->wait();
+    m_pThread.clear();
+    m_bRunning = false;
+
+    QMutexLocker locker(&m_mutex);
+    m_lFree.clear();
+
+    return !m_bError;
+}
+
+//=============================================================================================================
+
+bool FiffRawStreamWriter::isRunning() const
+{
+    return m_bRunning;
+}
+
+//=============================================================================================================
+
+QStringList FiffRawStreamWriter::fileNames() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_lFileNames;
+}
+
+//=============================================================================================================
+
+FiffRawStreamWriter::Statistics FiffRawStreamWriter::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    Statistics stats = m_statistics;
+    stats.dMeanFlushMs = stats.iFlushes > 0 ? (double)m_iFlushMsSum / stats.iFlushes : 0.0;
+    return stats;
+}
+
+//=============================================================================================================
+
+bool FiffRawStreamWriter::stageBuffer(const MatrixXd& buf,
+                                      const RowVectorXd* pCals)
+{
+    if(!m_bRunning) {
+        qWarning() << "[FiffRawStreamWriter::write_raw_buffer] The writer is not running.";
+        return false;
+    }
+
+    if(buf.rows() != m_vecCals.cols()) {
+        qWarning("buffer and channel sizes do not match\n");
+        return false;
+    }
+
+    m_mutex.lock();
+    bool bError = m_bError;
+    m_mutex.unlock();
+    if(bError) {
+        return false;
+    }
+
+    const qint64 iSampleSize = m_iDataType == FIFFT_DAU_PACK16 ? sizeof(qint16) : sizeof(float);
+    const qint64 iDataSize = buf.size() * iSampleSize;
+    const qint64 iTagSize = FIFFC_DATA_OFFSET + iDataSize;
+
+    if(iDataSize > std::numeric_limits<fiff_int_t>::max()) {
+        qWarning() << "[FiffRawStreamWriter::write_raw_buffer] The buffer is too large for a single tag.";
+        return false;
+    }
+
+    if(m_pCurrent->iUsed + iTagSize + s_iPadReserve > m_pCurrent->iCapacity) {
+        swapStagingBuffer(iTagSize + s_iPadReserve);
+    }
+
+    //
+    //   Tag header, big endian
+    //
+    uchar* pTag = reinterpret_cast<uchar*>(m_pCurrent->pData + m_pCurrent->iUsed);
+    qToBigEndian<qint32>(FIFF_DATA_BUFFER, pTag);
+    qToBigEndian<qint32>(m_iDataType, pTag + 4);
+    qToBigEndian<qint32>((qint32)iDataSize, pTag + 8);
+    qToBigEndian<qint32>(FIFFV_NEXT_SEQ, pTag + 12);
+
+    //
+    //   Samples in the on-disk type, then swapped to big endian
+    //
+    char* pData = reinterpret_cast<char*>(pTag + FIFFC_DATA_OFFSET);
+    if(pCals) {
+        m_vecScale = pCals->cwiseInverse();
+    }
+
+    if(m_iDataType == FIFFT_FLOAT) {
+        Map<MatrixXf> matOut(reinterpret_cast<float*>(pData), buf.rows(), buf.cols());
+        if(pCals) {
+            matOut = (m_vecScale.transpose().asDiagonal() * buf).cast<float>();
+        } else {
+            matOut = buf.cast<float>();
+        }
+    } else {
+        Map<Matrix<qint16, Dynamic, Dynamic> > matOut(reinterpret_cast<qint16*>(pData), buf.rows(), buf.cols());
+        if(pCals) {
+            matOut = (m_vecScale.transpose().asDiagonal() * buf).array().round().max(-32768.0).min(32767.0).cast<qint16>();
+        } else {
+            matOut = buf.array().round().max(-32768.0).min(32767.0).cast<qint16>();
+        }
+    }
+
+    if(Q_BYTE_ORDER == Q_LITTLE_ENDIAN) {
+        FiffTag::swap_bytes(pData, buf.size(), iSampleSize);
+    }
+
+    m_pCurrent->iUsed += iTagSize;
+    m_pCurrent->iSamples += buf.cols();
+
+    QMutexLocker locker(&m_mutex);
+    ++m_statistics.iBuffers;
+    m_statistics.iSamples += buf.cols();
+
+    return true;
+}
+
+//=============================================================================================================
+
+void FiffRawStreamWriter::swapStagingBuffer(qint64 iMinCapacity)
+{
+    //
+    //   A buffer which is larger than an empty staging buffer just grows it
+    //
+    if(m_pCurrent->iUsed == 0) {
+        m_pCurrent->reserve(qMax(m_iStagingSize, iMinCapacity));
+        return;
+    }
+
+    bool bAllocate = false;
+
+    m_mutex.lock();
+    m_lQueued.append(m_pCurrent);
+    m_statistics.iMaxQueued = qMax(m_statistics.iMaxQueued, m_lQueued.size());
+    m_pCurrent.clear();
+    m_bufferQueued.wakeAll();
+
+    if(m_lFree.isEmpty() && m_statistics.iStagingBuffers >= m_iMaxStagingBuffers && !m_bError) {
+        //
+        //   Back-pressure: all staging buffers are waiting for the disk
+        //
+        QElapsedTimer timer;
+        timer.start();
+        while(m_lFree.isEmpty() && !m_bError) {
+            m_bufferFreed.wait(&m_mutex);
+        }
+        ++m_statistics.iStalls;
+        m_statistics.iStallMs += timer.elapsed();
+    }
+
+    if(!m_lFree.isEmpty()) {
+        m_pCurrent = m_lFree.takeFirst();
+    } else {
+        bAllocate = true;
+        ++m_statistics.iStagingBuffers;
+    }
+    m_mutex.unlock();
+
+    if(bAllocate) {
+        m_pCurrent = StagingBufferSPtr(new StagingBuffer);
+    }
+
+    m_pCurrent->reserve(qMax(m_iStagingSize, iMinCapacity));
+    m_pCurrent->iUsed = 0;
+    m_pCurrent->iSamples = 0;
+}
+
+//=============================================================================================================
+
+void FiffRawStreamWriter::writePadding(char* pDest,
+                                       qint64 iPadSize)
+{
+    if(iPadSize <= 0) {
+        return;
+    }
+
+    uchar* pTag = reinterpret_cast<uchar*>(pDest);
+    qToBigEndian<qint32>(FIFF_NOP, pTag);
+    qToBigEndian<qint32>(FIFFT_VOID, pTag + 4);
+    qToBigEndian<qint32>((qint32)(iPadSize - FIFFC_DATA_OFFSET), pTag + 8);
+    qToBigEndian<qint32>(FIFFV_NEXT_SEQ, pTag + 12);
+    memset(pDest + FIFFC_DATA_OFFSET, 0, iPadSize - FIFFC_DATA_OFFSET);
+}
+
+//=============================================================================================================
+
+qint64 FiffRawStreamWriter::paddingSize(qint64 iPos)
+{
+    qint64 iPad = (s_iBlockSize - iPos % s_iBlockSize) % s_iBlockSize;
+
+    //
+    //   A gap smaller than a tag header is padded to the next but one block boundary
+    //
+    if(iPad > 0 && iPad < FIFFC_DATA_OFFSET) {
+        iPad += s_iBlockSize;
+    }
+
+    return iPad;
+}
+
+//=============================================================================================================
+
+void FiffRawStreamWriter::run()
+{
+    forever {
+        StagingBufferSPtr pBuffer;
+        bool bError;
+
+        m_mutex.lock();
+        while(m_lQueued.isEmpty() && !m_bFinish) {
+            m_bufferQueued.wait(&m_mutex);
+        }
+        if(!m_lQueued.isEmpty()) {
+            pBuffer = m_lQueued.takeFirst();
+        }
+        bError = m_bError;
+        m_mutex.unlock();
+
+        if(!pBuffer) {
+            break;
+        }
+
+        //
+        //   Buffers are still taken from the queue after an error so that write_raw_buffer() never blocks
+        //
+        QElapsedTimer timer;
+        timer.start();
+        bool bOk = !bError;
+
+        if(bOk && m_iSamplesInFile > 0 && m_pFile->pos() + pBuffer->iUsed + s_iSplitReserve > m_iMaxFileSize) {
+            bOk = splitFile();
+        }
+
+        if(bOk) {
+            //
+            //   Pad to whole blocks, the file offset is block aligned after the header and after every write
+            //
+            const qint64 iPad = paddingSize(m_pFile->pos() + pBuffer->iUsed);
+            writePadding(pBuffer->pData + pBuffer->iUsed, iPad);
+            pBuffer->iUsed += iPad;
+
+            bOk = m_pFile->write(pBuffer->pData, pBuffer->iUsed) == pBuffer->iUsed && m_pFile->flush();
+            if(bOk) {
+                m_iSamplesWritten += pBuffer->iSamples;
+                m_iSamplesInFile += pBuffer->iSamples;
+            }
+        }
+        qint64 iFlushMs = timer.elapsed();
+
+        if(!bOk && !bError) {
+            qWarning() << "[FiffRawStreamWriter::run] Could not write to" << (m_pFile ? m_pFile->fileName() : m_sFileName);
+        }
+
+        m_mutex.lock();
+        if(bOk) {
+            ++m_statistics.iFlushes;
+            m_statistics.iBytesWritten += pBuffer->iUsed;
+            m_statistics.iMaxFlushMs = qMax(m_statistics.iMaxFlushMs, iFlushMs);
+            m_iFlushMsSum += iFlushMs;
+        } else {
+            m_bError = true;
+        }
+        pBuffer->iUsed = 0;
+        pBuffer->iSamples = 0;
+        m_lFree.append(pBuffer);
+        m_bufferFreed.wakeAll();
+        m_mutex.unlock();
+    }
+
+    closeFile();
+}
+
+//=============================================================================================================
+
+bool FiffRawStreamWriter::openFile(const QString& sFileName)
+{
+    QSharedPointer<QFile> pFile(new QFile(sFileName));
+    RowVectorXd cals;
+
+    FiffStream::SPtr pStream = FiffStream::start_writing_raw(*pFile,
+                                                             m_info,
+                                                             cals,
+                                                             defaultMatrixXi,
+                                                             m_iDataType == FIFFT_FLOAT,
+                                                             m_iDataType);
+    if(!pStream) {
+        qWarning() << "[FiffRawStreamWriter::openFile] Could not create" << sFileName;
+        return false;
+    }
+
+    fiff_int_t first = m_iFirstSample + (fiff_int_t)m_iSamplesWritten;
+    pStream->write_int(FIFF_FIRST_SAMPLE, &first);
+
+    //
+    //   Pad the header so that the data buffers start at a block boundary
+    //
+    QByteArray padding(paddingSize(pFile->pos()), 0);
+    writePadding(padding.data(), padding.size());
+    if(pFile->write(padding) != padding.size() || !pFile->flush()) {
+        qWarning() << "[FiffRawStreamWriter::openFile] Could not write to" << sFileName;
+        pStream->close();
+        return false;
+    }
+
+    m_pFile = pFile;
+    m_pStream = pStream;
+    m_iSamplesInFile = 0;
+
+    QMutexLocker locker(&m_mutex);
+    m_lFileNames.append(sFileName);
+    ++m_statistics.iFiles;
+
+    return true;
+}
+
+//=============================================================================================================
+
+bool FiffRawStreamWriter::splitFile()
+{
+    m_mutex.lock();
+    const qint32 iNext = m_lFileNames.size();
+    m_mutex.unlock();
+
+    QString sNextFileName = splitFileName(iNext);
+
+    //
+    //   Link to the next file
+    //
+    m_pStream->end_block(FIFFB_RAW_DATA);
+
+    fiff_int_t data;
+    m_pStream->start_block(FIFFB_REF);
+    data = FIFFV_ROLE_NEXT_FILE;
+    m_pStream->write_int(FIFF_REF_ROLE, &data);
+    m_pStream->write_string(FIFF_REF_FILE_NAME, QFileInfo(sNextFileName).fileName());
+    m_pStream->write_id(FIFF_REF_FILE_ID);
+    data = iNext;
+    m_pStream->write_int(FIFF_REF_FILE_NUM, &data);
+    m_pStream->end_block(FIFFB_REF);
+
+    m_pStream->end_block(FIFFB_MEAS);
+    m_pStream->end_file();
+    m_pStream->close();
+    m_pStream.clear();
+    m_pFile.clear();
+
+    return openFile(sNextFileName);
+}
+
+//=============================================================================================================
+
+void FiffRawStreamWriter::closeFile()
+{
+    if(m_pStream) {
+        m_pStream->finish_writing_raw();
+    }
+
+    m_pStream.clear();
+    m_pFile.clear();
+}
+
+//=============================================================================================================
+
+QString FiffRawStreamWriter::splitFileName(qint32 iIndex) const
+{
+    if(iIndex == 0) {
+        return m_sFileName;
+    }
+
+    if(m_sFileName.endsWith("_raw.fif")) {
+        return m_sFileName.left(m_sFileName.size() - 8) + QString("-%1_raw.fif").arg(iIndex);
+    } else if(m_sFileName.endsWith(".fif")) {
+        return m_sFileName.left(m_sFileName.size() - 4) + QString("-%1.fif").arg(iIndex);
+    }
+
+    return m_sFileName + QString("-%1").arg(iIndex);
+}
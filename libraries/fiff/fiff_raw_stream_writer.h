@@ -0,0 +1,380 @@
+//=============================================================================================================
+/**
+ * @file     fiff_raw_stream_writer.h
+ * @author   Lorenz Esch <lesch@mgh.harvard.edu>
+ * @version  dev
+ * @date     April, 2020
+ *
+ * @section  LICENSE
+ *
+ * Copyright (C) 2020, Lorenz Esch. All rights reserved.
+ *
+ * the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+ *       following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ *       the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *     * Neither the name of MNE-CPP authors nor the names of its contributors may be used
+ *       to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @brief    FiffRawStreamWriter class declaration.
+ *
+ */
+
+#ifndef FIFF_RAW_STREAM_WRITER_H
+#define FIFF_RAW_STREAM_WRITER_H
+
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_global.h"
+#include "fiff_file.h"
+#include "fiff_info.h"
+
+//=============================================================================================================
+// EIGEN INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QSharedPointer>
+#include <QList>
+#include <QStringList>
+#include <QMutex>
+#include <QWaitCondition>
+
+//=============================================================================================================
+// FORWARD DECLARATIONS
+//=============================================================================================================
+
+class QFile;
+
+//=============================================================================================================
+// DEFINE NAMESPACE FIFFLIB
+//=============================================================================================================
+
+namespace FIFFLIB
+{
+
+//=============================================================================================================
+// FIFFLIB FORWARD DECLARATIONS
+//=============================================================================================================
+
+class FiffStream;
+class FiffRawStreamWriterThread;
+
+//=============================================================================================================
+/**
+ * Writes raw data buffers to a fiff file from a dedicated I/O thread. write_raw_buffer() converts the buffer to
+ * the on-disk type (float or 16 bit integer) and appends it as a complete data buffer tag to a preallocated
+ * staging buffer. Full staging buffers are handed to the I/O thread, which writes each of them with a single
+ * large write call. While the I/O thread is busy the writer switches to the other staging buffer. Further staging
+ * buffers are allocated up to the given limit if a disk write stalls, only then write_raw_buffer() blocks until a
+ * staging buffer is free again. Buffers are never dropped.
+ *
+ * Staging buffers are allocated aligned to the file system block size. Before a staging buffer is written, the I/O
+ * thread pads it with a FIFF_NOP tag to a multiple of the block size, and the header of every file is padded the
+ * same way, so that every write starts at a block aligned file offset and covers whole blocks. Readers skip the
+ * padding tags.
+ *
+ * Files are split before they exceed the maximal file size. The continuation files are named like the
+ * first file with a running index (sample-1_raw.fif, sample-2_raw.fif, ...) and are linked via a FIFFB_REF block.
+ *
+ * write_raw_buffer() must always be called from the same thread.
+ *
+ * @brief Raw data writer with background flushing and file splitting.
+ */
+class FIFFSHARED_EXPORT FiffRawStreamWriter
+{
+public:
+    typedef QSharedPointer<FiffRawStreamWriter> SPtr;               /**< Shared pointer type for FiffRawStreamWriter. */
+    typedef QSharedPointer<const FiffRawStreamWriter> ConstSPtr;    /**< Const shared pointer type for FiffRawStreamWriter. */
+
+    //=========================================================================================================
+    /**
+     * Throughput and back-pressure counters of the writer.
+     */
+    struct Statistics {
+        qint64 iBuffers;            /**< Data buffers accepted by write_raw_buffer(). */
+        qint64 iSamples;            /**< Samples accepted by write_raw_buffer(). */
+        qint64 iBytesWritten;       /**< Bytes written to disk by the I/O thread, headers included. */
+        qint64 iFlushes;            /**< Staging buffers written to disk. */
+        double dMeanFlushMs;        /**< Mean time of writing one staging buffer in ms. */
+        qint64 iMaxFlushMs;         /**< Maximal time of writing one staging buffer in ms. */
+        qint32 iMaxQueued;          /**< Maximal number of full staging buffers waiting for the I/O thread. */
+        qint32 iStagingBuffers;     /**< Staging buffers allocated so far. */
+        qint64 iStalls;             /**< Number of times write_raw_buffer() had to wait for a free staging buffer. */
+        qint64 iStallMs;            /**< Total time write_raw_buffer() waited for a free staging buffer in ms. */
+        qint32 iFiles;              /**< Files written so far. */
+    };
+
+    //=========================================================================================================
+    /**
+     * Constructs a writer. Nothing is written before start() is called.
+     *
+     * @param[in] sFileName              The name of the first file.
+     * @param[in] info                   The measurement info to write.
+     * @param[in] iDataType              The on-disk type of the samples, FIFFT_FLOAT or FIFFT_DAU_PACK16.
+     * @param[in] iFirstSample           The first sample of the recording.
+     * @param[in] iMaxFileSize           Files are split before they exceed this size in bytes.
+     * @param[in] iStagingSize           Size of one staging buffer in bytes.
+     * @param[in] iMaxStagingBuffers     Maximal number of staging buffers, at least two.
+     */
+    FiffRawStreamWriter(const QString& sFileName,
+                        const FiffInfo& info,
+                        fiff_int_t iDataType = FIFFT_FLOAT,
+                        fiff_int_t iFirstSample = 0,
+                        qint64 iMaxFileSize = 2000000000LL,
+                        qint64 iStagingSize = 16 * 1024 * 1024,
+                        qint32 iMaxStagingBuffers = 8);
+
+    //=========================================================================================================
+    /**
+     * Destroys the writer. Calls finish() if the writer is still running.
+     */
+    ~FiffRawStreamWriter();
+
+    //=========================================================================================================
+    /**
+     * Creates the first file, writes the measurement info and starts the I/O thread.
+     *
+     * @return true if the file could be created, false otherwise.
+     */
+    bool start();
+
+    //=========================================================================================================
+    /**
+     * Converts a buffer to the on-disk type and queues it for writing. The buffer is divided by the calibration
+     * factors before the conversion, use cals() to get the factors matching the written channel info.
+     * 16 bit integer samples are rounded and clipped.
+     *
+     * @param[in] buf    The data buffer (channels x samples).
+     * @param[in] cals   The calibration factors (one per channel).
+     *
+     * @return true if the buffer was queued, false if the sizes do not match or writing failed earlier.
+     */
+    bool write_raw_buffer(const Eigen::MatrixXd& buf,
+                          const Eigen::RowVectorXd& cals);
+
+    //=========================================================================================================
+    /**
+     * Converts a buffer to the on-disk type and queues it for writing, without calibration.
+     *
+     * @param[in] buf    The data buffer (channels x samples).
+     *
+     * @return true if the buffer was queued, false if the size does not match or writing failed earlier.
+     */
+    bool write_raw_buffer(const Eigen::MatrixXd& buf);
+
+    //=========================================================================================================
+    /**
+     * Writes all queued buffers, closes the measurement and the file and stops the I/O thread.
+     *
+     * @return true if all buffers were written, false otherwise.
+     */
+    bool finish();
+
+    //=========================================================================================================
+    /**
+     * Returns whether the writer was started and not yet finished.
+     *
+     * @return true if running.
+     */
+    bool isRunning() const;
+
+    //=========================================================================================================
+    /**
+     * Returns the calibration factors which match the written channel info, cal for floats and cal * range
+     * for 16 bit integers.
+     *
+     * @return the calibration factors.
+     */
+    inline const Eigen::RowVectorXd& cals() const;
+
+    //=========================================================================================================
+    /**
+     * Returns the names of all files written so far.
+     *
+     * @return the file names.
+     */
+    QStringList fileNames() const;
+
+    //=========================================================================================================
+    /**
+     * Returns the throughput and back-pressure counters.
+     *
+     * @return the counters.
+     */
+    Statistics statistics() const;
+
+private:
+    friend class FiffRawStreamWriterThread;
+
+    //=========================================================================================================
+    /**
+     * A staging buffer holding complete data buffer tags in file byte order.
+     */
+    struct StagingBuffer {
+        StagingBuffer();
+        ~StagingBuffer();
+
+        //=====================================================================================================
+        /**
+         * Makes sure the buffer holds at least iCapacity bytes. The content is not preserved.
+         *
+         * @param[in] iCapacity  The minimal capacity in bytes.
+         */
+        void reserve(qint64 iCapacity);
+
+        char* pData;            /**< The tags, aligned to the block size. */
+        qint64 iCapacity;       /**< Capacity of pData in bytes, a multiple of the block size. */
+        qint64 iUsed;           /**< Bytes used. */
+        qint64 iSamples;        /**< Samples held. */
+
+    private:
+        Q_DISABLE_COPY(StagingBuffer)
+    };
+
+    typedef QSharedPointer<StagingBuffer> StagingBufferSPtr;
+
+    //=========================================================================================================
+    /**
+     * Appends one data buffer tag to the current staging buffer.
+     *
+     * @param[in] buf        The data buffer (channels x samples).
+     * @param[in] pCals      The calibration factors or NULL.
+     *
+     * @return true if the buffer was queued.
+     */
+    bool stageBuffer(const Eigen::MatrixXd& buf,
+                     const Eigen::RowVectorXd* pCals);
+
+    //=========================================================================================================
+    /**
+     * Hands the current staging buffer to the I/O thread and takes a free one. Waits if no staging buffer is
+     * free and no further one may be allocated.
+     *
+     * @param[in] iMinCapacity   The minimal capacity of the new staging buffer in bytes.
+     */
+    void swapStagingBuffer(qint64 iMinCapacity);
+
+    //=========================================================================================================
+    /**
+     * Writes a FIFF_NOP tag of iPadSize bytes, header included, to pDest. iPadSize is zero or at least
+     * FIFFC_DATA_OFFSET.
+     *
+     * @param[in] pDest      The destination.
+     * @param[in] iPadSize   The size of the padding tag in bytes.
+     */
+    static void writePadding(char* pDest,
+                             qint64 iPadSize);
+
+    //=========================================================================================================
+    /**
+     * Returns the size of the padding tag which moves the file offset iPos to the next block boundary.
+     *
+     * @param[in] iPos   The file offset.
+     *
+     * @return the size of the padding tag in bytes, zero if iPos is already aligned.
+     */
+    static qint64 paddingSize(qint64 iPos);
+
+    //=========================================================================================================
+    /**
+     * The I/O thread loop: writes queued staging buffers until finish() was called and the queue is empty.
+     */
+    void run();
+
+    //=========================================================================================================
+    /**
+     * Creates a file and writes the measurement info. Called by the I/O thread and by start().
+     *
+     * @param[in] sFileName      The file name.
+     *
+     * @return true if succeeded.
+     */
+    bool openFile(const QString& sFileName);
+
+    //=========================================================================================================
+    /**
+     * Links the current file to the next one, closes it and opens the next one. Called by the I/O thread.
+     *
+     * @return true if succeeded.
+     */
+    bool splitFile();
+
+    //=========================================================================================================
+    /**
+     * Closes the measurement and the current file. Called by the I/O thread.
+     */
+    void closeFile();
+
+    //=========================================================================================================
+    /**
+     * Returns the name of the continuation file with the given index.
+     *
+     * @param[in] iIndex     The index, 0 is the first file.
+     *
+     * @return the file name.
+     */
+    QString splitFileName(qint32 iIndex) const;
+
+    QString                             m_sFileName;            /**< The name of the first file. */
+    FiffInfo                            m_info;                 /**< The measurement info. */
+    fiff_int_t                          m_iDataType;            /**< The on-disk type of the samples. */
+    fiff_int_t                          m_iFirstSample;         /**< The first sample of the recording. */
+    qint64                              m_iMaxFileSize;         /**< Files are split before they exceed this size. */
+    qint64                              m_iStagingSize;         /**< Size of one staging buffer in bytes. */
+    qint32                              m_iMaxStagingBuffers;   /**< Maximal number of staging buffers. */
+    Eigen::RowVectorXd                  m_vecCals;              /**< The calibration factors of the written channel info. */
+
+    StagingBufferSPtr                   m_pCurrent;             /**< The staging buffer write_raw_buffer() appends to. */
+    Eigen::RowVectorXd                  m_vecScale;             /**< Scratch for the inverse calibration factors. */
+
+    mutable QMutex                      m_mutex;                /**< Guards the queues, the flags and the counters. */
+    QWaitCondition                      m_bufferQueued;         /**< Signaled whenever a staging buffer was queued or finish() was called. */
+    QWaitCondition                      m_bufferFreed;          /**< Signaled whenever a staging buffer was written. */
+    QList<StagingBufferSPtr>            m_lQueued;              /**< Full staging buffers waiting for the I/O thread. */
+    QList<StagingBufferSPtr>            m_lFree;                /**< Free staging buffers. */
+    bool                                m_bRunning;             /**< Whether start() was called and finish() not yet. */
+    bool                                m_bFinish;              /**< Whether the I/O thread should stop once the queue is empty. */
+    bool                                m_bError;               /**< Whether writing failed. */
+    Statistics                          m_statistics;           /**< Counters. */
+    qint64                              m_iFlushMsSum;          /**< Sum of all flush times in ms. */
+    QStringList                         m_lFileNames;           /**< Names of the files written so far. */
+
+    QSharedPointer<QFile>               m_pFile;                /**< The current file, only used by the I/O thread after start(). */
+    QSharedPointer<FiffStream>          m_pStream;              /**< The stream on the current file. */
+    qint64                              m_iSamplesWritten;      /**< Samples written to disk so far. */
+    qint64                              m_iSamplesInFile;       /**< Samples written to the current file. */
+
+    QSharedPointer<FiffRawStreamWriterThread>   m_pThread;      /**< The I/O thread. */
+};
+
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline const Eigen::RowVectorXd& FiffRawStreamWriter::cals() const
+{
+    return m_vecCals;
+}
+
+} // NAMESPACE
+
+#endif // FIFF_RAW_STREAM_WRITER_H
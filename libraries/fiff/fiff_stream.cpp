@@ -60,6 +60,9 @@
 
 #define MALLOC_54(x,t) (t *)malloc((x)*sizeof(t))
 
+#define FIFF_DIR_INDEX_MAGIC    0x4D494458  /**< 'MIDX', identifies a tag directory index sidecar */
+#define FIFF_DIR_INDEX_VERSION  1           /**< Version of the tag directory index sidecar layout */
+
 #ifndef TRUE
 #define TRUE 1
 #endif
@@ -82,7 +85,10 @@
 // QT INCLUDES
 //=============================================================================================================
 
+#include <QDateTime>
 #include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
 #include <QTcpSocket>
 
 //=============================================================================================================
@@ -93,12 +99,32 @@ using namespace FIFFLIB;
 using namespace UTILSLIB;
 using namespace Eigen;
 
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+/**
+ * Resizes the tag data. The memory of the tag is kept if it is large enough, so that reading many tags into the
+ * same tag only allocates when a larger tag comes along.
+ */
+static inline void resize_tag_data(FiffTag& tag, qint32 size)
+{
+    if (size > tag.capacity()) {
+        // Nothing to preserve, drop the old data instead of copying it over
+        tag.clear();
+        tag.reserve(size);
+    }
+    tag.resize(size);
+}
+
 //=============================================================================================================
 // DEFINE MEMBER METHODS
 //=============================================================================================================
 
 FiffStream::FiffStream(QIODevice *p_pIODevice)
 : QDataStream(p_pIODevice)
+, m_bUseDirIndex(false)
+, m_bDirIndexable(false)
 {
     this->setFloatingPointPrecision(QDataStream::SinglePrecision);
     this->setByteOrder(QDataStream::BigEndian);
@@ -110,6 +136,8 @@ FiffStream::FiffStream(QIODevice *p_pIODevice)
 FiffStream::FiffStream(QByteArray * a,
                        QIODevice::OpenMode mode)
 : QDataStream(a, mode)
+, m_bUseDirIndex(false)
+, m_bDirIndexable(false)
 {
     this->setFloatingPointPrecision(QDataStream::SinglePrecision);
     this->setByteOrder(QDataStream::BigEndian);
@@ -167,6 +195,27 @@ const FiffDirNode::SPtr& FiffStream::dirtree() const
 
 //=============================================================================================================
 
+void FiffStream::setDirIndexEnabled(bool bEnabled)
+{
+    m_bUseDirIndex = bEnabled;
+}
+
+//=============================================================================================================
+
+bool FiffStream::dirIndexEnabled() const
+{
+    return m_bUseDirIndex;
+}
+
+//=============================================================================================================
+
+QString FiffStream::dirIndexFileName()
+{
+    return this->streamName() + QString(".idx");
+}
+
+//=============================================================================================================
+
 fiff_long_t FiffStream::end_block(fiff_int_t kind, fiff_int_t next)
 {
     return this->write_int(FIFF_BLOCK_END,&kind,1,next);
@@ -202,7 +251,7 @@ bool FiffStream::get_evoked_entries(const QList<FiffDirNode::SPtr> &evoked_node,
     aspect_kinds.clear();
     QList<FiffDirNode::SPtr>::ConstIterator ev;
 
-    FiffTag::SPtr t_pTag;
+    FiffTag::SPtr t_pTag(new FiffTag());
     qint32 kind, pos, k;
 
     for(ev = evoked_node.begin(); ev != evoked_node.end(); ++ev)
@@ -213,7 +262,7 @@ bool FiffStream::get_evoked_entries(const QList<FiffDirNode::SPtr> &evoked_node,
             pos = (*ev)->dir[k]->pos;
             if (kind == FIFF_COMMENT)
             {
-                this->read_tag(t_pTag,pos);
+                this->read_tag(*t_pTag, pos);
                 comments.append(t_pTag->toString());
             }
         }
@@ -224,7 +273,7 @@ bool FiffStream::get_evoked_entries(const QList<FiffDirNode::SPtr> &evoked_node,
             pos = my_aspect->dir[k]->pos;
             if (kind == FIFF_ASPECT_KIND)
             {
-                this->read_tag(t_pTag,pos);
+                this->read_tag(*t_pTag, pos);
                 aspect_kinds.append(*t_pTag->toInt());
             }
         }
@@ -292,16 +341,22 @@ bool FiffStream::open(QIODevice::OpenModeFlag mode)
     //
     qInfo("Creating tag directory for %s...", t_sFileName.toUtf8().constData());
     m_dir.clear();
+    m_rawDirIndex.clear();
     qint32 dirpos = *t_pTag->toInt();
+    m_bDirIndexable = dirpos <= 0;
     /*
      * Do we have a directory or not?
      */
     if (dirpos <= 0) {  /* Must do it in the hard way... */
-        bool ok = false;
-        m_dir = this->make_dir(&ok);
-        if (!ok) {
-          qCritical ("Could not create tag directory!");
-          return false;
+        if (!m_bUseDirIndex || !this->read_dir_index(m_dir, m_rawDirIndex)) {
+            bool ok = false;
+            m_dir = this->make_dir(&ok);
+            if (!ok) {
+              qCritical ("Could not create tag directory!");
+              return false;
+            }
+            if (m_bUseDirIndex)
+                this->write_dir_index(m_dir, QList<FiffRawDir>());
         }
     }
     else {              /* Just read the directory */
@@ -355,7 +410,7 @@ FiffDirNode::SPtr FiffStream::make_subtree(QList<FiffDirEntry::SPtr> &dentry)
     FiffDirNode::SPtr defaultNode;
     FiffDirNode::SPtr node = FiffDirNode::SPtr(new FiffDirNode);
     FiffDirNode::SPtr child;
-    FiffTag::SPtr t_pTag;
+    FiffTag t_tag;
     QList<FiffDirEntry::SPtr> dir;
     qint32 current = 0;
 
@@ -365,10 +420,10 @@ FiffDirNode::SPtr FiffStream::make_subtree(QList<FiffDirEntry::SPtr> &dentry)
     node->type = FIFFB_ROOT;
 
     if (dentry[current]->kind == FIFF_BLOCK_START) {
-        if (!this->read_tag(t_pTag,dentry[current]->pos))
+        if (!this->read_tag(t_tag,dentry[current]->pos))
             return defaultNode;
         else
-            node->type = *t_pTag->toInt();
+            node->type = *t_tag.toInt();
     }
     else {
         node->id = this->id();
@@ -402,11 +457,11 @@ FiffDirNode::SPtr FiffStream::make_subtree(QList<FiffDirEntry::SPtr> &dentry)
             * take precedence over parent block id and file id
             */
             if (((dentry[current]->kind == FIFF_PARENT_BLOCK_ID || dentry[current]->kind == FIFF_FILE_ID) && node->id.isEmpty()) || dentry[current]->kind == FIFF_BLOCK_ID) {
-                if (!this->read_tag(t_pTag,dentry[current]->pos))
+                if (!this->read_tag(t_tag,dentry[current]->pos))
                     return defaultNode;
-                node->id = t_pTag->toFiffID();
+                node->id = t_tag.toFiffID();
             }
-            dir.append(FiffDirEntry::SPtr(new FiffDirEntry(*dentry[current])));//Memcopy necessary here - or is a pointer fine?
+            dir.append(dentry[current]); // The entries are not modified once the tree is built, share them
         }
     }
     /*
@@ -421,13 +476,13 @@ FiffDirNode::SPtr FiffStream::make_subtree(QList<FiffDirEntry::SPtr> &dentry)
 QStringList FiffStream::read_bad_channels(const FiffDirNode::SPtr& p_Node)
 {
     QList<FiffDirNode::SPtr> node = p_Node->dir_tree_find(FIFFB_MNE_BAD_CHANNELS);
-    FiffTag::SPtr t_pTag;
+    FiffTag t_tag;
 
     QStringList bads;
 
     if (node.size() > 0)
-        if(node[0]->find_tag(this, FIFF_MNE_CH_NAME_LIST, t_pTag))
-            bads = split_name_list(t_pTag->toString());
+        if(node[0]->find_tag(this, FIFF_MNE_CH_NAME_LIST, t_tag))
+            bads = split_name_list(t_tag.toString());
 
     return bads;
 }
@@ -815,7 +870,7 @@ bool FiffStream::read_digitizer_data(const FiffDirNode::SPtr& p_Node, FiffDigiti
     fiff_int_t kind = -1;
     fiff_int_t pos = -1;
     int npoint = 0;
-    FiffTag::SPtr t_pTag;
+    FiffTag::SPtr t_pTag(new FiffTag());
 
     QList<FiffDirNode::SPtr> t_qListDigData = p_Node->dir_tree_find(FIFFB_ISOTRAK);
 
@@ -840,11 +895,11 @@ bool FiffStream::read_digitizer_data(const FiffDirNode::SPtr& p_Node, FiffDigiti
 
         switch(kind) {
         case FIFF_DIG_POINT:
-            this->read_tag(t_pTag, pos);
+            this->read_tag(*t_pTag, pos);
             p_digData.points.append(t_pTag->toDigPoint());
             break;
         case FIFF_MNE_COORD_FRAME:
-            this->read_tag(t_pTag, pos);
+            this->read_tag(*t_pTag, pos);
             p_digData.coord_frame = *t_pTag->toInt();
             break;
         }
@@ -886,7 +941,7 @@ bool FiffStream::read_meas_info_base(const FiffDirNode::SPtr& p_Node, FiffInfoBa
         return false;
     }
 
-    FiffTag::SPtr t_pTag;
+    FiffTag::SPtr t_pTag(new FiffTag());
 
     QList<FiffChInfo> chs;
     FiffCoordTrans cand;
@@ -899,7 +954,7 @@ bool FiffStream::read_meas_info_base(const FiffDirNode::SPtr& p_Node, FiffInfoBa
         pos  = parent_meg[0]->dir[k]->pos;
         if (kind == FIFF_CH_INFO)
         {
-            this->read_tag(t_pTag, pos);
+            this->read_tag(*t_pTag, pos);
             chs.append( t_pTag->toChInfo() );
         }
     }
@@ -965,7 +1020,7 @@ bool FiffStream::read_meas_info(const FiffDirNode::SPtr& p_Node, FiffInfo& info,
     //
     //   Read measurement info
     //
-    FiffTag::SPtr t_pTag;
+    FiffTag::SPtr t_pTag(new FiffTag());
 
     fiff_int_t nchan = -1;
     float sfreq = -1.0f;
@@ -1004,37 +1059,37 @@ bool FiffStream::read_meas_info(const FiffDirNode::SPtr& p_Node, FiffInfo& info,
         switch (kind)
         {
             case FIFF_NCHAN:
-                this->read_tag(t_pTag, pos);
+                this->read_tag(*t_pTag, pos);
                 nchan = *t_pTag->toInt();
                 break;
             case FIFF_SFREQ:
-                this->read_tag(t_pTag, pos);
+                this->read_tag(*t_pTag, pos);
                 sfreq = *t_pTag->toFloat();
                 break;
             case FIFF_LINE_FREQ:
-                this->read_tag(t_pTag, pos);
+                this->read_tag(*t_pTag, pos);
                 linefreq = *t_pTag->toFloat();
                 break;
             case FIFF_CH_INFO:
-                this->read_tag(t_pTag, pos);
+                this->read_tag(*t_pTag, pos);
                 chs.append( t_pTag->toChInfo() );
                 break;
             case FIFF_LOWPASS:
-                this->read_tag(t_pTag, pos);
+                this->read_tag(*t_pTag, pos);
                 lowpass = *t_pTag->toFloat();
                 break;
             case FIFF_HIGHPASS:
-                this->read_tag(t_pTag, pos);
+                this->read_tag(*t_pTag, pos);
                 highpass = *t_pTag->toFloat();
                 break;
             case FIFF_MEAS_DATE:
-                this->read_tag(t_pTag, pos);
+                this->read_tag(*t_pTag, pos);
                 meas_date[0] = t_pTag->toInt()[0];
                 meas_date[1] = t_pTag->toInt()[1];
                 break;
             case FIFF_COORD_TRANS:
                 //ToDo: This has to be debugged!!
-                this->read_tag(t_pTag, pos);
+                this->read_tag(*t_pTag, pos);
                 cand = t_pTag->toCoordTrans();
                 if(cand.from == FIFFV_COORD_DEVICE && cand.to == FIFFV_COORD_HEAD)
                     dev_head_t = cand;
@@ -1042,31 +1097,31 @@ bool FiffStream::read_meas_info(const FiffDirNode::SPtr& p_Node, FiffInfo& info,
                     ctf_head_t = cand;
                 break;
             case FIFF_PROJ_ID:
-                this->read_tag(t_pTag,pos);
+                this->read_tag(*t_pTag, pos);
                 proj_id = *t_pTag->toInt();
                 break;
             case FIFF_PROJ_NAME:
-                this->read_tag(t_pTag,pos);
+                this->read_tag(*t_pTag, pos);
                 proj_name = t_pTag->toString();
                 break;
             case FIFF_XPLOTTER_LAYOUT:
-                this->read_tag(t_pTag,pos);
+                this->read_tag(*t_pTag, pos);
                 xplotter_layout = t_pTag->toString();
                 break;
             case FIFF_EXPERIMENTER:
-                this->read_tag(t_pTag,pos);
+                this->read_tag(*t_pTag, pos);
                 experimenter = t_pTag->toString();
                 break;
             case FIFF_DESCRIPTION:
-                this->read_tag(t_pTag,pos);
+                this->read_tag(*t_pTag, pos);
                 description = t_pTag->toString();
                 break;
             case FIFF_GANTRY_ANGLE:
-                this->read_tag(t_pTag,pos);
+                this->read_tag(*t_pTag, pos);
                 gantry_angle = *t_pTag->toFloat();
                 break;
             case FIFF_UTC_OFFSET:
-                this->read_tag(t_pTag,pos);
+                this->read_tag(*t_pTag, pos);
                 utc_offset = t_pTag->toString();
                 break;
         }
@@ -1110,7 +1165,7 @@ bool FiffStream::read_meas_info(const FiffDirNode::SPtr& p_Node, FiffInfo& info,
                 pos  = hpi_result[0]->dir[k]->pos;
                 if (kind == FIFF_COORD_TRANS)
                 {
-                    this->read_tag(t_pTag, pos);
+                    this->read_tag(*t_pTag, pos);
                     cand = t_pTag->toCoordTrans();
                     if (cand.from == FIFFV_COORD_DEVICE && cand.to == FIFFV_COORD_HEAD)
                         dev_head_t = cand;
@@ -1138,20 +1193,20 @@ bool FiffStream::read_meas_info(const FiffDirNode::SPtr& p_Node, FiffInfo& info,
             pos  = isotrak[0]->dir[k]->pos;
             if (kind == FIFF_DIG_POINT)
             {
-                this->read_tag(t_pTag, pos);
+                this->read_tag(*t_pTag, pos);
                 dig.append(t_pTag->toDigPoint());
             }
             else
             {
                 if (kind == FIFF_MNE_COORD_FRAME)
                 {
-                    this->read_tag(t_pTag, pos);
+                    this->read_tag(*t_pTag, pos);
                     qDebug() << "NEEDS To BE DEBBUGED: FIFF_MNE_COORD_FRAME" << t_pTag->getType();
                     coord_frame = *t_pTag->toInt();
                 }
                 else if (kind == FIFF_COORD_TRANS)
                 {
-                    this->read_tag(t_pTag, pos);
+                    this->read_tag(*t_pTag, pos);
                     qDebug() << "NEEDS To BE DEBBUGED: FIFF_COORD_TRANS" << t_pTag->getType();
                     dig_trans = t_pTag->toCoordTrans();
                 }
@@ -1179,12 +1234,12 @@ bool FiffStream::read_meas_info(const FiffDirNode::SPtr& p_Node, FiffInfo& info,
             pos  = acqpars[0]->dir[k]->pos;
             if (kind == FIFF_DACQ_PARS)
             {
-                this->read_tag(t_pTag, pos);
+                this->read_tag(*t_pTag, pos);
                 acq_pars = t_pTag->toString();
             }
             else if (kind == FIFF_DACQ_STIM)
             {
-                this->read_tag(t_pTag, pos);
+                this->read_tag(*t_pTag, pos);
                 acq_stim = t_pTag->toString();
             }
         }
@@ -1346,45 +1401,45 @@ bool FiffStream::read_named_matrix(const FiffDirNode::SPtr& p_Node, fiff_int_t m
         }
     }
 
-    FiffTag::SPtr t_pTag;
+    FiffTag t_tag;
     //
     //   Read everything we need
     //
-    if(!node->find_tag(this, matkind, t_pTag))
+    if(!node->find_tag(this, matkind, t_tag))
     {
         qWarning("Matrix data missing.\n");
         return false;
     }
     else
     {
-        //qDebug() << "Is Matrix" << t_pTag->isMatrix() << "Special Type:" << t_pTag->getType();
-        mat.data = t_pTag->toFloatMatrix().cast<double>();
+        //qDebug() << "Is Matrix" << t_tag.isMatrix() << "Special Type:" << t_tag.getType();
+        mat.data = t_tag.toFloatMatrix().cast<double>();
         mat.data.transposeInPlace();
     }
 
     mat.nrow = mat.data.rows();
     mat.ncol = mat.data.cols();
 
-    if(node->find_tag(this, FIFF_MNE_NROW, t_pTag))
-        if (*t_pTag->toInt() != mat.nrow)
+    if(node->find_tag(this, FIFF_MNE_NROW, t_tag))
+        if (*t_tag.toInt() != mat.nrow)
         {
             qWarning("Number of rows in matrix data and FIFF_MNE_NROW tag do not match");
             return false;
         }
-    if(node->find_tag(this, FIFF_MNE_NCOL, t_pTag))
-        if (*t_pTag->toInt() != mat.ncol)
+    if(node->find_tag(this, FIFF_MNE_NCOL, t_tag))
+        if (*t_tag.toInt() != mat.ncol)
         {
             qWarning("Number of columns in matrix data and FIFF_MNE_NCOL tag do not match");
             return false;
         }
 
     QString row_names;
-    if(node->find_tag(this, FIFF_MNE_ROW_NAMES, t_pTag))
-        row_names = t_pTag->toString();
+    if(node->find_tag(this, FIFF_MNE_ROW_NAMES, t_tag))
+        row_names = t_tag.toString();
 
     QString col_names;
-    if(node->find_tag(this, FIFF_MNE_COL_NAMES, t_pTag))
-        col_names = t_pTag->toString();
+    if(node->find_tag(this, FIFF_MNE_COL_NAMES, t_tag))
+        col_names = t_tag.toString();
 
     //
     //   Put it together
@@ -1585,46 +1640,53 @@ bool FiffStream::read_tag_data(FiffTag::SPtr &p_pTag, fiff_long_t pos)
 
 fiff_long_t FiffStream::read_tag_info(FiffTag::SPtr &p_pTag, bool p_bDoSkip)
 {
-    fiff_long_t pos = this->device()->pos();
-
     p_pTag = FiffTag::SPtr(new FiffTag());
 
+    return read_tag_info(*p_pTag, p_bDoSkip);
+}
+
+//=============================================================================================================
+
+fiff_long_t FiffStream::read_tag_info(FiffTag& p_Tag, bool p_bDoSkip)
+{
+    fiff_long_t pos = this->device()->pos();
+
     //Option 1
 //    t_DataStream.readRawData((char *)p_pTag, FIFFC_TAG_INFO_SIZE);
-//    p_pTag->kind = Fiff::swap_int(p_pTag->kind);
-//    p_pTag->type = Fiff::swap_int(p_pTag->type);
-//    p_pTag->size = Fiff::swap_int(p_pTag->size);
-//    p_pTag->next = Fiff::swap_int(p_pTag->next);
+//    p_Tag.kind = Fiff::swap_int(p_Tag.kind);
+//    p_Tag.type = Fiff::swap_int(p_Tag.type);
+//    p_Tag.size = Fiff::swap_int(p_Tag.size);
+//    p_Tag.next = Fiff::swap_int(p_Tag.next);
 
     //Option 2
-     *this  >> p_pTag->kind;
-     *this  >> p_pTag->type;
+     *this  >> p_Tag.kind;
+     *this  >> p_Tag.type;
     qint32 size;
      *this  >> size;
-    p_pTag->resize(size);
-     *this  >> p_pTag->next;
+    resize_tag_data(p_Tag, size);
+     *this  >> p_Tag.next;
 
-//    qDebug() << "read_tag_info" << "  Kind:" << p_pTag->kind << "  Type:" << p_pTag->type << "  Size:" << p_pTag->size() << "  Next:" << p_pTag->next;
+//    qDebug() << "read_tag_info" << "  Kind:" << p_Tag.kind << "  Type:" << p_Tag.type << "  Size:" << p_Tag.size() << "  Next:" << p_Tag.next;
 
     if (p_bDoSkip)
     {
         QTcpSocket* t_qTcpSocket = qobject_cast<QTcpSocket*>(this->device());
         if(t_qTcpSocket)
         {
-            this->skipRawData(p_pTag->size());
+            this->skipRawData(p_Tag.size());
         }
         else
         {
-            if (p_pTag->next > 0)
+            if (p_Tag.next > 0)
             {
-                if(!this->device()->seek(p_pTag->next)) {
+                if(!this->device()->seek(p_Tag.next)) {
                     qCritical("fseek"); //fseek(fid,tag.next,'bof');
                     pos = -1;
                 }
             }
-            else if (p_pTag->size() > 0 && p_pTag->next == FIFFV_NEXT_SEQ)
+            else if (p_Tag.size() > 0 && p_Tag.next == FIFFV_NEXT_SEQ)
             {
-                if(!this->device()->seek(this->device()->pos()+p_pTag->size())) {
+                if(!this->device()->seek(this->device()->pos()+p_Tag.size())) {
                     qCritical("fseek"); //fseek(fid,tag.size,'cof');
                     pos = -1;
                 }
@@ -1658,24 +1720,32 @@ bool FiffStream::read_rt_tag(FiffTag::SPtr &p_pTag)
 
 bool FiffStream::read_tag(FiffTag::SPtr &p_pTag,
                           fiff_long_t pos)
+{
+    p_pTag = FiffTag::SPtr(new FiffTag());
+
+    return read_tag(*p_pTag, pos);
+}
+
+//=============================================================================================================
+
+bool FiffStream::read_tag(FiffTag& p_Tag,
+                          fiff_long_t pos)
 {
     if (pos >= 0) {
         this->device()->seek(pos);
     }
 
-    p_pTag = FiffTag::SPtr(new FiffTag());
-
     //
     // Read fiff tag header from stream
     //
-     *this  >> p_pTag->kind;
-     *this  >> p_pTag->type;
+     *this  >> p_Tag.kind;
+     *this  >> p_Tag.type;
     qint32 size;
      *this  >> size;
-    p_pTag->resize(size);
-     *this  >> p_pTag->next;
+    resize_tag_data(p_Tag, size);
+     *this  >> p_Tag.next;
 
-//    qDebug() << "read_tag" << "  Kind:" << p_pTag->kind << "  Type:" << p_pTag->type << "  Size:" << p_pTag->size() << "  Next:" << p_pTag->next;
+//    qDebug() << "read_tag" << "  Kind:" << p_Tag.kind << "  Type:" << p_Tag.type << "  Size:" << p_Tag.size() << "  Next:" << p_Tag.next;
 
     //
     // Read data when available
@@ -1689,15 +1759,15 @@ bool FiffStream::read_tag(FiffTag::SPtr &p_pTag,
         //printf("Endian: Big\n");
     }
 
-    if (p_pTag->size() > 0)
+    if (p_Tag.size() > 0)
     {
-        this->readRawData(p_pTag->data(), p_pTag->size());
-        //FiffTag::convert_tag_data(p_pTag,FIFFV_BIG_ENDIAN,FIFFV_NATIVE_ENDIAN);
-        FiffTag::convert_tag_data(p_pTag,endian,FIFFV_NATIVE_ENDIAN);
+        this->readRawData(p_Tag.data(), p_Tag.size());
+        //FiffTag::convert_tag_data(&p_Tag,FIFFV_BIG_ENDIAN,FIFFV_NATIVE_ENDIAN);
+        FiffTag::convert_tag_data(&p_Tag,endian,FIFFV_NATIVE_ENDIAN);
     }
 
-    if (p_pTag->next != FIFFV_NEXT_SEQ)
-        this->device()->seek(p_pTag->next);//fseek(fid,tag.next,'bof');
+    if (p_Tag.next != FIFFV_NEXT_SEQ)
+        this->device()->seek(p_Tag.next);//fseek(fid,tag.next,'bof');
 
     return true;
 }
@@ -1707,7 +1777,8 @@ bool FiffStream::read_tag(FiffTag::SPtr &p_pTag,
 bool FiffStream::setup_read_raw(QIODevice &p_IODevice,
                                 FiffRawData& data,
                                 bool allow_maxshield,
-                                bool is_littleEndian)
+                                bool is_littleEndian,
+                                bool use_dir_index)
 {
     //
     //   Open the file
@@ -1720,6 +1791,8 @@ bool FiffStream::setup_read_raw(QIODevice &p_IODevice,
         t_pStream->setByteOrder(QDataStream::LittleEndian);
     }
 
+    t_pStream->setDirIndexEnabled(use_dir_index);
+
     qInfo("Opening raw data %s...\n",t_sFileName.toUtf8().constData());
 
     if(!t_pStream->open()){
@@ -1786,10 +1859,10 @@ bool FiffStream::setup_read_raw(QIODevice &p_IODevice,
     //
     //  Get first sample tag if it is there
     //
-    FiffTag::SPtr t_pTag;
+    FiffTag::SPtr t_pTag(new FiffTag());
     if (dir[first]->kind == FIFF_FIRST_SAMPLE)
     {
-        t_pStream->read_tag(t_pTag, dir[first]->pos);
+        t_pStream->read_tag(*t_pTag, dir[first]->pos);
         first_samp = *t_pTag->toInt();
         ++first;
     }
@@ -1801,85 +1874,122 @@ bool FiffStream::setup_read_raw(QIODevice &p_IODevice,
         //
         //  This first skip can be applied only after we know the buffer size
         //
-        t_pStream->read_tag(t_pTag, dir[first]->pos);
+        t_pStream->read_tag(*t_pTag, dir[first]->pos);
         first_skip = *t_pTag->toInt();
         ++first;
     }
     data.first_samp = first_samp;
     //
-    //   Go through the remaining tags in the directory
+    //   Reuse the raw data directory from the index sidecar if it belongs to this raw data block
     //
     QList<FiffRawDir> rawdir;
-//        rawdir = struct('ent',{},'first',{},'last',{},'nsamp',{});
-    fiff_int_t nskip = 0;
-    fiff_int_t ndir  = 0;
-    fiff_int_t nsamp = 0;
-    for (qint32 k = first; k < nent; ++k)
-    {
-        FiffDirEntry::SPtr ent = dir[k];
-        if (ent->kind == FIFF_DATA_SKIP)
+    if (!t_pStream->m_rawDirIndex.isEmpty())
+    {
+        fiff_int_t firstBufferPos = -1;
+        for (qint32 k = first; k < nent; ++k)
         {
-            t_pStream->read_tag(t_pTag, ent->pos);
-            nskip = *t_pTag->toInt();
+            if (dir[k]->kind == FIFF_DATA_BUFFER)
+            {
+                firstBufferPos = dir[k]->pos;
+                break;
+            }
         }
-        else if(ent->kind == FIFF_DATA_BUFFER)
+        for (qint32 k = 0; k < t_pStream->m_rawDirIndex.size(); ++k)
         {
-            //
-            //   Figure out the number of samples in this buffer
-            //
-            switch(ent->type)
+            if (t_pStream->m_rawDirIndex[k].ent)
             {
-                case FIFFT_DAU_PACK16:
-                    nsamp = ent->size/(2*nchan);
-                    break;
-                case FIFFT_SHORT:
-                    nsamp = ent->size/(2*nchan);
-                    break;
-                case FIFFT_FLOAT:
-                    nsamp = ent->size/(4*nchan);
-                    break;
-                case FIFFT_INT:
-                    nsamp = ent->size/(4*nchan);
-                    break;
-                default:
-                    qWarning("Cannot handle data buffers of type %d\n",ent->type);
-                    return false;
+                if (t_pStream->m_rawDirIndex[k].ent->pos == firstBufferPos)
+                    rawdir = t_pStream->m_rawDirIndex;
+                break;
             }
-            //
-            //  Do we have an initial skip pending?
-            //
-            if (first_skip > 0)
+        }
+    }
+    if (!rawdir.isEmpty())
+    {
+        data.first_samp = rawdir.first().first;
+        first_samp = rawdir.last().last + 1;
+    }
+    else
+    {
+        //
+        //   Go through the remaining tags in the directory
+        //
+        //rawdir = struct('ent',{},'first',{},'last',{},'nsamp',{});
+        fiff_int_t nskip = 0;
+        fiff_int_t ndir  = 0;
+        fiff_int_t nsamp = 0;
+        for (qint32 k = first; k < nent; ++k)
+        {
+            FiffDirEntry::SPtr ent = dir[k];
+            if (ent->kind == FIFF_DATA_SKIP)
             {
-                first_samp += nsamp*first_skip;
-                data.first_samp = first_samp;
-                first_skip = 0;
+                t_pStream->read_tag(*t_pTag, ent->pos);
+                nskip = *t_pTag->toInt();
             }
-            //
-            //  Do we have a skip pending?
-            //
-            if (nskip > 0)
+            else if(ent->kind == FIFF_DATA_BUFFER)
             {
+                //
+                //   Figure out the number of samples in this buffer
+                //
+                switch(ent->type)
+                {
+                    case FIFFT_DAU_PACK16:
+                        nsamp = ent->size/(2*nchan);
+                        break;
+                    case FIFFT_SHORT:
+                        nsamp = ent->size/(2*nchan);
+                        break;
+                    case FIFFT_FLOAT:
+                        nsamp = ent->size/(4*nchan);
+                        break;
+                    case FIFFT_INT:
+                        nsamp = ent->size/(4*nchan);
+                        break;
+                    default:
+                        qWarning("Cannot handle data buffers of type %d\n",ent->type);
+                        return false;
+                }
+                //
+                //  Do we have an initial skip pending?
+                //
+                if (first_skip > 0)
+                {
+                    first_samp += nsamp*first_skip;
+                    data.first_samp = first_samp;
+                    first_skip = 0;
+                }
+                //
+                //  Do we have a skip pending?
+                //
+                if (nskip > 0)
+                {
+                    FiffRawDir t_RawDir;
+                    t_RawDir.first = first_samp;
+                    t_RawDir.last  = first_samp + nskip*nsamp - 1;//ToDo -1 right or is that MATLAB syntax
+                    t_RawDir.nsamp = nskip*nsamp;
+                    rawdir.append(t_RawDir);
+                    first_samp = first_samp + nskip*nsamp;
+                    nskip = 0;
+                    ++ndir;
+                }
+                //
+                //  Add a data buffer
+                //
                 FiffRawDir t_RawDir;
+                t_RawDir.ent  = ent;
                 t_RawDir.first = first_samp;
-                t_RawDir.last  = first_samp + nskip*nsamp - 1;//ToDo -1 right or is that MATLAB syntax
-                t_RawDir.nsamp = nskip*nsamp;
+                t_RawDir.last  = first_samp + nsamp - 1;//ToDo -1 right or is that MATLAB syntax
+                t_RawDir.nsamp = nsamp;
                 rawdir.append(t_RawDir);
-                first_samp = first_samp + nskip*nsamp;
-                nskip = 0;
+                first_samp += nsamp;
                 ++ndir;
             }
-            //
-            //  Add a data buffer
-            //
-            FiffRawDir t_RawDir;
-            t_RawDir.ent  = ent;
-            t_RawDir.first = first_samp;
-            t_RawDir.last  = first_samp + nsamp - 1;//ToDo -1 right or is that MATLAB syntax
-            t_RawDir.nsamp = nsamp;
-            rawdir.append(t_RawDir);
-            first_samp += nsamp;
-            ++ndir;
         }
+        //
+        //   Store the raw data directory in the index sidecar
+        //
+        if (t_pStream->m_bUseDirIndex && t_pStream->m_bDirIndexable)
+            t_pStream->write_dir_index(t_pStream->m_dir, rawdir);
     }
     data.last_samp  = first_samp - 1;//ToDo -1 right or is that MATLAB syntax
     //
@@ -2018,12 +2128,9 @@ FiffStream::SPtr FiffStream::start_writing_raw(QIODevice &p_IODevice,
                                                const FiffInfo& info,
                                                RowVectorXd& cals,
                                                MatrixXi sel,
-                                               bool bResetRange)
+                                               bool bResetRange,
+                                               fiff_int_t data_type)
 {
-    //
-    //   We will always write floats
-    //
-    fiff_int_t data_type = 4;
     qint32 k;
 
     if(sel.cols() == 0)
@@ -2044,6 +2151,8 @@ FiffStream::SPtr FiffStream::start_writing_raw(QIODevice &p_IODevice,
     //  Create the file and save the essentials
     //
     FiffStream::SPtr t_pStream = start_file(p_IODevice);//1, 2, 3
+    if(!t_pStream)
+        return t_pStream;
     t_pStream->start_block(FIFFB_MEAS);//4
     t_pStream->write_id(FIFF_BLOCK_ID);//5
     if(info.meas_id.version != -1)
@@ -2174,7 +2283,7 @@ FiffStream::SPtr FiffStream::start_writing_raw(QIODevice &p_IODevice,
         //
         chs[k].scanNo = k+1;
         if(bResetRange) {
-            chs[k].range = 1.0; // Reset to 1.0 because we always write floats.
+            chs[k].range = 1.0; // Reset to 1.0 because floats are written unscaled.
         }
         cals[k] = chs[k].cal;
         t_pStream->write_ch_info(chs[k]);
@@ -3174,7 +3283,7 @@ void FiffStream::write_rt_command(fiff_int_t command, const QString& data)
 
 QList<FiffDirEntry::SPtr> FiffStream::make_dir(bool *ok)
 {
-    FiffTag::SPtr t_pTag;
+    FiffTag t_tag;
     QList<FiffDirEntry::SPtr> dir;
     FiffDirEntry::SPtr t_pFiffDirEntry;
     fiff_long_t pos;
@@ -3184,25 +3293,25 @@ QList<FiffDirEntry::SPtr> FiffStream::make_dir(bool *ok)
      */
     if(!this->device()->seek(SEEK_SET))
         return dir;
-    while ((pos = this->read_tag_info(t_pTag)) != -1) {
+    while ((pos = this->read_tag_info(t_tag)) != -1) {
         /*
         * Check that we haven't run into the directory
         */
-        if (t_pTag->kind == FIFF_DIR)
+        if (t_tag.kind == FIFF_DIR)
             break;
         /*
         * Put in the new entry
         */
         t_pFiffDirEntry = FiffDirEntry::SPtr(new FiffDirEntry);
-        t_pFiffDirEntry->kind = t_pTag->kind;
-        t_pFiffDirEntry->type = t_pTag->type;
-        t_pFiffDirEntry->size = t_pTag->size();
+        t_pFiffDirEntry->kind = t_tag.kind;
+        t_pFiffDirEntry->type = t_tag.type;
+        t_pFiffDirEntry->size = t_tag.size();
         t_pFiffDirEntry->pos = (fiff_long_t)pos;
 
-        //qDebug() << "Kind: " << t_pTag->kind << "| Type:" << t_pTag->type << "| Size" << t_pTag->size() << "| Next:" << t_pTag->next;
+        //qDebug() << "Kind: " << t_tag.kind << "| Type:" << t_tag.type << "| Size" << t_tag.size() << "| Next:" << t_tag.next;
 
         dir.append(t_pFiffDirEntry);
-        if (t_pTag->next < 0)
+        if (t_tag.next < 0)
             break;
     }
     /*
@@ -3221,6 +3330,175 @@ QList<FiffDirEntry::SPtr> FiffStream::make_dir(bool *ok)
 
 //=============================================================================================================
 
+bool FiffStream::read_dir_index(QList<FiffDirEntry::SPtr>& dir, QList<FiffRawDir>& rawdir)
+{
+    dir.clear();
+    rawdir.clear();
+
+    QFile* t_pFile = qobject_cast<QFile*>(this->device());
+    if(!t_pFile)
+        return false;
+
+    QFile t_fileIndex(this->dirIndexFileName());
+    if(!t_fileIndex.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream t_streamIndex(&t_fileIndex);
+    t_streamIndex.setByteOrder(QDataStream::BigEndian);
+
+    //
+    //   The index belongs to exactly this file
+    //
+    quint32 magic;
+    qint32 version;
+    t_streamIndex >> magic >> version;
+    if(magic != FIFF_DIR_INDEX_MAGIC || version != FIFF_DIR_INDEX_VERSION)
+        return false;
+
+    FiffId t_id;
+    qint64 fileSize, fileModified;
+    t_streamIndex >> t_id.version >> t_id.machid[0] >> t_id.machid[1] >> t_id.time.secs >> t_id.time.usecs;
+    t_streamIndex >> fileSize >> fileModified;
+
+    QFileInfo t_fileInfo(*t_pFile);
+    if(t_id.version != m_id.version ||
+       t_id.machid[0] != m_id.machid[0] ||
+       t_id.machid[1] != m_id.machid[1] ||
+       t_id.time.secs != m_id.time.secs ||
+       t_id.time.usecs != m_id.time.usecs ||
+       fileSize != t_fileInfo.size() ||
+       fileModified != t_fileInfo.lastModified().toMSecsSinceEpoch())
+        return false;
+
+    //
+    //   Directory entries
+    //
+    //   A corrupt or truncated index must not make us allocate more entries than the files can hold:
+    //   every directory or raw directory entry takes at least 4 ints in the index
+    //   and every tag in the FIFF file at least its header
+    //
+    const qint64 entrySize = 4 * sizeof(fiff_int_t);
+    const qint64 rawEntrySize = 4 * sizeof(fiff_int_t);
+    qint32 nent;
+    t_streamIndex >> nent;
+    if(nent <= 0 || t_streamIndex.status() != QDataStream::Ok ||
+       nent > (t_fileIndex.size() - t_fileIndex.pos()) / entrySize ||
+       nent > fileSize / (qint64)FIFFC_TAG_INFO_SIZE + 1)
+        return false;
+
+    dir.reserve(nent);
+    for(qint32 k = 0; k < nent; ++k) {
+        FiffDirEntry::SPtr t_pEntry(new FiffDirEntry);
+        t_streamIndex >> t_pEntry->kind >> t_pEntry->type >> t_pEntry->size >> t_pEntry->pos;
+        dir.append(t_pEntry);
+    }
+
+    //
+    //   Raw data directory
+    //
+    qint32 nraw;
+    t_streamIndex >> nraw;
+    if(nraw < 0 || nraw > nent || nraw > (t_fileIndex.size() - t_fileIndex.pos()) / rawEntrySize) {
+        dir.clear();
+        return false;
+    }
+    rawdir.reserve(nraw);
+    for(qint32 k = 0; k < nraw && t_streamIndex.status() == QDataStream::Ok; ++k) {
+        FiffRawDir t_RawDir;
+        qint32 hasEnt;
+        t_streamIndex >> hasEnt;
+        if(hasEnt) {
+            t_RawDir.ent = FiffDirEntry::SPtr(new FiffDirEntry);
+            t_streamIndex >> t_RawDir.ent->kind >> t_RawDir.ent->type >> t_RawDir.ent->size >> t_RawDir.ent->pos;
+        }
+        t_streamIndex >> t_RawDir.first >> t_RawDir.last >> t_RawDir.nsamp;
+        rawdir.append(t_RawDir);
+    }
+
+    if(t_streamIndex.status() != QDataStream::Ok || dir.last()->kind != -1) {
+        dir.clear();
+        rawdir.clear();
+        return false;
+    }
+
+    //
+    //   Validate: the first, the middle and the last entry have to match the tag headers in the file
+    //
+    fiff_long_t t_pos = this->device()->pos();
+    QList<qint32> t_checks;
+    t_checks << 0 << (nent - 1) / 2 << nent - 2;
+    FiffTag::SPtr t_pTag;
+    bool bValid = true;
+    for(qint32 k = 0; k < t_checks.size() && bValid; ++k) {
+        const FiffDirEntry::SPtr& t_pEntry = dir[qMax(0, t_checks[k])];
+        if(t_pEntry->pos < 0)
+            continue;
+        if(!this->device()->seek(t_pEntry->pos)) {
+            bValid = false;
+            break;
+        }
+        this->read_tag_info(t_pTag, false);
+        bValid = t_pTag->kind == t_pEntry->kind && t_pTag->type == t_pEntry->type && t_pTag->size() == t_pEntry->size;
+    }
+    this->device()->seek(t_pos);
+
+    if(!bValid) {
+        qWarning("FiffStream::read_dir_index - Index %s does not match the file. Rescanning.", this->dirIndexFileName().toUtf8().constData());
+        dir.clear();
+        rawdir.clear();
+        return false;
+    }
+
+    qInfo("Tag directory read from index %s.", this->dirIndexFileName().toUtf8().constData());
+    return true;
+}
+
+//=============================================================================================================
+
+bool FiffStream::write_dir_index(const QList<FiffDirEntry::SPtr>& dir, const QList<FiffRawDir>& rawdir)
+{
+    QFile* t_pFile = qobject_cast<QFile*>(this->device());
+    if(!t_pFile || dir.isEmpty())
+        return false;
+
+    //
+    //   Write to a temporary file which replaces the index on commit, i.e. readers never see a partial index
+    //
+    QSaveFile t_fileIndex(this->dirIndexFileName());
+    if(!t_fileIndex.open(QIODevice::WriteOnly)) {
+        qWarning("FiffStream::write_dir_index - Cannot write index %s.", this->dirIndexFileName().toUtf8().constData());
+        return false;
+    }
+
+    QDataStream t_streamIndex(&t_fileIndex);
+    t_streamIndex.setByteOrder(QDataStream::BigEndian);
+
+    QFileInfo t_fileInfo(*t_pFile);
+    t_streamIndex << (quint32)FIFF_DIR_INDEX_MAGIC << (qint32)FIFF_DIR_INDEX_VERSION;
+    t_streamIndex << m_id.version << m_id.machid[0] << m_id.machid[1] << m_id.time.secs << m_id.time.usecs;
+    t_streamIndex << (qint64)t_fileInfo.size() << (qint64)t_fileInfo.lastModified().toMSecsSinceEpoch();
+
+    t_streamIndex << (qint32)dir.size();
+    for(qint32 k = 0; k < dir.size(); ++k)
+        t_streamIndex << dir[k]->kind << dir[k]->type << dir[k]->size << dir[k]->pos;
+
+    t_streamIndex << (qint32)rawdir.size();
+    for(qint32 k = 0; k < rawdir.size(); ++k) {
+        t_streamIndex << (qint32)(rawdir[k].ent ? 1 : 0);
+        if(rawdir[k].ent)
+            t_streamIndex << rawdir[k].ent->kind << rawdir[k].ent->type << rawdir[k].ent->size << rawdir[k].ent->pos;
+        t_streamIndex << rawdir[k].first << rawdir[k].last << rawdir[k].nsamp;
+    }
+
+    if(t_streamIndex.status() != QDataStream::Ok) {
+        t_fileIndex.cancelWriting();
+        return false;
+    }
+    return t_fileIndex.commit();
+}
+
+//=============================================================================================================
+
 bool FiffStream::check_beginning(FiffTag::SPtr &p_pTag)
 {
     this->read_tag(p_pTag);
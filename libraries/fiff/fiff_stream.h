@@ -47,6 +47,7 @@
 
 #include "fiff_dir_node.h"
 #include "fiff_dir_entry.h"
+#include "fiff_raw_dir.h"
 
 //=============================================================================================================
 // EIGEN INCLUDES
@@ -177,6 +178,33 @@ public:
      */
     const FiffDirNode::SPtr& dirtree() const;
 
+    //=========================================================================================================
+    /**
+     * Enables or disables the tag directory index sidecar. Files without a directory pointer have to be scanned
+     * tag by tag when opened. If the index is enabled, open() stores the scanned directory in <file>.idx and
+     * reuses it as long as file id, file size and modification time match. setup_read_raw additionally stores
+     * its raw data directory in there. Has to be set before open() is called. Default is disabled.
+     *
+     * @param[in] bEnabled   Whether to use the tag directory index sidecar.
+     */
+    void setDirIndexEnabled(bool bEnabled);
+
+    //=========================================================================================================
+    /**
+     * Returns whether the tag directory index sidecar is used.
+     *
+     * @return true if the index sidecar is enabled, false otherwise
+     */
+    bool dirIndexEnabled() const;
+
+    //=========================================================================================================
+    /**
+     * Returns the file name of the tag directory index sidecar, i.e. the stream name with ".idx" appended.
+     *
+     * @return the file name of the index sidecar
+     */
+    QString dirIndexFileName();
+
     //=========================================================================================================
     /**
      * ### MNE toolbox root function ###: Definition of the fiff_end_block function
@@ -404,6 +432,19 @@ public:
      */
     fiff_long_t read_tag_info(QSharedPointer<FiffTag>& p_pTag, bool p_bDoSkip = true);
 
+    //=========================================================================================================
+    /**
+     * Read tag information of one tag from a fif file into a caller owned tag. The memory of the tag is reused,
+     * it only grows if a larger tag comes along.
+     * if pos is not provided, reading starts from the current file position
+     *
+     * @param[out] p_Tag the read tag info
+     * @param[in] p_bDoSkip if true it skips the data of the tag (optional, default = true)
+     *
+     * @return the position where the tag info was read from
+     */
+    fiff_long_t read_tag_info(FiffTag& p_Tag, bool p_bDoSkip = true);
+
     //=========================================================================================================
     /**
      * Read one tag from a fif real-time stream.
@@ -429,6 +470,20 @@ public:
     bool read_tag(QSharedPointer<FiffTag>& p_pTag,
                   fiff_long_t pos = -1);
 
+    //=========================================================================================================
+    /**
+     * Read one tag from a fif file into a caller owned tag. The memory of the tag is reused, it only grows if a
+     * larger tag comes along. Pointers returned by the to* functions of the tag are invalid after the next read.
+     * if pos is not provided, reading starts from the current file position
+     *
+     * @param[out] p_Tag the read tag
+     * @param[in] pos position of the tag inside the fif file
+     *
+     * @return true if succeeded, false otherwise
+     */
+    bool read_tag(FiffTag& p_Tag,
+                  fiff_long_t pos = -1);
+
     //=========================================================================================================
     /**
      * fiff_setup_read_raw
@@ -440,13 +495,16 @@ public:
      * @param[in] p_IODevice        An fiff IO device like a fiff QFile or QTCPSocket
      * @param[out] data              The raw data information - contains the opened fiff file
      * @param[in] allow_maxshield    Accept unprocessed MaxShield data
+     * @param[in] is_littleEndian    Whether the file is stored in little endian byte order
+     * @param[in] use_dir_index      Whether to use the tag directory index sidecar (see setDirIndexEnabled)
      *
      * @return true if succeeded, false otherwise
      */
     static bool setup_read_raw(QIODevice &p_IODevice,
                                FiffRawData& data,
                                bool allow_maxshield = true,
-                               bool is_littleEndian = false);
+                               bool is_littleEndian = false,
+                               bool use_dir_index = false);
 
     //=========================================================================================================
     /**
@@ -508,6 +566,7 @@ public:
      * @param[out] cals          A copy of the calibration values
      * @param[in] sel            Which channels will be included in the output file (optional)
      * @param[in] bResetRange    Flag whether to reset the channel range to 1.0. Default is true.
+     * @param[in] data_type      The on-disk type of the samples written to FIFF_DATA_PACK. Default is FIFFT_FLOAT.
      *
      * @return the started fiff file
      */
@@ -515,7 +574,8 @@ public:
                                               const FiffInfo& info,
                                               Eigen::RowVectorXd& cals,
                                               Eigen::MatrixXi sel = defaultMatrixXi,
-                                              bool bResetRange = true);
+                                              bool bResetRange = true,
+                                              fiff_int_t data_type = FIFFT_FLOAT);
 
     //=========================================================================================================
     /**
@@ -880,6 +940,30 @@ private:
      */
     QList<FiffDirEntry::SPtr> make_dir(bool *ok=Q_NULLPTR);
 
+    //=========================================================================================================
+    /**
+     * Reads the tag directory and the raw data directory from the index sidecar. The index is only accepted if
+     * file id, file size and modification time match and a few sampled directory entries agree with the tag
+     * headers found in the file.
+     *
+     * @param[out] dir       The directory stored in the index
+     * @param[out] rawdir    The raw data directory stored in the index, empty if none was stored
+     *
+     * @return true if a valid index was read, false otherwise
+     */
+    bool read_dir_index(QList<FiffDirEntry::SPtr>& dir, QList<FiffRawDir>& rawdir);
+
+    //=========================================================================================================
+    /**
+     * Writes the tag directory and the raw data directory to the index sidecar.
+     *
+     * @param[in] dir        The directory to store
+     * @param[in] rawdir     The raw data directory to store, may be empty
+     *
+     * @return true if the index was written, false otherwise
+     */
+    bool write_dir_index(const QList<FiffDirEntry::SPtr>& dir, const QList<FiffRawDir>& rawdir);
+
 private:
 
 //    char         *file_name;    /**< Name of the file */ -> Use streamName() instead
@@ -888,6 +972,9 @@ private:
     QList<FiffDirEntry::SPtr>   m_dir;  /**< This is the directory. If no directory exists, open automatically scans the file to create one. */
 //    int         nent;           /**< How many entries? */ -> Use nent() instead
     FiffDirNode::SPtr           m_dirtree; /**< Directory compiled into a tree */
+    bool                        m_bUseDirIndex;     /**< Whether the tag directory index sidecar is used. */
+    bool                        m_bDirIndexable;    /**< Whether the directory of this file had to be scanned, i.e. the index sidecar applies. */
+    QList<FiffRawDir>           m_rawDirIndex;      /**< The raw data directory restored from the index sidecar. */
 //    char        *ext_file_name; /**< Name of the file holding the external data */
 //    FILE        *ext_fd;        /**< The file descriptor of the above file if open  */
 
@@ -41,14 +41,32 @@
 #include "fiff_tag.h"
 #include <utils/ioutils.h>
 
+#include <atomic>
 #include <complex>
+#include <cstring>
 #include <iostream>
 
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(__EMSCRIPTEN__)
+    #define FIFF_TAG_SSE2
+    #include <emmintrin.h>
+    #if defined(__GNUC__) || defined(__clang__)
+        #define FIFF_TAG_AVX2
+        #define FIFF_TAG_TARGET_AVX2 __attribute__((target("avx2")))
+        #include <immintrin.h>
+    #elif defined(_MSC_VER)
+        #define FIFF_TAG_AVX2
+        #define FIFF_TAG_TARGET_AVX2
+        #include <immintrin.h>
+        #include <intrin.h>
+    #endif
+#endif
+
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
 
 #include <QTcpSocket>
+#include <QtEndian>
 
 //=============================================================================================================
 // USED NAMESPACES
@@ -57,6 +75,387 @@
 using namespace UTILSLIB;
 using namespace FIFFLIB;
 
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+
+/**
+ * Reads one element of type T whose byte order is swapped if requested. U is the unsigned integer of the same size.
+ */
+template<typename T, typename U>
+static inline T load_element(const char* p, bool bSwap)
+{
+    U bits;
+    memcpy(&bits, p, sizeof(U));
+    if(bSwap)
+        bits = qbswap(bits);
+    T value;
+    memcpy(&value, &bits, sizeof(T));
+    return value;
+}
+
+//=============================================================================================================
+
+template<typename U>
+static void swap_bytes_scalar(char* p, qint64 n)
+{
+    for(qint64 i = 0; i < n; ++i, p += sizeof(U)) {
+        U bits;
+        memcpy(&bits, p, sizeof(U));
+        bits = qbswap(bits);
+        memcpy(p, &bits, sizeof(U));
+    }
+}
+
+//=============================================================================================================
+
+template<typename T, typename U, typename Scalar>
+static void decode_samples_scalar(const char* pSrc, bool bSwap, qint64 n, const Scalar* pCals, Scalar* pDest)
+{
+    if(pCals) {
+        for(qint64 i = 0; i < n; ++i)
+            pDest[i] = pCals[i] * static_cast<Scalar>(load_element<T, U>(pSrc + i * sizeof(T), bSwap));
+    } else {
+        for(qint64 i = 0; i < n; ++i)
+            pDest[i] = static_cast<Scalar>(load_element<T, U>(pSrc + i * sizeof(T), bSwap));
+    }
+}
+
+#ifdef FIFF_TAG_SSE2
+
+//=============================================================================================================
+/**
+ * SSE2 kernels. Each returns the number of elements it processed, the remainder is left to the scalar kernels.
+ */
+template<int Size>
+static inline __m128i sse2_bswap(__m128i x);
+
+template<>
+inline __m128i sse2_bswap<2>(__m128i x)
+{
+    return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+template<>
+inline __m128i sse2_bswap<4>(__m128i x)
+{
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    return sse2_bswap<2>(x);
+}
+
+template<>
+inline __m128i sse2_bswap<8>(__m128i x)
+{
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+    return sse2_bswap<2>(x);
+}
+
+//=============================================================================================================
+
+template<int Size>
+static qint64 swap_bytes_sse2(char* p, qint64 n)
+{
+    const qint64 nStep = 16 / Size;
+    qint64 i = 0;
+    for(; i + nStep <= n; i += nStep, p += 16)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), sse2_bswap<Size>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+    return i;
+}
+
+//=============================================================================================================
+
+static inline void sse2_store(__m128 v, const float* pCals, float* pDest)
+{
+    if(pCals)
+        v = _mm_mul_ps(_mm_loadu_ps(pCals), v);
+    _mm_storeu_ps(pDest, v);
+}
+
+static inline void sse2_store(__m128 v, const double* pCals, double* pDest)
+{
+    __m128d lo = _mm_cvtps_pd(v);
+    __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+    if(pCals) {
+        lo = _mm_mul_pd(_mm_loadu_pd(pCals), lo);
+        hi = _mm_mul_pd(_mm_loadu_pd(pCals + 2), hi);
+    }
+    _mm_storeu_pd(pDest, lo);
+    _mm_storeu_pd(pDest + 2, hi);
+}
+
+static inline void sse2_store(__m128i v, const float* pCals, float* pDest)
+{
+    sse2_store(_mm_cvtepi32_ps(v), pCals, pDest);
+}
+
+static inline void sse2_store(__m128i v, const double* pCals, double* pDest)
+{
+    __m128d lo = _mm_cvtepi32_pd(v);
+    __m128d hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    if(pCals) {
+        lo = _mm_mul_pd(_mm_loadu_pd(pCals), lo);
+        hi = _mm_mul_pd(_mm_loadu_pd(pCals + 2), hi);
+    }
+    _mm_storeu_pd(pDest, lo);
+    _mm_storeu_pd(pDest + 2, hi);
+}
+
+//=============================================================================================================
+
+template<typename Scalar>
+static qint64 decode_sse2(qint16, const char* pSrc, bool bSwap, qint64 n, const Scalar* pCals, Scalar* pDest)
+{
+    qint64 i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i * 2));
+        if(bSwap)
+            x = sse2_bswap<2>(x);
+        sse2_store(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16), pCals ? pCals + i : nullptr, pDest + i);
+        sse2_store(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16), pCals ? pCals + i + 4 : nullptr, pDest + i + 4);
+    }
+    return i;
+}
+
+template<typename Scalar>
+static qint64 decode_sse2(qint32, const char* pSrc, bool bSwap, qint64 n, const Scalar* pCals, Scalar* pDest)
+{
+    qint64 i = 0;
+    for(; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i * 4));
+        if(bSwap)
+            x = sse2_bswap<4>(x);
+        sse2_store(x, pCals ? pCals + i : nullptr, pDest + i);
+    }
+    return i;
+}
+
+template<typename Scalar>
+static qint64 decode_sse2(float, const char* pSrc, bool bSwap, qint64 n, const Scalar* pCals, Scalar* pDest)
+{
+    qint64 i = 0;
+    for(; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i * 4));
+        if(bSwap)
+            x = sse2_bswap<4>(x);
+        sse2_store(_mm_castsi128_ps(x), pCals ? pCals + i : nullptr, pDest + i);
+    }
+    return i;
+}
+
+#endif
+
+#ifdef FIFF_TAG_AVX2
+
+//=============================================================================================================
+/**
+ * AVX2 kernels, only called if the cpu supports AVX2.
+ */
+template<int Size>
+static FIFF_TAG_TARGET_AVX2 inline __m256i avx2_bswap(__m256i x)
+{
+    // Reverses the bytes of every element within each 128 bit lane
+    const __m128i mask = Size == 2 ? _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14)
+                       : Size == 4 ? _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12)
+                                   : _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    return _mm256_shuffle_epi8(x, _mm256_broadcastsi128_si256(mask));
+}
+
+//=============================================================================================================
+
+template<int Size>
+static FIFF_TAG_TARGET_AVX2 qint64 swap_bytes_avx2(char* p, qint64 n)
+{
+    const qint64 nStep = 32 / Size;
+    qint64 i = 0;
+    for(; i + nStep <= n; i += nStep, p += 32)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), avx2_bswap<Size>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))));
+    return i;
+}
+
+//=============================================================================================================
+
+static FIFF_TAG_TARGET_AVX2 inline void avx2_store(__m256 v, const float* pCals, float* pDest)
+{
+    if(pCals)
+        v = _mm256_mul_ps(_mm256_loadu_ps(pCals), v);
+    _mm256_storeu_ps(pDest, v);
+}
+
+static FIFF_TAG_TARGET_AVX2 inline void avx2_store(__m256 v, const double* pCals, double* pDest)
+{
+    __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+    __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+    if(pCals) {
+        lo = _mm256_mul_pd(_mm256_loadu_pd(pCals), lo);
+        hi = _mm256_mul_pd(_mm256_loadu_pd(pCals + 4), hi);
+    }
+    _mm256_storeu_pd(pDest, lo);
+    _mm256_storeu_pd(pDest + 4, hi);
+}
+
+static FIFF_TAG_TARGET_AVX2 inline void avx2_store(__m256i v, const float* pCals, float* pDest)
+{
+    avx2_store(_mm256_cvtepi32_ps(v), pCals, pDest);
+}
+
+static FIFF_TAG_TARGET_AVX2 inline void avx2_store(__m256i v, const double* pCals, double* pDest)
+{
+    __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(v));
+    __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1));
+    if(pCals) {
+        lo = _mm256_mul_pd(_mm256_loadu_pd(pCals), lo);
+        hi = _mm256_mul_pd(_mm256_loadu_pd(pCals + 4), hi);
+    }
+    _mm256_storeu_pd(pDest, lo);
+    _mm256_storeu_pd(pDest + 4, hi);
+}
+
+//=============================================================================================================
+
+template<typename Scalar>
+static FIFF_TAG_TARGET_AVX2 qint64 decode_avx2(qint16, const char* pSrc, bool bSwap, qint64 n, const Scalar* pCals, Scalar* pDest)
+{
+    qint64 i = 0;
+    for(; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i * 2));
+        if(bSwap)
+            x = avx2_bswap<2>(x);
+        avx2_store(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)), pCals ? pCals + i : nullptr, pDest + i);
+        avx2_store(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)), pCals ? pCals + i + 8 : nullptr, pDest + i + 8);
+    }
+    return i;
+}
+
+template<typename Scalar>
+static FIFF_TAG_TARGET_AVX2 qint64 decode_avx2(qint32, const char* pSrc, bool bSwap, qint64 n, const Scalar* pCals, Scalar* pDest)
+{
+    qint64 i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i * 4));
+        if(bSwap)
+            x = avx2_bswap<4>(x);
+        avx2_store(x, pCals ? pCals + i : nullptr, pDest + i);
+    }
+    return i;
+}
+
+template<typename Scalar>
+static FIFF_TAG_TARGET_AVX2 qint64 decode_avx2(float, const char* pSrc, bool bSwap, qint64 n, const Scalar* pCals, Scalar* pDest)
+{
+    qint64 i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i * 4));
+        if(bSwap)
+            x = avx2_bswap<4>(x);
+        avx2_store(_mm256_castsi256_ps(x), pCals ? pCals + i : nullptr, pDest + i);
+    }
+    return i;
+}
+
+#endif
+
+//=============================================================================================================
+
+static int detect_simd_level()
+{
+#if defined(FIFF_TAG_AVX2) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? 2 : 1;
+#elif defined(FIFF_TAG_AVX2) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7)
+        return 1;
+    __cpuid(info, 1);
+    const bool bOsAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return bOsAvx && (info[1] & (1 << 5)) ? 2 : 1;
+#elif defined(FIFF_TAG_SSE2)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+//=============================================================================================================
+
+// Read by the reader threads while set_simd_level() might be called from another one
+static std::atomic<int>& simd_level_ref()
+{
+    static std::atomic<int> iLevel(detect_simd_level());
+    return iLevel;
+}
+
+//=============================================================================================================
+
+template<int Size, typename U>
+static void swap_bytes_impl(char* p, qint64 n)
+{
+    qint64 i = 0;
+    switch(simd_level_ref().load(std::memory_order_relaxed)) {
+#ifdef FIFF_TAG_AVX2
+        case 2:
+            i = swap_bytes_avx2<Size>(p, n);
+            break;
+#endif
+#ifdef FIFF_TAG_SSE2
+        case 1:
+            i = swap_bytes_sse2<Size>(p, n);
+            break;
+#endif
+        default:
+            break;
+    }
+    swap_bytes_scalar<U>(p + i * Size, n - i);
+}
+
+//=============================================================================================================
+
+template<typename T, typename U, typename Scalar>
+static void decode_samples_impl(const char* pSrc, bool bSwap, qint64 n, const Scalar* pCals, Scalar* pDest)
+{
+    qint64 i = 0;
+    switch(simd_level_ref().load(std::memory_order_relaxed)) {
+#ifdef FIFF_TAG_AVX2
+        case 2:
+            i = decode_avx2(T(), pSrc, bSwap, n, pCals, pDest);
+            break;
+#endif
+#ifdef FIFF_TAG_SSE2
+        case 1:
+            i = decode_sse2(T(), pSrc, bSwap, n, pCals, pDest);
+            break;
+#endif
+        default:
+            break;
+    }
+    decode_samples_scalar<T, U>(pSrc + i * sizeof(T), bSwap, n - i, pCals ? pCals + i : nullptr, pDest + i);
+}
+
+//=============================================================================================================
+
+template<typename Scalar>
+static bool decode_samples_type(const char* pSrc, fiff_int_t type, bool bSwap, qint64 n, const Scalar* pCals, Scalar* pDest)
+{
+    switch(type) {
+        case FIFFT_DAU_PACK16:
+        case FIFFT_SHORT:
+            decode_samples_impl<qint16, quint16>(pSrc, bSwap, n, pCals, pDest);
+            return true;
+        case FIFFT_INT:
+            decode_samples_impl<qint32, quint32>(pSrc, bSwap, n, pCals, pDest);
+            return true;
+        case FIFFT_FLOAT:
+            decode_samples_impl<float, quint32>(pSrc, bSwap, n, pCals, pDest);
+            return true;
+        default:
+            return false;
+    }
+}
+
 //=============================================================================================================
 // DEFINE MEMBER METHODS
 //=============================================================================================================
@@ -315,16 +714,14 @@ void FiffTag::convert_ch_pos(FiffChPos* pos)
 
 //=============================================================================================================
 
-void FiffTag::convert_matrix_from_file_data(FiffTag::SPtr tag)
+void FiffTag::convert_matrix_from_file_data(FiffTag* tag)
 /*
  * Assumes that the input is in the non-native byte order and needs to be swapped to the other one
  */
 {
     int ndim;
     int k;
-    int *dimp,*data,kind,np,nz;
-    float *fdata;
-    double *ddata;
+    int *dimp,kind,np,nz;
     unsigned int tsize = tag->size();
 
     if (fiff_type_fundamental(tag->type) != FIFFTS_FS_MATRIX)
@@ -364,41 +761,32 @@ void FiffTag::convert_matrix_from_file_data(FiffTag::SPtr tag)
         /*
          * Take care of the indices
         */
-        for (data = (int *)(tag->data())+nz, k = 0; k < np; k++)
-            IOUtils::swap_intp(data+k);
+        swap_bytes((int *)(tag->data())+nz, np, sizeof(fiff_int_t));
         np = nz;
     }
     /*
      * Now convert data...
      */
     kind = fiff_type_base(tag->type);
-    if (kind == FIFFT_INT) {
-        for (data = (int *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_intp(data+k);
-    }
-    else if (kind == FIFFT_FLOAT) {
-        for (fdata = (float *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_floatp(fdata+k);
-    }
-    else if (kind == FIFFT_DOUBLE) {
-        for (ddata = (double *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_doublep(ddata+k);
-    }
+    if (kind == FIFFT_INT)
+        swap_bytes(tag->data(), np, sizeof(fiff_int_t));
+    else if (kind == FIFFT_FLOAT)
+        swap_bytes(tag->data(), np, sizeof(float));
+    else if (kind == FIFFT_DOUBLE)
+        swap_bytes(tag->data(), np, sizeof(double));
     return;
 }
 
 //=============================================================================================================
 
-void FiffTag::convert_matrix_to_file_data(FiffTag::SPtr tag)
+void FiffTag::convert_matrix_to_file_data(FiffTag* tag)
 /*
  * Assumes that the input is in the NATIVE_ENDIAN byte order and needs to be swapped to the other one
  */
 {
     int ndim;
     int k;
-    int *dimp,*data,kind,np;
-    float *fdata;
-    double *ddata;
+    int *dimp,kind,np;
     unsigned int tsize = tag->size();
 
     if (fiff_type_fundamental(tag->type) != FIFFTS_FS_MATRIX)
@@ -440,41 +828,28 @@ void FiffTag::convert_matrix_to_file_data(FiffTag::SPtr tag)
      * Now convert data...
      */
     kind = fiff_type_base(tag->type);
-    if (kind == FIFFT_INT) {
-        for (data = (int *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_intp(data+k);
-    }
-    else if (kind == FIFFT_FLOAT) {
-        for (fdata = (float *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_floatp(fdata+k);
-    }
-    else if (kind == FIFFT_DOUBLE) {
-        for (ddata = (double *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_doublep(ddata+k);
-    }
-    else if (kind == FIFFT_COMPLEX_FLOAT) {
-        for (fdata = (float *)(tag->data()), k = 0; k < 2*np; k++)
-            IOUtils::swap_floatp(fdata+k);
-    }
-    else if (kind == FIFFT_COMPLEX_DOUBLE) {
-        for (ddata = (double *)(tag->data()), k = 0; k < 2*np; k++)
-            IOUtils::swap_doublep(ddata+k);
-    }
+    if (kind == FIFFT_INT)
+        swap_bytes(tag->data(), np, sizeof(fiff_int_t));
+    else if (kind == FIFFT_FLOAT)
+        swap_bytes(tag->data(), np, sizeof(float));
+    else if (kind == FIFFT_DOUBLE)
+        swap_bytes(tag->data(), np, sizeof(double));
+    else if (kind == FIFFT_COMPLEX_FLOAT)
+        swap_bytes(tag->data(), 2*np, sizeof(float));
+    else if (kind == FIFFT_COMPLEX_DOUBLE)
+        swap_bytes(tag->data(), 2*np, sizeof(double));
     return;
 }
 
 //=============================================================================================================
 //ToDo remove this function by swapping -> define little endian big endian, QByteArray
-void FiffTag::convert_tag_data(FiffTag::SPtr tag, int from_endian, int to_endian)
+void FiffTag::convert_tag_data(FiffTag* tag, int from_endian, int to_endian)
 {
     int            np;
     int            k,r;//,c;
     char           *offset;
     fiff_int_t     *ithis;
-    fiff_short_t   *sthis;
-    fiff_long_t    *lthis;
     float          *fthis;
-    double         *dthis;
 //    fiffDirEntry   dethis;
 //    fiffId         idthis;
 //    fiffChInfoRec* chthis;//FiffChInfo*     chthis;//ToDo adapt parsing to the new class
@@ -507,38 +882,28 @@ void FiffTag::convert_tag_data(FiffTag::SPtr tag, int from_endian, int to_endian
     case FIFFT_INT :
     case FIFFT_UINT :
     case FIFFT_JULIAN :
-        np = tag->size()/sizeof(fiff_int_t);
-        for (ithis = (fiff_int_t *)tag->data(), k = 0; k < np; k++, ithis++)
-            IOUtils::swap_intp(ithis);
+        swap_bytes(tag->data(), tag->size()/sizeof(fiff_int_t), sizeof(fiff_int_t));
         break;
 
     case FIFFT_LONG :
     case FIFFT_ULONG :
-        np = tag->size()/sizeof(fiff_long_t);
-        for (lthis = (fiff_long_t *)tag->data(), k = 0; k < np; k++, lthis++)
-            IOUtils::swap_longp(lthis);
+        swap_bytes(tag->data(), tag->size()/sizeof(fiff_long_t), sizeof(fiff_long_t));
         break;
 
     case FIFFT_SHORT :
     case FIFFT_DAU_PACK16 :
     case FIFFT_USHORT :
-        np = tag->size()/sizeof(fiff_short_t);
-        for (sthis = (fiff_short_t *)tag->data(), k = 0; k < np; k++, sthis++)
-            *sthis = IOUtils::swap_short(*sthis);
+        swap_bytes(tag->data(), tag->size()/sizeof(fiff_short_t), sizeof(fiff_short_t));
         break;
 
     case FIFFT_FLOAT :
     case FIFFT_COMPLEX_FLOAT :
-        np = tag->size()/sizeof(fiff_float_t);
-        for (fthis = (fiff_float_t *)tag->data(), k = 0; k < np; k++, fthis++)
-            IOUtils::swap_floatp(fthis);
+        swap_bytes(tag->data(), tag->size()/sizeof(fiff_float_t), sizeof(fiff_float_t));
         break;
 
     case FIFFT_DOUBLE :
     case FIFFT_COMPLEX_DOUBLE :
-        np = tag->size()/sizeof(fiff_double_t);
-        for (dthis = (fiff_double_t *)tag->data(), k = 0; k < np; k++, dthis++)
-            IOUtils::swap_doublep(dthis);
+        swap_bytes(tag->data(), tag->size()/sizeof(fiff_double_t), sizeof(fiff_double_t));
         break;
 
     case FIFFT_OLD_PACK :
@@ -548,10 +913,7 @@ void FiffTag::convert_tag_data(FiffTag::SPtr tag, int from_endian, int to_endian
      */
         IOUtils::swap_floatp(fthis+0);
         IOUtils::swap_floatp(fthis+1);
-        sthis = (short *)(fthis+2);
-        np = (tag->size() - 2*sizeof(float))/sizeof(short);
-        for (k = 0; k < np; k++,sthis++)
-            *sthis = IOUtils::swap_short(*sthis);
+        swap_bytes(fthis+2, (tag->size() - 2*sizeof(float))/sizeof(short), sizeof(short));
         break;
 
     case FIFFT_DIR_ENTRY_STRUCT :
@@ -738,3 +1100,81 @@ fiff_int_t FiffTag::fiff_type_matrix_coding(fiff_int_t type)
 {
     return type & FIFFTS_MC_MASK;
 }
+
+//=============================================================================================================
+
+void FiffTag::swap_bytes(void* pData, qint64 n, int iElementSize)
+{
+    char* p = static_cast<char*>(pData);
+
+    switch(iElementSize) {
+        case 2:
+            swap_bytes_impl<2, quint16>(p, n);
+            break;
+        case 4:
+            swap_bytes_impl<4, quint32>(p, n);
+            break;
+        case 8:
+            swap_bytes_impl<8, quint64>(p, n);
+            break;
+        default:
+            break;
+    }
+}
+
+//=============================================================================================================
+
+bool FiffTag::decode_samples(const char* pSrc,
+                             fiff_int_t type,
+                             bool bSwap,
+                             qint64 n,
+                             const float* pCals,
+                             float* pDest)
+{
+    return decode_samples_type(pSrc, type, bSwap, n, pCals, pDest);
+}
+
+//=============================================================================================================
+
+bool FiffTag::decode_samples(const char* pSrc,
+                             fiff_int_t type,
+                             bool bSwap,
+                             qint64 n,
+                             const double* pCals,
+                             double* pDest)
+{
+    return decode_samples_type(pSrc, type, bSwap, n, pCals, pDest);
+}
+
+//=============================================================================================================
+
+bool FiffTag::decode_samples(const char* pSrc,
+                             fiff_int_t type,
+                             bool bSwap,
+                             qint64 n,
+                             qint16* pDest)
+{
+    if(type != FIFFT_DAU_PACK16 && type != FIFFT_SHORT)
+        return false;
+
+    memcpy(pDest, pSrc, n * sizeof(qint16));
+    if(bSwap)
+        swap_bytes(pDest, n, sizeof(qint16));
+    return true;
+}
+
+//=============================================================================================================
+
+int FiffTag::simd_level()
+{
+    return simd_level_ref().load(std::memory_order_relaxed);
+}
+
+//=============================================================================================================
+
+int FiffTag::set_simd_level(int iLevel)
+{
+    const int iClamped = qBound(0, iLevel, detect_simd_level());
+    simd_level_ref().store(iClamped, std::memory_order_relaxed);
+    return iClamped;
+}
@@ -439,7 +439,9 @@ public:
      *
      * @param[in, out] tag    matrix data to convert
      */
-    static void convert_matrix_from_file_data(FiffTag::SPtr tag);
+    static void convert_matrix_from_file_data(FiffTag* tag);
+
+    static inline void convert_matrix_from_file_data(FiffTag::SPtr tag);
 
     //=========================================================================================================
     /**
@@ -447,7 +449,9 @@ public:
      *
      * @param[in, out] tag    matrix data to convert
      */
-    static void convert_matrix_to_file_data(FiffTag::SPtr tag);
+    static void convert_matrix_to_file_data(FiffTag* tag);
+
+    static inline void convert_matrix_to_file_data(FiffTag::SPtr tag);
 
     //
     // Data type conversions for the little endian systems.
@@ -466,7 +470,9 @@ public:
      * @param[in] from_endian    from endian encoding
      * @param[in] to_endian      to endian encoding
      */
-    static void convert_tag_data(FiffTag::SPtr tag, int from_endian, int to_endian);
+    static void convert_tag_data(FiffTag* tag, int from_endian, int to_endian);
+
+    static inline void convert_tag_data(FiffTag::SPtr tag, int from_endian, int to_endian);
 
     //
     // from fiff_type_spec.c
@@ -495,6 +501,86 @@ public:
      */
     static fiff_int_t fiff_type_matrix_coding(fiff_int_t type);
 
+    //
+    // Bulk conversion kernels
+    //
+    //=========================================================================================================
+    /**
+     * Swaps the byte order of n consecutive elements in place. SSE2 or AVX2 is used when supported by the cpu.
+     *
+     * @param[in, out] pData         the elements to swap.
+     * @param[in] n                  number of elements.
+     * @param[in] iElementSize       size of one element in bytes (2, 4 or 8).
+     */
+    static void swap_bytes(void* pData, qint64 n, int iElementSize);
+
+    //=========================================================================================================
+    /**
+     * Decodes n consecutive samples of the given fiff type (FIFFT_DAU_PACK16, FIFFT_SHORT, FIFFT_INT or FIFFT_FLOAT)
+     * in one pass: the byte order is swapped if requested, the samples are converted and, if pCals is set,
+     * multiplied element wise with pCals. SSE2 or AVX2 is used when supported by the cpu.
+     *
+     * @param[in] pSrc       the samples as stored in the file, no alignment required.
+     * @param[in] type       the fiff type of the samples.
+     * @param[in] bSwap      whether the byte order of the samples is not the native one.
+     * @param[in] n          number of samples.
+     * @param[in] pCals      n calibration factors or NULL.
+     * @param[out] pDest     n decoded samples.
+     *
+     * @return false if the type is not supported.
+     */
+    static bool decode_samples(const char* pSrc,
+                               fiff_int_t type,
+                               bool bSwap,
+                               qint64 n,
+                               const float* pCals,
+                               float* pDest);
+
+    static bool decode_samples(const char* pSrc,
+                               fiff_int_t type,
+                               bool bSwap,
+                               qint64 n,
+                               const double* pCals,
+                               double* pDest);
+
+    //=========================================================================================================
+    /**
+     * Decodes n consecutive 16 bit samples (FIFFT_DAU_PACK16 or FIFFT_SHORT) without conversion.
+     *
+     * @param[in] pSrc       the samples as stored in the file, no alignment required.
+     * @param[in] type       the fiff type of the samples.
+     * @param[in] bSwap      whether the byte order of the samples is not the native one.
+     * @param[in] n          number of samples.
+     * @param[out] pDest     n decoded samples.
+     *
+     * @return false if the type is not supported.
+     */
+    static bool decode_samples(const char* pSrc,
+                               fiff_int_t type,
+                               bool bSwap,
+                               qint64 n,
+                               qint16* pDest);
+
+    //=========================================================================================================
+    /**
+     * Returns the instruction set used by swap_bytes and decode_samples: 0 scalar, 1 SSE2, 2 AVX2.
+     *
+     * @return the simd level.
+     */
+    static int simd_level();
+
+    //=========================================================================================================
+    /**
+     * Limits the instruction set used by swap_bytes and decode_samples, e.g. to compare against the scalar
+     * kernels. Levels above the one supported by the cpu are clamped. Can be called while other threads read tags,
+     * they pick up the new level with their next call.
+     *
+     * @param[in] iLevel     0 scalar, 1 SSE2, 2 AVX2.
+     *
+     * @return the simd level in use.
+     */
+    static int set_simd_level(int iLevel);
+
 public:
     fiff_int_t  kind;       /**< Tag number.
                              *   This defines the meaning of the item */
@@ -536,6 +622,25 @@ private:
 // INLINE DEFINITIONS
 //=============================================================================================================
 
+inline void FiffTag::convert_matrix_from_file_data(FiffTag::SPtr tag)
+{
+    convert_matrix_from_file_data(tag.data());
+}
+
+//=============================================================================================================
+
+inline void FiffTag::convert_matrix_to_file_data(FiffTag::SPtr tag)
+{
+    convert_matrix_to_file_data(tag.data());
+}
+
+//=============================================================================================================
+
+inline void FiffTag::convert_tag_data(FiffTag::SPtr tag, int from_endian, int to_endian)
+{
+    convert_tag_data(tag.data(), from_endian, to_endian);
+}
+
 //=============================================================================================================
 // Simple types
 //=============================================================================================================
@@ -56,12 +56,18 @@
 #include <QList>
 #include <QThread>
 #include <QtConcurrent>
+#include <QAtomicInt>
+#include <QVector>
+#include <QtEndian>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <string.h>
 
 #include <Eigen/Dense>
 
+#include <functional>
+
 static float Qx[] = {1.0,0.0,0.0};
 static float Qy[] = {0.0,1.0,0.0};
 static float Qz[] = {0.0,0.0,1.0};
@@ -182,15 +188,171 @@ void fromFloatEigenMatrix_40(const Eigen::MatrixXf& from_mat, float **& to_mat)
     fromFloatEigenMatrix_40(from_mat, to_mat, from_mat.rows(), from_mat.cols());
 }
 
+/*
+ * Column block width of the LU decomposition and
+ * chunk sizes of the multithreaded loops below
+ */
+#define LU_BLOCK_40    128
+#define LU_NRHS_40     64
+#define ROW_CHUNK_40   32
+#define COL_CHUNK_40   256
+
+static void parallel_chunks_40(int n,
+                               int chunk,
+                               const std::function<void(int from, int to)>& func,
+                               bool report)
+/*
+ * Call func for the ranges [from,to) covering [0,n) using all available threads.
+ * The chunks are claimed one at a time so that chunks of unequal cost even out.
+ * If requested, the calling thread reports the progress in 10% steps.
+ */
+{
+    QAtomicInt next(0);
+    QAtomicInt ndone(0);
+    int  nchunk   = (n + chunk - 1)/chunk;
+    int  nthread  = qMin(qMax(1,QThread::idealThreadCount()),nchunk);
+    int  reported = 0;
+    int  k;
+
+    auto work = [&](bool main) {
+        int c;
+        while ((c = next.fetchAndAddOrdered(1)) < nchunk) {
+            func(c*chunk,qMin(n,(c+1)*chunk));
+            ndone.fetchAndAddOrdered(1);
+            if (main && report)
+                for (; reported + 10 <= 100*ndone.loadAcquire()/nchunk; reported += 10)
+                    fprintf(stderr,"%d%% ",reported+10);
+        }
+    };
+    QVector<QFuture<void> > futures;
+    for (k = 1; k < nthread; k++)
+        futures.append(QtConcurrent::run(work,false));
+    work(true);
+    for (k = 0; k < futures.size(); k++)
+        futures[k].waitForFinished();
+    if (report)
+        for (; reported < 100; reported += 10)
+            fprintf(stderr,"%d%% ",reported+10);
+}
+
+static int lu_panel_40(Eigen::Ref<Eigen::MatrixXf> a, int *piv)
+/*
+ * Recursive LU decomposition of a tall panel with partial pivoting.
+ * The row interchanges are applied within the panel only,
+ * piv[j] is the row exchanged with row j (relative to the panel)
+ */
+{
+    int m = a.rows();
+    int w = a.cols();
+    int w1,w2,j;
+
+    if (w == 1) {
+        if (a.col(0).cwiseAbs().maxCoeff(&piv[0]) == 0.0)
+            return FAIL;
+        if (piv[0] != 0)
+            std::swap(a(0,0),a(piv[0],0));
+        a.col(0).tail(m-1) /= a(0,0);
+        return OK;
+    }
+    w1 = w/2;
+    w2 = w - w1;
+    if (lu_panel_40(a.leftCols(w1),piv) == FAIL)
+        return FAIL;
+    for (j = 0; j < w1; j++)
+        if (piv[j] != j)
+            a.row(j).tail(w2).swap(a.row(piv[j]).tail(w2));
+    a.topLeftCorner(w1,w1).triangularView<Eigen::UnitLower>().solveInPlace(a.topRightCorner(w1,w2));
+    a.bottomRightCorner(m-w1,w2).noalias() -= a.bottomLeftCorner(m-w1,w1)*a.topRightCorner(w1,w2);
+    if (lu_panel_40(a.bottomRightCorner(m-w1,w2),piv+w1) == FAIL)
+        return FAIL;
+    for (j = w1; j < w; j++) {
+        piv[j] += w1;
+        if (piv[j] != j)
+            a.row(j).head(w1).swap(a.row(piv[j]).head(w1));
+    }
+    return OK;
+}
+
+static int lu_factor_40(Eigen::Map<Eigen::MatrixXf>& a, Eigen::VectorXi& piv)
+/*
+ * Blocked right-looking LU decomposition with partial pivoting.
+ * The panels are factored on the calling thread, the row interchanges
+ * and the trailing matrix update are distributed over the threads by columns
+ */
+{
+    int n = a.rows();
+    int k,nb,j,reported;
+
+    piv.resize(n);
+    fprintf(stderr,"\t\tLU decomposition ... ");
+    for (k = 0, reported = 0; k < n; k += nb) {
+        nb = qMin(LU_BLOCK_40,n-k);
+        if (lu_panel_40(a.block(k,k,n-k,nb),piv.data()+k) == FAIL) {
+            fprintf(stderr,"[failed]\n");
+            printf("The coefficient matrix is singular.\n");
+            return FAIL;
+        }
+        for (j = k; j < k+nb; j++)
+            piv[j] += k;
+        /*
+         * The columns outside the panel in the order [0,k) [k+nb,n)
+         */
+        parallel_chunks_40(n-nb,LU_BLOCK_40,[&](int from, int to) {
+            int left = qMin(to,k) - from;
+            int c;
+            if (left > 0)
+                for (c = k; c < k+nb; c++)
+                    if (piv[c] != c)
+                        a.block(c,from,1,left).swap(a.block(piv[c],from,1,left));
+            from = qMax(from,k) + nb;
+            to   = to + nb;
+            if (to > from) {
+                for (c = k; c < k+nb; c++)
+                    if (piv[c] != c)
+                        a.block(c,from,1,to-from).swap(a.block(piv[c],from,1,to-from));
+                a.block(k,k,nb,nb).triangularView<Eigen::UnitLower>().solveInPlace(a.block(k,from,nb,to-from));
+                a.block(k+nb,from,n-k-nb,to-from).noalias() -= a.block(k+nb,k,n-k-nb,nb)*a.block(k,from,nb,to-from);
+            }
+        },false);
+        /*
+         * The work left is proportional to the cube of the trailing dimension
+         */
+        for (; reported + 10 <= 100.0*(1.0 - pow((double)(n-k-nb)/n,3)); reported += 10)
+            fprintf(stderr,"%d%% ",reported+10);
+    }
+    fprintf(stderr,"[done]\n");
+    return OK;
+}
+
 float **mne_lu_invert_40(float **mat,int dim)
 /*
-      * Invert a matrix using the LU decomposition from
-      * LAPACK
+      * Invert a matrix using the LU decomposition.
+      * The contiguous row-major matrix is used as is as the column-major transpose:
+      * inverting the transpose in place leaves the row-major inverse behind.
+      * Returns NULL if the matrix is singular.
       */
 {
-    Eigen::MatrixXf eigen_mat = toFloatEigenMatrix_40(mat, dim, dim);
-    Eigen::MatrixXf eigen_mat_inv = eigen_mat.inverse();
-    fromFloatEigenMatrix_40(eigen_mat_inv, mat);
+    Eigen::Map<Eigen::MatrixXf> lu(mat[0],dim,dim);
+    Eigen::VectorXi piv;
+    Eigen::MatrixXf inv(dim,dim);
+
+    if (lu_factor_40(lu,piv) == FAIL)
+        return NULL;
+    fprintf(stderr,"\t\tInverse ... ");
+    parallel_chunks_40(dim,LU_NRHS_40,[&](int from, int to) {
+        Eigen::Ref<Eigen::MatrixXf> x = inv.middleCols(from,to-from);
+        int j;
+        x.setZero();
+        for (j = from; j < to; j++)
+            x(j,j-from) = 1.0;
+        for (j = 0; j < dim; j++)
+            if (piv[j] != j)
+                x.row(j).swap(x.row(piv[j]));
+        lu.triangularView<Eigen::UnitLower>().solveInPlace(x);
+        lu.triangularView<Eigen::Upper>().solveInPlace(x);
+    },true);
+    fprintf(stderr,"[done]\n");
+    lu = inv;
     return mat;
 }
 
@@ -281,41 +443,19 @@ float **mne_mat_mat_mult_40 (float **m1,
            &one,m2[0],&d3,m1[0],&d2,&zero,result[0],&d3);
     return (result);
 #else
+    typedef Eigen::Map<Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> > RowMajorMap;
     float **result = ALLOC_CMATRIX_40(d1,d3);
-    int j,k,p;
-    float sum;
-
-    // TODO: Hack to include faster Eigen processing. This should eventually be replaced dwith pure Eigen logic.
-    MatrixXf a(d1,d2);
-    MatrixXf b(d2,d3);
-
-    for (j = 0; j < d1; j++) {
-        for (k = 0; k < d2; k++) {
-            a(j,k) = m1[j][k];
-        }
-    }
-
-    for (j = 0; j < d2; j++) {
-        for (k = 0; k < d3; k++) {
-            b(j,k) = m2[j][k];
-        }
-    }
-
-    MatrixXf resultMat = a * b;
-
-    for (j = 0; j < d1; j++) {
-        for (k = 0; k < d3; k++) {
-            result[j][k] = resultMat(j,k);
-        }
-    }
+    /*
+     * The cmatrices are contiguous row-major blocks: multiply them in place,
+     * splitting the columns of the result between the threads
+     */
+    RowMajorMap a(m1[0],d1,d2);
+    RowMajorMap b(m2[0],d2,d3);
+    RowMajorMap c(result[0],d1,d3);
 
-//    for (j = 0; j < d1; j++)
-//        for (k = 0; k < d3; k++) {
-//            sum = 0.0;
-//            for (p = 0; p < d2; p++)
-//                sum = sum + m1[j][p]*m2[p][k];
-//            result[j][k] = sum;
-//        }
+    parallel_chunks_40(d3,COL_CHUNK_40,[&](int from, int to) {
+        c.middleCols(from,to-from).noalias() = a*b.middleCols(from,to-from);
+    },false);
     return (result);
 #endif
 }
@@ -638,6 +778,45 @@ FwdBemModel *FwdBemModel::fwd_bem_load_three_layer_surfaces(const QString &name)
 
 //=============================================================================================================
 
+static float **read_mapped_solution_40(QFile& file, const FiffDirEntry::SPtr& ent, int dim)
+/*
+ * Read a dim x dim solution matrix by mapping the tag data into memory
+ * and fixing the (big endian) byte order while copying it into the cmatrix.
+ * The matrix is stored row by row in the file, i.e., exactly like a cmatrix.
+ * Returns NULL if the tag is not a dense float matrix of this size
+ * or if it cannot be mapped; the caller then reads the tag as usual.
+ */
+{
+    qint64 nval = (qint64)dim*dim;
+    float  **sol;
+    uchar  *data;
+    float  *to;
+    qint64 k;
+
+    if (ent->type != FIFFT_MATRIX_FLOAT || ent->size != nval*(qint64)sizeof(float) + 3*(qint64)sizeof(fiff_int_t))
+        return NULL;
+    if ((data = file.map(ent->pos + FIFFC_DATA_OFFSET,ent->size)) == NULL)
+        return NULL;
+    /*
+     * The dimensions and their number follow the data
+     */
+    if (qFromBigEndian<qint32>(data + ent->size - sizeof(fiff_int_t)) != 2 ||
+            qFromBigEndian<qint32>(data + nval*sizeof(float)) != dim ||
+            qFromBigEndian<qint32>(data + nval*sizeof(float) + sizeof(fiff_int_t)) != dim) {
+        file.unmap(data);
+        return NULL;
+    }
+    sol = ALLOC_CMATRIX_40(dim,dim);
+    for (k = 0, to = sol[0]; k < nval; k++) {
+        quint32 val = qFromBigEndian<quint32>(data + k*sizeof(float));
+        memcpy(to + k,&val,sizeof(float));
+    }
+    file.unmap(data);
+    return sol;
+}
+
+//=============================================================================================================
+
 int FwdBemModel::fwd_bem_load_solution(const QString &name, int bem_method, FwdBemModel *m)
 /*
      * Load the potential solution matrix and attach it to the model:
@@ -648,6 +827,10 @@ int FwdBemModel::fwd_bem_load_solution(const QString &name, int bem_method, FwdB
      *       FALSE  did not find a suitable solution
      *       FAIL   error in reading the solution
      *
+     * The collocation equations are not symmetric and neither is their solution,
+     * so the full matrix is kept. It is loaded once per model and reused for all
+     * coil and electrode sets specified with it, e.g., for many head positions.
+     *
      */
 {
     QFile file(name);
@@ -694,6 +877,20 @@ int FwdBemModel::fwd_bem_load_solution(const QString &name, int bem_method, FwdB
     {
         int         dim,k;
 
+        for (k = 0, dim = 0; k < m->nsurf; k++)
+            dim = dim + ((method == FWD_BEM_LINEAR_COLL) ? m->surfs[k]->np : m->surfs[k]->ntri);
+        /*
+         * Try the fast route first
+         */
+        for (k = 0; k < bem_node->nent(); k++)
+            if (bem_node->dir[k]->kind == FIFF_BEM_POT_SOLUTION) {
+                sol = read_mapped_solution_40(file,bem_node->dir[k],dim);
+                break;
+            }
+        if (sol) {
+            nsol = dim;
+            goto found;
+        }
         if (!bem_node->find_tag(stream, FIFF_BEM_POT_SOLUTION, t_pTag))
             goto bad;
         qint32 ndim;
@@ -704,18 +901,24 @@ int FwdBemModel::fwd_bem_load_solution(const QString &name, int bem_method, FwdB
             printf("Expected a two-dimensional solution matrix instead of a %d dimensional one",ndim);
             goto bad;
         }
-        for (k = 0, dim = 0; k < m->nsurf; k++)
-            dim = dim + ((method == FWD_BEM_LINEAR_COLL) ? m->surfs[k]->np : m->surfs[k]->ntri);
+        if (t_pTag->getType() != FIFFT_FLOAT || FiffTag::fiff_type_matrix_coding(t_pTag->type) != FIFFTS_MC_DENSE) {
+            printf("Expected a dense float solution matrix");
+            goto bad;
+        }
         if (dims[0] != dim || dims[1] != dim) {
             printf("Expected a %d x %d solution matrix instead of a %d x %d  one",dim,dim,dims[0],dims[1]);
             goto not_found;
         }
 
-        MatrixXf tmp_sol = t_pTag->toFloatMatrix().transpose();
-        sol = ALLOC_CMATRIX_40(tmp_sol.rows(),tmp_sol.cols());
-        fromFloatEigenMatrix_40(tmp_sol, sol);
-        nsol = dims[1];
+        /*
+         * The tag data are already in the row-major order of a cmatrix
+         */
+        sol = ALLOC_CMATRIX_40(dim,dim);
+        memcpy(sol[0],t_pTag->data(),(size_t)dim*dim*sizeof(float));
+        nsol = dim;
     }
+
+found :
     if(m)
         m->fwd_bem_free_solution();
     m->sol_name = name;
@@ -1042,10 +1245,7 @@ float **FwdBemModel::fwd_bem_lin_pot_coeff(const QList<MneSurfaceOld*>& surfs)
     float **sub_mat = NULL;
     int   np1,np2,ntri,np_tot,np_max;
     float **nodes;
-    MneTriangle*   tri;
-    double omega[3];
-    double *row = NULL;
-    int    j,k,p,q,c;
+    int    j,k,p,q;
     int    joff,koff;
     MneSurfaceOld* surf1;
     MneSurfaceOld* surf2;
@@ -1060,7 +1260,6 @@ float **FwdBemModel::fwd_bem_lin_pot_coeff(const QList<MneSurfaceOld*>& surfs)
     for (j = 0; j < np_tot; j++)
         for (k = 0; k < np_tot; k++)
             mat[j][k] = 0.0;
-    row        = MALLOC_40(np_max,double);
     sub_mat = MALLOC_40(np_max,float *);
     for (p = 0, joff = 0; p < surfs.size(); p++, joff = joff + np1) {
         surf1 = surfs[p];
@@ -1075,26 +1274,37 @@ float **FwdBemModel::fwd_bem_lin_pot_coeff(const QList<MneSurfaceOld*>& surfs)
                     fwd_bem_explain_surface(surf1->id).toUtf8().constData(),np1,
                     fwd_bem_explain_surface(surf2->id).toUtf8().constData(),np2);
 
-            for (j = 0; j < np1; j++) {
-                for (k = 0; k < np2; k++)
-                    row[k] = 0.0;
-                for (k = 0, tri = surf2->tris; k < ntri; k++,tri++) {
-                    /*
-               * No contribution from a triangle that
-               * this vertex belongs to
-               */
-                    if (p == q && (tri->vert[0] == j || tri->vert[1] == j || tri->vert[2] == j))
-                        continue;
-                    /*
-               * Otherwise do the hard job
-               */
-                    lin_pot_coeff (nodes[j],tri,omega);
-                    for (c = 0; c < 3; c++)
-                        row[tri->vert[c]] = row[tri->vert[c]] - omega[c];
+            /*
+             * The rows are independent: compute them in parallel
+             */
+            parallel_chunks_40(np1,ROW_CHUNK_40,[&](int from, int to) {
+                double *row = MALLOC_40(np2,double);
+                double omega[3];
+                MneTriangle* tri;
+                int    j,k,c;
+
+                for (j = from; j < to; j++) {
+                    for (k = 0; k < np2; k++)
+                        row[k] = 0.0;
+                    for (k = 0, tri = surf2->tris; k < ntri; k++,tri++) {
+                        /*
+                         * No contribution from a triangle that
+                         * this vertex belongs to
+                         */
+                        if (p == q && (tri->vert[0] == j || tri->vert[1] == j || tri->vert[2] == j))
+                            continue;
+                        /*
+                         * Otherwise do the hard job
+                         */
+                        lin_pot_coeff (nodes[j],tri,omega);
+                        for (c = 0; c < 3; c++)
+                            row[tri->vert[c]] = row[tri->vert[c]] - omega[c];
+                    }
+                    for (k = 0; k < np2; k++)
+                        mat[j+joff][k+koff] = row[k];
                 }
-                for (k = 0; k < np2; k++)
-                    mat[j+joff][k+koff] = row[k];
-            }
+                FREE_40(row);
+            },true);
             if (p == q) {
                 for (j = 0; j < np1; j++)
                     sub_mat[j] = mat[j+joff]+koff;
@@ -1103,7 +1313,6 @@ float **FwdBemModel::fwd_bem_lin_pot_coeff(const QList<MneSurfaceOld*>& surfs)
             fprintf(stderr,"[done]\n");
         }
     }
-    FREE_40(row);
     FREE_40(sub_mat);
     return(mat);
 }
@@ -1344,12 +1553,10 @@ float **FwdBemModel::fwd_bem_solid_angles(const QList<MneSurfaceOld*>& surfs)
 {
     MneSurfaceOld* surf1;
     MneSurfaceOld* surf2;
-    MneTriangle* tri;
     int ntri1,ntri2,ntri_tot;
-    int j,k,p,q;
+    int j,p,q;
     int joff,koff;
     float **solids;
-    float result;
     float **sub_solids = NULL;
     float desired;
 
@@ -1365,14 +1572,17 @@ float **FwdBemModel::fwd_bem_solid_angles(const QList<MneSurfaceOld*>& surfs)
             surf2 = surfs[q];
             ntri2 = surf2->ntri;
             fprintf(stderr,"\t\t%s (%d) -> %s (%d) ... ",fwd_bem_explain_surface(surf1->id).toUtf8().constData(),ntri1,fwd_bem_explain_surface(surf2->id).toUtf8().constData(),ntri2);
-            for (j = 0; j < ntri1; j++)
-                for (k = 0, tri = surf2->tris; k < ntri2; k++, tri++) {
-                    if (p == q && j == k)
-                        result = 0.0;
-                    else
-                        result = MneSurfaceOrVolume::solid_angle (surf1->tris[j].cent,tri);
-                    solids[j+joff][k+koff] = result;
-                }
+            parallel_chunks_40(ntri1,ROW_CHUNK_40,[&](int from, int to) {
+                MneTriangle* tri;
+                int j,k;
+                for (j = from; j < to; j++)
+                    for (k = 0, tri = surf2->tris; k < ntri2; k++, tri++) {
+                        if (p == q && j == k)
+                            solids[j+joff][k+koff] = 0.0;
+                        else
+                            solids[j+joff][k+koff] = MneSurfaceOrVolume::solid_angle (surf1->tris[j].cent,tri);
+                    }
+            },true);
             for (j = 0; j < ntri1; j++)
                 sub_solids[j] = solids[j+joff]+koff;
             fprintf(stderr,"[done]\n");
@@ -2128,15 +2338,9 @@ float **FwdBemModel::fwd_bem_field_coeff(FwdBemModel *m, FwdCoilSet *coils)	/* G
      * Compute the weighting factors to obtain the magnetic field
      */
 {
-    MneSurfaceOld*     surf;
-    MneTriangle*    tri;
-    FwdCoil*        coil;
     FwdCoilSet*     tcoils = NULL;
     int            ntri;
     float          **coeff = NULL;
-    int            j,k,p,s,off;
-    double         res;
-    double         mult;
 
     if (m->solution == NULL) {
         printf("Solution matrix missing in fwd_bem_field_coeff");
@@ -2173,23 +2377,33 @@ float **FwdBemModel::fwd_bem_field_coeff(FwdBemModel *m, FwdCoilSet *coils)	/* G
     ntri  = m->nsol;
     coeff = ALLOC_CMATRIX_40(coils->ncoil,ntri);
 
-    for (s = 0, off = 0; s < m->nsurf; s++) {
-        surf = m->surfs[s];
-        ntri = surf->ntri;
-        tri  = surf->tris;
-        mult = m->field_mult[s];
-
-        for (k = 0; k < ntri; k++,tri++) {
-            for (j = 0; j < coils->ncoil; j++) {
-                coil = coils->coils[j];
-                res = 0.0;
-                for (p = 0; p < coil->np; p++)
-                    res = res + coil->w[p]*one_field_coeff(coil->rmag[p],coil->cosmag[p],tri);
-                coeff[j][k+off] = mult*res;
+    /*
+     * Each coil has its own row: process the coils in parallel
+     */
+    parallel_chunks_40(coils->ncoil,1,[&](int from, int to) {
+        MneSurfaceOld* surf;
+        MneTriangle*   tri;
+        FwdCoil*       coil;
+        int            ntri,j,k,p,s,off;
+        double         res,mult;
+
+        for (s = 0, off = 0; s < m->nsurf; s++) {
+            surf = m->surfs[s];
+            ntri = surf->ntri;
+            mult = m->field_mult[s];
+
+            for (k = 0, tri = surf->tris; k < ntri; k++,tri++) {
+                for (j = from; j < to; j++) {
+                    coil = coils->coils[j];
+                    res = 0.0;
+                    for (p = 0; p < coil->np; p++)
+                        res = res + coil->w[p]*one_field_coeff(coil->rmag[p],coil->cosmag[p],tri);
+                    coeff[j][k+off] = mult*res;
+                }
             }
+            off = off + ntri;
         }
-        off = off + ntri;
-    }
+    },false);
     delete tcoils;
     return coeff;
 }
@@ -2345,15 +2559,9 @@ float **FwdBemModel::fwd_bem_lin_field_coeff(FwdBemModel *m, FwdCoilSet *coils,
           * in the linear potential approximation
           */
 {
-    MneSurfaceOld*  surf;
-    MneTriangle* tri;
-    FwdCoil*     coil;
     FwdCoilSet*  tcoils = NULL;
-    int         ntri;
     float       **coeff  = NULL;
-    int         j,k,p,pp,off,s;
-    double      res[3],one[3];
-    float       mult;
+    int         j,k;
     linFieldIntFunc func;
 
     if (m->solution == NULL) {
@@ -2402,35 +2610,46 @@ float **FwdBemModel::fwd_bem_lin_field_coeff(FwdBemModel *m, FwdCoilSet *coils,
     /*
        * Process each of the surfaces
        */
-    for (s = 0, off = 0; s < m->nsurf; s++) {
-        surf = m->surfs[s];
-        ntri = surf->ntri;
-        tri  = surf->tris;
-        mult = m->field_mult[s];
-
-        for (k = 0; k < ntri; k++,tri++) {
-            for (j = 0; j < coils->ncoil; j++) {
-                coil = coils->coils[j];
-                for (pp = 0; pp < 3; pp++)
-                    res[pp] = 0;
-                /*
-             * Accumulate the coefficients for each triangle node...
-             */
-                for (p = 0; p < coil->np; p++) {
-                    func(coil->rmag[p],coil->cosmag[p],tri,one);
+    /*
+     * Each coil has its own row: process the coils in parallel
+     */
+    parallel_chunks_40(coils->ncoil,1,[&](int from, int to) {
+        MneSurfaceOld* surf;
+        MneTriangle*   tri;
+        FwdCoil*       coil;
+        int            ntri,j,k,p,pp,off,s;
+        double         res[3],one[3];
+        float          mult;
+
+        for (s = 0, off = 0; s < m->nsurf; s++) {
+            surf = m->surfs[s];
+            ntri = surf->ntri;
+            mult = m->field_mult[s];
+
+            for (k = 0, tri = surf->tris; k < ntri; k++,tri++) {
+                for (j = from; j < to; j++) {
+                    coil = coils->coils[j];
+                    for (pp = 0; pp < 3; pp++)
+                        res[pp] = 0;
+                    /*
+                     * Accumulate the coefficients for each triangle node...
+                     */
+                    for (p = 0; p < coil->np; p++) {
+                        func(coil->rmag[p],coil->cosmag[p],tri,one);
+                        for (pp = 0; pp < 3; pp++)
+                            res[pp] = res[pp] + coil->w[p]*one[pp];
+                    }
+                    /*
+                     * Add these to the corresponding coefficient matrix
+                     * elements...
+                     */
                     for (pp = 0; pp < 3; pp++)
-                        res[pp] = res[pp] + coil->w[p]*one[pp];
+                        coeff[j][tri->vert[pp]+off] = coeff[j][tri->vert[pp]+off] + mult*res[pp];
                 }
-                /*
-             * Add these to the corresponding coefficient matrix
-             * elements...
-             */
-                for (pp = 0; pp < 3; pp++)
-                    coeff[j][tri->vert[pp]+off] = coeff[j][tri->vert[pp]+off] + mult*res[pp];
             }
+            off = off + surf->np;
         }
-        off = off + surf->np;
-    }
+    },false);
     /*
        * Discard the duplicate
        */
@@ -2477,7 +2696,7 @@ int FwdBemModel::fwd_bem_specify_coils(FwdBemModel *m, FwdCoilSet *coils)
                                           m->solution,
                                           coils->ncoil,
                                           m->nsol,
-                                          m->nsol);//TODO: Suspicion, that this is slow - use Eigen
+                                          m->nsol);
 
     FREE_CMATRIX_40(sol);
     return OK;
@@ -6,6 +6,10 @@
 
 #include <string.h>
 #include <QScopedPointer>
+#include <QVector>
+#include <QThread>
+#include <QAtomicInt>
+#include <QtConcurrent>
 
 using namespace INVERSELIB;
 using namespace MNELIB;
@@ -48,6 +52,8 @@ using namespace FWDLIB;
 
 #define EPS_VALUES 0.05
 
+#define FIT_BATCH_PER_THREAD 16
+
 //=============================================================================================================
 // STATIC DEFINITIONS ToDo make members
 //=============================================================================================================
@@ -546,6 +552,133 @@ int mne_get_values_from_data_ch (float time,      /* Interesting time point */
     return (0);
 }
 
+//=============================================================================================================
+
+/*
+ * Time points collected for fitting in parallel.
+ * Each thread owns its copy of the forward functions, so that their work areas are not shared.
+ * Thread 0 is the calling thread, which uses the original functions of the fit data.
+ */
+typedef struct {
+    int                     nthreads;
+    int                     nchan;
+    int                     size;           /* Capacity of the batch */
+    int                     npoint;         /* Time points collected so far */
+    int                     warm;           /* Has one point been fitted yet? */
+    float                   *times;
+    float                   **B;
+    QVector<dipoleFitFuncs> sphere_funcs;
+    QVector<dipoleFitFuncs> bem_funcs;
+    QVector<ECD>            dips;
+    QVector<bool>           ok;
+} *fitBatch,fitBatchRec;
+
+static fitBatch new_fit_batch(DipoleFitData* fit, int nthreads, int nchan)
+{
+    fitBatch batch = new fitBatchRec;
+    int      bem   = !fit->bemname.isEmpty();
+
+    batch->nthreads = nthreads;
+    batch->nchan    = nchan;
+    batch->size     = FIT_BATCH_PER_THREAD*nthreads;
+    batch->npoint   = 0;
+    batch->warm     = FALSE;
+    batch->times    = MALLOC(batch->size,float);
+    batch->B        = ALLOC_CMATRIX(batch->size,nchan);
+    batch->dips.resize(batch->size);
+    batch->ok.resize(batch->size);
+
+    batch->sphere_funcs.append(fit->sphere_funcs);
+    batch->bem_funcs.append(bem ? fit->bem_funcs : NULL);
+    for (int k = 1; k < nthreads; k++) {
+        batch->sphere_funcs.append(DipoleFitData::dup_dipole_fit_funcs(fit->sphere_funcs,false));
+        batch->bem_funcs.append(bem ? DipoleFitData::dup_dipole_fit_funcs(fit->bem_funcs,true) : NULL);
+    }
+    return batch;
+}
+
+static void free_fit_batch(fitBatch batch)
+{
+    if (!batch)
+        return;
+    for (int k = 1; k < batch->nthreads; k++) {
+        DipoleFitData::free_dup_dipole_fit_funcs(batch->sphere_funcs[k],false);
+        if (batch->bem_funcs[k])
+            DipoleFitData::free_dup_dipole_fit_funcs(batch->bem_funcs[k],true);
+    }
+    FREE(batch->times);
+    FREE_CMATRIX(batch->B);
+    delete batch;
+}
+
+static void fit_batch_add(fitBatch batch, float time, float *one)
+{
+    batch->times[batch->npoint] = time;
+    memcpy(batch->B[batch->npoint],one,batch->nchan*sizeof(float));
+    batch->npoint++;
+}
+
+static void fit_batch_points(fitBatch batch, DipoleFitData* fit, GuessData* guess, int verbose)
+/*
+ * Fit all collected points. The threads pick the next unfitted point until none are left,
+ * the results are stored by index so that the time order is preserved.
+ * With verbose output the simplex reports of points fitted at the same time may interleave.
+ */
+{
+    QAtomicInt             next(0);
+    QVector<QFuture<void>> futures;
+    int                    first = 0;
+
+    /*
+     * Fit the first point of the run alone to complete any lazy initializations of the models
+     */
+    if (!batch->warm && batch->npoint > 0) {
+        batch->ok[0] = DipoleFitData::fit_one(fit,batch->sphere_funcs[0],batch->bem_funcs[0],guess,
+                                              batch->times[0],batch->B[0],verbose,batch->dips[0]);
+        batch->warm = TRUE;
+        first = 1;
+    }
+    next = first;
+
+    ECD  *dips = batch->dips.data();
+    bool *ok   = batch->ok.data();
+    auto worker = [batch, fit, guess, verbose, dips, ok, &next](int thread) {
+        dipoleFitFuncs sphere_funcs = batch->sphere_funcs.at(thread);
+        dipoleFitFuncs bem_funcs    = batch->bem_funcs.at(thread);
+        int k;
+        while ((k = next.fetchAndAddOrdered(1)) < batch->npoint)
+            ok[k] = DipoleFitData::fit_one(fit,sphere_funcs,bem_funcs,guess,batch->times[k],batch->B[k],verbose,dips[k]);
+    };
+
+    for (int t = 1; t < batch->nthreads && first + t < batch->npoint; t++)
+        futures.append(QtConcurrent::run(worker,t));
+    worker(0);
+    for (int t = 0; t < futures.size(); t++)
+        futures[t].waitForFinished();
+}
+
+static void fit_batch_flush(fitBatch batch, DipoleFitData* fit, GuessData* guess, int verbose, int report_interval, ECDSet& set)
+/*
+ * Fit the collected points and add the results to the set in time order
+ */
+{
+    fit_batch_points(batch,fit,guess,verbose);
+    for (int k = 0; k < batch->npoint; k++) {
+        if (!batch->ok[k])
+            printf("t = %7.1f ms : %s\n",1000*batch->times[k],"error (tbd: catch)");
+        else {
+            set.addEcd(batch->dips[k]);
+            if (verbose)
+                batch->dips[k].print(stdout);
+            else {
+                if (set.size() % report_interval == 0)
+                    fprintf(stderr,"%d..",set.size());
+            }
+        }
+    }
+    batch->npoint = 0;
+}
+
 //=============================================================================================================
 // DEFINE MEMBER METHODS
 //=============================================================================================================
@@ -662,7 +795,8 @@ ECDSet DipoleFit::calculateFit() const
     printf("\n---- Computing the forward solution for the guesses...\n\n");
     guess.reset(new GuessData( settings->guessname,
                                settings->guess_surfname,
-                               settings->guess_mindist, settings->guess_exclude, settings->guess_grid, fit_data));
+                               settings->guess_mindist, settings->guess_exclude, settings->guess_grid, fit_data,
+                               settings->guess_cache_dir));
     if (guess.isNull())
         goto out;
 
@@ -670,11 +804,11 @@ ECDSet DipoleFit::calculateFit() const
              1000*settings->tmin,1000*settings->tmax,1000*settings->tstep,1000*settings->integ);
 
     if (raw) {
-        if (fit_dipoles_raw(settings->measname,raw,sel,fit_data,guess.take(),settings->tmin,settings->tmax,settings->tstep,settings->integ,settings->verbose) == FAIL)
+        if (fit_dipoles_raw(settings->measname,raw,sel,fit_data,guess.take(),settings->tmin,settings->tmax,settings->tstep,settings->integ,settings->verbose,settings->nthreads) == FAIL)
             goto out;
     }
     else {
-        if (fit_dipoles(settings->measname,data,fit_data,guess.take(),settings->tmin,settings->tmax,settings->tstep,settings->integ,settings->verbose,set) == FAIL)
+        if (fit_dipoles(settings->measname,data,fit_data,guess.take(),settings->tmin,settings->tmax,settings->tstep,settings->integ,settings->verbose,set,settings->nthreads) == FAIL)
             goto out;
     }
     printf("%d dipoles fitted\n",set.size());
@@ -686,7 +820,7 @@ out : {
 
 //=============================================================================================================
 
-int DipoleFit::fit_dipoles( const QString& dataname, MneMeasData* data, DipoleFitData* fit, GuessData* guess, float tmin, float tmax, float tstep, float integ, int verbose, ECDSet& p_set)
+int DipoleFit::fit_dipoles( const QString& dataname, MneMeasData* data, DipoleFitData* fit, GuessData* guess, float tmin, float tmax, float tstep, float integ, int verbose, ECDSet& p_set, int nthreads)
 {
     float *one = MALLOC(data->nchan,float);
     float time;
@@ -694,6 +828,7 @@ int DipoleFit::fit_dipoles( const QString& dataname, MneMeasData* data, DipoleFi
     ECD   dip;
     int   s;
     int   report_interval = 10;
+    fitBatch batch = nthreads > 1 ? new_fit_batch(fit,nthreads,data->nchan) : NULL;
 
     set.dataname = dataname;
 
@@ -708,6 +843,12 @@ int DipoleFit::fit_dipoles( const QString& dataname, MneMeasData* data, DipoleFi
             continue;
         }
 
+        if (batch) {
+            fit_batch_add(batch,time,one);
+            if (batch->npoint == batch->size)
+                fit_batch_flush(batch,fit,guess,verbose,report_interval,set);
+            continue;
+        }
         if (!DipoleFitData::fit_one(fit,guess,time,one,verbose,dip))
             printf("t = %7.1f ms : %s\n",1000*time,"error (tbd: catch)");
         else {
@@ -720,6 +861,10 @@ int DipoleFit::fit_dipoles( const QString& dataname, MneMeasData* data, DipoleFi
             }
         }
     }
+    if (batch) {
+        fit_batch_flush(batch,fit,guess,verbose,report_interval,set);
+        free_fit_batch(batch);
+    }
     if (!verbose)
         fprintf(stderr,"[done]\n");
     FREE(one);
@@ -729,7 +874,7 @@ int DipoleFit::fit_dipoles( const QString& dataname, MneMeasData* data, DipoleFi
 
 //=============================================================================================================
 
-int DipoleFit::fit_dipoles_raw(const QString& dataname, MneRawData* raw, mneChSelection sel, DipoleFitData* fit, GuessData* guess, float tmin, float tmax, float tstep, float integ, int verbose, ECDSet& p_set)
+int DipoleFit::fit_dipoles_raw(const QString& dataname, MneRawData* raw, mneChSelection sel, DipoleFitData* fit, GuessData* guess, float tmin, float tmax, float tstep, float integ, int verbose, ECDSet& p_set, int nthreads)
 {
     float *one    = MALLOC(sel->nchan,float);
     float sfreq   = raw->info->sfreq;
@@ -745,6 +890,7 @@ int DipoleFit::fit_dipoles_raw(const QString& dataname, MneRawData* raw, mneChSe
     ECD    dip;
     ECDSet set;
     int    report_interval = 10;
+    fitBatch batch = nthreads > 1 ? new_fit_batch(fit,nthreads,sel->nchan) : NULL;
 
     set.dataname = dataname;
 
@@ -774,6 +920,12 @@ int DipoleFit::fit_dipoles_raw(const QString& dataname, MneRawData* raw, mneChSe
         /*
      * Fit
      */
+        if (batch) {
+            fit_batch_add(batch,time,one);
+            if (batch->npoint == batch->size)
+                fit_batch_flush(batch,fit,guess,verbose,report_interval,set);
+            continue;
+        }
         if (!DipoleFitData::fit_one(fit,guess,time,one,verbose,dip))
             qWarning() << "Error";
         else {
@@ -786,6 +938,10 @@ int DipoleFit::fit_dipoles_raw(const QString& dataname, MneRawData* raw, mneChSe
             }
         }
     }
+    if (batch) {
+        fit_batch_flush(batch,fit,guess,verbose,report_interval,set);
+        free_fit_batch(batch);
+    }
     if (!verbose)
         fprintf(stderr,"[done]\n");
     FREE_CMATRIX(data);
@@ -794,6 +950,7 @@ int DipoleFit::fit_dipoles_raw(const QString& dataname, MneRawData* raw, mneChSe
     return OK;
 
 bad : {
+        free_fit_batch(batch);
         FREE_CMATRIX(data);
         FREE(one);
         return FAIL;
@@ -802,8 +959,8 @@ bad : {
 
 //=============================================================================================================
 
-int DipoleFit::fit_dipoles_raw(const QString& dataname, MneRawData* raw, mneChSelection sel, DipoleFitData* fit, GuessData* guess, float tmin, float tmax, float tstep, float integ, int verbose)
+int DipoleFit::fit_dipoles_raw(const QString& dataname, MneRawData* raw, mneChSelection sel, DipoleFitData* fit, GuessData* guess, float tmin, float tmax, float tstep, float integ, int verbose, int nthreads)
 {
     ECDSet set;
-    return fit_dipoles_raw(dataname, raw, sel, fit, guess, tmin, tmax, tstep, integ, verbose, set);
+    return fit_dipoles_raw(dataname, raw, sel, fit, guess, tmin, tmax, tstep, integ, verbose, set, nthreads);
 }
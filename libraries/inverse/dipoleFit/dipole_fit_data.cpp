@@ -14,6 +14,7 @@
 #include <mne/c/mne_surface_old.h>
 
 #include <fwd/fwd_comp_data.h>
+#include <fwd/fwd_thread_arg.h>
 
 #include <Eigen/Dense>
 
@@ -462,6 +463,8 @@ typedef struct {
     float          *B;
     double         B2;
     DipoleForward*  fwd;
+    DipoleFitData*  fit;            /* The fit data */
+    dipoleFitFuncs  funcs;          /* The forward functions to use in the current pass */
 } *fitDipUser,fitDipUserRec;
 
 int mne_is_diag_cov_3(MneCovMatrix* c)
@@ -4223,6 +4226,7 @@ out : {
 //=============================================================================================================
 
 DipoleForward* dipole_forward(DipoleFitData* d,
+                              dipoleFitFuncs funcs,
                               float         **rd,
                               int           ndip,
                               DipoleForward* old)
@@ -4259,7 +4263,7 @@ DipoleForward* dipole_forward(DipoleFitData* d,
         /*
      * Calculate the field of three orthogonal dipoles
      */
-        if ((DipoleFitData::compute_dipole_field(d,rd[k],TRUE,this_fwd)) == FAIL)
+        if ((DipoleFitData::compute_dipole_field(d,funcs,rd[k],TRUE,this_fwd)) == FAIL)
             goto bad;
         /*
      * Choice of column normalization
@@ -4317,10 +4321,20 @@ DipoleForward* DipoleFitData::dipole_forward_one(DipoleFitData* d,
 /*
  * Convenience function to compute the field of one dipole
  */
+{
+    return dipole_forward_one(d,d->funcs,rd,old);
+}
+
+//=============================================================================================================
+
+DipoleForward* DipoleFitData::dipole_forward_one(DipoleFitData* d,
+                                                 dipoleFitFuncs funcs,
+                                                 float         *rd,
+                                                 DipoleForward* old)
 {
     float *rds[1];
     rds[0] = rd;
-    return dipole_forward(d,rds,1,old);
+    return dipole_forward(d,funcs,rds,1,old);
 }
 
 //=============================================================================================================
@@ -4330,13 +4344,12 @@ static float fit_eval(float *rd,int npar,void *user)
  * Calculate the residual sum of squares
  */
 {
-    DipoleFitData* fit   = (DipoleFitData*)user;
+    fitDipUser       fuser = (fitDipUser)user;
     DipoleForward* fwd;
-    fitDipUser       fuser = (fitDipUser)fit->user;
     double        Bm2,one;
     int           ncomp,c;
 
-    fwd = fuser->fwd = DipoleFitData::dipole_forward_one(fit,rd,fuser->fwd);
+    fwd = fuser->fwd = DipoleFitData::dipole_forward_one(fuser->fit,fuser->funcs,rd,fuser->fwd);
     ncomp = fwd->sing[2]/fwd->sing[0] > fuser->limit ? 3 : 2;
     if (fuser->report_dim)
         fprintf(stderr,"ncomp = %d\n",ncomp);
@@ -4355,38 +4368,21 @@ static int find_best_guess(float     *B,         /* The whitened data */
                            int       *bestp,	 /* Which is the best */
                            float     *goodp)	 /* Best goodness of fit */
 /*
- * Thanks to the precomputed SVD everything is really simple
+ * Thanks to the precomputed SVD everything is really simple:
+ * the packed guess fields are projected on the data with one matrix-vector product
  */
 {
-    int    k,c;
-    double B2,Bm2,this_good,one;
-    int    best = -1;
-    float  good = 0.0;
-    DipoleForward* fwd;
-    int    ncomp;
-
-    B2 = mne_dot_vectors_3(B,B,nch);
-    for (k = 0; k < guess->nguess; k++) {
-        fwd = guess->guess_fwd[k];
-        if (fwd->nch == nch) {
-            ncomp = fwd->sing[2]/fwd->sing[0] > limit ? 3 : 2;
-            for (c = 0, Bm2 = 0.0; c < ncomp; c++) {
-                one = mne_dot_vectors_3(fwd->uu[c],B,nch);
-                Bm2 = Bm2 + one*one;
-            }
-            this_good = 1.0 - (B2 - Bm2)/B2;
-            if (this_good > good) {
-                best = k;
-                good = this_good;
-            }
-        }
-    }
-    if (best < 0) {
+    VectorXi best;
+    VectorXf good;
+
+    if (!guess->find_best_guesses(Map<MatrixXf>(B,nch,1),limit,best,good))
+        return FAIL;
+    if (best[0] < 0) {
         printf("No reasonable initial guess found.");
         return FAIL;
     }
-     *bestp = best;
-     *goodp = good;
+     *bestp = best[0];
+     *goodp = good[0];
     return OK;
 }
 
@@ -4441,6 +4437,7 @@ static int report_func(int     loop,
 }
 
 static int fit_Q(DipoleFitData* fit,	     /* The fit data */
+                 dipoleFitFuncs funcs,	     /* The forward functions */
                  float *B,		     /* Measurement */
                  float *rd,		     /* Dipole position */
                  float limit,		     /* Radial component omission limit */
@@ -4452,7 +4449,7 @@ static int fit_Q(DipoleFitData* fit,	     /* The fit data */
  */
 {
     int c;
-    DipoleForward* fwd = DipoleFitData::dipole_forward_one(fit,rd,NULL);
+    DipoleForward* fwd = DipoleFitData::dipole_forward_one(fit,funcs,rd,NULL);
     float Bm2,one;
 
     if (!fwd)
@@ -4650,6 +4647,24 @@ bool DipoleFitData::fit_one(DipoleFitData* fit,	            /* Precomputed fitti
                     int           verbose,
                     ECD&          res               /* The fitted dipole */
                     )
+{
+    return fit_one(fit,
+                   fit->sphere_funcs,
+                   !fit->bemname.isEmpty() ? fit->bem_funcs : NULL,
+                   guess,time,B,verbose,res);
+}
+
+//=============================================================================================================
+
+bool DipoleFitData::fit_one(DipoleFitData* fit,	            /* Precomputed fitting data */
+                    dipoleFitFuncs sphere_funcs,     /* Forward functions for the first pass */
+                    dipoleFitFuncs bem_funcs,        /* Forward functions for the second pass (NULL = sphere model) */
+                    GuessData*     guess,	            /* The initial guesses */
+                    float         time,              /* Which time is it? */
+                    float         *B,	            /* The field to fit */
+                    int           verbose,
+                    ECD&          res               /* The fitted dipole */
+                    )
 {
     float  **simplex       = NULL;	       /* The simplex */
     float  vals[4];			       /* Values at the vertices */
@@ -4687,7 +4702,8 @@ bool DipoleFitData::fit_one(DipoleFitData* fit,	            /* Precomputed fitti
     user.B2    = mne_dot_vectors_3(B,B,nchan);
     user.fwd   = NULL;
     user.report_dim = FALSE;
-    fit->user  = &user;
+    user.fit   = fit;
+    user.funcs = sphere_funcs;
 
     VEC_COPY_3(rd_guess,guess->rr[best]);
     VEC_COPY_3(rd_final,guess->rr[best]);
@@ -4699,20 +4715,20 @@ bool DipoleFitData::fit_one(DipoleFitData* fit,	            /* Precomputed fitti
      * Do first pass with the sphere model
      */
         if (k == 0)
-            fit->funcs = fit->sphere_funcs;
+            user.funcs = sphere_funcs;
         else
-            fit->funcs = !fit->bemname.isEmpty() ? fit->bem_funcs : fit->sphere_funcs;
+            user.funcs = bem_funcs ? bem_funcs : sphere_funcs;
 
         simplex = make_initial_dipole_simplex(rd_guess,size);
         for (p = 0; p < 4; p++)
-            vals[p] = fit_eval(simplex[p],3,fit);
+            vals[p] = fit_eval(simplex[p],3,&user);
         if (simplex_minimize(simplex,           /* The initial simplex */
                              vals,              /* Function values at the vertices */
                              3,                 /* Number of variables */
                              ftol[k],           /* Relative convergence tolerance for the target function */
                              atol[k],           /* Absolute tolerance for the change in the parameters */
                              fit_eval,          /* The function to be evaluated */
-                             fit,               /* Data to be passed to the above function in each evaluation */
+                             &user,             /* Data to be passed to the above function in each evaluation */
                              max_eval,          /* Maximum number of function evaluations */
                              &neval,            /* Number of function evaluations */
                              report_interval,   /* How often to report (-1 = no_reporting) */
@@ -4738,7 +4754,7 @@ bool DipoleFitData::fit_one(DipoleFitData* fit,	            /* Precomputed fitti
     /*
    * Compute the dipole moment at the final point
    */
-    if (fit_Q(fit,user.B,rd_final,user.limit,Q,&ncomp,&final_val) == OK) {
+    if (fit_Q(fit,user.funcs,user.B,rd_final,user.limit,Q,&ncomp,&final_val) == OK) {
         res.time  = time;
         res.valid = true;
         for(int i = 0; i < 3; ++i)
@@ -4771,10 +4787,76 @@ bad : {
 
 //=============================================================================================================
 
+dipoleFitFuncs DipoleFitData::dup_dipole_fit_funcs(dipoleFitFuncs f, bool bem_model)
+/*
+ * Create a duplicate to make the forward calculation thread safe
+ * The work areas are private to the duplicate, read-only parts are shared with the original
+ */
+{
+    dipoleFitFuncs res = new_dipole_fit_funcs();
+    FwdThreadArg*  arg;
+    FwdThreadArg*  dup;
+
+    if (!f)
+        return res;
+    *res = *f;
+    res->meg_client_free = NULL;
+    res->eeg_client_free = NULL;
+
+    if (f->meg_client) {
+        arg = new FwdThreadArg();
+        arg->client = f->meg_client;
+        dup = FwdThreadArg::create_meg_multi_thread_duplicate(arg,bem_model);
+        res->meg_client = dup->client;
+        delete dup;
+        delete arg;
+    }
+    if (f->eeg_client && bem_model) {
+        arg = new FwdThreadArg();
+        arg->client = f->eeg_client;
+        dup = FwdThreadArg::create_eeg_multi_thread_duplicate(arg,bem_model);
+        res->eeg_client = dup->client;
+        delete dup;
+        delete arg;
+    }
+    return res;
+}
+
+//=============================================================================================================
+
+void DipoleFitData::free_dup_dipole_fit_funcs(dipoleFitFuncs f, bool bem_model)
+{
+    FwdThreadArg* arg;
+
+    if (!f)
+        return;
+
+    if (f->meg_client) {
+        arg = new FwdThreadArg();
+        arg->client = f->meg_client;
+        FwdThreadArg::free_meg_multi_thread_duplicate(arg,bem_model);
+    }
+    if (f->eeg_client && bem_model) {
+        arg = new FwdThreadArg();
+        arg->client = f->eeg_client;
+        FwdThreadArg::free_eeg_multi_thread_duplicate(arg,bem_model);
+    }
+    FREE_3(f);
+}
+
+//=============================================================================================================
+
 int DipoleFitData::compute_dipole_field(DipoleFitData* d, float *rd, int whiten, float **fwd)
 /*
  * Compute the field and take whitening and projection into account
  */
+{
+    return compute_dipole_field(d,d->funcs,rd,whiten,fwd);
+}
+
+//=============================================================================================================
+
+int DipoleFitData::compute_dipole_field(DipoleFitData* d, dipoleFitFuncs funcs, float *rd, int whiten, float **fwd)
 {
     float *eeg_fwd[3];
     static float Qx[] = {1.0,0.0,0.0};
@@ -4785,34 +4867,34 @@ int DipoleFitData::compute_dipole_field(DipoleFitData* d, float *rd, int whiten,
    * Compute the fields
    */
     if (d->nmeg > 0) {
-        if (d->funcs->meg_vec_field) {
-            if (d->funcs->meg_vec_field(rd,d->meg_coils,fwd,d->funcs->meg_client) != OK)
+        if (funcs->meg_vec_field) {
+            if (funcs->meg_vec_field(rd,d->meg_coils,fwd,funcs->meg_client) != OK)
                 goto bad;
         }
         else {
-            if (d->funcs->meg_field(rd,Qx,d->meg_coils,fwd[0],d->funcs->meg_client) != OK)
+            if (funcs->meg_field(rd,Qx,d->meg_coils,fwd[0],funcs->meg_client) != OK)
                 goto bad;
-            if (d->funcs->meg_field(rd,Qy,d->meg_coils,fwd[1],d->funcs->meg_client) != OK)
+            if (funcs->meg_field(rd,Qy,d->meg_coils,fwd[1],funcs->meg_client) != OK)
                 goto bad;
-            if (d->funcs->meg_field(rd,Qz,d->meg_coils,fwd[2],d->funcs->meg_client) != OK)
+            if (funcs->meg_field(rd,Qz,d->meg_coils,fwd[2],funcs->meg_client) != OK)
                 goto bad;
         }
     }
 
     if (d->neeg > 0) {
-        if (d->funcs->eeg_vec_pot) {
+        if (funcs->eeg_vec_pot) {
             eeg_fwd[0] = fwd[0]+d->nmeg;
             eeg_fwd[1] = fwd[1]+d->nmeg;
             eeg_fwd[2] = fwd[2]+d->nmeg;
-            if (d->funcs->eeg_vec_pot(rd,d->eeg_els,eeg_fwd,d->funcs->eeg_client) != OK)
+            if (funcs->eeg_vec_pot(rd,d->eeg_els,eeg_fwd,funcs->eeg_client) != OK)
                 goto bad;
         }
         else {
-            if (d->funcs->eeg_pot(rd,Qx,d->eeg_els,fwd[0]+d->nmeg,d->funcs->eeg_client) != OK)
+            if (funcs->eeg_pot(rd,Qx,d->eeg_els,fwd[0]+d->nmeg,funcs->eeg_client) != OK)
                 goto bad;
-            if (d->funcs->eeg_pot(rd,Qy,d->eeg_els,fwd[1]+d->nmeg,d->funcs->eeg_client) != OK)
+            if (funcs->eeg_pot(rd,Qy,d->eeg_els,fwd[1]+d->nmeg,funcs->eeg_client) != OK)
                 goto bad;
-            if (d->funcs->eeg_pot(rd,Qz,d->eeg_els,fwd[2]+d->nmeg,d->funcs->eeg_client) != OK)
+            if (funcs->eeg_pot(rd,Qz,d->eeg_els,fwd[2]+d->nmeg,funcs->eeg_client) != OK)
                 goto bad;
         }
     }
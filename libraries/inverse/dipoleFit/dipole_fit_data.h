@@ -180,16 +180,61 @@ public:
      */
     static bool fit_one(DipoleFitData* fit, GuessData* guess, float time, float *B, int verbose, ECD& res);
 
+    //=========================================================================================================
+    /**
+     * Fit a single dipole to the given data using the given forward functions.
+     * Does not modify fit, so several time points can be fitted concurrently as long as each thread
+     * passes its own copies of the forward functions (see dup_dipole_fit_funcs).
+     *
+     * @param[in] fit           Precomputed fitting data
+     * @param[in] sphere_funcs  Sphere model forward functions used in the first pass
+     * @param[in] bem_funcs     BEM forward functions used in the second pass (NULL = sphere model)
+     * @param[in] guess         The initial guesses
+     * @param[in] time          Which time is it?
+     * @param[in] B             The field to fit
+     * @param[in] verbose
+     * @param[in] res           The fitted dipole
+     */
+    static bool fit_one(DipoleFitData* fit, dipoleFitFuncs sphere_funcs, dipoleFitFuncs bem_funcs, GuessData* guess, float time, float *B, int verbose, ECD& res);
+
+    //=========================================================================================================
+    /**
+     * Duplicate forward functions so that they can be evaluated in a separate thread.
+     * The mutable work areas of the client data are private to the copy, read-only parts are shared.
+     *
+     * @param[in] f          The forward functions to duplicate
+     * @param[in] bem_model  Are the clients BEM models?
+     *
+     * @return The duplicate, to be released with free_dup_dipole_fit_funcs.
+     */
+    static dipoleFitFuncs dup_dipole_fit_funcs(dipoleFitFuncs f, bool bem_model);
+
+    //=========================================================================================================
+    /**
+     * Free forward functions created with dup_dipole_fit_funcs
+     *
+     * @param[in] f          The duplicate to free
+     * @param[in] bem_model  Are the clients BEM models?
+     */
+    static void free_dup_dipole_fit_funcs(dipoleFitFuncs f, bool bem_model);
+
 //============================= dipole_forward.c
 
     static int compute_dipole_field(DipoleFitData* d, float *rd, int whiten, float **fwd);
 
+    static int compute_dipole_field(DipoleFitData* d, dipoleFitFuncs funcs, float *rd, int whiten, float **fwd);
+
     //============================= dipole_forward.c
 
     static DipoleForward* dipole_forward_one(DipoleFitData* d,
                                      float         *rd,
                                      DipoleForward* old);
 
+    static DipoleForward* dipole_forward_one(DipoleFitData* d,
+                                             dipoleFitFuncs funcs,
+                                             float         *rd,
+                                             DipoleForward* old);
+
 public:
       FIFFLIB::FiffCoordTransOld*    mri_head_t; /**< MRI <-> head coordinate transformation */
       FIFFLIB::FiffCoordTransOld*    meg_head_t; /**< MEG <-> head coordinate transformation */
@@ -2,6 +2,8 @@
 
 #include "dipole_fit_settings.h"
 
+#include <QThread>
+
 using namespace Eigen;
 using namespace INVERSELIB;
 
@@ -103,6 +105,7 @@ void DipoleFitSettings::initMembers()
     do_baseline  = false;         
     setno        = 1;             
     verbose      = false;
+    nthreads     = 1;
     omit_data_proj = false;
 
          
@@ -167,6 +170,8 @@ void DipoleFitSettings::checkIntegrity()
         if (guess_exclude > 0)
             printf("Guess exclude    : %6.1f mm\n",1000*guess_exclude);
     }
+    if (!guess_cache_dir.isEmpty())
+        printf("Guess cache      : %s\n",guess_cache_dir.toUtf8().data());
     printf("Data             : %s\n",measname.toUtf8().data());
     if (projnames.size() > 0) {
         printf("SSP sources      :\n");
@@ -262,7 +267,9 @@ void DipoleFitSettings::usage(char *name)
     printf("\t--exclude dist/mm Exclude points which are closer than this distance from the CM of the inner skull surface (default =  %6.1f mm).\n",1000*guess_exclude);
     printf("\t--mindist dist/mm Exclude points which are closer than this distance from the inner skull surface  (default = %6.1f mm).\n",1000*guess_mindist);
     printf("\t--grid    dist/mm Source space grid size (default = %6.1f mm).\n",1000*guess_grid);
+    printf("\t--guesscache dir  Store the guess fields in this directory and reuse them in later runs with the same model.\n");
     printf("\t--magdip          Fit magnetic dipoles instead of current dipoles.\n");
+    printf("\t--nthreads n      Fit this many time points in parallel (0 = one per core, default = %d).\n",nthreads);
     printf("\nOutput:\n\n");
     printf("\t--dip     name    xfit dip format output file name\n");
     printf("\t--bdip    name    xfit bdip format output file name\n");
@@ -807,6 +814,30 @@ bool DipoleFitSettings::check_args (int *argc,char **argv)
             found = 1;
             fit_mag_dipoles = true;
         }
+        else if (strcmp(argv[k],"--guesscache") == 0) {
+            found = 2;
+            if (k == *argc - 1) {
+                qCritical ("--guesscache: argument required.");
+                return false;
+            }
+            guess_cache_dir = QString(argv[k+1]);
+        }
+        else if (strcmp(argv[k],"--nthreads") == 0) {
+            found = 2;
+            if (k == *argc - 1) {
+                qCritical ("--nthreads: argument required.");
+                return false;
+            }
+            if (sscanf(argv[k+1],"%d",&ival) != 1) {
+                qCritical() << "Illegal number:" << argv[k+1];
+                return false;
+            }
+            if (ival < 0) {
+                qCritical ("Number of threads should be positive or zero.");
+                return false;
+            }
+            nthreads = ival > 0 ? ival : qMax(1,QThread::idealThreadCount());
+        }
         else if (strcmp(argv[k],"--dip") == 0) {
             found = 2;
             if (k == *argc - 1) {
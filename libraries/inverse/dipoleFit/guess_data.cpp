@@ -44,10 +44,25 @@
 #include <mne/c/mne_surface_old.h>
 #include <mne/c/mne_source_space_old.h>
 
+#include <mne/c/mne_cov_matrix.h>
+#include <mne/c/mne_proj_op.h>
+#include <mne/c/mne_ctf_comp_data_set.h>
+#include <mne/c/mne_ctf_comp_data.h>
+#include <mne/c/mne_named_matrix.h>
+
 #include <fiff/fiff_stream.h>
 #include <fiff/fiff_tag.h>
 
+#include <fwd/fwd_coil_set.h>
+#include <fwd/fwd_coil.h>
+#include <fwd/fwd_comp_data.h>
+
+#include <string.h>
+
 #include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QCryptographicHash>
 
 //=============================================================================================================
 // USED NAMESPACES
@@ -162,6 +177,147 @@ void fromIntEigenMatrix_16(const Eigen::MatrixXi& from_mat, int **&to_mat)
     fromIntEigenMatrix_16(from_mat, to_mat, from_mat.rows(), from_mat.cols());
 }
 
+//=============================================================================================================
+
+#define GUESS_CACHE_MAGIC    0x4D475346  /**< 'MGSF', identifies a guess field cache file */
+#define GUESS_CACHE_VERSION  1           /**< Version of the guess field cache layout */
+
+/*
+ * Header of a guess field cache file. It is followed by the singular values (nguess x 3),
+ * the column scales (nguess x 3), the right singular vectors (nguess x 3 x 3), the left
+ * singular vectors (nguess x 3 x nch) and the forward solutions (nguess x 3 x nch) as floats,
+ * so that the file can be mapped and copied without parsing.
+ */
+typedef struct {
+    quint32 magic;
+    qint32  version;
+    char    key[20];         /* SHA-1 of the inputs of the guess fields */
+    qint32  nguess;
+    qint32  nch;
+} guessCacheHeaderRec;
+
+static void hash_ints_16(QCryptographicHash& hash, const int *data, int n)
+{
+    if (data && n > 0)
+        hash.addData((const char *)data,n*sizeof(int));
+}
+
+static void hash_floats_16(QCryptographicHash& hash, const float *data, int n)
+{
+    if (data && n > 0)
+        hash.addData((const char *)data,n*sizeof(float));
+}
+
+static void hash_doubles_16(QCryptographicHash& hash, const double *data, int n)
+{
+    if (data && n > 0)
+        hash.addData((const char *)data,n*sizeof(double));
+}
+
+static void hash_coil_set_16(QCryptographicHash& hash, const FwdCoilSet* set)
+{
+    int n = set ? set->ncoil : 0;
+
+    hash_ints_16(hash,&n,1);
+    if (!set)
+        return;
+    hash_ints_16(hash,&set->coord_frame,1);
+    for (int k = 0; k < set->ncoil; k++) {
+        const FwdCoil* coil = set->coils[k];
+        hash.addData(coil->chname.toUtf8());
+        hash_ints_16(hash,&coil->coil_class,1);
+        hash_ints_16(hash,&coil->type,1);
+        hash_ints_16(hash,&coil->np,1);
+        hash_floats_16(hash,coil->r0,3);
+        hash_floats_16(hash,coil->ex,3);
+        hash_floats_16(hash,coil->ey,3);
+        hash_floats_16(hash,coil->ez,3);
+        for (int p = 0; p < coil->np; p++) {
+            hash_floats_16(hash,coil->rmag[p],3);
+            hash_floats_16(hash,coil->cosmag[p],3);
+        }
+        hash_floats_16(hash,coil->w,coil->np);
+    }
+}
+
+static QByteArray make_guess_fields_key(float **rr, int nguess, DipoleFitData* f)
+/*
+ * Hash everything the whitened and projected guess fields depend on
+ */
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    int version = GUESS_CACHE_VERSION;
+    int n;
+
+    hash_ints_16(hash,&version,1);
+    hash_ints_16(hash,&nguess,1);
+    for (int k = 0; k < nguess; k++)
+        hash_floats_16(hash,rr[k],3);
+    /*
+     * Forward model
+     */
+    hash_ints_16(hash,&f->fit_mag_dipoles,1);
+    hash_ints_16(hash,&f->column_norm,1);
+    hash_ints_16(hash,&f->coord_frame,1);
+    hash_floats_16(hash,f->r0,3);
+    if (f->eeg_model && f->neeg > 0) {
+        FwdEegSphereModel* m = f->eeg_model;
+        for (int k = 0; k < m->layers.size(); k++) {
+            hash_floats_16(hash,&m->layers[k].rad,1);
+            hash_floats_16(hash,&m->layers[k].sigma,1);
+        }
+        hash_floats_16(hash,m->r0.data(),3);
+        hash_floats_16(hash,m->mu.data(),m->mu.size());
+        hash_floats_16(hash,m->lambda.data(),m->lambda.size());
+        hash_ints_16(hash,&m->nfit,1);
+        hash_ints_16(hash,&m->scale_pos,1);
+    }
+    /*
+     * Sensors, including the CTF compensation
+     */
+    hash_ints_16(hash,&f->nmeg,1);
+    hash_ints_16(hash,&f->neeg,1);
+    hash.addData(f->ch_names.join(QLatin1Char(':')).toUtf8());
+    hash_coil_set_16(hash,f->meg_coils);
+    hash_coil_set_16(hash,f->eeg_els);
+    if (f->sphere_funcs && f->sphere_funcs->meg_client) {
+        FwdCompData* comp = (FwdCompData*)f->sphere_funcs->meg_client;
+        hash_coil_set_16(hash,comp->comp_coils);
+        if (comp->set && comp->set->current && comp->set->current->data) {
+            MneNamedMatrix* data = comp->set->current->data;
+            hash_ints_16(hash,&data->nrow,1);
+            hash_ints_16(hash,&data->ncol,1);
+            for (int k = 0; k < data->nrow; k++)
+                hash_floats_16(hash,data->data[k],data->ncol);
+        }
+    }
+    /*
+     * Whitening and projection
+     */
+    if (f->noise) {
+        MneCovMatrix* C = f->noise;
+        n = C->cov_diag != NULL;
+        hash_ints_16(hash,&n,1);
+        hash_ints_16(hash,&C->ncov,1);
+        hash_ints_16(hash,&C->nzero,1);
+        hash_doubles_16(hash,C->inv_lambda,C->ncov);
+        if (!C->cov_diag && C->eigen)
+            for (int k = 0; k < C->ncov; k++)
+                hash_floats_16(hash,C->eigen[k],C->ncov);
+    }
+    if (f->proj && f->proj->nitems > 0) {
+        hash_ints_16(hash,&f->proj->nvec,1);
+        for (int k = 0; k < f->proj->nvec; k++)
+            hash_floats_16(hash,f->proj->proj_data[k],f->proj->nch);
+    }
+    return hash.result();
+}
+
+static QString guess_fields_cache_name(const QString& guess_cache_dir, const QByteArray& key)
+{
+    return QDir(guess_cache_dir).filePath(QString("guess-%1.bin").arg(QString(key.toHex())));
+}
+
 //=============================================================================================================
 // DEFINE MEMBER METHODS
 //=============================================================================================================
@@ -181,7 +337,7 @@ GuessData::GuessData()
 
 //=============================================================================================================
 
-GuessData::GuessData(const QString &guessname, const QString &guess_surfname, float mindist, float exclude, float grid, DipoleFitData *f)
+GuessData::GuessData(const QString &guessname, const QString &guess_surfname, float mindist, float exclude, float grid, DipoleFitData *f, const QString &guess_cache_dir)
 {
     MneSourceSpaceOld* *sp = NULL;
     int            nsp = 0;
@@ -242,10 +398,18 @@ GuessData::GuessData(const QString &guessname, const QString &guess_surfname, fl
         }
     delete guesses; guesses = NULL;
 
-    fprintf(stderr,"Go through all guess source locations...");
     this->guess_fwd = MALLOC_16(this->nguess,DipoleForward*);
     for (k = 0; k < this->nguess; k++)
         this->guess_fwd[k] = NULL;
+    /*
+     * Reuse the guess fields from an earlier run if possible
+     */
+    if (!guess_cache_dir.isEmpty() && read_guess_fields_cache(guess_cache_dir,f)) {
+        fprintf(stderr,"Guess fields loaded from the cache in %s [%d sources]\n",guess_cache_dir.toUtf8().constData(),this->nguess);
+        pack_guess_fields();
+        return;
+    }
+    fprintf(stderr,"Go through all guess source locations...");
     /*
         * Compute the guesses using the sphere model for speed
         */
@@ -264,6 +428,9 @@ GuessData::GuessData(const QString &guessname, const QString &guess_surfname, fl
 #endif
     }
     f->funcs = orig;
+    pack_guess_fields();
+    if (!guess_cache_dir.isEmpty() && !write_guess_fields_cache(guess_cache_dir,f))
+        qWarning("Could not store the guess fields in %s",guess_cache_dir.toUtf8().constData());
 
     fprintf(stderr,"[done %d sources]\n",p);
 
@@ -427,7 +594,171 @@ bool GuessData::compute_guess_fields(DipoleFitData* f)
 #endif
     }
     f->funcs = orig;
+    pack_guess_fields();
     printf("[done %d sources]\n",this->nguess);
 
     return true;
 }
+
+
+//=============================================================================================================
+
+bool GuessData::read_guess_fields_cache(const QString& guess_cache_dir, DipoleFitData* f)
+{
+    guessCacheHeaderRec header;
+    QByteArray key = make_guess_fields_key(this->rr,this->nguess,f);
+    QFile      file(guess_fields_cache_name(guess_cache_dir,key));
+    int        nch = f->nmeg+f->neeg;
+    qint64     nvalues = (qint64)this->nguess*(3+3+9+2*3*nch);
+    uchar      *map;
+    float      *sing,*scales,*vv,*uu,*fwd;
+
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    if (file.size() != (qint64)sizeof(header) + nvalues*(qint64)sizeof(float))
+        return false;
+    if ((map = file.map(0,file.size())) == NULL)
+        return false;
+    /*
+     * The file has to be exactly for these guesses and this model
+     */
+    memcpy(&header,map,sizeof(header));
+    if (header.magic != GUESS_CACHE_MAGIC || header.version != GUESS_CACHE_VERSION ||
+            header.nguess != this->nguess || header.nch != nch ||
+            memcmp(header.key,key.constData(),sizeof(header.key)) != 0) {
+        file.unmap(map);
+        return false;
+    }
+    sing   = (float *)(map + sizeof(header));
+    scales = sing + 3*this->nguess;
+    vv     = scales + 3*this->nguess;
+    uu     = vv + 9*this->nguess;
+    fwd    = uu + (qint64)3*nch*this->nguess;
+
+    for (int k = 0; k < this->nguess; k++) {
+        DipoleForward* res = new DipoleForward;
+        res->ndip   = 1;
+        res->nch    = nch;
+        res->rd     = ALLOC_CMATRIX_16(1,3);
+        res->sing   = MALLOC_16(3,float);
+        res->scales = MALLOC_16(3,float);
+        res->vv     = ALLOC_CMATRIX_16(3,3);
+        res->uu     = ALLOC_CMATRIX_16(3,nch);
+        res->fwd    = ALLOC_CMATRIX_16(3,nch);
+        VEC_COPY_16(res->rd[0],this->rr[k]);
+        memcpy(res->sing,sing+3*k,3*sizeof(float));
+        memcpy(res->scales,scales+3*k,3*sizeof(float));
+        for (int c = 0; c < 3; c++) {
+            memcpy(res->vv[c],vv+9*k+3*c,3*sizeof(float));
+            memcpy(res->uu[c],uu+((qint64)3*k+c)*nch,nch*sizeof(float));
+            memcpy(res->fwd[c],fwd+((qint64)3*k+c)*nch,nch*sizeof(float));
+        }
+        delete this->guess_fwd[k];
+        this->guess_fwd[k] = res;
+    }
+    file.unmap(map);
+    return true;
+}
+
+//=============================================================================================================
+
+bool GuessData::write_guess_fields_cache(const QString& guess_cache_dir, DipoleFitData* f) const
+{
+    guessCacheHeaderRec header;
+    QByteArray key = make_guess_fields_key(this->rr,this->nguess,f);
+    int        nch = f->nmeg+f->neeg;
+    int        k,c;
+
+    if (this->nguess <= 0 || !this->guess_fwd)
+        return false;
+    for (k = 0; k < this->nguess; k++)
+        if (!this->guess_fwd[k] || this->guess_fwd[k]->nch != nch || this->guess_fwd[k]->ndip != 1)
+            return false;
+    if (!QDir().mkpath(guess_cache_dir))
+        return false;
+    /*
+     * Write to a temporary file which replaces the cache file only when complete,
+     * so that concurrent runs never see a partial file
+     */
+    QSaveFile file(guess_fields_cache_name(guess_cache_dir,key));
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    memset(&header,0,sizeof(header));
+    header.magic   = GUESS_CACHE_MAGIC;
+    header.version = GUESS_CACHE_VERSION;
+    memcpy(header.key,key.constData(),sizeof(header.key));
+    header.nguess  = this->nguess;
+    header.nch     = nch;
+    file.write((const char *)&header,sizeof(header));
+
+    for (k = 0; k < this->nguess; k++)
+        file.write((const char *)this->guess_fwd[k]->sing,3*sizeof(float));
+    for (k = 0; k < this->nguess; k++)
+        file.write((const char *)this->guess_fwd[k]->scales,3*sizeof(float));
+    for (k = 0; k < this->nguess; k++)
+        for (c = 0; c < 3; c++)
+            file.write((const char *)this->guess_fwd[k]->vv[c],3*sizeof(float));
+    for (k = 0; k < this->nguess; k++)
+        for (c = 0; c < 3; c++)
+            file.write((const char *)this->guess_fwd[k]->uu[c],nch*sizeof(float));
+    for (k = 0; k < this->nguess; k++)
+        for (c = 0; c < 3; c++)
+            file.write((const char *)this->guess_fwd[k]->fwd[c],nch*sizeof(float));
+
+    return file.commit();
+}
+//=============================================================================================================
+
+void GuessData::pack_guess_fields()
+{
+    if (nguess <= 0 || !guess_fwd || !guess_fwd[0]) {
+        guess_uu.resize(0,0);
+        guess_sing_ratio.resize(0);
+        return;
+    }
+    int nch = guess_fwd[0]->nch;
+
+    guess_uu.resize(3*nguess,nch);
+    guess_sing_ratio.resize(nguess);
+    for (int k = 0; k < nguess; k++) {
+        DipoleForward* fwd = guess_fwd[k];
+        for (int c = 0; c < 3; c++)
+            guess_uu.row(3*k+c) = Map<const RowVectorXf>(fwd->uu[c],nch);
+        guess_sing_ratio[k] = fwd->sing[2]/fwd->sing[0];
+    }
+}
+
+//=============================================================================================================
+
+bool GuessData::find_best_guesses(const MatrixXf& matB,
+                                  float limit,
+                                  VectorXi& vecBest,
+                                  VectorXf& vecGood) const
+{
+    if (guess_uu.rows() != 3*nguess || guess_uu.cols() != matB.rows()) {
+        qCritical("Guess fields and data do not match in find_best_guesses");
+        return false;
+    }
+    /*
+     * The third component is omitted for pseudoradial guesses
+     */
+    VectorXf vecThird = (guess_sing_ratio.array() > limit).cast<float>();
+    VectorXf vecB2 = matB.colwise().squaredNorm().transpose();
+    MatrixXf matProj = guess_uu * matB;
+    VectorXf vecBm2;
+    int best;
+
+    vecBest.resize(matB.cols());
+    vecGood.resize(matB.cols());
+    for (int j = 0; j < matB.cols(); j++) {
+        Map<const MatrixXf> proj(matProj.col(j).data(),3,nguess);
+        vecBm2 = proj.topRows(2).colwise().squaredNorm().transpose() + vecThird.cwiseProduct(proj.row(2).transpose().cwiseAbs2());
+        float fBm2 = vecBm2.maxCoeff(&best);
+        vecGood[j] = vecB2[j] > 0 ? fBm2/vecB2[j] : 0.0f;
+        vecBest[j] = vecGood[j] > 0.0f ? best : -1;
+        if (vecBest[j] < 0)
+            vecGood[j] = 0.0f;
+    }
+    return true;
+}
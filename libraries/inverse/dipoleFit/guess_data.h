@@ -55,6 +55,7 @@
 //=============================================================================================================
 
 #include <QSharedPointer>
+#include <QString>
 
 //=============================================================================================================
 // DEFINE NAMESPACE INVERSELIB
@@ -102,9 +103,12 @@ public:
      * Refactored: make_guess_data (setup.c)
      *
      * @param[in] guessname
+     * @param[in] guess_cache_dir    Directory of the guess field cache (optional). If the guess fields for
+     *                               this guess grid, forward model, sensors, noise covariance and projection
+     *                               are found there they are loaded, otherwise they are computed and stored.
      *
      */
-    GuessData( const QString& guessname, const QString& guess_surfname, float mindist, float exclude, float grid, DipoleFitData* f);
+    GuessData( const QString& guessname, const QString& guess_surfname, float mindist, float exclude, float grid, DipoleFitData* f, const QString& guess_cache_dir = QString());
 
     //=========================================================================================================
     /**
@@ -134,10 +138,61 @@ public:
      */
     bool compute_guess_fields(DipoleFitData* f);
 
+    //=========================================================================================================
+    /**
+     * Packs the left singular vectors of all guess forward solutions into one contiguous matrix,
+     * so that the guesses can be scanned with a single matrix product.
+     * Called once the guess fields have been computed.
+     */
+    void pack_guess_fields();
+
+    //=========================================================================================================
+    /**
+     * Loads the guess fields from the cache directory.
+     * The cache file is named after a hash of everything the guess fields depend on: the guess locations,
+     * the forward model, the sensor and electrode definitions, the noise covariance and the projection.
+     *
+     * @param[in] guess_cache_dir    The cache directory
+     * @param[in] f                  Dipole Fit Data the guess fields are computed with
+     *
+     * @return true when matching guess fields were found and loaded
+     */
+    bool read_guess_fields_cache(const QString& guess_cache_dir, DipoleFitData* f);
+
+    //=========================================================================================================
+    /**
+     * Stores the computed guess fields in the cache directory, see read_guess_fields_cache.
+     *
+     * @param[in] guess_cache_dir    The cache directory (created if it does not exist)
+     * @param[in] f                  Dipole Fit Data the guess fields were computed with
+     *
+     * @return true when successful
+     */
+    bool write_guess_fields_cache(const QString& guess_cache_dir, DipoleFitData* f) const;
+
+    //=========================================================================================================
+    /**
+     * Finds the best fitting guess for each of the given (whitened and projected) data vectors.
+     * The goodness of fit of all guesses is computed as one product of the packed guess fields with the data.
+     *
+     * @param[in] matB       The whitened data, one time point per column (nch x ntimes)
+     * @param[in] limit      Pseudoradial component omission limit
+     * @param[out] vecBest   Index of the best guess for each time point (-1 if none was reasonable)
+     * @param[out] vecGood   Goodness of fit of the best guess for each time point
+     *
+     * @return true when successful
+     */
+    bool find_best_guesses(const Eigen::MatrixXf& matB,
+                           float limit,
+                           Eigen::VectorXi& vecBest,
+                           Eigen::VectorXf& vecGood) const;
+
 public:
     float          **rr;            /**< These are the guess dipole locations */
     DipoleForward** guess_fwd;      /**< Forward solutions for the guesses */
     int            nguess;          /**< How many sources */
+    Eigen::MatrixXf guess_uu;       /**< Left singular vectors of all guesses, row 3*k+c is component c of guess k (3*nguess x nch) */
+    Eigen::VectorXf guess_sing_ratio; /**< Ratio of the smallest to the largest singular value of each guess */
 
 // ### OLD STRUCT ###
 //    typedef struct {
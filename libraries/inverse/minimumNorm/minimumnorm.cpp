@@ -44,6 +44,7 @@
 #include <fiff/fiff_evoked.h>
 
 #include <iostream>
+#include <algorithm>
 
 //=============================================================================================================
 // EIGEN INCLUDES
@@ -68,6 +69,7 @@ using namespace FIFFLIB;
 MinimumNorm::MinimumNorm(const MNEInverseOperator &p_inverseOperator, float lambda, const QString method)
 : m_inverseOperator(p_inverseOperator)
 , inverseSetup(false)
+, m_bUseFactoredKernel(false)
 {
     this->setRegularization(lambda);
     this->setMethod(method);
@@ -78,6 +80,7 @@ MinimumNorm::MinimumNorm(const MNEInverseOperator &p_inverseOperator, float lamb
 MinimumNorm::MinimumNorm(const MNEInverseOperator &p_inverseOperator, float lambda, bool dSPM, bool sLORETA)
 : m_inverseOperator(p_inverseOperator)
 , inverseSetup(false)
+, m_bUseFactoredKernel(false)
 {
     this->setRegularization(lambda);
     this->setMethod(dSPM, sLORETA);
@@ -188,6 +191,19 @@ MNESourceEstimate MinimumNorm::calculateInverse(const MatrixXd &data, float tmin
         return MNESourceEstimate();
     }
 
+    //Results
+    VectorXi p_vecVertices(inv.src[0].vertno.size() + inv.src[1].vertno.size());
+    p_vecVertices << inv.src[0].vertno, inv.src[1].vertno;
+
+    if(m_matKernelTrans.size() > 0) {
+        if(m_matKernelTrans.cols() != data.rows()) {
+            qWarning() << "MinimumNorm::calculateInverse - Dimension mismatch between kernel columns and data.rows() -" << m_matKernelTrans.cols() << "and" << data.rows();
+            return MNESourceEstimate();
+        }
+
+        return MNESourceEstimate(applyFactoredKernel(data, pick_normal), p_vecVertices, tmin, tstep);
+    }
+
     if(K.cols() != data.rows()) {
         qWarning() << "MinimumNorm::calculateInverse - Dimension mismatch between K.cols() and data.rows() -" << K.cols() << "and" << data.rows();
         return MNESourceEstimate();
@@ -222,10 +238,6 @@ MNESourceEstimate MinimumNorm::calculateInverse(const MatrixXd &data, float tmin
     }
     printf("[done]\n");
 
-    //Results
-    VectorXi p_vecVertices(inv.src[0].vertno.size() + inv.src[1].vertno.size());
-    p_vecVertices << inv.src[0].vertno, inv.src[1].vertno;
-
 //    VectorXi p_vecVertices();
 //    for(qint32 h = 0; h < inv.src.size(); ++h)
 //        t_qListVertices.push_back(inv.src[h].vertno);
@@ -243,9 +255,25 @@ void MinimumNorm::doInverseSetup(qint32 nave, bool pick_normal)
     inv = m_inverseOperator.prepare_inverse_operator(nave, m_fLambda, m_bdSPM, m_bsLORETA);
 
     printf("Computing inverse...\n");
-    inv.assemble_kernel(label, m_sMethod, pick_normal, K, noise_norm, vertno);
+    if(m_bUseFactoredKernel) {
+        MatrixXd matLeads, matTrans;
+        inv.assemble_kernel_factors(label, m_sMethod, pick_normal, matLeads, matTrans, noise_norm, vertno);
+
+        m_matKernelLeads = matLeads.cast<float>();
+        m_matKernelTrans = matTrans.cast<float>();
+        m_vecNoiseNorm = (m_bdSPM || m_bsLORETA) ? VectorXf(inv.noisenorm.diagonal().cast<float>()) : VectorXf();
+        K.resize(0,0);
+
+        std::cout << "K " << m_matKernelLeads.rows() << " x " << m_matKernelLeads.cols() << " * " << m_matKernelTrans.rows() << " x " << m_matKernelTrans.cols() << std::endl;
+    } else {
+        inv.assemble_kernel(label, m_sMethod, pick_normal, K, noise_norm, vertno);
 
-    std::cout << "K " << K.rows() << " x " << K.cols() << std::endl;
+        m_matKernelLeads.resize(0,0);
+        m_matKernelTrans.resize(0,0);
+        m_vecNoiseNorm.resize(0);
+
+        std::cout << "K " << K.rows() << " x " << K.cols() << std::endl;
+    }
 
     inverseSetup = true;
 }
@@ -314,3 +342,54 @@ void MinimumNorm::setRegularization(float lambda)
 {
     m_fLambda = lambda;
 }
+
+//=============================================================================================================
+
+void MinimumNorm::setUseFactoredKernel(bool bUseFactoredKernel)
+{
+    m_bUseFactoredKernel = bUseFactoredKernel;
+}
+
+//=============================================================================================================
+
+MatrixXd MinimumNorm::applyFactoredKernel(const MatrixXd &data, bool pick_normal) const
+{
+    // Project the data onto the rank limited inner dimension first
+    MatrixXf matInner = m_matKernelTrans * data.cast<float>();
+
+    MatrixXf sol;
+
+    if (inv.source_ori == FIFFV_MNE_FREE_ORI && pick_normal == false)
+    {
+        // Compute the current components block wise and combine them right away, so the full
+        // (3 * sources) x samples matrix is never held in memory
+        const int iNSources = m_matKernelLeads.rows() / 3;
+        const int iBlockSize = 256;
+
+        sol.resize(iNSources, matInner.cols());
+        MatrixXf matBlock;
+
+        for(int iStart = 0; iStart < iNSources; iStart += iBlockSize) {
+            int iNBlock = std::min(iBlockSize, iNSources - iStart);
+
+            matBlock.noalias() = m_matKernelLeads.middleRows(3 * iStart, 3 * iNBlock) * matInner;
+
+            for(int i = 0; i < iNBlock; ++i) {
+                sol.row(iStart + i) = (matBlock.row(3 * i).array().square()
+                                       + matBlock.row(3 * i + 1).array().square()
+                                       + matBlock.row(3 * i + 2).array().square()).sqrt();
+            }
+        }
+    }
+    else
+    {
+        sol.noalias() = m_matKernelLeads * matInner;
+    }
+
+    if (m_vecNoiseNorm.size() > 0)
+    {
+        sol = m_vecNoiseNorm.asDiagonal() * sol;
+    }
+
+    return sol.cast<double>();
+}
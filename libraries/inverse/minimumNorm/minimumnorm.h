@@ -173,15 +173,40 @@ public:
      */
     void setRegularization(float lambda);
 
+    //=========================================================================================================
+    /**
+     * Set whether the imaging kernel is kept in its factored single precision form K = A * B, with the inner
+     * dimension limited to the rank of the inverse operator. Each block is then computed as A * (B * data) and,
+     * for free orientations, the combination of the current components is fused into the product with A.
+     * This cuts memory and per-block latency of streaming source estimation. The dense kernel K is not
+     * assembled in this mode. Takes effect with the next call of doInverseSetup.
+     *
+     * @param[in] bUseFactoredKernel   Whether to use the factored single precision kernel.
+     */
+    void setUseFactoredKernel(bool bUseFactoredKernel);
+
     //=========================================================================================================
     /**
      * Get the assembled kernel
      *
-     * @return the assembled kernel
+     * @return the assembled kernel, empty when the factored kernel is used
      */
     inline Eigen::MatrixXd& getKernel();
 
 private:
+    //=========================================================================================================
+    /**
+     * Applies the factored kernel to the data, combines the current components of free orientations and
+     * applies the noise normalization.
+     *
+     * @param[in] data           The data (channels x samples).
+     * @param[in] pick_normal    Whether only the normal components were kept.
+     *
+     * @return the source activity (sources x samples)
+     */
+    Eigen::MatrixXd applyFactoredKernel(const Eigen::MatrixXd &data, bool pick_normal) const;
+
+
     MNELIB::MNEInverseOperator m_inverseOperator;   /**< The inverse operator */
     float m_fLambda;                                /**< Regularization parameter */
     QString m_sMethod;                              /**< Selected method */
@@ -194,6 +219,11 @@ private:
     QList<Eigen::VectorXi> vertno;                  /**< The vertices numbers */
     FSLIB::Label label;                             /**< The corresponding labels */
     Eigen::MatrixXd K;                              /**< Imaging kernel */
+
+    bool m_bUseFactoredKernel;                      /**< Use the factored single precision kernel */
+    Eigen::MatrixXf m_matKernelLeads;               /**< Left kernel factor (sources x rank) */
+    Eigen::MatrixXf m_matKernelTrans;               /**< Right kernel factor (rank x channels) */
+    Eigen::VectorXf m_vecNoiseNorm;                 /**< The noise normalization factors, empty for MNE */
 };
 
 //=============================================================================================================
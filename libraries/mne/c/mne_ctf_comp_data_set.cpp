@@ -570,6 +570,11 @@ MneCTFCompDataSet::MneCTFCompDataSet()
 //=============================================================================================================
 
 MneCTFCompDataSet::MneCTFCompDataSet(const MneCTFCompDataSet &set)
+:ncomp(0)
+,chs(set.chs)
+,nch(set.nch)
+,undo(NULL)
+,current(NULL)
 {
 //    if (!set)
 //        return NULL;
@@ -432,8 +432,7 @@ int MneProjOp::mne_proj_op_proj_vector(MneProjOp *op, float *vec, int nvec, int
      * Assume that all dimension checking etc. has been done before
      */
 {
-    static float *res = NULL;
-    int    res_size   = 0;
+    float *res = NULL;
     float *pvec;
     float  w;
     int k,p;
@@ -446,11 +445,10 @@ int MneProjOp::mne_proj_op_proj_vector(MneProjOp *op, float *vec, int nvec, int
         return FAIL;
     }
 
-    if (op->nch > res_size) {
-        res = REALLOC_23(res,op->nch,float);
-        res_size = op->nch;
-    }
-
+    /*
+     * Local scratch so that the operator can be applied from several threads at once
+     */
+    res = MALLOC_23(op->nch,float);
     for (k = 0; k < op->nch; k++)
         res[k] = 0.0;
 
@@ -468,6 +466,7 @@ int MneProjOp::mne_proj_op_proj_vector(MneProjOp *op, float *vec, int nvec, int
         for (k = 0; k < op->nch; k++)
             vec[k] = res[k];
     }
+    FREE_23(res);
     return OK;
 }
 
@@ -1254,23 +1254,23 @@ bool MNEForwardSolution::read(QIODevice& p_IODevice,
     //
     //   Locate and read the forward solutions
     //
-    FiffTag::SPtr t_pTag;
+    FiffTag t_tag;
     FiffDirNode::SPtr megnode;
     FiffDirNode::SPtr eegnode;
     for(qint32 k = 0; k < fwds.size(); ++k)
     {
-        if(!fwds[k]->find_tag(t_pStream, FIFF_MNE_INCLUDED_METHODS, t_pTag))
+        if(!fwds[k]->find_tag(t_pStream, FIFF_MNE_INCLUDED_METHODS, t_tag))
         {
             t_pStream->close();
             std::cout << "Methods not listed for one of the forward solutions\n"; // ToDo throw error
             return false;
         }
-        if (*t_pTag->toInt() == FIFFV_MNE_MEG)
+        if (*t_tag.toInt() == FIFFV_MNE_MEG)
         {
             printf("MEG solution found\n");
             megnode = fwds[k];
         }
-        else if(*t_pTag->toInt() == FIFFV_MNE_EEG)
+        else if(*t_tag.toInt() == FIFFV_MNE_EEG)
         {
             printf("EEG solution found\n");
             eegnode = fwds[k];
@@ -1343,7 +1343,7 @@ bool MNEForwardSolution::read(QIODevice& p_IODevice,
     //
     //   Get the MRI <-> head coordinate transformation
     //
-    if(!parent_mri[0]->find_tag(t_pStream, FIFF_COORD_TRANS, t_pTag))
+    if(!parent_mri[0]->find_tag(t_pStream, FIFF_COORD_TRANS, t_tag))
     {
         t_pStream->close();
         std::cout << "MRI/head coordinate transformation not found\n"; // ToDo throw error
@@ -1351,7 +1351,7 @@ bool MNEForwardSolution::read(QIODevice& p_IODevice,
     }
     else
     {
-        fwd.mri_head_t = t_pTag->toCoordTrans();
+        fwd.mri_head_t = t_tag.toCoordTrans();
 
         if (fwd.mri_head_t.from != FIFFV_COORD_MRI || fwd.mri_head_t.to != FIFFV_COORD_HEAD)
         {
@@ -1692,43 +1692,43 @@ bool MNEForwardSolution::read_one(FiffStream::SPtr& p_pStream,
         return false;
 
     one.clear();
-    FiffTag::SPtr t_pTag;
+    FiffTag t_tag;
 
-    if(!p_Node->find_tag(p_pStream, FIFF_MNE_SOURCE_ORIENTATION, t_pTag))
+    if(!p_Node->find_tag(p_pStream, FIFF_MNE_SOURCE_ORIENTATION, t_tag))
     {
         p_pStream->close();
         std::cout << "Source orientation tag not found."; //ToDo: throw error.
         return false;
     }
 
-    one.source_ori = *t_pTag->toInt();
+    one.source_ori = *t_tag.toInt();
 
-    if(!p_Node->find_tag(p_pStream, FIFF_MNE_COORD_FRAME, t_pTag))
+    if(!p_Node->find_tag(p_pStream, FIFF_MNE_COORD_FRAME, t_tag))
     {
         p_pStream->close();
         std::cout << "Coordinate frame tag not found."; //ToDo: throw error.
         return false;
     }
 
-    one.coord_frame = *t_pTag->toInt();
+    one.coord_frame = *t_tag.toInt();
 
-    if(!p_Node->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NPOINTS, t_pTag))
+    if(!p_Node->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NPOINTS, t_tag))
     {
         p_pStream->close();
         std::cout << "Number of sources not found."; //ToDo: throw error.
         return false;
     }
 
-    one.nsource = *t_pTag->toInt();
+    one.nsource = *t_tag.toInt();
 
-    if(!p_Node->find_tag(p_pStream, FIFF_NCHAN, t_pTag))
+    if(!p_Node->find_tag(p_pStream, FIFF_NCHAN, t_tag))
     {
         p_pStream->close();
         printf("Number of channels not found."); //ToDo: throw error.
         return false;
     }
 
-    one.nchan = *t_pTag->toInt();
+    one.nchan = *t_tag.toInt();
 
     if(p_pStream->read_named_matrix(p_Node, FIFF_MNE_FORWARD_SOLUTION, *one.sol.data()))
         one.sol->transpose_named_matrix();
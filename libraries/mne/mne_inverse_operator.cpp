@@ -43,6 +43,7 @@
 #include <fs/label.h>
 
 #include <iostream>
+#include <limits>
 
 //=============================================================================================================
 // QT INCLUDES
@@ -56,6 +57,7 @@
 //=============================================================================================================
 
 #include <Eigen/SVD>
+#include <Eigen/Eigenvalues>
 
 //=============================================================================================================
 // USED NAMESPACES
@@ -108,9 +110,10 @@ MNEInverseOperator::MNEInverseOperator(const FiffInfo &info,
                                        float loose,
                                        float depth,
                                        bool fixed,
-                                       bool limit_depth_chs)
+                                       bool limit_depth_chs,
+                                       SvdMethod svdMethod)
 {
-     *this = MNEInverseOperator::make_inverse_operator(info, forward, p_noise_cov, loose, depth, fixed, limit_depth_chs);
+     *this = MNEInverseOperator::make_inverse_operator(info, forward, p_noise_cov, loose, depth, fixed, limit_depth_chs, svdMethod);
     qRegisterMetaType<QSharedPointer<MNELIB::MNEInverseOperator> >("QSharedPointer<MNELIB::MNEInverseOperator>");
     qRegisterMetaType<MNELIB::MNEInverseOperator>("MNELIB::MNEInverseOperator");
 }
@@ -161,6 +164,29 @@ bool MNEInverseOperator::assemble_kernel(const Label &label,
                                          MatrixXd &K,
                                          SparseMatrix<double> &noise_norm,
                                          QList<VectorXi> &vertno)
+{
+    MatrixXd matLeads, matTrans;
+    if(!assemble_kernel_factors(label, method, pick_normal, matLeads, matTrans, noise_norm, vertno)) {
+        return false;
+    }
+
+    K = matLeads * matTrans;
+
+    //store assembled kernel
+    m_K = K;
+
+    return true;
+}
+
+//=============================================================================================================
+
+bool MNEInverseOperator::assemble_kernel_factors(const Label &label,
+                                                 QString method,
+                                                 bool pick_normal,
+                                                 MatrixXd &matLeads,
+                                                 MatrixXd &matTrans,
+                                                 SparseMatrix<double> &noise_norm,
+                                                 QList<VectorXi> &vertno)
 {
     MatrixXd t_eigen_leads = this->eigen_leads->data;
     MatrixXd t_source_cov = this->source_cov->data;
@@ -256,14 +282,25 @@ bool MNEInverseOperator::assemble_kernel(const Label &label,
         t_source_cov.conservativeResize(count, t_source_cov.cols());
     }
 
-    tripletList.clear();
-    tripletList.reserve(reginv.rows());
-    for(qint32 i = 0; i < reginv.rows(); ++i)
-        tripletList.push_back(T(i, i, reginv(i,0)));
-    SparseMatrix<double> t_reginv(reginv.rows(),reginv.rows());
-    t_reginv.setFromTriplets(tripletList.begin(), tripletList.end());
+    //
+    //   Keep only the components with a non-zero regularized inverse weight
+    //
+    VectorXi vecComp(reginv.rows());
+    qint32 iNComp = 0;
+    for(qint32 i = 0; i < reginv.rows(); ++i) {
+        if(reginv(i,0) != 0.0) {
+            vecComp[iNComp++] = i;
+        }
+    }
+
+    MatrixXd t_eigen_fields(iNComp, eigen_fields->data.cols());
+    MatrixXd t_leads(t_eigen_leads.rows(), iNComp);
+    for(qint32 i = 0; i < iNComp; ++i) {
+        t_eigen_fields.row(i) = reginv(vecComp[i],0) * eigen_fields->data.row(vecComp[i]);
+        t_leads.col(i) = t_eigen_leads.col(vecComp[i]);
+    }
 
-    MatrixXd trans = t_reginv*eigen_fields->data*whitener*proj;
+    matTrans = t_eigen_fields*(whitener*proj);
     //
     //   Transformation into current distributions by weighting the eigenleads
     //   with the weights computed above
@@ -274,7 +311,7 @@ bool MNEInverseOperator::assemble_kernel(const Label &label,
         //     R^0.5 has been already factored in
         //
         printf("(eigenleads already weighted)...\n");
-        K = t_eigen_leads*trans;
+        matLeads = t_leads;
     }
     else
     {
@@ -283,22 +320,12 @@ bool MNEInverseOperator::assemble_kernel(const Label &label,
         //
        printf("(eigenleads need to be weighted)...\n");
 
-       std::vector<T> tripletList2;
-       tripletList2.reserve(t_source_cov.rows());
-       for(qint32 i = 0; i < t_source_cov.rows(); ++i)
-           tripletList2.push_back(T(i, i, sqrt(t_source_cov(i,0))));
-       SparseMatrix<double> t_sourceCov(t_source_cov.rows(),t_source_cov.rows());
-       t_sourceCov.setFromTriplets(tripletList2.begin(), tripletList2.end());
-
-       K = t_sourceCov*t_eigen_leads*trans;
+       matLeads = t_source_cov.col(0).cwiseSqrt().asDiagonal()*t_leads;
     }
 
     if(method.compare("MNE") == 0)
         noise_norm = SparseMatrix<double>();
 
-    //store assembled kernel
-    m_K = K;
-
     return true;
 }
 
@@ -683,7 +710,8 @@ MNEInverseOperator MNEInverseOperator::make_inverse_operator(const FiffInfo &inf
                                                              float loose,
                                                              float depth,
                                                              bool fixed,
-                                                             bool limit_depth_chs)
+                                                             bool limit_depth_chs,
+                                                             SvdMethod svdMethod)
 {
     bool is_fixed_ori = forward.isFixedOrient();
     MNEInverseOperator p_MNEInverseOperator;
@@ -820,7 +848,7 @@ MNEInverseOperator MNEInverseOperator::make_inverse_operator(const FiffInfo &inf
     for(qint32 i = 0; i < gain.rows(); ++i)
         gain.row(i) = gain.row(i).array() * source_std.array();
 
-    double trace_GRGT = (gain * gain.transpose()).trace();//pow(gain.norm(), 2);
+    double trace_GRGT = gain.squaredNorm(); // equals (gain * gain.transpose()).trace()
     double scaling_source_cov = (double)n_nzero / trace_GRGT;
 
     p_source_cov->data.array() *= scaling_source_cov;
@@ -834,22 +862,17 @@ MNEInverseOperator MNEInverseOperator::make_inverse_operator(const FiffInfo &inf
     // 12. Decompose the combined matrix
     //
     printf("Computing SVD of whitened and weighted lead field matrix.\n");
-    JacobiSVD<MatrixXd> svd(gain, ComputeThinU | ComputeThinV);
-    std::cout << "ToDo Sorting Necessary?" << std::endl;
-    VectorXd p_sing = svd.singularValues();
-    MatrixXd t_U = svd.matrixU();
-    MNEMath::sort<double>(p_sing, t_U);
-    FiffNamedMatrix::SDPtr p_eigen_fields = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( svd.matrixU().cols(),
-                                                                                        svd.matrixU().rows(),
+    VectorXd p_sing;
+    MatrixXd t_U, t_V;
+    compute_gain_svd(gain, p_sing, t_U, t_V, svdMethod);
+    FiffNamedMatrix::SDPtr p_eigen_fields = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( t_U.cols(),
+                                                                                        t_U.rows(),
                                                                                         defaultQStringList,
                                                                                         gain_info.ch_names,
                                                                                         t_U.transpose() ));
 
-    p_sing = svd.singularValues();
-    MatrixXd t_V = svd.matrixV();
-    MNEMath::sort<double>(p_sing, t_V);
-    FiffNamedMatrix::SDPtr p_eigen_leads = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( svd.matrixV().rows(),
-                                                                                       svd.matrixV().cols(),
+    FiffNamedMatrix::SDPtr p_eigen_leads = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( t_V.rows(),
+                                                                                       t_V.cols(),
                                                                                        defaultQStringList,
                                                                                        defaultQStringList,
                                                                                        t_V ));
@@ -921,6 +944,73 @@ MNEInverseOperator MNEInverseOperator::make_inverse_operator(const FiffInfo &inf
 
 //=============================================================================================================
 
+void MNEInverseOperator::compute_gain_svd(const MatrixXd& gain,
+                                          VectorXd& sing,
+                                          MatrixXd& matU,
+                                          MatrixXd& matV,
+                                          SvdMethod svdMethod)
+{
+    switch(svdMethod) {
+        case SvdBdc: {
+            BDCSVD<MatrixXd> svd(gain, ComputeThinU | ComputeThinV);
+            sing = svd.singularValues();
+            matU = svd.matrixU();
+            matV = svd.matrixV();
+            break;
+        }
+
+        case SvdGramEigen: {
+            // Decompose the Gram matrix of the smaller dimension, i.e., G*G^T when there are less channels than sources
+            const bool bTransposed = gain.rows() > gain.cols();
+            const int iNSmall = std::min(gain.rows(), gain.cols());
+            MatrixXd& matSmall = bTransposed ? matV : matU;
+            MatrixXd& matLarge = bTransposed ? matU : matV;
+
+            MatrixXd matGram = MatrixXd::Zero(iNSmall, iNSmall);
+            if(bTransposed) {
+                matGram.selfadjointView<Lower>().rankUpdate(gain.transpose());
+            } else {
+                matGram.selfadjointView<Lower>().rankUpdate(gain);
+            }
+
+            // The solver only references the lower triangle and returns the eigenvalues in ascending order
+            SelfAdjointEigenSolver<MatrixXd> eig(matGram);
+            VectorXd vecEigVal = eig.eigenvalues().reverse();
+            matSmall = eig.eigenvectors().rowwise().reverse();
+
+            // Eigenvalues below the rounding level of the Gram matrix (e.g. projected out components) are zero
+            double dTol = iNSmall > 0 ? vecEigVal(0) * iNSmall * std::numeric_limits<double>::epsilon() : 0.0;
+            sing = (vecEigVal.array() > dTol).select(vecEigVal.array().max(0.0).sqrt(), 0.0);
+
+            // Recover the other singular vectors, e.g. V = G^T * U * S^-1
+            if(bTransposed) {
+                matLarge.noalias() = gain * matSmall;
+            } else {
+                matLarge.noalias() = gain.transpose() * matSmall;
+            }
+
+            for(int i = 0; i < sing.size(); ++i) {
+                if(sing[i] > 0.0) {
+                    matLarge.col(i) /= sing[i];
+                } else {
+                    matLarge.col(i).setZero();
+                }
+            }
+            break;
+        }
+
+        default: {
+            JacobiSVD<MatrixXd> svd(gain, ComputeThinU | ComputeThinV);
+            sing = svd.singularValues();
+            matU = svd.matrixU();
+            matV = svd.matrixV();
+            break;
+        }
+    }
+}
+
+//=============================================================================================================
+
 MNEInverseOperator MNEInverseOperator::prepare_inverse_operator(qint32 nave ,float lambda2, bool dSPM, bool sLORETA) const
 {
     if(nave <= 0)
@@ -1128,43 +1218,43 @@ bool MNEInverseOperator::read_inverse_operator(QIODevice& p_IODevice, MNEInverse
     //
     //   Methods and source orientations
     //
-    FiffTag::SPtr t_pTag;
-    if (!invs->find_tag(t_pStream, FIFF_MNE_INCLUDED_METHODS, t_pTag))
+    FiffTag t_tag;
+    if (!invs->find_tag(t_pStream, FIFF_MNE_INCLUDED_METHODS, t_tag))
     {
         printf("Modalities not found\n");
         return false;
     }
 
     inv = MNEInverseOperator();
-    inv.methods = *t_pTag->toInt();
+    inv.methods = *t_tag.toInt();
     //
-    if (!invs->find_tag(t_pStream, FIFF_MNE_SOURCE_ORIENTATION, t_pTag))
+    if (!invs->find_tag(t_pStream, FIFF_MNE_SOURCE_ORIENTATION, t_tag))
     {
         printf("Source orientation constraints not found\n");
         return false;
     }
-    inv.source_ori = *t_pTag->toInt();
+    inv.source_ori = *t_tag.toInt();
     //
-    if (!invs->find_tag(t_pStream, FIFF_MNE_SOURCE_SPACE_NPOINTS, t_pTag))
+    if (!invs->find_tag(t_pStream, FIFF_MNE_SOURCE_SPACE_NPOINTS, t_tag))
     {
         printf("Number of sources not found\n");
         return false;
     }
-    inv.nsource = *t_pTag->toInt();
+    inv.nsource = *t_tag.toInt();
     inv.nchan   = 0;
     //
     //   Coordinate frame
     //
-    if (!invs->find_tag(t_pStream, FIFF_MNE_COORD_FRAME, t_pTag))
+    if (!invs->find_tag(t_pStream, FIFF_MNE_COORD_FRAME, t_tag))
     {
         printf("Coordinate frame tag not found\n");
         return false;
     }
-    inv.coord_frame = *t_pTag->toInt();
+    inv.coord_frame = *t_tag.toInt();
     //
     //   The actual source orientation vectors
     //
-    if (!invs->find_tag(t_pStream, FIFF_MNE_INVERSE_SOURCE_ORIENTATIONS, t_pTag))
+    if (!invs->find_tag(t_pStream, FIFF_MNE_INVERSE_SOURCE_ORIENTATIONS, t_tag))
     {
         printf("Source orientation information not found\n");
         return false;
@@ -1172,7 +1262,7 @@ bool MNEInverseOperator::read_inverse_operator(QIODevice& p_IODevice, MNEInverse
 
 //    if(inv.source_nn)
 //        delete inv.source_nn;
-    inv.source_nn = t_pTag->toFloatMatrix();
+    inv.source_nn = t_tag.toFloatMatrix();
     inv.source_nn.transposeInPlace();
 
     printf("[done]\n");
@@ -1180,7 +1270,7 @@ bool MNEInverseOperator::read_inverse_operator(QIODevice& p_IODevice, MNEInverse
     //   The SVD decomposition...
     //
     printf("\tReading inverse operator decomposition...");
-    if (!invs->find_tag(t_pStream, FIFF_MNE_INVERSE_SING, t_pTag))
+    if (!invs->find_tag(t_pStream, FIFF_MNE_INVERSE_SING, t_tag))
     {
         printf("Singular values not found\n");
         return false;
@@ -1188,7 +1278,7 @@ bool MNEInverseOperator::read_inverse_operator(QIODevice& p_IODevice, MNEInverse
 
 //    if(inv.sing)
 //        delete inv.sing;
-    inv.sing = Map<VectorXf>(t_pTag->toFloat(), t_pTag->size()/4).cast<double>();
+    inv.sing = Map<VectorXf>(t_tag.toFloat(), t_tag.size()/4).cast<double>();
     inv.nchan = inv.sing.rows();
     //
     //   The eigenleads and eigenfields
@@ -1276,14 +1366,14 @@ bool MNEInverseOperator::read_inverse_operator(QIODevice& p_IODevice, MNEInverse
     //   Get the MRI <-> head coordinate transformation
     //
     FiffCoordTrans mri_head_t;// = NULL;
-    if (!parent_mri[0]->find_tag(t_pStream, FIFF_COORD_TRANS, t_pTag))
+    if (!parent_mri[0]->find_tag(t_pStream, FIFF_COORD_TRANS, t_tag))
     {
         printf("MRI/head coordinate transformation not found\n");
         return false;
     }
     else
     {
-        mri_head_t = t_pTag->toCoordTrans();
+        mri_head_t = t_tag.toCoordTrans();
         if (mri_head_t.from != FIFFV_COORD_MRI || mri_head_t.to != FIFFV_COORD_HEAD)
         {
             mri_head_t.invert_transform();
@@ -144,6 +144,16 @@ public:
     typedef QSharedPointer<MNEInverseOperator> SPtr;            /**< Shared pointer type for MNEInverseOperator. */
     typedef QSharedPointer<const MNEInverseOperator> ConstSPtr; /**< Const shared pointer type for MNEInverseOperator. */
 
+    //=========================================================================================================
+    /**
+     * Decomposition used for the whitened and weighted gain matrix.
+     */
+    enum SvdMethod {
+        SvdJacobi,      /**< Two-sided Jacobi SVD. Reference method, slowest. */
+        SvdBdc,         /**< Bidiagonal divide and conquer SVD. */
+        SvdGramEigen    /**< Eigendecomposition of the small Gram matrix, e.g. G*G^T, with recovery of the other singular vectors. Fastest. */
+    };
+
     //=========================================================================================================
     /**
      * Default constructor
@@ -169,6 +179,7 @@ public:
      * @param[in] depth              float in [0, 1]. Depth weighting coefficients. If None, no depth weighting is performed.
      * @param[in] fixed              Use fixed source orientations normal to the cortical mantle. If True, the loose parameter is ignored.
      * @param[in] limit_depth_chs    If True, use only grad channels in depth weighting (equivalent to MNE C code). If grad chanels aren't present, only mag channels will be used (if no mag, then eeg). If False, use all channels.
+     * @param[in] svdMethod          Decomposition used for the whitened and weighted gain matrix (optional, default = SvdJacobi).
      */
     MNEInverseOperator(const FIFFLIB::FiffInfo &info,
                        const MNEForwardSolution& forward,
@@ -176,7 +187,8 @@ public:
                        float loose = 0.2f,
                        float depth = 0.8f,
                        bool fixed = false,
-                       bool limit_depth_chs = true);
+                       bool limit_depth_chs = true,
+                       SvdMethod svdMethod = SvdJacobi);
 
     //=========================================================================================================
     /**
@@ -216,6 +228,31 @@ public:
                          Eigen::SparseMatrix<double> &noise_norm,
                          QList<Eigen::VectorXi> &vertno);
 
+    //=========================================================================================================
+    /**
+     * Assembles the imaging kernel in its factored form K = matLeads * matTrans, without forming K.
+     * matLeads holds the (source covariance weighted) eigenleads and matTrans the regularized inverse
+     * of the eigenfields including whitener and projector. Components with a zero regularized inverse
+     * weight are dropped, so the inner dimension is limited to the rank of the whitened gain matrix.
+     *
+     * @param[in] label          labels.
+     * @param[in] method         The applied normals. ("MNE" | "dSPM" | "sLORETA")
+     * @param[in] pick_normal    Pick normals.
+     * @param[out] matLeads      Left kernel factor (sources x rank).
+     * @param[out] matTrans      Right kernel factor (rank x channels).
+     * @param[out] noise_norm    Noise normals.
+     * @param[out] vertno        Vertices of the hemispheres.
+     *
+     * @return true if the kernel factors were assembled, false otherwise
+     */
+    bool assemble_kernel_factors(const FSLIB::Label &label,
+                                 QString method,
+                                 bool pick_normal,
+                                 Eigen::MatrixXd &matLeads,
+                                 Eigen::MatrixXd &matTrans,
+                                 Eigen::SparseMatrix<double> &noise_norm,
+                                 QList<Eigen::VectorXi> &vertno);
+
     //=========================================================================================================
     /**
      * Check that channels in inverse operator are measurements.
@@ -277,6 +314,7 @@ public:
      * @param[in] depth              float in [0, 1]. Depth weighting coefficients. If None, no depth weighting is performed.
      * @param[in] fixed              Use fixed source orientations normal to the cortical mantle. If True, the loose parameter is ignored.
      * @param[in] limit_depth_chs    If True, use only grad channels in depth weighting (equivalent to MNE C code). If grad chanels aren't present, only mag channels will be used (if no mag, then eeg). If False, use all channels.
+     * @param[in] svdMethod          Decomposition used for the whitened and weighted gain matrix (optional, default = SvdJacobi).
      *
      * @return the assembled inverse operator
      */
@@ -286,7 +324,28 @@ public:
                                                     float loose = 0.2f,
                                                     float depth = 0.8f,
                                                     bool fixed = false,
-                                                    bool limit_depth_chs = true);
+                                                    bool limit_depth_chs = true,
+                                                    SvdMethod svdMethod = SvdJacobi);
+
+    //=========================================================================================================
+    /**
+     * Computes the thin singular value decomposition gain = U * diag(sing) * V^T of the whitened and weighted
+     * gain matrix. The singular values are returned in descending order.
+     * SvdGramEigen decomposes the Gram matrix of the smaller dimension and recovers the other singular vectors
+     * by projection. Singular values which vanish at the precision of the Gram matrix are set to zero together
+     * with their recovered singular vectors, which leaves their regularized inverse weights unchanged (zero).
+     *
+     * @param[in] gain       The whitened and weighted gain matrix (channels x sources).
+     * @param[out] sing      The singular values in descending order.
+     * @param[out] matU      The left singular vectors (channels x min(channels, sources)).
+     * @param[out] matV      The right singular vectors (sources x min(channels, sources)).
+     * @param[in] svdMethod  The decomposition to use (optional, default = SvdJacobi).
+     */
+    static void compute_gain_svd(const Eigen::MatrixXd& gain,
+                                 Eigen::VectorXd& sing,
+                                 Eigen::MatrixXd& matU,
+                                 Eigen::MatrixXd& matV,
+                                 SvdMethod svdMethod = SvdJacobi);
 
     //=========================================================================================================
     /**
@@ -346,62 +346,62 @@ bool MNESourceSpace::read_source_space(FiffStream::SPtr& p_pStream, const FiffDi
 {
     p_Hemisphere.clear();
 
-    FiffTag::SPtr t_pTag;
+    FiffTag t_tag;
 
     //=====================================================================
-    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_ID, t_pTag))
+    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_ID, t_tag))
         p_Hemisphere.id = FIFFV_MNE_SURF_UNKNOWN;
     else
-        p_Hemisphere.id = *t_pTag->toInt();
+        p_Hemisphere.id = *t_tag.toInt();
 
-//        qDebug() << "Read SourceSpace ID; type:" << t_pTag->getType() << "value:" << *t_pTag->toInt();
+//        qDebug() << "Read SourceSpace ID; type:" << t_tag.getType() << "value:" << *t_tag.toInt();
 
     //=====================================================================
-    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NPOINTS, t_pTag))
+    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NPOINTS, t_tag))
     {
         p_pStream->close();
         std::cout << "error: Number of vertices not found."; //ToDo: throw error.
         return false;
     }
-//        qDebug() << "Number of vertice; type:" << t_pTag->getType() << "value:" << *t_pTag->toInt();
-    p_Hemisphere.np = *t_pTag->toInt();
+//        qDebug() << "Number of vertice; type:" << t_tag.getType() << "value:" << *t_tag.toInt();
+    p_Hemisphere.np = *t_tag.toInt();
 
     //=====================================================================
-    if(!p_Tree->find_tag(p_pStream, FIFF_BEM_SURF_NTRI, t_pTag))
+    if(!p_Tree->find_tag(p_pStream, FIFF_BEM_SURF_NTRI, t_tag))
     {
-        if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NTRI, t_pTag))
+        if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NTRI, t_tag))
             p_Hemisphere.ntri = 0;
         else
-            p_Hemisphere.ntri = *t_pTag->toInt();
+            p_Hemisphere.ntri = *t_tag.toInt();
     }
     else
     {
-        p_Hemisphere.ntri = *t_pTag->toInt();
+        p_Hemisphere.ntri = *t_tag.toInt();
     }
-//        qDebug() << "Number of Tris; type:" << t_pTag->getType() << "value:" << *t_pTag->toInt();
+//        qDebug() << "Number of Tris; type:" << t_tag.getType() << "value:" << *t_tag.toInt();
 
     //=====================================================================
-    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_COORD_FRAME, t_pTag))
+    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_COORD_FRAME, t_tag))
     {
         p_pStream->close();
         std::cout << "Coordinate frame information not found."; //ToDo: throw error.
         return false;
     }
-    p_Hemisphere.coord_frame = *t_pTag->toInt();
-//        qDebug() << "Coord Frame; type:" << t_pTag->getType() << "value:" << *t_pTag->toInt();
+    p_Hemisphere.coord_frame = *t_tag.toInt();
+//        qDebug() << "Coord Frame; type:" << t_tag.getType() << "value:" << *t_tag.toInt();
 
     //=====================================================================
     //
     //   Vertices, normals, and triangles
     //
-    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_POINTS, t_pTag))
+    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_POINTS, t_tag))
     {
         p_pStream->close();
         std::cout << "Vertex data not found."; //ToDo: throw error.
         return false;
     }
 
-    p_Hemisphere.rr = t_pTag->toFloatMatrix().transpose();
+    p_Hemisphere.rr = t_tag.toFloatMatrix().transpose();
     qint32 rows_rr = p_Hemisphere.rr.rows();
 //        qDebug() << "last element rr: " << p_Hemisphere.rr(rows_rr-1, 0) << p_Hemisphere.rr(rows_rr-1, 1) << p_Hemisphere.rr(rows_rr-1, 2);
 
@@ -411,17 +411,17 @@ bool MNESourceSpace::read_source_space(FiffStream::SPtr& p_pStream, const FiffDi
         std::cout << "Vertex information is incorrect."; //ToDo: throw error.
         return false;
     }
-//        qDebug() << "Source Space Points; type:" << t_pTag->getType();
+//        qDebug() << "Source Space Points; type:" << t_tag.getType();
 
     //=====================================================================
-    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NORMALS, t_pTag))
+    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NORMALS, t_tag))
     {
         p_pStream->close();
         std::cout << "Vertex normals not found."; //ToDo: throw error.
         return false;
     }
 
-    p_Hemisphere.nn = t_pTag->toFloatMatrix().transpose();
+    p_Hemisphere.nn = t_tag.toFloatMatrix().transpose();
     qint32 rows_nn = p_Hemisphere.nn.rows();
 
     if (rows_nn != p_Hemisphere.np)
@@ -430,14 +430,14 @@ bool MNESourceSpace::read_source_space(FiffStream::SPtr& p_pStream, const FiffDi
         std::cout << "Vertex normal information is incorrect."; //ToDo: throw error.
         return false;
     }
-//        qDebug() << "Source Space Normals; type:" << t_pTag->getType();
+//        qDebug() << "Source Space Normals; type:" << t_tag.getType();
 
     //=====================================================================
     if (p_Hemisphere.ntri > 0)
     {
-        if(!p_Tree->find_tag(p_pStream, FIFF_BEM_SURF_TRIANGLES, t_pTag))
+        if(!p_Tree->find_tag(p_pStream, FIFF_BEM_SURF_TRIANGLES, t_tag))
         {
-            if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_TRIANGLES, t_pTag))
+            if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_TRIANGLES, t_tag))
             {
                 p_pStream->close();
                 std::cout << "Triangulation not found."; //ToDo: throw error.
@@ -445,13 +445,13 @@ bool MNESourceSpace::read_source_space(FiffStream::SPtr& p_pStream, const FiffDi
             }
             else
             {
-                p_Hemisphere.tris = t_pTag->toIntMatrix().transpose();
+                p_Hemisphere.tris = t_tag.toIntMatrix().transpose();
                 p_Hemisphere.tris -= MatrixXi::Constant(p_Hemisphere.tris.rows(),3,1);//0 based indizes
             }
         }
         else
         {
-            p_Hemisphere.tris = t_pTag->toIntMatrix().transpose();
+            p_Hemisphere.tris = t_tag.toIntMatrix().transpose();
             p_Hemisphere.tris -= MatrixXi::Constant(p_Hemisphere.tris.rows(),3,1);//0 based indizes
         }
         if (p_Hemisphere.tris.rows() != p_Hemisphere.ntri)
@@ -466,12 +466,12 @@ bool MNESourceSpace::read_source_space(FiffStream::SPtr& p_pStream, const FiffDi
         MatrixXi p_defaultMatrix(0, 0);
         p_Hemisphere.tris = p_defaultMatrix;
     }
-//        qDebug() << "Triangles; type:" << t_pTag->getType() << "rows:" << p_Hemisphere.tris.rows() << "cols:" << p_Hemisphere.tris.cols();
+//        qDebug() << "Triangles; type:" << t_tag.getType() << "rows:" << p_Hemisphere.tris.rows() << "cols:" << p_Hemisphere.tris.cols();
 
     //
     //   Which vertices are active
     //
-    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NUSE, t_pTag))
+    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NUSE, t_tag))
     {
         p_Hemisphere.nuse   = 0;
         p_Hemisphere.inuse  = VectorXi::Zero(p_Hemisphere.nuse);
@@ -480,14 +480,14 @@ bool MNESourceSpace::read_source_space(FiffStream::SPtr& p_pStream, const FiffDi
     }
     else
     {
-        p_Hemisphere.nuse = *t_pTag->toInt();
-        if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_SELECTION, t_pTag))
+        p_Hemisphere.nuse = *t_tag.toInt();
+        if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_SELECTION, t_tag))
         {
             p_pStream->close();
             std::cout << "Source selection information missing."; //ToDo: throw error.
             return false;
         }
-        p_Hemisphere.inuse = VectorXi(Map<VectorXi>(t_pTag->toInt(), t_pTag->size()/4, 1));//use copy constructor, for the sake of easy memory management
+        p_Hemisphere.inuse = VectorXi(Map<VectorXi>(t_tag.toInt(), t_tag.size()/4, 1));//use copy constructor, for the sake of easy memory management
 
         p_Hemisphere.vertno = VectorXi::Zero(p_Hemisphere.nuse);
         if (p_Hemisphere.inuse.rows() != p_Hemisphere.np)
@@ -506,14 +506,14 @@ bool MNESourceSpace::read_source_space(FiffStream::SPtr& p_pStream, const FiffDi
             }
         }
     }
-//        qDebug() << "Vertices; type:" << t_pTag->getType() << "nuse:" << p_Hemisphere.nuse;
+//        qDebug() << "Vertices; type:" << t_tag.getType() << "nuse:" << p_Hemisphere.nuse;
 
     //
     //   Use triangulation
     //
-    FiffTag::SPtr t_pTag1;
-    FiffTag::SPtr t_pTag2;
-    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NUSE_TRI, t_pTag1) || !p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_USE_TRIANGLES, t_pTag2))
+    FiffTag t_tag1;
+    FiffTag t_tag2;
+    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NUSE_TRI, t_tag1) || !p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_USE_TRIANGLES, t_tag2))
     {
         MatrixX3i p_defaultMatrix;
         p_Hemisphere.nuse_tri = 0;
@@ -521,16 +521,16 @@ bool MNESourceSpace::read_source_space(FiffStream::SPtr& p_pStream, const FiffDi
     }
     else
     {
-        p_Hemisphere.nuse_tri = *t_pTag1->toInt();
-        p_Hemisphere.use_tris = t_pTag2->toIntMatrix().transpose();
+        p_Hemisphere.nuse_tri = *t_tag1.toInt();
+        p_Hemisphere.use_tris = t_tag2.toIntMatrix().transpose();
         p_Hemisphere.use_tris -= MatrixXi::Constant(p_Hemisphere.use_tris.rows(),3,1); //0 based indizes
     }
-//        qDebug() << "triangulation; type:" << t_pTag2->getType() << "use_tris:" << p_Hemisphere.use_tris.rows()<< "x" << p_Hemisphere.use_tris.cols();
+//        qDebug() << "triangulation; type:" << t_tag2.getType() << "use_tris:" << p_Hemisphere.use_tris.rows()<< "x" << p_Hemisphere.use_tris.cols();
 
     //
     //   Patch-related information
     //
-    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NEAREST, t_pTag1) || !p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NEAREST_DIST, t_pTag2))
+    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NEAREST, t_tag1) || !p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_NEAREST_DIST, t_tag2))
     {
         VectorXi p_defaultVector;
         p_Hemisphere.nearest = p_defaultVector;
@@ -540,8 +540,8 @@ bool MNESourceSpace::read_source_space(FiffStream::SPtr& p_pStream, const FiffDi
     else
     {
        //res.nearest = tag1.data + 1;
-       p_Hemisphere.nearest = VectorXi(Map<VectorXi>(t_pTag1->toInt(), t_pTag1->size()/4, 1));//use copy constructor, for the sake of easy memory management
-       p_Hemisphere.nearest_dist = VectorXd((Map<VectorXf>(t_pTag2->toFloat(), t_pTag1->size()/4, 1)).cast<double>());//use copy constructor, for the sake of easy memory management
+       p_Hemisphere.nearest = VectorXi(Map<VectorXi>(t_tag1.toInt(), t_tag1.size()/4, 1));//use copy constructor, for the sake of easy memory management
+       p_Hemisphere.nearest_dist = VectorXd((Map<VectorXf>(t_tag2.toFloat(), t_tag1.size()/4, 1)).cast<double>());//use copy constructor, for the sake of easy memory management
     }
 
 //    patch_info(p_Hemisphere.nearest, p_Hemisphere.pinfo);
@@ -553,15 +553,15 @@ bool MNESourceSpace::read_source_space(FiffStream::SPtr& p_pStream, const FiffDi
     //
 //    if(p_Hemisphere.dist)
 //        delete p_Hemisphere.dist;
-    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_DIST, t_pTag1) || !p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_DIST_LIMIT, t_pTag2))
+    if(!p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_DIST, t_tag1) || !p_Tree->find_tag(p_pStream, FIFF_MNE_SOURCE_SPACE_DIST_LIMIT, t_tag2))
     {
        p_Hemisphere.dist = SparseMatrix<double>();//NULL;
        p_Hemisphere.dist_limit = 0;
     }
     else
     {
-        p_Hemisphere.dist       = t_pTag1->toSparseFloatMatrix();
-        p_Hemisphere.dist_limit = *t_pTag2->toFloat(); //ToDo Check if this is realy always a float and not a matrix
+        p_Hemisphere.dist       = t_tag1.toSparseFloatMatrix();
+        p_Hemisphere.dist_limit = *t_tag2.toFloat(); //ToDo Check if this is realy always a float and not a matrix
         //
         //  Add the upper triangle
         //
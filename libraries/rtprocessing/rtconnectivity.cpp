@@ -41,6 +41,7 @@
 #include <connectivity/connectivitysettings.h>
 #include <connectivity/connectivity.h>
 #include <connectivity/network/network.h>
+#include <connectivity/metrics/abstractmetric.h>
 
 //=============================================================================================================
 // EIGEN INCLUDES
@@ -51,6 +52,7 @@
 //=============================================================================================================
 
 #include <QElapsedTimer>
+#include <QMutexLocker>
 #include <QDebug>
 
 //=============================================================================================================
@@ -64,6 +66,15 @@ using namespace CONNECTIVITYLIB;
 // DEFINE MEMBER METHODS RtConnectivityWorker
 //=============================================================================================================
 
+RtConnectivityWorker::RtConnectivityWorker()
+: m_iNumberBinStart(-1)
+, m_iNumberBinAmount(-1)
+, m_iPendingWindowSize(0)
+{
+}
+
+//=============================================================================================================
+
 void RtConnectivityWorker::doWork(const ConnectivitySettings &connectivitySettings)
 {
     if(this->thread()->isInterruptionRequested()) {
@@ -98,15 +109,150 @@ void RtConnectivityWorker::doWork(const ConnectivitySettings &connectivitySettin
     emit resultReady(finalNetworks, connectivitySettingsTemp);
 }
 
+//=============================================================================================================
+
+void RtConnectivityWorker::doWorkIncremental(const ConnectivitySettings& connectivitySettings,
+                                             int iWindowSize)
+{
+    if(this->thread()->isInterruptionRequested()) {
+        return;
+    }
+
+    if(connectivitySettings.getConnectivityMethods().isEmpty()) {
+        qDebug()<<"RtConnectivityWorker::doWorkIncremental() - Network methods are empty";
+        return;
+    }
+
+    if(!AbstractMetric::m_bStorageModeIsActive) {
+        qDebug()<<"RtConnectivityWorker::doWorkIncremental() - Storage mode is not active. All trials of the window will be recomputed.";
+    }
+
+    if(!m_pConnectivitySettings || !isCompatible(connectivitySettings, *m_pConnectivitySettings)) {
+        // Start a new window
+        m_pConnectivitySettings = QSharedPointer<ConnectivitySettings>::create(connectivitySettings);
+    } else {
+        // The cached CSDs are only valid for the frequency bins they were computed for
+        if(m_iNumberBinStart != AbstractMetric::m_iNumberBinStart ||
+           m_iNumberBinAmount != AbstractMetric::m_iNumberBinAmount) {
+            m_pConnectivitySettings->clearIntermediateMetricData();
+        }
+
+        m_pConnectivitySettings->setConnectivityMethods(connectivitySettings.getConnectivityMethods());
+
+        for(int i = 0; i < connectivitySettings.size(); ++i) {
+            m_pConnectivitySettings->append(connectivitySettings.at(i).matData);
+        }
+    }
+
+    // Subtract the oldest trials from the running sums
+    if(m_pConnectivitySettings->size() > iWindowSize) {
+        m_pConnectivitySettings->removeFirst(m_pConnectivitySettings->size() - iWindowSize);
+    }
+
+    if(m_pConnectivitySettings->isEmpty()) {
+        return;
+    }
+
+    QList<Network> finalNetworks = Connectivity::calculate(*m_pConnectivitySettings);
+
+    m_iNumberBinStart = AbstractMetric::m_iNumberBinStart;
+    m_iNumberBinAmount = AbstractMetric::m_iNumberBinAmount;
+
+    // Only pass on the parameters. The window itself stays with the worker.
+    emit resultReady(finalNetworks, connectivitySettings);
+}
+
+//=============================================================================================================
+
+bool RtConnectivityWorker::queueIncremental(const ConnectivitySettings& connectivitySettings,
+                                            int iWindowSize)
+{
+    QMutexLocker locker(&m_pendingMutex);
+
+    m_iPendingWindowSize = iWindowSize;
+
+    bool bWasIdle = m_pPendingSettings.isNull();
+
+    if(bWasIdle) {
+        m_pPendingSettings = QSharedPointer<ConnectivitySettings>::create(connectivitySettings);
+    } else if(!isCompatible(connectivitySettings, *m_pPendingSettings)) {
+        // The window would be restarted with the new trials anyway
+        *m_pPendingSettings = connectivitySettings;
+    } else {
+        // Coalesce with the request that is still waiting
+        m_pPendingSettings->setConnectivityMethods(connectivitySettings.getConnectivityMethods());
+
+        for(int i = 0; i < connectivitySettings.size(); ++i) {
+            m_pPendingSettings->append(connectivitySettings.at(i).matData);
+        }
+    }
+
+    // Older trials would be removed from the window right away
+    if(m_pPendingSettings->size() > iWindowSize) {
+        m_pPendingSettings->removeFirst(m_pPendingSettings->size() - iWindowSize);
+    }
+
+    return bWasIdle;
+}
+
+//=============================================================================================================
+
+void RtConnectivityWorker::doWorkPending()
+{
+    QSharedPointer<ConnectivitySettings> pPendingSettings;
+    int iWindowSize = 0;
+
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        pPendingSettings.swap(m_pPendingSettings);
+        iWindowSize = m_iPendingWindowSize;
+    }
+
+    if(!pPendingSettings) {
+        return;
+    }
+
+    doWorkIncremental(*pPendingSettings,
+                      iWindowSize);
+}
+
+//=============================================================================================================
+
+bool RtConnectivityWorker::isCompatible(const ConnectivitySettings& connectivitySettings,
+                                        const ConnectivitySettings& windowSettings)
+{
+    if(connectivitySettings.getSamplingFrequency() != windowSettings.getSamplingFrequency() ||
+       connectivitySettings.getFFTSize() != windowSettings.getFFTSize() ||
+       connectivitySettings.getWindowType() != windowSettings.getWindowType()) {
+        return false;
+    }
+
+    if(connectivitySettings.getNodePositions().rows() != windowSettings.getNodePositions().rows() ||
+       connectivitySettings.getNodePositions() != windowSettings.getNodePositions()) {
+        return false;
+    }
+
+    if(!connectivitySettings.isEmpty() && !windowSettings.isEmpty()) {
+        if(connectivitySettings.at(0).matData.rows() != windowSettings.at(0).matData.rows() ||
+           connectivitySettings.at(0).matData.cols() != windowSettings.at(0).matData.cols()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 //=============================================================================================================
 // DEFINE MEMBER METHODS RtConnectivity
 //=============================================================================================================
 
 RtConnectivity::RtConnectivity(QObject *parent)
 : QObject(parent)
+, m_pWorker(Q_NULLPTR)
 {
     RtConnectivityWorker *worker = new RtConnectivityWorker;
     worker->moveToThread(&m_workerThread);
+    m_pWorker = worker;
 
     connect(&m_workerThread, &QThread::finished,
             worker, &QObject::deleteLater);
@@ -114,6 +260,9 @@ RtConnectivity::RtConnectivity(QObject *parent)
     connect(this, &RtConnectivity::operate,
             worker, &RtConnectivityWorker::doWork);
 
+    connect(this, &RtConnectivity::operateIncremental,
+            worker, &RtConnectivityWorker::doWorkPending);
+
     connect(worker, &RtConnectivityWorker::resultReady,
             this, &RtConnectivity::newConnectivityResultAvailable);
 
@@ -136,12 +285,28 @@ void RtConnectivity::append(const ConnectivitySettings& connectivitySettings)
 
 //=============================================================================================================
 
+void RtConnectivity::appendIncremental(const ConnectivitySettings& connectivitySettings,
+                                       int iWindowSize)
+{
+    if(!m_pWorker) {
+        return;
+    }
+
+    // Only trigger the worker if it has not been triggered yet. Otherwise the trials join the waiting request.
+    if(m_pWorker->queueIncremental(connectivitySettings, iWindowSize)) {
+        emit operateIncremental();
+    }
+}
+
+//=============================================================================================================
+
 void RtConnectivity::restart()
 {
     stop();
 
     RtConnectivityWorker *worker = new RtConnectivityWorker;
     worker->moveToThread(&m_workerThread);
+    m_pWorker = worker;
 
     connect(&m_workerThread, &QThread::finished,
             worker, &QObject::deleteLater);
@@ -149,6 +314,9 @@ void RtConnectivity::restart()
     connect(this, &RtConnectivity::operate,
             worker, &RtConnectivityWorker::doWork);
 
+    connect(this, &RtConnectivity::operateIncremental,
+            worker, &RtConnectivityWorker::doWorkPending);
+
     connect(worker, &RtConnectivityWorker::resultReady,
             this, &RtConnectivity::newConnectivityResultAvailable);
 
@@ -162,4 +330,7 @@ void RtConnectivity::stop()
     m_workerThread.requestInterruption();
     m_workerThread.quit();
     m_workerThread.wait();
+
+    // The worker is deleted once the thread has finished
+    m_pWorker = Q_NULLPTR;
 }
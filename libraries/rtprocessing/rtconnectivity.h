@@ -51,6 +51,8 @@
 
 #include <QObject>
 #include <QThread>
+#include <QSharedPointer>
+#include <QMutex>
 
 //=============================================================================================================
 // FORWARD DECLARATIONS
@@ -87,6 +89,12 @@ class RTPROCESINGSHARED_EXPORT RtConnectivityWorker : public QObject
     Q_OBJECT
 
 public:
+    //=========================================================================================================
+    /**
+     * Constructs a RtConnectivityWorker object.
+     */
+    RtConnectivityWorker();
+
     //=========================================================================================================
     /**
      * Perform actual connectivity estimation.
@@ -95,6 +103,61 @@ public:
      */
     void doWork(const CONNECTIVITYLIB::ConnectivitySettings& connectivitySettings);
 
+    //=========================================================================================================
+    /**
+     * Perform incremental connectivity estimation over a sliding window of trials. The worker keeps the trials
+     * of the window together with their intermediate data (storage mode). New trials are added to the running
+     * sums, the oldest trials beyond the window are subtracted from them and the networks are derived from the
+     * sums, so only the new trials need to be transformed. The window is restarted whenever the data layout or
+     * the spectral parameters change.
+     *
+     * @param[in] connectivitySettings           The connectivity settings holding the new trials only.
+     * @param[in] iWindowSize                    The number of most recent trials to estimate the connectivity from.
+     */
+    void doWorkIncremental(const CONNECTIVITYLIB::ConnectivitySettings& connectivitySettings,
+                           int iWindowSize);
+
+    //=========================================================================================================
+    /**
+     * Queues new trials for the incremental estimation. This function is thread safe. If a request is still
+     * waiting, the new trials are merged into it, so stale requests never pile up when the estimation is slower
+     * than the incoming trials. Only the last iWindowSize trials are kept.
+     *
+     * @param[in] connectivitySettings           The connectivity settings holding the new trials only.
+     * @param[in] iWindowSize                    The number of most recent trials to estimate the connectivity from.
+     *
+     * @return Whether no request was waiting, i.e. whether doWorkPending() needs to be triggered.
+     */
+    bool queueIncremental(const CONNECTIVITYLIB::ConnectivitySettings& connectivitySettings,
+                          int iWindowSize);
+
+    //=========================================================================================================
+    /**
+     * Performs the incremental connectivity estimation on all trials queued since the last call.
+     */
+    void doWorkPending();
+
+protected:
+    //=========================================================================================================
+    /**
+     * Checks whether the trials of two connectivity settings can be put in the same window.
+     *
+     * @param[in] connectivitySettings           The connectivity settings holding the new trials.
+     * @param[in] windowSettings                 The connectivity settings holding the current window.
+     *
+     * @return Whether the data layout and spectral parameters match.
+     */
+    static bool isCompatible(const CONNECTIVITYLIB::ConnectivitySettings& connectivitySettings,
+                             const CONNECTIVITYLIB::ConnectivitySettings& windowSettings);
+
+    QSharedPointer<CONNECTIVITYLIB::ConnectivitySettings>   m_pConnectivitySettings;    /**< The trials of the sliding window and their intermediate data. */
+    int                                                     m_iNumberBinStart;          /**< The first frequency bin the cached intermediate data was computed for. */
+    int                                                     m_iNumberBinAmount;         /**< The number of frequency bins the cached intermediate data was computed for. */
+
+    QMutex                                                  m_pendingMutex;             /**< The mutex guarding the queued trials. */
+    QSharedPointer<CONNECTIVITYLIB::ConnectivitySettings>   m_pPendingSettings;         /**< The trials queued since the last incremental estimation. Null if no request is waiting. */
+    int                                                     m_iPendingWindowSize;       /**< The window size of the latest queued request. */
+
 signals:
     void resultReady(const  QList<CONNECTIVITYLIB::Network>& connectivityResults, const CONNECTIVITYLIB::ConnectivitySettings& connectivitySettings);
 };
@@ -135,6 +198,17 @@ public:
      */
     void append(const CONNECTIVITYLIB::ConnectivitySettings& connectivitySettings);
 
+    //=========================================================================================================
+    /**
+     * Slot to receive new trials for the incremental sliding-window estimation. The worker keeps the last
+     * iWindowSize trials, so only the new trials have to be passed.
+     *
+     * @param[in] connectivitySettings   The connectivity settings holding the new trials only.
+     * @param[in] iWindowSize            The number of most recent trials to estimate the connectivity from.
+     */
+    void appendIncremental(const CONNECTIVITYLIB::ConnectivitySettings& connectivitySettings,
+                           int iWindowSize);
+
     //=========================================================================================================
     /**
      * Restarts the thread by interrupting its computation queue, quitting, waiting and then starting it again.
@@ -148,12 +222,15 @@ public:
     void stop();
 
 protected:
-    QThread             m_workerThread;         /**< The worker thread. */
+    QThread                 m_workerThread;         /**< The worker thread. */
+    RtConnectivityWorker*   m_pWorker;              /**< The worker. Null while the thread is stopped. */
 
 signals:
     void newConnectivityResultAvailable(const QList<CONNECTIVITYLIB::Network>& connectivityResults, const CONNECTIVITYLIB::ConnectivitySettings& connectivitySettings);
 
     void operate(const CONNECTIVITYLIB::ConnectivitySettings& connectivitySettings);
+
+    void operateIncremental();
 };
 
 //=============================================================================================================
@@ -40,13 +40,20 @@
 
 #include "rtcov.h"
 
+#include <cmath>
+#include <limits>
 
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
 
 #include <QDebug>
-#include <QtConcurrent>
+
+//=============================================================================================================
+// EIGEN INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Dense>
 
 //=============================================================================================================
 // USED NAMESPACES
@@ -61,9 +68,20 @@ using namespace Eigen;
 //=============================================================================================================
 
 RtCov::RtCov(QSharedPointer<FIFFLIB::FiffInfo> pFiffInfo)
-: m_fiffInfo(*pFiffInfo)
-, m_iSamples(0)
+: m_estimationMode(Block)
+, m_dSamples(0.0)
+, m_dForgettingFactor(0.9999)
+, m_iWindowSize(0)
+, m_iNewSamples(0)
+, m_iWindowSamples(0)
+, m_fiffInfo(*pFiffInfo)
 {
+    for(int i = 0; i < m_fiffInfo.chs.size(); i++) {
+        if(m_fiffInfo.chs.at(i).kind != FIFFV_MEG_CH &&
+           m_fiffInfo.chs.at(i).kind != FIFFV_EEG_CH) {
+            m_lExclude << m_fiffInfo.chs.at(i).ch_name;
+        }
+    }
 }
 
 //=============================================================================================================
@@ -76,93 +94,165 @@ FiffCov RtCov::estimateCovariance(const Eigen::MatrixXd& matData,
         return FiffCov();
     }
 
-    m_lData.append(matData);
-    m_iSamples += matData.cols();
+    append(matData);
+    m_iNewSamples += matData.cols();
 
-    if(m_iSamples < iNewMaxSamples) {
+    if(m_iNewSamples < iNewMaxSamples) {
         return FiffCov();
     }
 
-    QFuture<RtCovComputeResult> result = QtConcurrent::mappedReduced(m_lData,
-                                                                     compute,
-                                                                     reduce);
+    FiffCov computedCov = getCovariance();
 
-    result.waitForFinished();
+    m_iNewSamples = 0;
+    if(m_estimationMode == Block) {
+        reset();
+    }
 
-    RtCovComputeResult finalResult = result.result();
+    return computedCov;
+}
 
-    //Final computation
-    FiffCov computedCov;
-    computedCov.data = finalResult.matData;
+//=============================================================================================================
 
-    QStringList exclude;
-    for(int i = 0; i<m_fiffInfo.chs.size(); i++) {
-        if(m_fiffInfo.chs.at(i).kind != FIFFV_MEG_CH &&
-           m_fiffInfo.chs.at(i).kind != FIFFV_EEG_CH) {
-            exclude << m_fiffInfo.chs.at(i).ch_name;
+void RtCov::append(const MatrixXd& matData)
+{
+    if(matData.cols() == 0) {
+        return;
+    }
+
+    if(m_vecShift.size() != matData.rows()) {
+        if(m_vecShift.size() != 0) {
+            qWarning() << "[RtCov::append] Number of channels changed. Resetting the covariance estimation.";
         }
+        reset();
+        m_vecShift = matData.rowwise().mean();
+        m_vecSum = VectorXd::Zero(matData.rows());
+        m_matSumSquares = MatrixXd::Zero(matData.rows(), matData.rows());
     }
-    bool doProj = true;
 
-    if(m_iSamples > 0) {
-        finalResult.mu /= (float)m_iSamples;
-        computedCov.data.array() -= m_iSamples * (finalResult.mu * finalResult.mu.transpose()).array();
-        computedCov.data.array() /= (m_iSamples - 1);
+    switch(m_estimationMode) {
+        case Exponential: {
+            double dDecay = std::pow(m_dForgettingFactor, (double)matData.cols());
+            m_dSamples *= dDecay;
+            m_vecSum *= dDecay;
+            m_matSumSquares.triangularView<Lower>() *= dDecay;
+            update(matData, 1.0);
+            break;
+        }
 
-        computedCov.kind = FIFFV_MNE_NOISE_COV;
-        computedCov.diag = false;
-        computedCov.dim = computedCov.data.rows();
+        case SlidingWindow: {
+            update(matData, 1.0);
+            m_lWindowData.append(matData);
+            m_iWindowSamples += matData.cols();
+
+            // Keep at least the newest block, even if it is longer than the window
+            while(m_lWindowData.size() > 1 && m_iWindowSamples - m_lWindowData.first().cols() >= m_iWindowSize) {
+                m_iWindowSamples -= m_lWindowData.first().cols();
+                update(m_lWindowData.first(), -1.0);
+                m_lWindowData.removeFirst();
+            }
+            break;
+        }
 
-        //ToDo do picks
-        computedCov.names = m_fiffInfo.ch_names;
-        computedCov.projs = m_fiffInfo.projs;
-        computedCov.bads = m_fiffInfo.bads;
-        computedCov.nfree = m_iSamples;
+        default:
+            update(matData, 1.0);
+            break;
+    }
+}
 
-        // regularize noise covariance
-        computedCov = computedCov.regularize(m_fiffInfo, 0.05, 0.05, 0.1, doProj, exclude);
+//=============================================================================================================
 
-//            qint32 samples = rawSegment.cols();
-//            VectorXf mu = rawSegment.rowwise().sum().array() / (float)samples;
+FiffCov RtCov::getCovariance(bool bRegularize) const
+{
+    if(m_dSamples <= 1.0) {
+        qWarning() << "[RtCov::getCovariance] Not enough samples. Returning empty covariance estimation.";
+        return FiffCov();
+    }
 
-//            MatrixXf noise_covariance = rawSegment * rawSegment.transpose();// noise_covariance == raw_covariance
-//            noise_covariance.array() -= samples * (mu * mu.transpose()).array();
-//            noise_covariance.array() /= (samples - 1);
+    VectorXd vecMu = m_vecSum / m_dSamples;
 
-//            std::cout << "Noise Covariance:\n" << noise_covariance.block(0,0,10,10) << std::endl;
+    FiffCov computedCov;
+    computedCov.data = m_matSumSquares.selfadjointView<Lower>();
+    computedCov.data -= m_dSamples * vecMu * vecMu.transpose();
+    computedCov.data /= (m_dSamples - 1.0);
 
-//            printf("%d raw buffer (%d x %d) generated\r\n", count, tmp.rows(), tmp.cols());
+    computedCov.kind = FIFFV_MNE_NOISE_COV;
+    computedCov.diag = false;
+    computedCov.dim = computedCov.data.rows();
 
-        m_lData.clear();
-        m_iSamples = 0;
+    //ToDo do picks
+    computedCov.names = m_fiffInfo.ch_names;
+    computedCov.projs = m_fiffInfo.projs;
+    computedCov.bads = m_fiffInfo.bads;
+    computedCov.nfree = (int)std::lround(m_dSamples);
 
-        return computedCov;
-    } else {
-        qWarning() << "[RtCov::estimateCovariance] Number of samples equals zero. Regularization not possible. Returning empty covariance estimation.";
-        return FiffCov();
+    if(bRegularize) {
+        // regularize noise covariance
+        computedCov = computedCov.regularize(m_fiffInfo, 0.05, 0.05, 0.1, true, m_lExclude);
     }
 
+    return computedCov;
+}
+
+//=============================================================================================================
+
+void RtCov::reset()
+{
+    m_dSamples = 0.0;
+    m_iNewSamples = 0;
+    m_vecShift.resize(0);
+    m_vecSum.resize(0);
+    m_matSumSquares.resize(0,0);
+    m_lWindowData.clear();
+    m_iWindowSamples = 0;
 }
 
 //=============================================================================================================
 
-RtCovComputeResult RtCov::compute(const MatrixXd &matData)
+void RtCov::setEstimationMode(EstimationMode mode)
 {
-    RtCovComputeResult result;
-    result.mu = matData.rowwise().sum();
-    result.matData = matData * matData.transpose();
-    return result;
+    if(m_estimationMode != mode) {
+        m_estimationMode = mode;
+        reset();
+    }
 }
 
 //=============================================================================================================
 
-void RtCov::reduce(RtCovComputeResult& finalResult, const RtCovComputeResult &tempResult)
+void RtCov::setForgettingFactor(double dForgettingFactor)
 {
-    if(finalResult.matData.size() == 0 || finalResult.mu.size() == 0) {
-        finalResult.mu = tempResult.mu;
-        finalResult.matData = tempResult.matData;
-    } else {
-        finalResult.mu += tempResult.mu;
-        finalResult.matData += tempResult.matData;
+    if(dForgettingFactor <= 0.0 || dForgettingFactor > 1.0) {
+        qWarning() << "[RtCov::setForgettingFactor] Forgetting factor" << dForgettingFactor << "is out of (0,1]. Clamping.";
     }
+
+    m_dForgettingFactor = qBound(std::numeric_limits<double>::min(), dForgettingFactor, 1.0);
+}
+
+//=============================================================================================================
+
+void RtCov::setWindowSize(int iWindowSize)
+{
+    m_iWindowSize = qMax(0, iWindowSize);
+
+    if(m_estimationMode == SlidingWindow) {
+        reset();
+    }
+}
+
+//=============================================================================================================
+
+double RtCov::samples() const
+{
+    return m_dSamples;
+}
+
+//=============================================================================================================
+
+void RtCov::update(const MatrixXd& matData,
+                   double dSign)
+{
+    MatrixXd matShifted = matData.colwise() - m_vecShift;
+
+    m_vecSum += dSign * matShifted.rowwise().sum();
+    m_matSumSquares.selfadjointView<Lower>().rankUpdate(matShifted, dSign);
+    m_dSamples += dSign * matShifted.cols();
 }
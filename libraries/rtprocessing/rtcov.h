@@ -51,6 +51,7 @@
 
 #include <QSharedPointer>
 #include <QThread>
+#include <QStringList>
 
 //=============================================================================================================
 // EIGEN INCLUDES
@@ -77,14 +78,11 @@ namespace RTPROCESSINGLIB
 // RTPROCESSINGLIB FORWARD DECLARATIONS
 //=============================================================================================================
 
-struct RtCovComputeResult {
-    Eigen::VectorXd mu;
-    Eigen::MatrixXd matData;
-};
-
 //=============================================================================================================
 /**
- * Real-time covariance worker.
+ * Real-time covariance worker. The estimator keeps running sums of the incoming blocks, which are updated with a
+ * rank-k update per block, instead of storing the raw data. The data is shifted by the mean of the first block
+ * before accumulation to avoid cancellation when the channels carry large offsets.
  *
  * @brief Real-time covariance worker.
  */
@@ -93,40 +91,113 @@ class RTPROCESINGSHARED_EXPORT RtCov : public QObject
     Q_OBJECT
 
 public:
+    /**
+     * The estimation modes.
+     */
+    enum EstimationMode {
+        Block,              /**< All samples are weighted equally. The sums are reset after every estimate returned by estimateCovariance. */
+        Exponential,        /**< Past samples are down weighted by the forgetting factor per sample. */
+        SlidingWindow       /**< Only the samples of the last window are used. */
+    };
+
     RtCov(QSharedPointer<FIFFLIB::FiffInfo> pFiffInfo);
 
     //=========================================================================================================
     /**
-     * Perform actual covariance estimation.
+     * Adds the data to the running sums and returns a new covariance estimate whenever iNewMaxSamples samples were
+     * added since the last estimate. In Block mode the running sums are reset afterwards.
+     *
+     * @param[in] matData           Data to estimate the covariance from.
+     * @param[in] iNewMaxSamples    The number of samples after which a new estimate is returned.
      *
-     * @param[in] inputData  Data to estimate the covariance from.
+     * @return The regularized covariance estimate or an empty covariance if no estimate is due yet.
      */
     FIFFLIB::FiffCov estimateCovariance(const Eigen::MatrixXd& matData,
                                         int iNewMaxSamples);
 
-protected:
     //=========================================================================================================
     /**
-     * Computer multiplication with transposed.
+     * Adds a data block to the running sums.
      *
-     * @param[in] matData  Data to self multiply with.
+     * @param[in] matData  Data block (channels x samples).
+     */
+    void append(const Eigen::MatrixXd& matData);
+
+    //=========================================================================================================
+    /**
+     * Returns the covariance of the samples added so far. This can be called at any time.
+     *
+     * @param[in] bRegularize  Whether to regularize the covariance.
+     *
+     * @return The covariance estimate or an empty covariance if fewer than two samples were added.
+     */
+    FIFFLIB::FiffCov getCovariance(bool bRegularize = true) const;
+
+    //=========================================================================================================
+    /**
+     * Clears the running sums.
+     */
+    void reset();
+
+    //=========================================================================================================
+    /**
+     * Sets the estimation mode. This clears the running sums.
      *
-     * @return   The multiplication result.
+     * @param[in] mode  The new estimation mode.
      */
-    static RtCovComputeResult compute(const Eigen::MatrixXd &matData);
+    void setEstimationMode(EstimationMode mode);
 
     //=========================================================================================================
     /**
-     * Computer multiplication with transposed.
+     * Sets the forgetting factor per sample used in Exponential mode, e.g. 0.9999. Values are clamped to (0,1].
      *
-     * @param[out]   finalResult     The final covariance estimation.
-     * @param[in]    tempResult      The intermediate result from the compute function
+     * @param[in] dForgettingFactor  The new forgetting factor.
      */
-    static void reduce(RtCovComputeResult& finalResult, const RtCovComputeResult &tempResult);
+    void setForgettingFactor(double dForgettingFactor);
+
+    //=========================================================================================================
+    /**
+     * Sets the window size in samples used in SlidingWindow mode. This clears the running sums.
+     *
+     * @param[in] iWindowSize  The new window size.
+     */
+    void setWindowSize(int iWindowSize);
+
+    //=========================================================================================================
+    /**
+     * Returns the (effective) number of samples the current estimate is based on.
+     *
+     * @return The number of samples.
+     */
+    double samples() const;
+
+protected:
+    //=========================================================================================================
+    /**
+     * Adds the shifted data block to or removes it from the running sums.
+     *
+     * @param[in] matData   Data block (channels x samples).
+     * @param[in] dSign     1 to add the block, -1 to remove it.
+     */
+    void update(const Eigen::MatrixXd& matData,
+                double dSign);
+
+    EstimationMode          m_estimationMode;           /**< The estimation mode. */
+
+    double                  m_dSamples;                 /**< The (effective) number of accumulated samples. */
+    double                  m_dForgettingFactor;        /**< The forgetting factor per sample in Exponential mode. */
+
+    int                     m_iWindowSize;              /**< The window size in samples in SlidingWindow mode. */
+    int                     m_iNewSamples;              /**< The number of samples added since the last estimate. */
+
+    Eigen::VectorXd         m_vecShift;                 /**< The shift applied before accumulation. */
+    Eigen::VectorXd         m_vecSum;                   /**< The running sum of the shifted samples. */
+    Eigen::MatrixXd         m_matSumSquares;            /**< The running sum of the outer products of the shifted samples (lower triangle). */
 
-    int                     m_iSamples;                 /**< The number of stored samples. */
+    QList<Eigen::MatrixXd>  m_lWindowData;              /**< The blocks of the current window in SlidingWindow mode. */
+    int                     m_iWindowSamples;           /**< The number of samples in m_lWindowData. */
 
-    QList<Eigen::MatrixXd>  m_lData;                    /**< The stored data blocks. */
+    QStringList             m_lExclude;                 /**< The channels which are excluded from the regularization. */
 
     FIFFLIB::FiffInfo       m_fiffInfo;                 /**< Holds the fiff measurement information. */
 };
@@ -38,9 +38,16 @@
 //=============================================================================================================
 
 #include "rtfilter.h"
+
+#include <fiff/fiff_raw_data.h>
+#include <fiff/fiff_raw_stream_writer.h>
+
 #include <Eigen/Dense>
 #include <Eigen/Core>
 
+#include <cmath>
+#include <functional>
+
 //=============================================================================================================
 // USED NAMESPACES
 //=============================================================================================================
@@ -55,29 +62,43 @@ using namespace FIFFLIB;
 //=============================================================================================================
 
 #include <QDebug>
+#include <QThread>
 
 //=============================================================================================================
-// DEFINE MEMBER METHODS
+// DEFINE GLOBAL METHODS
 //=============================================================================================================
 
-RtFilter::RtFilter()
+/**
+ * Returns the full linear convolution of two coefficient sets.
+ */
+static RowVectorXd convolve(const RowVectorXd& vecA,
+                            const RowVectorXd& vecB)
 {
+    if(vecA.cols() == 0 || vecB.cols() == 0) {
+        return vecA.cols() == 0 ? vecB : vecA;
+    }
+
+    RowVectorXd vecResult = RowVectorXd::Zero(vecA.cols() + vecB.cols() - 1);
+    for(int j = 0; j < vecB.cols(); ++j) {
+        vecResult.segment(j, vecA.cols()) += vecB(j) * vecA;
+    }
+
+    return vecResult;
 }
 
+//=============================================================================================================
+// DEFINE MEMBER METHODS
 //=============================================================================================================
 
-RtFilter::~RtFilter()
+RtFilter::RtFilter()
+: m_iFftLength(0)
 {
 }
 
 //=============================================================================================================
 
-void RtFilter::filterChannel(RtFilter::RtFilterData &channelDataTime)
+RtFilter::~RtFilter()
 {
-    for(int i = 0; i < channelDataTime.lFilterData.size(); ++i) {
-        //channelDataTime.vecData = channelDataTime.first.at(i).applyConvFilter(channelDataTime.vecData, true, FilterData::ZeroPad);
-        channelDataTime.vecData = channelDataTime.lFilterData.at(i).applyFFTFilter(channelDataTime.vecData, true, FilterData::ZeroPad); //FFT Convolution for rt is not suitable. FFT make the signal filtering non causal.
-    }
 }
 
 //=============================================================================================================
@@ -87,70 +108,88 @@ MatrixXd RtFilter::filterDataBlock(const MatrixXd& matDataIn,
                                    const RowVectorXi &vecPicks,
                                    const QList<FilterData>& lFilterData)
 {
-    //Initialise the overlay matrix
-    if(m_matOverlap.cols() != iOrder || m_matOverlap.rows() < matDataIn.rows()) {
-        m_matOverlap.resize(matDataIn.rows(), iOrder);
-        m_matOverlap.setZero();
-    }
+    //Copy input data
+    MatrixXd matDataOut = matDataIn;
 
-    if(m_matDelay.cols() != iOrder/2 || m_matOverlap.rows() < matDataIn.rows()) {
-        m_matDelay.resize(matDataIn.rows(), iOrder/2);
-        m_matDelay.setZero();
+    if(vecPicks.cols() == 0 || lFilterData.isEmpty() || matDataIn.cols() == 0) {
+        return matDataOut;
     }
 
-    //Copy input data
-    MatrixXd matDataOut = matDataIn;
+    //IIR filters are applied after the FIR filters
+    prepareSOS(lFilterData, matDataIn.rows());
 
-    //Do the concurrent filtering
-    if(vecPicks.cols() > 0) {
-        //Generate QList structure which can be handled by the QConcurrent framework
-        QList<RtFilterData> timeData;
+    bool bFIR = false;
+    for(int i = 0; i < lFilterData.size(); ++i) {
+        bFIR |= !lFilterData.at(i).isIIR();
+    }
 
-        //Only select channels specified in vecPicks
-        RtFilterData data;
-        for(qint32 i = 0; i < vecPicks.cols(); ++i) {
-            data.lFilterData = lFilterData;
-            data.iRow = vecPicks[i];
-            data.vecData = matDataIn.row(vecPicks[i]);
-            timeData.append(data);
-        }
+    if(!bFIR) {
+        filterSOS(vecPicks, matDataOut);
+        return matDataOut;
+    }
+
+    prepareKernel(lFilterData, matDataIn.cols());
 
-        // Copy in data from last data block. This is necessary in order to also delay channels which are not filtered.
-        matDataOut.block(0, iOrder/2, matDataIn.rows(), matDataOut.cols()-iOrder/2) = matDataIn.block(0, 0, matDataIn.rows(), matDataOut.cols()-iOrder/2);
-        matDataOut.block(0, 0, matDataIn.rows(), iOrder/2) = m_matDelay;
+    //Initialise the delay line and the input history
+    int iDelay = iOrder/2;
 
-        QFuture<void> future = QtConcurrent::map(timeData,
-                                                 filterChannel);
+    if(m_matDelay.cols() != iDelay || m_matDelay.rows() != matDataIn.rows()) {
+        m_matDelay = MatrixXd::Zero(matDataIn.rows(), iDelay);
+    }
 
-        future.waitForFinished();
+    if(m_matHistory.rows() != matDataIn.rows()) {
+        m_matHistory = MatrixXd::Zero(matDataIn.rows(), m_vecKernel.cols() - 1);
+    }
 
-        //Do the overlap add method and store in matDataOut
-        int iFilteredNumberCols = timeData.at(0).vecData.cols();
-        RowVectorXd tempData;
+    // Delay all channels by half of the filter length. This is necessary in order to also delay channels which are not filtered.
+    if(matDataIn.cols() >= iDelay) {
+        matDataOut.rightCols(matDataIn.cols() - iDelay) = matDataIn.leftCols(matDataIn.cols() - iDelay);
+        matDataOut.leftCols(iDelay) = m_matDelay;
+        m_matDelay = matDataIn.rightCols(iDelay);
+    } else {
+        matDataOut = m_matDelay.leftCols(matDataIn.cols());
+        MatrixXd matDelay(matDataIn.rows(), iDelay);
+        matDelay << m_matDelay.rightCols(iDelay - matDataIn.cols()), matDataIn;
+        m_matDelay = matDelay;
+    }
 
-        for(int r = 0; r < timeData.size(); r++) {
-            //Get the currently filtered data. This data has a delay of filterLength/2 in front and back.
-            tempData = timeData.at(r).vecData;
+    //Distribute the picked channels over the workers. The last part is filtered in the calling thread.
+    int iWorkers = qBound(1, QThread::idealThreadCount(), int(vecPicks.cols()));
 
-            //Perform the actual overlap add by adding the last filter length data to the newly filtered one
-            tempData.head(iOrder) += m_matOverlap.row(timeData.at(r).iRow);
+    while(m_lWorkers.size() < iWorkers) {
+        QSharedPointer<FftWorker> pWorker = QSharedPointer<FftWorker>::create();
+        pWorker->fft.SetFlag(pWorker->fft.HalfSpectrum);
+        m_lWorkers.append(pWorker);
+    }
 
-            //Write the newly calculated filtered data to the filter data matrix.
-            //Keep in mind that the current block also effect last part of the last block (begin at dataIndex-iFilterDelay).
-            int start = 0;
-            matDataOut.row(timeData.at(r).iRow).segment(start,iFilteredNumberCols-iOrder) = tempData.head(iFilteredNumberCols-iOrder);
+    QVector<QFuture<void> > vecThreads(iWorkers - 1);
+    int iBegin = 0;
 
-            //Refresh the m_matOverlap with the new calculated filtered data.
-            m_matOverlap.row(timeData.at(r).iRow) = timeData.at(r).vecData.tail(iOrder);
-        }
+    for(int i = 0; i < iWorkers; ++i) {
+        int iEnd = int((qint64(i + 1) * vecPicks.cols()) / iWorkers);
 
-        if(matDataIn.cols() >= iOrder/2) {
-            m_matDelay = matDataIn.block(0, matDataIn.cols()-iOrder/2, matDataIn.rows(), iOrder/2);
+        if(i == iWorkers - 1) {
+            filterChannels(i, matDataIn, vecPicks, iBegin, iEnd, matDataOut);
         } else {
-            qWarning() << "[RtFilter::filterDataBlock] Half of filter length is larger than data size. Not filling m_matDelay for next step.";
+            vecThreads[i] = QtConcurrent::run(std::bind(&RtFilter::filterChannels,
+                                                        this,
+                                                        i,
+                                                        std::cref(matDataIn),
+                                                        std::cref(vecPicks),
+                                                        iBegin,
+                                                        iEnd,
+                                                        std::ref(matDataOut)));
         }
+
+        iBegin = iEnd;
     }
 
+    for(QFuture<void>& f : vecThreads) {
+        f.waitForFinished();
+    }
+
+    filterSOS(vecPicks, matDataOut);
+
     return matDataOut;
 }
 
@@ -222,3 +261,422 @@ MatrixXd RtFilter::filterData(const MatrixXd& matDataIn,
     }
     return matDataOut;
 }
+
+//=============================================================================================================
+
+bool RtFilter::filterFile(const FiffRawData& raw,
+                          const QString& sFileNameOut,
+                          const QList<FilterData>& lFilterData,
+                          const RowVectorXi& vecPicks,
+                          int iChunkSize)
+{
+    if(lFilterData.isEmpty() || iChunkSize <= 0) {
+        qWarning() << "[RtFilter::filterFile] No filter or invalid chunk size. Returning.";
+        return false;
+    }
+
+    RowVectorXi vecUsedPicks = vecPicks;
+    if(vecUsedPicks.cols() == 0) {
+        vecUsedPicks = RowVectorXi::LinSpaced(raw.info.nchan, 0, raw.info.nchan - 1);
+    }
+
+    //Filtering forward and backward with the FIR filters equals filtering with the convolution of their coefficients
+    //and the reversed coefficients. The resulting kernel is symmetric, hence has zero phase around its center.
+    RowVectorXd vecForward = RowVectorXd::Ones(1);
+    RowVectorXd vecImpulse = RowVectorXd::Zero(qMax(1, int(raw.info.sfreq * 10)));
+    vecImpulse(0) = 1.0;
+    bool bIIR = false;
+
+    for(int i = 0; i < lFilterData.size(); ++i) {
+        if(lFilterData.at(i).isIIR()) {
+            vecImpulse = lFilterData.at(i).applySOSFilter(vecImpulse);
+            bIIR = true;
+        } else {
+            vecForward = convolve(vecForward, lFilterData.at(i).m_dCoeffA);
+        }
+    }
+
+    RowVectorXd vecKernel = convolve(vecForward, vecForward.reverse());
+
+    //Each chunk is read with the neighbouring samples which influence it. For IIR filters these are the samples
+    //until the impulse response decayed.
+    int iPad = vecKernel.cols()/2;
+
+    if(bIIR) {
+        double dThreshold = 1e-7 * vecImpulse.cwiseAbs().maxCoeff();
+        int iDecay = vecImpulse.cols();
+        while(iDecay > 1 && std::fabs(vecImpulse(iDecay - 1)) <= dThreshold) {
+            --iDecay;
+        }
+        iPad = qMax(iPad, iDecay);
+    }
+
+    int iFftLength = 2;
+    while(iFftLength < iChunkSize + 2 * iPad + vecKernel.cols() - 1) {
+        iFftLength *= 2;
+    }
+
+    RowVectorXcd vecKernelFreq;
+    RowVectorXd vecKernelZeroPad = RowVectorXd::Zero(iFftLength);
+    vecKernelZeroPad.head(vecKernel.cols()) = vecKernel;
+
+    Eigen::FFT<double> fft;
+    fft.SetFlag(fft.HalfSpectrum);
+    fft.fwd(vecKernelFreq, vecKernelZeroPad);
+
+    int iWorkers = qBound(1, QThread::idealThreadCount(), int(vecUsedPicks.cols()));
+
+    while(m_lWorkers.size() < iWorkers) {
+        QSharedPointer<FftWorker> pWorker = QSharedPointer<FftWorker>::create();
+        pWorker->fft.SetFlag(pWorker->fft.HalfSpectrum);
+        m_lWorkers.append(pWorker);
+    }
+
+    FiffRawStreamWriter writer(sFileNameOut,
+                               raw.info,
+                               FIFFT_FLOAT,
+                               raw.first_samp);
+
+    if(!writer.start()) {
+        qWarning() << "[RtFilter::filterFile] Could not create" << sFileNameOut << ". Returning.";
+        return false;
+    }
+
+    MatrixXd matData, matTimes, matDataOut;
+
+    for(fiff_int_t from = raw.first_samp; from <= raw.last_samp; from += iChunkSize) {
+        fiff_int_t to = qMin(from + iChunkSize - 1, raw.last_samp);
+        fiff_int_t readFrom = qMax(raw.first_samp, from - iPad);
+        fiff_int_t readTo = qMin(raw.last_samp, to + iPad);
+
+        if(!raw.read_raw_segment(matData, matTimes, readFrom, readTo)) {
+            qWarning() << "[RtFilter::filterFile] Could not read samples" << readFrom << "to" << readTo << ". Returning.";
+            writer.finish();
+            return false;
+        }
+
+        //Channels which are not filtered are copied
+        matDataOut = matData.middleCols(from - readFrom, to - from + 1);
+
+        int iFront = iPad - (from - readFrom);
+        int iBack = iPad - (readTo - to);
+
+        QVector<QFuture<void> > vecThreads(iWorkers - 1);
+        int iBegin = 0;
+
+        for(int i = 0; i < iWorkers; ++i) {
+            int iEnd = int((qint64(i + 1) * vecUsedPicks.cols()) / iWorkers);
+
+            if(i == iWorkers - 1) {
+                filterChannelsZeroPhase(i, matData, iFront, iBack, iPad, vecKernel, vecKernelFreq, lFilterData, vecUsedPicks, iBegin, iEnd, matDataOut);
+            } else {
+                vecThreads[i] = QtConcurrent::run(std::bind(&RtFilter::filterChannelsZeroPhase,
+                                                            this,
+                                                            i,
+                                                            std::cref(matData),
+                                                            iFront,
+                                                            iBack,
+                                                            iPad,
+                                                            std::cref(vecKernel),
+                                                            std::cref(vecKernelFreq),
+                                                            std::cref(lFilterData),
+                                                            std::cref(vecUsedPicks),
+                                                            iBegin,
+                                                            iEnd,
+                                                            std::ref(matDataOut)));
+            }
+
+            iBegin = iEnd;
+        }
+
+        for(QFuture<void>& f : vecThreads) {
+            f.waitForFinished();
+        }
+
+        if(!writer.write_raw_buffer(matDataOut, writer.cals())) {
+            qWarning() << "[RtFilter::filterFile] Could not write samples" << from << "to" << to << ". Returning.";
+            writer.finish();
+            return false;
+        }
+    }
+
+    return writer.finish();
+}
+
+//=============================================================================================================
+
+void RtFilter::reset()
+{
+    m_matDelay.resize(0,0);
+    m_matHistory.resize(0,0);
+    m_matSOSState.setZero();
+}
+
+//=============================================================================================================
+
+void RtFilter::prepareKernel(const QList<FilterData>& lFilterData,
+                             int iBlockSize)
+{
+    bool bChanged = m_lKernelCoeffs.size() != lFilterData.size();
+
+    for(int i = 0; !bChanged && i < lFilterData.size(); ++i) {
+        bChanged = m_lKernelCoeffs.at(i).cols() != lFilterData.at(i).m_dCoeffA.cols()
+                   || m_lKernelCoeffs.at(i) != lFilterData.at(i).m_dCoeffA;
+    }
+
+    if(!bChanged && iBlockSize <= m_iFftLength - m_vecKernel.cols() + 1) {
+        return;
+    }
+
+    if(bChanged) {
+        //Applying the filters one after another equals filtering with the convolution of their coefficients
+        m_lKernelCoeffs.clear();
+        m_vecKernel = RowVectorXd::Ones(1);
+
+        for(int i = 0; i < lFilterData.size(); ++i) {
+            const RowVectorXd& vecCoeffs = lFilterData.at(i).m_dCoeffA;
+            m_lKernelCoeffs.append(vecCoeffs);
+
+            if(!lFilterData.at(i).isIIR()) {
+                m_vecKernel = convolve(m_vecKernel, vecCoeffs);
+            }
+        }
+
+        //Keep the most recent input samples if the kernel length changed
+        int iHistory = m_vecKernel.cols() - 1;
+
+        if(m_matHistory.cols() != iHistory) {
+            MatrixXd matHistory = MatrixXd::Zero(m_matHistory.rows(), iHistory);
+            int iKeep = qMin(int(m_matHistory.cols()), iHistory);
+            matHistory.rightCols(iKeep) = m_matHistory.rightCols(iKeep);
+            m_matHistory = matHistory;
+        }
+    }
+
+    //Each FFT filters the history plus at least one block
+    m_iFftLength = 2;
+    while(m_iFftLength < m_vecKernel.cols() - 1 + iBlockSize) {
+        m_iFftLength *= 2;
+    }
+
+    #ifdef EIGEN_FFTW_DEFAULT
+        fftw_make_planner_thread_safe();
+    #endif
+
+    RowVectorXd vecKernelZeroPad = RowVectorXd::Zero(m_iFftLength);
+    vecKernelZeroPad.head(m_vecKernel.cols()) = m_vecKernel;
+
+    Eigen::FFT<double> fft;
+    fft.SetFlag(fft.HalfSpectrum);
+    fft.fwd(m_vecKernelFreq, vecKernelZeroPad);
+}
+
+//=============================================================================================================
+
+void RtFilter::filterChannels(int iWorker,
+                              const MatrixXd& matDataIn,
+                              const RowVectorXi& vecPicks,
+                              int iBegin,
+                              int iEnd,
+                              MatrixXd& matDataOut)
+{
+    FftWorker& worker = *m_lWorkers[iWorker];
+
+    const int iHistory = m_matHistory.cols();
+    const int iStep = m_iFftLength - iHistory;
+    const int iSamples = matDataIn.cols();
+
+    worker.vecTime.resize(m_iFftLength);
+
+    for(int i = iBegin; i < iEnd; ++i) {
+        const int iRow = vecPicks[i];
+
+        if(iRow < 0 || iRow >= matDataIn.rows()) {
+            continue;
+        }
+
+        for(int iDone = 0; iDone < iSamples; iDone += iStep) {
+            const int iSize = qMin(iStep, iSamples - iDone);
+
+            //Overlap-save: the first iHistory output samples are corrupted by the circular convolution and dropped
+            worker.vecTime.head(iHistory) = m_matHistory.row(iRow);
+            worker.vecTime.segment(iHistory, iSize) = matDataIn.row(iRow).segment(iDone, iSize);
+            worker.vecTime.tail(m_iFftLength - iHistory - iSize).setZero();
+
+            worker.fft.fwd(worker.vecFreq, worker.vecTime);
+            worker.vecFreq.array() *= m_vecKernelFreq.array();
+            worker.fft.inv(worker.vecFiltered, worker.vecFreq, m_iFftLength);
+
+            matDataOut.row(iRow).segment(iDone, iSize) = worker.vecFiltered.segment(iHistory, iSize);
+
+            //The history of the next segment are the last iHistory input samples
+            m_matHistory.row(iRow) = worker.vecTime.segment(iSize, iHistory);
+        }
+    }
+}
+
+//=============================================================================================================
+
+void RtFilter::prepareSOS(const QList<FilterData>& lFilterData,
+                          int iRows)
+{
+    int iSections = 0;
+    for(int i = 0; i < lFilterData.size(); ++i) {
+        iSections += lFilterData.at(i).m_matSOS.rows();
+    }
+
+    bool bChanged = m_matSOS.rows() != iSections;
+
+    for(int i = 0, iRow = 0; !bChanged && i < lFilterData.size(); ++i) {
+        const MatrixXd& matSOS = lFilterData.at(i).m_matSOS;
+        bChanged = matSOS.rows() > 0 && m_matSOS.middleRows(iRow, matSOS.rows()) != matSOS;
+        iRow += matSOS.rows();
+    }
+
+    if(bChanged) {
+        m_matSOS.resize(iSections, 6);
+
+        for(int i = 0, iRow = 0; i < lFilterData.size(); ++i) {
+            const MatrixXd& matSOS = lFilterData.at(i).m_matSOS;
+            m_matSOS.middleRows(iRow, matSOS.rows()) = matSOS;
+            iRow += matSOS.rows();
+        }
+    }
+
+    if(bChanged || m_matSOSState.rows() != iRows) {
+        m_matSOSState = MatrixXd::Zero(iRows, 2 * iSections);
+    }
+}
+
+//=============================================================================================================
+
+void RtFilter::filterSOS(const RowVectorXi& vecPicks,
+                         MatrixXd& matData)
+{
+    if(m_matSOS.rows() == 0) {
+        return;
+    }
+
+    const int iSamples = matData.cols();
+
+    //Gather the picked channels and their states
+    m_matSOSData.resize(vecPicks.cols(), iSamples);
+    m_matSOSWork.resize(vecPicks.cols(), m_matSOSState.cols());
+
+    int iPicks = 0;
+    for(int i = 0; i < vecPicks.cols(); ++i) {
+        if(vecPicks[i] < 0 || vecPicks[i] >= matData.rows()) {
+            continue;
+        }
+
+        m_matSOSData.row(iPicks) = matData.row(vecPicks[i]);
+        m_matSOSWork.row(iPicks) = m_matSOSState.row(vecPicks[i]);
+        ++iPicks;
+    }
+
+    //Direct form II transposed, one section after another. Every step processes one sample of all picked channels.
+    ArrayXd vecY(iPicks);
+
+    for(int s = 0; s < m_matSOS.rows(); ++s) {
+        const double b0 = m_matSOS(s,0) / m_matSOS(s,3);
+        const double b1 = m_matSOS(s,1) / m_matSOS(s,3);
+        const double b2 = m_matSOS(s,2) / m_matSOS(s,3);
+        const double a1 = m_matSOS(s,4) / m_matSOS(s,3);
+        const double a2 = m_matSOS(s,5) / m_matSOS(s,3);
+
+        auto z1 = m_matSOSWork.col(2*s).head(iPicks).array();
+        auto z2 = m_matSOSWork.col(2*s+1).head(iPicks).array();
+
+        for(int t = 0; t < iSamples; ++t) {
+            auto x = m_matSOSData.col(t).head(iPicks).array();
+
+            vecY = b0*x + z1;
+            z1 = b1*x - a1*vecY + z2;
+            z2 = b2*x - a2*vecY;
+            x = vecY;
+        }
+    }
+
+    //Scatter the filtered data and the states
+    iPicks = 0;
+    for(int i = 0; i < vecPicks.cols(); ++i) {
+        if(vecPicks[i] < 0 || vecPicks[i] >= matData.rows()) {
+            continue;
+        }
+
+        matData.row(vecPicks[i]) = m_matSOSData.row(iPicks);
+        m_matSOSState.row(vecPicks[i]) = m_matSOSWork.row(iPicks);
+        ++iPicks;
+    }
+}
+
+//=============================================================================================================
+
+void RtFilter::filterChannelsZeroPhase(int iWorker,
+                                       const MatrixXd& matData,
+                                       int iFront,
+                                       int iBack,
+                                       int iPad,
+                                       const RowVectorXd& vecKernel,
+                                       const RowVectorXcd& vecKernelFreq,
+                                       const QList<FilterData>& lFilterData,
+                                       const RowVectorXi& vecPicks,
+                                       int iBegin,
+                                       int iEnd,
+                                       MatrixXd& matDataOut)
+{
+    FftWorker& worker = *m_lWorkers[iWorker];
+
+    const int iRead = matData.cols();
+    const int iLength = iFront + iRead + iBack;
+    const int iFftLength = 2 * (vecKernelFreq.cols() - 1);
+    const int iHalf = vecKernel.cols()/2;
+
+    RowVectorXd vecPadded(iLength);
+
+    for(int i = iBegin; i < iEnd; ++i) {
+        const int iRow = vecPicks[i];
+
+        if(iRow < 0 || iRow >= matData.rows()) {
+            continue;
+        }
+
+        //Mirror the data at the beginning and end of the file
+        vecPadded.segment(iFront, iRead) = matData.row(iRow);
+        for(int k = 1; k <= iFront; ++k) {
+            vecPadded(iFront - k) = matData(iRow, qMin(k, iRead - 1));
+        }
+        for(int k = 1; k <= iBack; ++k) {
+            vecPadded(iFront + iRead - 1 + k) = matData(iRow, qMax(iRead - 1 - k, 0));
+        }
+
+        //Zero-phase FIR kernel, centered at iHalf
+        if(vecKernel.cols() > 1) {
+            worker.vecTime.setZero(iFftLength);
+            worker.vecTime.head(iLength) = vecPadded;
+
+            worker.fft.fwd(worker.vecFreq, worker.vecTime);
+            worker.vecFreq.array() *= vecKernelFreq.array();
+            worker.fft.inv(worker.vecFiltered, worker.vecFreq, iFftLength);
+
+            vecPadded = worker.vecFiltered.segment(iHalf, iLength);
+        }
+
+        //IIR filters forward and backward
+        for(int j = 0; j < lFilterData.size(); ++j) {
+            if(lFilterData.at(j).isIIR()) {
+                vecPadded = lFilterData.at(j).applySOSFilter(vecPadded);
+            }
+        }
+
+        vecPadded.reverseInPlace();
+        for(int j = 0; j < lFilterData.size(); ++j) {
+            if(lFilterData.at(j).isIIR()) {
+                vecPadded = lFilterData.at(j).applySOSFilter(vecPadded);
+            }
+        }
+        vecPadded.reverseInPlace();
+
+        matDataOut.row(iRow) = vecPadded.segment(iPad, matDataOut.cols());
+    }
+}
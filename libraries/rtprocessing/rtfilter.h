@@ -60,6 +60,14 @@
 #include <Eigen/Core>
 #include <unsupported/Eigen/FFT>
 
+//=============================================================================================================
+// FORWARD DECLARATIONS
+//=============================================================================================================
+
+namespace FIFFLIB {
+    class FiffRawData;
+}
+
 //=============================================================================================================
 // DEFINE NAMESPACE RTPROCESSINGLIB
 //=============================================================================================================
@@ -73,7 +81,11 @@ namespace RTPROCESSINGLIB
 
 //=============================================================================================================
 /**
- * Real-time filtering with fft overlap
+ * Real-time filtering with fft overlap. FIR filters are applied with the overlap-save method. The input history of
+ * every channel, the spectrum of the filter kernel and one FFT object with its work buffers per worker thread are
+ * kept between the calls, so that filtering a block does not create FFT plans or allocate memory once the block
+ * size and the filter are stable. IIR filters (see FilterData::isIIR) are applied as a cascade of second-order
+ * sections with a persistent state per channel. They do not add the delay of half the filter length.
  *
  * @brief Real-time filtering
  */
@@ -83,11 +95,6 @@ class RTPROCESINGSHARED_EXPORT RtFilter
 public:
     typedef QSharedPointer<RtFilter> SPtr;             /**< Shared pointer type for RtFilter. */
     typedef QSharedPointer<const RtFilter> ConstSPtr;  /**< Const shared pointer type for RtFilter. */
-    typedef struct {
-        QList<UTILSLIB::FilterData> lFilterData;
-        int iRow;
-        Eigen::RowVectorXd vecData;
-    } RtFilterData;
 
     //=========================================================================================================
     /**
@@ -101,8 +108,6 @@ public:
      */
     ~RtFilter();
 
-    static void filterChannel(RtFilter::RtFilterData &channelDataTime);
-
     //=========================================================================================================
     /**
      * Calculates the filtered version of the raw input data
@@ -148,9 +153,143 @@ public:
                                qint32 iFftLength = 4096,
                                UTILSLIB::FilterData::DesignMethod designMethod = UTILSLIB::FilterData::Cosine);
 
+    //=========================================================================================================
+    /**
+     * Filters a whole raw file forward and backward (zero-phase) and writes the result to a new file. The file is
+     * read, filtered and written in chunks, so the recording is never held in memory as a whole. Each chunk is
+     * read with enough neighbouring samples to filter it like the complete recording, the data is mirrored at the
+     * beginning and end of the file. The picked channels of a chunk are filtered in parallel.
+     *
+     * FIR filters are applied with the convolution of their coefficients and the reversed coefficients, which
+     * equals forward-backward filtering. This is exact apart from the mirroring at the file boundaries. IIR
+     * filters are applied forward and backward per chunk, padded with the samples until their impulse response
+     * decayed.
+     *
+     * @param [in] raw               The raw data to filter.
+     * @param [in] sFileNameOut      The file to write the filtered data to.
+     * @param [in] lFilterData       The filters to apply one after another.
+     * @param [in] vecPicks          The channels to filter as indices. All channels are filtered if empty.
+     * @param [in] iChunkSize        The number of samples written per chunk.
+     *
+     * @return true if the file was written, false otherwise.
+     */
+    bool filterFile(const FIFFLIB::FiffRawData& raw,
+                    const QString& sFileNameOut,
+                    const QList<UTILSLIB::FilterData>& lFilterData,
+                    const Eigen::RowVectorXi& vecPicks = Eigen::RowVectorXi(),
+                    int iChunkSize = 16384);
+
+    //=========================================================================================================
+    /**
+     * Clears the filter state, i.e. the input history, the delay line and the states of the IIR filters.
+     */
+    void reset();
+
 protected:
-    Eigen::MatrixXd                 m_matOverlap;                   /**< Last overlap block */
+    /**
+     * The FFT object and the work buffers of one worker thread.
+     */
+    struct FftWorker {
+        Eigen::FFT<double>      fft;            /**< The FFT object, which caches its plans. */
+        Eigen::RowVectorXd      vecTime;        /**< The zero padded input segment. */
+        Eigen::RowVectorXcd     vecFreq;        /**< The half spectrum of the input segment. */
+        Eigen::RowVectorXd      vecFiltered;    /**< The filtered segment. */
+    };
+
+    //=========================================================================================================
+    /**
+     * Combines the filters to one kernel and transforms it if the filters or the block size changed.
+     *
+     * @param [in] lFilterData   The filters to apply one after another.
+     * @param [in] iBlockSize    The number of samples per block.
+     */
+    void prepareKernel(const QList<UTILSLIB::FilterData>& lFilterData,
+                       int iBlockSize);
+
+    //=========================================================================================================
+    /**
+     * Stacks the second-order sections of all IIR filters and resets their state if the sections changed.
+     *
+     * @param [in] lFilterData   The filters to apply one after another.
+     * @param [in] iRows         The number of rows of the data.
+     */
+    void prepareSOS(const QList<UTILSLIB::FilterData>& lFilterData,
+                    int iRows);
+
+    //=========================================================================================================
+    /**
+     * Applies the second-order sections to the picked channels. All picked channels are processed together for
+     * every sample, so that the inner loop runs over contiguous memory and can be vectorized.
+     *
+     * @param [in] vecPicks          The used channel as index in RowVector.
+     * @param [in, out] matData      The data which is to be filtered.
+     */
+    void filterSOS(const Eigen::RowVectorXi& vecPicks,
+                   Eigen::MatrixXd& matData);
+
+    //=========================================================================================================
+    /**
+     * Filters the picked channels iBegin to iEnd-1 with the overlap-save method.
+     *
+     * @param [in] iWorker       The index of the worker whose FFT object and buffers are used.
+     * @param [in] matDataIn     The data which is to be filtered.
+     * @param [in] vecPicks      The used channel as index in RowVector.
+     * @param [in] iBegin        The first pick.
+     * @param [in] iEnd          The pick after the last one.
+     * @param [out] matDataOut   The filtered data.
+     */
+    void filterChannels(int iWorker,
+                        const Eigen::MatrixXd& matDataIn,
+                        const Eigen::RowVectorXi& vecPicks,
+                        int iBegin,
+                        int iEnd,
+                        Eigen::MatrixXd& matDataOut);
+
+    //=========================================================================================================
+    /**
+     * Filters the picked channels iBegin to iEnd-1 of a chunk read by filterFile forward and backward.
+     *
+     * @param [in] iWorker           The index of the worker whose FFT object and buffers are used.
+     * @param [in] matData           The chunk including the neighbouring samples.
+     * @param [in] iFront            The number of samples to mirror in front of the data.
+     * @param [in] iBack             The number of samples to mirror after the data.
+     * @param [in] iPad              The number of neighbouring samples on each side of the chunk.
+     * @param [in] vecKernel         The zero-phase FIR kernel (odd length, symmetric).
+     * @param [in] vecKernelFreq     The half spectrum of the FIR kernel, zero padded to the FFT length.
+     * @param [in] lFilterData       The filters, only IIR filters are used.
+     * @param [in] vecPicks          The used channel as index in RowVector.
+     * @param [in] iBegin            The first pick.
+     * @param [in] iEnd              The pick after the last one.
+     * @param [out] matDataOut       The filtered chunk.
+     */
+    void filterChannelsZeroPhase(int iWorker,
+                                 const Eigen::MatrixXd& matData,
+                                 int iFront,
+                                 int iBack,
+                                 int iPad,
+                                 const Eigen::RowVectorXd& vecKernel,
+                                 const Eigen::RowVectorXcd& vecKernelFreq,
+                                 const QList<UTILSLIB::FilterData>& lFilterData,
+                                 const Eigen::RowVectorXi& vecPicks,
+                                 int iBegin,
+                                 int iEnd,
+                                 Eigen::MatrixXd& matDataOut);
+
     Eigen::MatrixXd                 m_matDelay;                     /**< Last delay block */
+    Eigen::MatrixXd                 m_matHistory;                   /**< The last input samples (kernel length - 1) of every channel */
+
+    Eigen::RowVectorXd              m_vecKernel;                    /**< The combined kernel of all filters */
+    Eigen::RowVectorXcd             m_vecKernelFreq;                /**< The half spectrum of the zero padded kernel */
+    QList<Eigen::RowVectorXd>       m_lKernelCoeffs;                /**< The filter coefficients the kernel was created from */
+
+    int                             m_iFftLength;                   /**< The FFT length */
+
+    Eigen::MatrixXd                 m_matSOS;                       /**< The stacked second-order sections (b0 b1 b2 a0 a1 a2) of all IIR filters */
+    Eigen::MatrixXd                 m_matSOSState;                  /**< The two direct form II transposed states per section of every channel */
+    Eigen::MatrixXd                 m_matSOSData;                   /**< The picked channels of the current block, one sample per column */
+    Eigen::MatrixXd                 m_matSOSWork;                   /**< The states of the picked channels */
+
+    QVector<QSharedPointer<FftWorker> > m_lWorkers;                 /**< The FFT objects and work buffers of the worker threads */
 
 private:
 };
@@ -82,7 +82,10 @@ void RtInvOpWorker::doWork(const RtInvOpInput &inputData)
                                 forwardMeg,
                                 inputData.noiseCov,
                                 0.2f,
-                                0.8f);
+                                0.8f,
+                                false,
+                                true,
+                                MNEInverseOperator::SvdGramEigen);
 
     emit resultReady(invOpMeg);
 }
@@ -38,6 +38,9 @@
 // INCLUDES
 //=============================================================================================================
 
+#define _USE_MATH_DEFINES
+#include <math.h>
+
 #include "filterdata.h"
 
 #include "../mnemath.h"
@@ -52,6 +55,7 @@
 //=============================================================================================================
 
 #include <QDebug>
+#include <QList>
 
 //=============================================================================================================
 // EIGEN INCLUDES
@@ -70,12 +74,64 @@
 using namespace UTILSLIB;
 using namespace Eigen;
 
+//=============================================================================================================
+// DEFINE GLOBAL METHODS
+//=============================================================================================================
+
+/**
+ * Appends the second-order sections of a digital Butterworth low- or highpass, designed with the bilinear transform.
+ *
+ * @param [in] iOrder        The order of the filter.
+ * @param [in] dCutOff       The cut off frequency in Hz.
+ * @param [in] dSFreq        The sampling frequency in Hz.
+ * @param [in] bHighpass     Whether to design a highpass instead of a lowpass.
+ * @param [in, out] lSOS     The list the sections (b0 b1 b2 a0 a1 a2) are appended to.
+ */
+static void appendButterworthSOS(int iOrder,
+                                 double dCutOff,
+                                 double dSFreq,
+                                 bool bHighpass,
+                                 QList<RowVectorXd>& lSOS)
+{
+    //Prewarp the cut off frequency
+    double K = std::tan(M_PI * dCutOff / dSFreq);
+    RowVectorXd vecSection(6);
+
+    //Conjugate pole pairs of the analog prototype
+    for(int k = 0; k < iOrder/2; ++k) {
+        double Q = 1.0 / (2.0 * std::sin(M_PI * (2*k + 1) / (2.0 * iOrder)));
+        double norm = 1.0 / (1.0 + K/Q + K*K);
+
+        if(bHighpass) {
+            vecSection << norm, -2.0*norm, norm, 1.0, 2.0*(K*K - 1.0)*norm, (1.0 - K/Q + K*K)*norm;
+        } else {
+            vecSection << K*K*norm, 2.0*K*K*norm, K*K*norm, 1.0, 2.0*(K*K - 1.0)*norm, (1.0 - K/Q + K*K)*norm;
+        }
+
+        lSOS.append(vecSection);
+    }
+
+    //Real pole of odd orders
+    if(iOrder % 2 != 0) {
+        double norm = 1.0 / (1.0 + K);
+
+        if(bHighpass) {
+            vecSection << norm, -norm, 0.0, 1.0, (K - 1.0)*norm, 0.0;
+        } else {
+            vecSection << K*norm, K*norm, 0.0, 1.0, (K - 1.0)*norm, 0.0;
+        }
+
+        lSOS.append(vecSection);
+    }
+}
+
 //=============================================================================================================
 
 FilterData::FilterData()
 : m_Type(UNKNOWN)
 , m_iFilterOrder(80)
 , m_iFFTlength(512)
+, m_iIIROrder(4)
 , m_sName("Unknown")
 , m_dParksWidth(0.1)
 , m_designMethod(External)
@@ -98,7 +154,8 @@ FilterData::FilterData(QString unique_name,
                        double parkswidth,
                        double sFreq,
                        qint32 fftlength,
-                       DesignMethod designMethod)
+                       DesignMethod designMethod,
+                       int iirOrder)
 : m_designMethod(designMethod)
 , m_Type(type)
 , m_sFreq(sFreq)
@@ -107,6 +164,7 @@ FilterData::FilterData(QString unique_name,
 , m_dParksWidth(parkswidth)
 , m_iFilterOrder(order)
 , m_iFFTlength(fftlength)
+, m_iIIROrder(iirOrder)
 , m_sName(unique_name)
 {
     if(order < 9) {
@@ -120,6 +178,8 @@ FilterData::FilterData(QString unique_name,
 
 void FilterData::designFilter()
 {
+    m_matSOS.resize(0,0);
+
     switch(m_designMethod) {
         case Tschebyscheff: {
             ParksMcClellan filter(m_iFilterOrder,
@@ -183,6 +243,63 @@ void FilterData::designFilter()
 
             break;
         }
+
+        case Butterworth: {
+            double dNyquist = m_sFreq/2.0;
+            int iOrder = qBound(1, m_iIIROrder, 16);
+            QList<RowVectorXd> lSOS;
+
+            switch(m_Type) {
+                case LPF:
+                    appendButterworthSOS(iOrder, qBound(1e-6, m_dCenterFreq, 0.999) * dNyquist, m_sFreq, false, lSOS);
+                    break;
+
+                case HPF:
+                    appendButterworthSOS(iOrder, qBound(1e-6, m_dCenterFreq, 0.999) * dNyquist, m_sFreq, true, lSOS);
+                    break;
+
+                case BPF:
+                    appendButterworthSOS(iOrder, qBound(1e-6, m_dCenterFreq - m_dBandwidth/2, 0.999) * dNyquist, m_sFreq, true, lSOS);
+                    appendButterworthSOS(iOrder, qBound(1e-6, m_dCenterFreq + m_dBandwidth/2, 0.999) * dNyquist, m_sFreq, false, lSOS);
+                    break;
+
+                case NOTCH: {
+                    //Second-order notch sections with the stop band as bandwidth
+                    double w0 = M_PI * qBound(1e-6, m_dCenterFreq, 0.999);
+                    double alpha = std::sin(w0) * qMax(1e-6, m_dBandwidth) / (2.0 * qBound(1e-6, m_dCenterFreq, 0.999));
+                    RowVectorXd vecSection(6);
+                    vecSection << 1.0, -2.0*std::cos(w0), 1.0, 1.0 + alpha, -2.0*std::cos(w0), 1.0 - alpha;
+                    vecSection /= 1.0 + alpha;
+
+                    for(int i = 0; i < qMax(1, iOrder/2); ++i) {
+                        lSOS.append(vecSection);
+                    }
+                    break;
+                }
+
+                default:
+                    break;
+            }
+
+            m_matSOS.resize(lSOS.size(), 6);
+            for(int i = 0; i < lSOS.size(); ++i) {
+                m_matSOS.row(i) = lSOS.at(i);
+            }
+
+            //Consumers of FIR coefficients get the truncated impulse response. It is shifted by half of the taps,
+            //because they compensate the delay of a linear phase filter.
+            RowVectorXd vecImpulse = RowVectorXd::Zero(m_iFilterOrder - m_iFilterOrder/2);
+            if(vecImpulse.cols() > 0) {
+                vecImpulse(0) = 1.0;
+            }
+
+            m_dCoeffA = RowVectorXd::Zero(m_iFilterOrder);
+            m_dCoeffA.tail(vecImpulse.cols()) = applySOSFilter(vecImpulse);
+
+            fftTransformCoeffs();
+
+            break;
+        }
     }
 
     switch(m_Type) {
@@ -301,8 +418,8 @@ RowVectorXd FilterData::applyFFTFilter(const RowVectorXd& data, bool keepOverhea
             break;
     }
 
-    //generate fft object
-    Eigen::FFT<double> fft;
+    //generate fft object once per thread, it caches its plans between the calls
+    static thread_local Eigen::FFT<double> fft;
     fft.SetFlag(fft.HalfSpectrum);
 
     //fft-transform data sequence
@@ -325,6 +442,41 @@ RowVectorXd FilterData::applyFFTFilter(const RowVectorXd& data, bool keepOverhea
 
 //=============================================================================================================
 
+bool FilterData::isIIR() const
+{
+    return m_matSOS.rows() > 0;
+}
+
+//=============================================================================================================
+
+RowVectorXd FilterData::applySOSFilter(const RowVectorXd& data) const
+{
+    RowVectorXd t_filteredTime = data;
+
+    for(int s = 0; s < m_matSOS.rows(); ++s) {
+        const double b0 = m_matSOS(s,0) / m_matSOS(s,3);
+        const double b1 = m_matSOS(s,1) / m_matSOS(s,3);
+        const double b2 = m_matSOS(s,2) / m_matSOS(s,3);
+        const double a1 = m_matSOS(s,4) / m_matSOS(s,3);
+        const double a2 = m_matSOS(s,5) / m_matSOS(s,3);
+
+        double z1 = 0.0;
+        double z2 = 0.0;
+
+        for(int i = 0; i < t_filteredTime.cols(); ++i) {
+            double x = t_filteredTime(i);
+            double y = b0*x + z1;
+            z1 = b1*x - a1*y + z2;
+            z2 = b2*x - a2*y;
+            t_filteredTime(i) = y;
+        }
+    }
+
+    return t_filteredTime;
+}
+
+//=============================================================================================================
+
 QString FilterData::getStringForDesignMethod(const FilterData::DesignMethod &designMethod)
 {
     QString designMethodString = "External";
@@ -338,6 +490,9 @@ QString FilterData::getStringForDesignMethod(const FilterData::DesignMethod &des
     if(designMethod == FilterData::Tschebyscheff)
         designMethodString = "Tschebyscheff";
 
+    if(designMethod == FilterData::Butterworth)
+        designMethodString = "Butterworth";
+
     return designMethodString;
 }
 
@@ -377,6 +532,9 @@ FilterData::DesignMethod FilterData::getDesignMethodForString(const QString &des
     if(designMethodString == "Cosine")
         designMethod = FilterData::Cosine;
 
+    if(designMethodString == "Butterworth")
+        designMethod = FilterData::Butterworth;
+
     return designMethod;
 }
 
@@ -83,7 +83,8 @@ public:
     enum DesignMethod {
         Tschebyscheff,
         Cosine,
-        External
+        External,
+        Butterworth
     } m_designMethod;
 
     enum FilterType {
@@ -115,7 +116,8 @@ public:
      * @param [in] parkswidth determines the width of the filter slopes (steepness) - normed to sFreq/2 (nyquist)
      * @param [in] sFreq sampling frequency
      * @param [in] fftlength length of the fft (multiple integer of 2^x)
-     * @param [in] designMethod specifies the design method to use. Choose between Cosind and Tschebyscheff
+     * @param [in] designMethod specifies the design method to use. Choose between Cosind, Tschebyscheff and Butterworth
+     * @param [in] iirOrder the order of the Butterworth IIR filter per cut off frequency, ignored for FIR design methods
      **/
 
     FilterData(QString unique_name,
@@ -126,7 +128,8 @@ public:
                double parkswidth,
                double sFreq,
                qint32 fftlength=4096,
-               DesignMethod designMethod = Cosine);
+               DesignMethod designMethod = Cosine,
+               int iirOrder = 4);
 
     /**
      * @brief fftTransformCoeffs transforms the calculated filter coefficients to frequency-domain
@@ -164,6 +167,20 @@ public:
                                       CompensateEdgeEffects compensateEdgeEffects = MirrorData)
                                       const;
 
+    /**
+     * @brief isIIR returns whether the filter is an IIR filter given by second-order sections in m_matSOS
+     */
+    bool isIIR() const;
+
+    /**
+     * Applies the second-order sections of an IIR filter to the input data (causal, direct form II transposed).
+     *
+     * @param [in] data holds the data to be filtered
+     *
+     * @return the filtered data in form of a RowVectorXd
+     */
+    Eigen::RowVectorXd applySOSFilter(const Eigen::RowVectorXd& data) const;
+
     /**
      * @brief getStringForDesignMethod returns the current design method as a string
      */
@@ -193,6 +210,7 @@ public:
 
     int             m_iFilterOrder;         /**< represents the order of the filter instance. */
     int             m_iFFTlength;           /**< represents the filter length. */
+    int             m_iIIROrder;            /**< the order of the Butterworth IIR filter per cut off frequency. */
 
     QString         m_sName;                /**< contains name of the filter. */
 
@@ -201,6 +219,8 @@ public:
 
     Eigen::RowVectorXcd    m_dFFTCoeffA;    /**< the FFT-transformed forward filter coefficient set, required for frequency-domain filtering, zero-padded to m_iFFTlength. */
     Eigen::RowVectorXcd    m_dFFTCoeffB;    /**< the FFT-transformed backward filter coefficient set, required for frequency-domain filtering, zero-padded to m_iFFTlength. */
+
+    Eigen::MatrixXd        m_matSOS;        /**< the second-order sections of IIR designs, one section (b0 b1 b2 a0 a1 a2) per row. Empty for FIR designs. */
 };
 
 //=============================================================================================================
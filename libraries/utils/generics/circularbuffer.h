@@ -42,12 +42,17 @@
 
 #include "../utils_global.h"
 
+#include <atomic>
+#include <utility>
+
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
 
 #include <QPair>
-#include <QSemaphore>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
 #include <QSharedPointer>
 
 //=============================================================================================================
@@ -71,6 +76,16 @@ namespace IOBUFFER
 /**
  * TEMPLATE CIRCULAR BUFFER
  *
+ * Lock-free ring buffer for exactly one producer and one consumer thread. The read and the write index are
+ * atomics on separate cache lines, pushing and popping an element does not take a lock. Only if a blocking call
+ * has to wait, the waiting thread spins for a configurable number of tries and then sleeps on a wait condition
+ * until the other side made progress or the timeout expired.
+ *
+ * Elements are moved instead of being copied: pop() move assigns the slot to the output element and push() of an
+ * rvalue swaps the element into the slot. Since the move assignment of Eigen matrices swaps the storage, the
+ * storage of matrices circulates between producer, buffer and consumer, and no allocation takes place once all
+ * slots hold matrices of the streamed shape. Use the prototype constructor to preallocate the slots.
+ *
  * @brief The TEMPLATE CIRCULAR BUFFER provides a template for thread safe circular buffers.
  */
 template<typename _Tp>
@@ -88,6 +103,17 @@ public:
      */
     explicit CircularBuffer(unsigned int uiMaxNumElements);
 
+    //=========================================================================================================
+    /**
+     * Constructs a CircularBuffer whose slots are preallocated with copies of a prototype, e.g. a matrix of the
+     * streamed block shape.
+     *
+     * @param [in] uiMaxNumElements length of buffer.
+     * @param [in] prototype the element every slot is initialized with.
+     */
+    CircularBuffer(unsigned int uiMaxNumElements,
+                   const _Tp& prototype);
+
     //=========================================================================================================
     /**
      * Destroys the CircularBuffer.
@@ -96,7 +122,7 @@ public:
 
     //=========================================================================================================
     /**
-     * Adds a whole array at the end buffer.
+     * Adds a whole array at the end buffer. Waits until enough elements are free or the timeout expired.
      *
      * @param [in] pArray pointer to an Array which should be apend to the end.
      * @param [in] size number of elements containing the array.
@@ -105,15 +131,25 @@ public:
 
     //=========================================================================================================
     /**
-     * Adds an element at the end of the buffer.
+     * Adds an element at the end of the buffer. Waits until an element is free or the timeout expired.
      *
-     * @param [in] newElement pointer to an Array which should be apend to the end.
+     * @param [in] newElement the element which is copied to the end.
      */
     inline bool push(const _Tp& newElement);
 
     //=========================================================================================================
     /**
-     * Returns the first element (first in first out).
+     * Adds an element at the end of the buffer without copying it. Waits until an element is free or the timeout
+     * expired. On success newElement holds the storage of a previously popped element, otherwise it is unchanged.
+     *
+     * @param [in] newElement the element which is swapped to the end.
+     */
+    inline bool push(_Tp&& newElement);
+
+    //=========================================================================================================
+    /**
+     * Returns the first element (first in first out). Waits until an element is available or the timeout expired.
+     * The element is moved out of the buffer.
      *
      * @return the first element
      */
@@ -121,7 +157,17 @@ public:
 
     //=========================================================================================================
     /**
-     * Clears the buffer.
+     * Non-blocking variants of push() and pop().
+     *
+     * @return false if the buffer is full or empty respectively.
+     */
+    inline bool tryPush(const _Tp& newElement);
+    inline bool tryPush(_Tp&& newElement);
+    inline bool tryPop(_Tp& element);
+
+    //=========================================================================================================
+    /**
+     * Clears the buffer. Must be called from the consumer thread or while nothing is pushed.
      */
     void clear();
 
@@ -131,6 +177,23 @@ public:
      */
     inline void pause(bool);
 
+    //=========================================================================================================
+    /**
+     * Sets the timeout of the blocking calls.
+     *
+     * @param [in] iTimeout the timeout in ms.
+     */
+    inline void setTimeout(int iTimeout);
+
+    //=========================================================================================================
+    /**
+     * Sets how often a blocking call polls the buffer before it sleeps. Spinning lowers the latency for high
+     * block rates at the cost of cpu time.
+     *
+     * @param [in] iSpinCount number of polls, 0 sleeps right away.
+     */
+    inline void setSpinCount(int iSpinCount);
+
     //=========================================================================================================
     /**
      * Returns the number of free elements for thread safe reading.
@@ -146,21 +209,55 @@ public:
 private:
     //=========================================================================================================
     /**
-     * Returns the current circular index to the corresponding given index.
+     * Waits until at least iNum elements can be written.
+     *
+     * @param [in] iNum number of elements.
+     * @return false if the timeout expired.
+     */
+    inline bool waitForFree(unsigned int iNum);
+
+    //=========================================================================================================
+    /**
+     * Waits until at least one element can be read.
      *
-     * @param [in] index which should be mapped.
-     * @return the mapped index.
+     * @return false if the timeout expired.
      */
-    inline unsigned int mapIndex(int& index);
-    unsigned int    m_uiMaxNumElements;     /**< Holds the maximal number of buffer elements.*/
-    _Tp*            m_pBuffer;              /**< Holds the circular buffer.*/
-    int             m_iCurrentReadIndex;    /**< Holds the current read index.*/
-    int             m_iCurrentWriteIndex;   /**< Holds the current write index.*/
-    QSemaphore*     m_pFreeElements;        /**< Holds a semaphore which acquires free elements for thread safe writing. A semaphore is a generalization of a mutex.*/
-    QSemaphore*     m_pUsedElements;        /**< Holds a semaphore which acquires written semaphore for thread safe reading.*/
-    int             m_iTimeout;             /**< Holds the timeout value after which the acquire statement will return false.*/
-
-    bool            m_bPause;
+    inline bool waitForUsed();
+
+    //=========================================================================================================
+    /**
+     * Spins and then sleeps until the readiness check returns true.
+     *
+     * @param [in] isReady the readiness check.
+     * @return false if the timeout expired.
+     */
+    template<typename Predicate>
+    inline bool wait(Predicate isReady);
+
+    //=========================================================================================================
+    /**
+     * Publishes a new index and wakes up the other side if it sleeps.
+     *
+     * @param [in] index the index to store.
+     * @param [in] value the new value.
+     */
+    inline void publish(std::atomic<quint64>& index, quint64 value);
+
+    unsigned int            m_uiMaxNumElements;     /**< Holds the maximal number of buffer elements.*/
+    _Tp*                    m_pBuffer;              /**< Holds the circular buffer.*/
+    int                     m_iTimeout;             /**< Holds the timeout value after which the blocking calls return false.*/
+    int                     m_iSpinCount;           /**< Holds the number of polls before a blocking call sleeps.*/
+    std::atomic<bool>       m_bPause;               /**< Holds whether the buffer is paused.*/
+
+    char                    m_padRead[64];          /**< Keeps the read index on its own cache line.*/
+    std::atomic<quint64>    m_iReadIndex;           /**< Holds the number of elements read so far, written by the consumer.*/
+    char                    m_padWrite[64];         /**< Keeps the write index on its own cache line.*/
+    std::atomic<quint64>    m_iWriteIndex;          /**< Holds the number of elements written so far, written by the producer.*/
+    char                    m_padWait[64];          /**< Keeps the wait state on its own cache line.*/
+
+    std::atomic<int>        m_iWaiting;             /**< Holds the number of sleeping threads.*/
+    QMutex                  m_mutex;                /**< Holds the mutex of the wait condition.*/
+    QWaitCondition          m_progress;             /**< Holds the wait condition signaled whenever an index changed while a thread sleeps.*/
 };
 
 //=============================================================================================================
@@ -171,22 +268,32 @@ template<typename _Tp>
 CircularBuffer<_Tp>::CircularBuffer(unsigned int uiMaxNumElements)
 : m_uiMaxNumElements(uiMaxNumElements)
 , m_pBuffer(new _Tp[m_uiMaxNumElements])
-, m_iCurrentReadIndex(-1)
-, m_iCurrentWriteIndex(-1)
-, m_pFreeElements(new QSemaphore(m_uiMaxNumElements))
-, m_pUsedElements(new QSemaphore(0))
 , m_iTimeout(1000)
+, m_iSpinCount(1000)
 , m_bPause(false)
+, m_iReadIndex(0)
+, m_iWriteIndex(0)
+, m_iWaiting(0)
 {
 }
 
 //=============================================================================================================
 
+template<typename _Tp>
+CircularBuffer<_Tp>::CircularBuffer(unsigned int uiMaxNumElements,
+                                    const _Tp& prototype)
+: CircularBuffer(uiMaxNumElements)
+{
+    for(unsigned int i = 0; i < m_uiMaxNumElements; ++i) {
+        m_pBuffer[i] = prototype;
+    }
+}
+
+//=============================================================================================================
+
 template<typename _Tp>
 CircularBuffer<_Tp>::~CircularBuffer()
 {
-    delete m_pFreeElements;
-    delete m_pUsedElements;
     delete [] m_pBuffer;
 }
 
@@ -195,15 +302,16 @@ CircularBuffer<_Tp>::~CircularBuffer()
 template<typename _Tp>
 inline bool CircularBuffer<_Tp>::push(const _Tp* pArray, unsigned int size)
 {
-    if(!m_bPause) {
-        if(m_pFreeElements->tryAcquire(size, m_iTimeout)) {
-            for(unsigned int i = 0; i < size; ++i) {
-                m_pBuffer[mapIndex(m_iCurrentWriteIndex)] = pArray[i];
-            }
-            const QSemaphoreReleaser releaser(m_pUsedElements, size);
-        } else {
+    if(!m_bPause.load(std::memory_order_relaxed)) {
+        if(size > m_uiMaxNumElements || !waitForFree(size)) {
             return false;
         }
+
+        const quint64 iWrite = m_iWriteIndex.load(std::memory_order_relaxed);
+        for(unsigned int i = 0; i < size; ++i) {
+            m_pBuffer[(iWrite + i) % m_uiMaxNumElements] = pArray[i];
+        }
+        publish(m_iWriteIndex, iWrite + size);
     }
 
     return true;
@@ -214,13 +322,30 @@ inline bool CircularBuffer<_Tp>::push(const _Tp* pArray, unsigned int size)
 template<typename _Tp>
 inline bool CircularBuffer<_Tp>::push(const _Tp& newElement)
 {
-    if(m_pFreeElements->tryAcquire(1, m_iTimeout)) {
-        m_pBuffer[mapIndex(m_iCurrentWriteIndex)] = newElement;
-        const QSemaphoreReleaser releaser(m_pUsedElements, 1);
-    } else {
-       return false;
+    if(!waitForFree(1)) {
+        return false;
     }
 
+    const quint64 iWrite = m_iWriteIndex.load(std::memory_order_relaxed);
+    m_pBuffer[iWrite % m_uiMaxNumElements] = newElement;
+    publish(m_iWriteIndex, iWrite + 1);
+
+    return true;
+}
+
+//=============================================================================================================
+
+template<typename _Tp>
+inline bool CircularBuffer<_Tp>::push(_Tp&& newElement)
+{
+    if(!waitForFree(1)) {
+        return false;
+    }
+
+    const quint64 iWrite = m_iWriteIndex.load(std::memory_order_relaxed);
+    std::swap(m_pBuffer[iWrite % m_uiMaxNumElements], newElement);
+    publish(m_iWriteIndex, iWrite + 1);
+
     return true;
 }
 
@@ -229,13 +354,14 @@ inline bool CircularBuffer<_Tp>::push(const _Tp& newElement)
 template<typename _Tp>
 inline bool CircularBuffer<_Tp>::pop(_Tp& element)
 {
-    if(!m_bPause) {
-        if(m_pUsedElements->tryAcquire(1, m_iTimeout)) {
-            element = m_pBuffer[mapIndex(m_iCurrentReadIndex)];
-            const QSemaphoreReleaser releaser(m_pFreeElements, 1);
-        } else {
+    if(!m_bPause.load(std::memory_order_relaxed)) {
+        if(!waitForUsed()) {
             return false;
         }
+
+        const quint64 iRead = m_iReadIndex.load(std::memory_order_relaxed);
+        element = std::move(m_pBuffer[iRead % m_uiMaxNumElements]);
+        publish(m_iReadIndex, iRead + 1);
     }
 
     return true;
@@ -244,24 +370,57 @@ inline bool CircularBuffer<_Tp>::pop(_Tp& element)
 //=============================================================================================================
 
 template<typename _Tp>
-inline unsigned int CircularBuffer<_Tp>::mapIndex(int& index)
+inline bool CircularBuffer<_Tp>::tryPush(const _Tp& newElement)
 {
-    int aux = index;
-    return index = ++aux % m_uiMaxNumElements;
+    if(getFreeElementsWrite() < 1) {
+        return false;
+    }
+
+    const quint64 iWrite = m_iWriteIndex.load(std::memory_order_relaxed);
+    m_pBuffer[iWrite % m_uiMaxNumElements] = newElement;
+    publish(m_iWriteIndex, iWrite + 1);
+
+    return true;
 }
 
 //=============================================================================================================
 
 template<typename _Tp>
-inline void CircularBuffer<_Tp>::clear()
+inline bool CircularBuffer<_Tp>::tryPush(_Tp&& newElement)
 {
-    delete m_pFreeElements;
-    m_pFreeElements = new QSemaphore(m_uiMaxNumElements);
-    delete m_pUsedElements;
-    m_pUsedElements = new QSemaphore(0);
+    if(getFreeElementsWrite() < 1) {
+        return false;
+    }
+
+    const quint64 iWrite = m_iWriteIndex.load(std::memory_order_relaxed);
+    std::swap(m_pBuffer[iWrite % m_uiMaxNumElements], newElement);
+    publish(m_iWriteIndex, iWrite + 1);
+
+    return true;
+}
+
+//=============================================================================================================
+
+template<typename _Tp>
+inline bool CircularBuffer<_Tp>::tryPop(_Tp& element)
+{
+    if(getFreeElementsRead() < 1) {
+        return false;
+    }
+
+    const quint64 iRead = m_iReadIndex.load(std::memory_order_relaxed);
+    element = std::move(m_pBuffer[iRead % m_uiMaxNumElements]);
+    publish(m_iReadIndex, iRead + 1);
+
+    return true;
+}
+
+//=============================================================================================================
 
-    m_iCurrentReadIndex = -1;
-    m_iCurrentWriteIndex = -1;
+template<typename _Tp>
+inline void CircularBuffer<_Tp>::clear()
+{
+    publish(m_iReadIndex, m_iWriteIndex.load(std::memory_order_acquire));
 }
 
 //=============================================================================================================
@@ -269,7 +428,23 @@ inline void CircularBuffer<_Tp>::clear()
 template<typename _Tp>
 inline void CircularBuffer<_Tp>::pause(bool bPause)
 {
-    m_bPause = bPause;
+    m_bPause.store(bPause, std::memory_order_relaxed);
+}
+
+//=============================================================================================================
+
+template<typename _Tp>
+inline void CircularBuffer<_Tp>::setTimeout(int iTimeout)
+{
+    m_iTimeout = iTimeout;
+}
+
+//=============================================================================================================
+
+template<typename _Tp>
+inline void CircularBuffer<_Tp>::setSpinCount(int iSpinCount)
+{
+    m_iSpinCount = iSpinCount;
 }
 
 //=============================================================================================================
@@ -277,7 +452,7 @@ inline void CircularBuffer<_Tp>::pause(bool bPause)
 template<typename _Tp>
 inline int CircularBuffer<_Tp>::getFreeElementsRead()
 {
-    return m_pUsedElements->available();
+    return static_cast<int>(m_iWriteIndex.load(std::memory_order_acquire) - m_iReadIndex.load(std::memory_order_acquire));
 }
 
 //=============================================================================================================
@@ -285,7 +460,78 @@ inline int CircularBuffer<_Tp>::getFreeElementsRead()
 template<typename _Tp>
 inline int CircularBuffer<_Tp>::getFreeElementsWrite()
 {
-    return m_pFreeElements->available();
+    return static_cast<int>(m_uiMaxNumElements - (m_iWriteIndex.load(std::memory_order_acquire) - m_iReadIndex.load(std::memory_order_acquire)));
+}
+
+//=============================================================================================================
+
+template<typename _Tp>
+inline bool CircularBuffer<_Tp>::waitForFree(unsigned int iNum)
+{
+    return wait([this, iNum]() { return getFreeElementsWrite() >= static_cast<int>(iNum); });
+}
+
+//=============================================================================================================
+
+template<typename _Tp>
+inline bool CircularBuffer<_Tp>::waitForUsed()
+{
+    return wait([this]() { return getFreeElementsRead() >= 1; });
+}
+
+//=============================================================================================================
+
+template<typename _Tp>
+template<typename Predicate>
+inline bool CircularBuffer<_Tp>::wait(Predicate isReady)
+{
+    for(int i = 0; i < m_iSpinCount; ++i) {
+        if(isReady()) {
+            return true;
+        }
+    }
+
+    if(isReady()) {
+        return true;
+    }
+
+    //
+    // Sleep. The counter is raised before the final check, publish() raises the index before it reads the
+    // counter, so either this thread sees the new index or the other side sees the sleeping thread.
+    //
+    QElapsedTimer timer;
+    timer.start();
+
+    QMutexLocker locker(&m_mutex);
+    m_iWaiting.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool bReady = isReady();
+    while(!bReady) {
+        qint64 iRemaining = m_iTimeout - timer.elapsed();
+        if(iRemaining <= 0) {
+            break;
+        }
+        m_progress.wait(&m_mutex, static_cast<unsigned long>(iRemaining));
+        bReady = isReady();
+    }
+
+    m_iWaiting.fetch_sub(1);
+
+    return bReady;
+}
+
+//=============================================================================================================
+
+template<typename _Tp>
+inline void CircularBuffer<_Tp>::publish(std::atomic<quint64>& index, quint64 value)
+{
+    index.store(value);
+
+    if(m_iWaiting.load() > 0) {
+        QMutexLocker locker(&m_mutex);
+        m_progress.wakeAll();
+    }
 }
 
 //=============================================================================================================
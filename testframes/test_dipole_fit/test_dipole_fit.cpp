@@ -39,18 +39,26 @@
 
 #include <inverse/dipoleFit/dipole_fit_settings.h>
 #include <inverse/dipoleFit/dipole_fit.h>
+#include <inverse/dipoleFit/guess_data.h>
+#include <inverse/dipoleFit/dipole_fit_data.h>
+#include <fwd/fwd_eeg_sphere_model.h>
+
+#include <Eigen/Dense>
 
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
 
 #include <QtTest>
+#include <QTemporaryDir>
 
 //=============================================================================================================
 // USED NAMESPACES
 //=============================================================================================================
 
 using namespace INVERSELIB;
+using namespace FWDLIB;
+using namespace Eigen;
 
 //=============================================================================================================
 /**
@@ -70,6 +78,9 @@ private slots:
     void initTestCase();
     void dipoleFitSimple();
     void dipoleFitAdvanced();
+    void dipoleFitParallel();
+    void dipoleFitParallelCached();
+    void findBestGuesses();
     void cleanupTestCase();
 
 private:
@@ -258,6 +269,310 @@ void TestDipoleFit::dipoleFitAdvanced()
 
 //=============================================================================================================
 
+void TestDipoleFit::dipoleFitParallel()
+{
+    QFile testFile;
+
+    //*********************************************************************************************************
+    // Dipole Fit Settings
+    //*********************************************************************************************************
+
+    printf(">>>>>>>>>>>>>>>>>>>>>>>>> Dipole Fit Settings >>>>>>>>>>>>>>>>>>>>>>>>>\n");
+
+    //Same as dipoleFitSimple (sphere model) and dipoleFitAdvanced (BEM)
+    DipoleFitSettings settingsSphere;
+    testFile.setFileName(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis-ave.fif"); QVERIFY( testFile.exists() );
+    settingsSphere.measname = testFile.fileName();
+    settingsSphere.is_raw = false;
+    settingsSphere.setno = 1;
+    settingsSphere.include_meg = true;
+    settingsSphere.include_eeg = true;
+    settingsSphere.tmin = 32.0f/1000.0f;
+    settingsSphere.tmax = 148.0f/1000.0f;
+    settingsSphere.bmin = -100.0f/1000.0f;
+    settingsSphere.bmax = 0.0f/1000.0f;
+
+    settingsSphere.checkIntegrity();
+
+    DipoleFitSettings settingsBem;
+    settingsBem.measname = testFile.fileName();
+    settingsBem.is_raw = false;
+    settingsBem.setno = 1;
+    settingsBem.include_meg = true;
+    settingsBem.include_eeg = false;
+    settingsBem.tmin = 0.15f;
+    settingsBem.tmax = 0.25f;
+    settingsBem.tstep = 0.01f;
+    settingsBem.bmin = 1000000.0f;
+    settingsBem.bmax = 1000000.0f;
+    settingsBem.guess_mindist = 0.0f;
+    settingsBem.guess_rad = 0.1f;
+
+    testFile.setFileName(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/subjects/sample/bem/sample-5120-bem.fif"); QVERIFY( testFile.exists() );
+    settingsBem.bemname = testFile.fileName();
+
+    testFile.setFileName(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/all-trans.fif"); QVERIFY( testFile.exists() );
+    settingsBem.mriname = testFile.fileName();
+
+    testFile.setFileName(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis-cov.fif"); QVERIFY( testFile.exists() );
+    settingsBem.noisename = testFile.fileName();
+
+    settingsBem.projnames.append(settingsBem.measname);
+
+    settingsBem.checkIntegrity();
+
+    printf("<<<<<<<<<<<<<<<<<<<<<<<<< Dipole Fit Settings Finished <<<<<<<<<<<<<<<<<<<<<<<<<\n");
+
+    //*********************************************************************************************************
+    // Compare the parallel fits with the sequential fits
+    //*********************************************************************************************************
+
+    QList<DipoleFitSettings> settingsList;
+    settingsList << settingsSphere << settingsBem;
+
+    for (int i = 0; i < settingsList.size(); ++i)
+    {
+        printf(">>>>>>>>>>>>>>>>>>>>>>>>> Compute Dipole Fit (sequential) >>>>>>>>>>>>>>>>>>>>>>>>>\n");
+
+        DipoleFitSettings settingsSequential(settingsList[i]);
+        settingsSequential.nthreads = 1;
+        DipoleFit dipFitSequential(&settingsSequential);
+        m_refECDSet = dipFitSequential.calculateFit();
+
+        printf(">>>>>>>>>>>>>>>>>>>>>>>>> Compute Dipole Fit (parallel) >>>>>>>>>>>>>>>>>>>>>>>>>\n");
+
+        DipoleFitSettings settingsParallel(settingsList[i]);
+        settingsParallel.nthreads = 3;
+        DipoleFit dipFitParallel(&settingsParallel);
+        m_ECDSet = dipFitParallel.calculateFit();
+
+        // Each point is fitted by the same code, so the sets have to match exactly and in time order
+        QVERIFY( m_refECDSet.size() > 1 );
+        compareFit();
+    }
+}
+
+//=============================================================================================================
+
+void TestDipoleFit::dipoleFitParallelCached()
+{
+    QString refFileName(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/Result/ref_dip_fit.dat");
+    QFile testFile;
+    QTemporaryDir cacheDir;
+    QVERIFY( cacheDir.isValid() );
+
+    //*********************************************************************************************************
+    // Dipole Fit Settings
+    //*********************************************************************************************************
+
+    printf(">>>>>>>>>>>>>>>>>>>>>>>>> Dipole Fit Settings >>>>>>>>>>>>>>>>>>>>>>>>>\n");
+
+    //Same as dipoleFitSimple, fitted with four threads and a guess field cache
+    DipoleFitSettings settings;
+    testFile.setFileName(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis-ave.fif"); QVERIFY( testFile.exists() );
+    settings.measname = testFile.fileName();
+    settings.is_raw = false;
+    settings.setno = 1;
+    settings.include_meg = true;
+    settings.include_eeg = true;
+    settings.tmin = 32.0f/1000.0f;
+    settings.tmax = 148.0f/1000.0f;
+    settings.bmin = -100.0f/1000.0f;
+    settings.bmax = 0.0f/1000.0f;
+    settings.nthreads = 4;
+    settings.guess_cache_dir = cacheDir.path();
+
+    settings.checkIntegrity();
+
+    printf("<<<<<<<<<<<<<<<<<<<<<<<<< Dipole Fit Settings Finished <<<<<<<<<<<<<<<<<<<<<<<<<\n");
+
+    m_refECDSet = ECDSet::read_dipoles_dip(refFileName);
+
+    //*********************************************************************************************************
+    // Compute the guess fields and store them in the cache
+    //*********************************************************************************************************
+
+    printf(">>>>>>>>>>>>>>>>>>>>>>>>> Compute Dipole Fit (guess fields computed) >>>>>>>>>>>>>>>>>>>>>>>>>\n");
+
+    DipoleFitSettings settingsFirst(settings);
+    DipoleFit dipFitFirst(&settingsFirst);
+    ECDSet setFirst = dipFitFirst.calculateFit();
+    QVERIFY( QDir(cacheDir.path()).entryList(QStringList("guess-*.bin"), QDir::Files).size() == 1 );
+
+    // The reference was written to and read from a .dat file
+    setFirst.save_dipoles_dip(cacheDir.filePath("dip_fit_first.dat"));
+    m_ECDSet = ECDSet::read_dipoles_dip(cacheDir.filePath("dip_fit_first.dat"));
+
+    compareFit();
+
+    //*********************************************************************************************************
+    // Load the cached guess fields directly and compare them with freshly computed ones
+    //*********************************************************************************************************
+
+    printf(">>>>>>>>>>>>>>>>>>>>>>>>> Compare Cached Guess Fields >>>>>>>>>>>>>>>>>>>>>>>>>\n");
+
+    //Same setup as in DipoleFit::calculateFit
+    DipoleFitSettings settingsGuess(settings);
+    FwdEegSphereModel* eeg_model = FwdEegSphereModel::setup_eeg_sphere_model(settingsGuess.eeg_model_file,settingsGuess.eeg_model_name,settingsGuess.eeg_sphere_rad);
+    QVERIFY( eeg_model != NULL );
+
+    QScopedPointer<DipoleFitData> fit_data(DipoleFitData::setup_dipole_fit_data(settingsGuess.mriname,
+                                                                                settingsGuess.measname,
+                                                                                settingsGuess.bemname,
+                                                                                &settingsGuess.r0,
+                                                                                eeg_model,
+                                                                                settingsGuess.accurate,
+                                                                                settingsGuess.badname,
+                                                                                settingsGuess.noisename,
+                                                                                settingsGuess.grad_std,
+                                                                                settingsGuess.mag_std,
+                                                                                settingsGuess.eeg_std,
+                                                                                settingsGuess.mag_reg,
+                                                                                settingsGuess.grad_reg,
+                                                                                settingsGuess.eeg_reg,
+                                                                                settingsGuess.diagnoise,
+                                                                                settingsGuess.projnames,
+                                                                                settingsGuess.include_meg,
+                                                                                settingsGuess.include_eeg));
+    QVERIFY( !fit_data.isNull() );
+    fit_data->fit_mag_dipoles = settingsGuess.fit_mag_dipoles;
+
+    // Without a cache directory the guess fields are computed
+    GuessData guess(settingsGuess.guessname,
+                    settingsGuess.guess_surfname,
+                    settingsGuess.guess_mindist, settingsGuess.guess_exclude, settingsGuess.guess_grid, fit_data.data());
+    QVERIFY( guess.nguess > 0 );
+
+    int nch = fit_data->nmeg + fit_data->neeg;
+    MatrixXf matFreshFwd(3*guess.nguess,nch);
+    MatrixXf matFreshUu(3*guess.nguess,nch);
+    VectorXf vecFreshSing(3*guess.nguess);
+    for (int k = 0; k < guess.nguess; k++) {
+        for (int c = 0; c < 3; c++) {
+            matFreshFwd.row(3*k+c) = Map<const RowVectorXf>(guess.guess_fwd[k]->fwd[c],nch);
+            matFreshUu.row(3*k+c) = Map<const RowVectorXf>(guess.guess_fwd[k]->uu[c],nch);
+            vecFreshSing[3*k+c] = guess.guess_fwd[k]->sing[c];
+        }
+    }
+
+    // The first fit has to have stored exactly these guess fields
+    QVERIFY( guess.read_guess_fields_cache(cacheDir.path(),fit_data.data()) );
+    guess.pack_guess_fields();
+
+    for (int k = 0; k < guess.nguess; k++) {
+        QVERIFY( guess.guess_fwd[k]->nch == nch );
+        for (int c = 0; c < 3; c++) {
+            QVERIFY( (Map<const RowVectorXf>(guess.guess_fwd[k]->fwd[c],nch) - matFreshFwd.row(3*k+c)).cwiseAbs().maxCoeff() <= epsilon * matFreshFwd.row(3*k+c).cwiseAbs().maxCoeff() );
+            QVERIFY( std::fabs(guess.guess_fwd[k]->sing[c] - vecFreshSing[3*k+c]) <= epsilon * vecFreshSing[3*k] );
+        }
+    }
+    QVERIFY( (guess.guess_uu - matFreshUu).cwiseAbs().maxCoeff() <= epsilon );
+
+    printf("<<<<<<<<<<<<<<<<<<<<<<<<< Compare Cached Guess Fields Finished <<<<<<<<<<<<<<<<<<<<<<<<<\n");
+
+    //*********************************************************************************************************
+    // Reuse the cached guess fields
+    //*********************************************************************************************************
+
+    printf(">>>>>>>>>>>>>>>>>>>>>>>>> Compute Dipole Fit (guess fields cached) >>>>>>>>>>>>>>>>>>>>>>>>>\n");
+
+    DipoleFitSettings settingsSecond(settings);
+    DipoleFit dipFitSecond(&settingsSecond);
+    ECDSet setSecond = dipFitSecond.calculateFit();
+
+    setSecond.save_dipoles_dip(cacheDir.filePath("dip_fit_second.dat"));
+    m_ECDSet = ECDSet::read_dipoles_dip(cacheDir.filePath("dip_fit_second.dat"));
+
+    compareFit();
+}
+
+//=============================================================================================================
+
+void TestDipoleFit::findBestGuesses()
+{
+    printf(">>>>>>>>>>>>>>>>>>>>>>>>> Compare Guess Scan >>>>>>>>>>>>>>>>>>>>>>>>>\n");
+
+    const int nch    = 40;
+    const int nguess = 300;
+    const int pseudoradial = 17;
+
+    //*********************************************************************************************************
+    // Random guess fields with orthonormal left singular vectors
+    //*********************************************************************************************************
+
+    std::srand(5);
+
+    GuessData guess;
+    guess.nguess = nguess;
+    guess.guess_uu.resize(3*nguess,nch);
+    guess.guess_sing_ratio = (VectorXf::Random(nguess).array() + 1.0f) / 2.0f;
+    guess.guess_sing_ratio[pseudoradial] = 0.01f;
+
+    for (int k = 0; k < nguess; k++) {
+        MatrixXf matQ = MatrixXf::Random(nch,3).householderQr().householderQ() * MatrixXf::Identity(nch,3);
+        guess.guess_uu.middleRows(3*k,3) = matQ.transpose();
+    }
+
+    //*********************************************************************************************************
+    // Data: random columns, a column dominated by the pseudoradial component of one guess and an empty column
+    //*********************************************************************************************************
+
+    MatrixXf matB = MatrixXf::Random(nch,7);
+    matB.col(5) = 10.0f * guess.guess_uu.row(3*pseudoradial+2).transpose() + guess.guess_uu.row(3*pseudoradial).transpose() + matB.col(5);
+    matB.col(6).setZero();
+
+    QList<float> limits;
+    limits << 0.0f << 0.3f << 2.0f;
+
+    for (int l = 0; l < limits.size(); l++) {
+        float limit = limits[l];
+
+        VectorXi vecBest;
+        VectorXf vecGood;
+        QVERIFY( guess.find_best_guesses(matB,limit,vecBest,vecGood) );
+        QVERIFY( vecBest.size() == matB.cols() );
+        QVERIFY( vecGood.size() == matB.cols() );
+
+        //*****************************************************************************************************
+        // The per-guess scan find_best_guesses replaced
+        //*****************************************************************************************************
+
+        for (int j = 0; j < matB.cols(); j++) {
+            double B2   = matB.col(j).cast<double>().squaredNorm();
+            int    best = -1;
+            double good = 0.0;
+
+            for (int k = 0; k < nguess; k++) {
+                int    ncomp = guess.guess_sing_ratio[k] > limit ? 3 : 2;
+                double Bm2   = 0.0;
+                for (int c = 0; c < ncomp; c++) {
+                    double one = guess.guess_uu.row(3*k+c).cast<double>().dot(matB.col(j).cast<double>());
+                    Bm2 = Bm2 + one*one;
+                }
+                double this_good = 1.0 - (B2 - Bm2)/B2;
+                if (this_good > good) {
+                    best = k;
+                    good = this_good;
+                }
+            }
+
+            QVERIFY( vecBest[j] == best );
+            QVERIFY( std::fabs(vecGood[j] - good) < 1e-5 );
+        }
+
+        // The pseudoradial component only counts if the guess is not pseudoradial
+        if (guess.guess_sing_ratio[pseudoradial] > limit)
+            QVERIFY( vecBest[5] == pseudoradial );
+        else
+            QVERIFY( vecBest[5] != pseudoradial );
+        QVERIFY( vecBest[6] == -1 );
+    }
+
+    printf("<<<<<<<<<<<<<<<<<<<<<<<<< Compare Guess Scan Finished <<<<<<<<<<<<<<<<<<<<<<<<<\n");
+}
+
+//=============================================================================================================
+
 void TestDipoleFit::compareFit()
 {
     //*********************************************************************************************************
@@ -0,0 +1,292 @@
+//=============================================================================================================
+/**
+ * @file     test_fiff_dir_index.cpp
+ * @author   Lorenz Esch <lesch@mgh.harvard.edu>
+ * @version  dev
+ * @date     April, 2020
+ *
+ * @section  LICENSE
+ *
+ * Copyright (C) 2020, Lorenz Esch. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ * the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+ *       following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ *       the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *     * Neither the name of MNE-CPP authors nor the names of its contributors may be used
+ *       to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @brief    Test for the tag directory index sidecar of FiffStream
+ *
+ */
+
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include <utils/generics/applicationlogger.h>
+
+#include <fiff/fiff.h>
+
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtTest>
+
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+using namespace Eigen;
+
+//=============================================================================================================
+/**
+ * DECLARE CLASS TestFiffDirIndex
+ *
+ * @brief The TestFiffDirIndex class verifies the tag directory index sidecar and compares cold and cached opens
+ *
+ */
+class TestFiffDirIndex: public QObject
+{
+    Q_OBJECT
+
+public:
+    TestFiffDirIndex();
+
+private slots:
+    void initTestCase();
+    void benchmarkColdScan();
+    void compareIndexedSetup();
+    void rejectInvalidIndex();
+    void cleanupTestCase();
+
+private:
+    bool compareRawDir(const FiffRawData& raw1, const FiffRawData& raw2);
+    bool compareDir(const QList<FiffDirEntry::SPtr>& dir1, const QList<FiffDirEntry::SPtr>& dir2);
+
+    double dEpsilon;
+    int iRepetitions;
+
+    QString sFileName;
+    QString sIndexFileName;
+
+    FiffRawData rawCold;
+    qint64 iColdMSecs;
+};
+
+//=============================================================================================================
+
+TestFiffDirIndex::TestFiffDirIndex()
+: dEpsilon(0.000001)
+, iRepetitions(10)
+, iColdMSecs(0)
+{
+}
+
+//=============================================================================================================
+
+void TestFiffDirIndex::initTestCase()
+{
+    qInstallMessageHandler(UTILSLIB::ApplicationLogger::customLogWriter);
+
+    QFile t_fileIn(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis_trunc_raw.fif");
+    sFileName = QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis_trunc_raw_test_dir_index_out.fif";
+    QFile t_fileOut(sFileName);
+
+    //
+    //   Written raw files carry no directory pointer, i.e. they have to be scanned when opened
+    //
+    FiffRawData raw(t_fileIn);
+    QVERIFY(!raw.isEmpty());
+
+    RowVectorXd vCals;
+    FiffStream::SPtr outfid = FiffStream::start_writing_raw(t_fileOut, raw.info, vCals);
+
+    MatrixXd data, times;
+    fiff_int_t quantum = ceil(raw.info.sfreq);
+    for(fiff_int_t first = raw.first_samp; first < raw.last_samp; first += quantum) {
+        fiff_int_t last = qMin(first + quantum - 1, raw.last_samp);
+        QVERIFY(raw.read_raw_segment(data, times, first, last));
+        if(first == raw.first_samp && first > 0)
+            outfid->write_int(FIFF_FIRST_SAMPLE, &first);
+        outfid->write_raw_buffer(data, vCals);
+    }
+    outfid->finish_writing_raw();
+
+    sIndexFileName = sFileName + ".idx";
+    QFile::remove(sIndexFileName);
+}
+
+//=============================================================================================================
+
+void TestFiffDirIndex::benchmarkColdScan()
+{
+    QFile t_file(sFileName);
+
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < iRepetitions; ++i) {
+        rawCold = FiffRawData();
+        QVERIFY(FiffStream::setup_read_raw(t_file, rawCold, true, false, false));
+    }
+    iColdMSecs = timer.elapsed();
+
+    QVERIFY(!QFile::exists(sIndexFileName));
+    qInfo("TestFiffDirIndex::benchmarkColdScan - %d opens with make_dir took %lld ms", iRepetitions, iColdMSecs);
+}
+
+//=============================================================================================================
+
+void TestFiffDirIndex::compareIndexedSetup()
+{
+    QFile t_file(sFileName);
+
+    //
+    //   The first open scans the file and writes the index
+    //
+    FiffRawData rawIndexed;
+    QVERIFY(FiffStream::setup_read_raw(t_file, rawIndexed, true, false, true));
+    QVERIFY(QFile::exists(sIndexFileName));
+    QVERIFY(compareRawDir(rawCold, rawIndexed));
+
+    //
+    //   All following opens are served from the index
+    //
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < iRepetitions; ++i) {
+        rawIndexed = FiffRawData();
+        QVERIFY(FiffStream::setup_read_raw(t_file, rawIndexed, true, false, true));
+    }
+    qint64 iCachedMSecs = timer.elapsed();
+    qInfo("TestFiffDirIndex::compareIndexedSetup - %d opens from the index took %lld ms (make_dir: %lld ms)", iRepetitions, iCachedMSecs, iColdMSecs);
+
+    QVERIFY(compareRawDir(rawCold, rawIndexed));
+    QCOMPARE(rawIndexed.file->dir().size(), rawCold.file->dir().size());
+
+    MatrixXd dataCold, dataIndexed, times;
+    QVERIFY(rawCold.read_raw_segment(dataCold, times));
+    QVERIFY(rawIndexed.read_raw_segment(dataIndexed, times));
+    QVERIFY((dataCold - dataIndexed).cwiseAbs().maxCoeff() < dEpsilon);
+}
+
+//=============================================================================================================
+
+void TestFiffDirIndex::rejectInvalidIndex()
+{
+    QFile t_file(sFileName);
+    QFile t_fileIndex(sIndexFileName);
+    QDataStream t_stream(&t_fileIndex);
+    qint32 iKind, iNent;
+
+    //
+    //   Corrupt the first directory entry, which is part of the validation
+    //
+    QVERIFY(t_fileIndex.open(QIODevice::ReadWrite));
+    t_fileIndex.seek(44);
+    t_stream >> iNent >> iKind;
+    t_fileIndex.seek(48);
+    t_stream << (qint32)9999;
+    t_fileIndex.close();
+
+    FiffRawData rawIndexed;
+    QVERIFY(FiffStream::setup_read_raw(t_file, rawIndexed, true, false, true));
+    QVERIFY(compareRawDir(rawCold, rawIndexed));
+    QVERIFY(compareDir(rawCold.file->dir(), rawIndexed.file->dir()));
+
+    //
+    //   The rescan replaced the index
+    //
+    qint32 iKindNew, iNentNew;
+    QVERIFY(t_fileIndex.open(QIODevice::ReadOnly));
+    t_fileIndex.seek(44);
+    t_stream >> iNentNew >> iKindNew;
+    t_fileIndex.close();
+    QCOMPARE(iNentNew, iNent);
+    QCOMPARE(iKindNew, iKind);
+
+    //
+    //   A truncated index claiming a huge directory is rejected before anything is allocated
+    //
+    QVERIFY(t_fileIndex.open(QIODevice::ReadWrite));
+    t_fileIndex.seek(44);
+    t_stream << (qint32)0x7FFFFFFF;
+    QVERIFY(t_fileIndex.resize(48));
+    t_fileIndex.close();
+
+    rawIndexed = FiffRawData();
+    QVERIFY(FiffStream::setup_read_raw(t_file, rawIndexed, true, false, true));
+    QVERIFY(compareRawDir(rawCold, rawIndexed));
+    QVERIFY(compareDir(rawCold.file->dir(), rawIndexed.file->dir()));
+    QVERIFY(QFileInfo(sIndexFileName).size() > 48);
+}
+
+//=============================================================================================================
+
+void TestFiffDirIndex::cleanupTestCase()
+{
+    QFile::remove(sIndexFileName);
+    QFile::remove(sFileName);
+}
+
+//=============================================================================================================
+
+bool TestFiffDirIndex::compareRawDir(const FiffRawData& raw1, const FiffRawData& raw2)
+{
+    if(raw1.first_samp != raw2.first_samp || raw1.last_samp != raw2.last_samp || raw1.rawdir.size() != raw2.rawdir.size())
+        return false;
+
+    for(int i = 0; i < raw1.rawdir.size(); ++i) {
+        if(raw1.rawdir[i].first != raw2.rawdir[i].first ||
+           raw1.rawdir[i].last != raw2.rawdir[i].last ||
+           raw1.rawdir[i].nsamp != raw2.rawdir[i].nsamp ||
+           raw1.rawdir[i].ent.isNull() != raw2.rawdir[i].ent.isNull())
+            return false;
+
+        if(raw1.rawdir[i].ent && (raw1.rawdir[i].ent->pos != raw2.rawdir[i].ent->pos ||
+                                  raw1.rawdir[i].ent->type != raw2.rawdir[i].ent->type ||
+                                  raw1.rawdir[i].ent->size != raw2.rawdir[i].ent->size))
+            return false;
+    }
+
+    return true;
+}
+
+//=============================================================================================================
+
+bool TestFiffDirIndex::compareDir(const QList<FiffDirEntry::SPtr>& dir1, const QList<FiffDirEntry::SPtr>& dir2)
+{
+    if(dir1.size() != dir2.size())
+        return false;
+
+    for(int i = 0; i < dir1.size(); ++i) {
+        if(dir1[i]->kind != dir2[i]->kind ||
+           dir1[i]->type != dir2[i]->type ||
+           dir1[i]->size != dir2[i]->size ||
+           dir1[i]->pos != dir2[i]->pos)
+            return false;
+    }
+
+    return true;
+}
+
+//=============================================================================================================
+// MAIN
+//=============================================================================================================
+
+QTEST_GUILESS_MAIN(TestFiffDirIndex)
+#include "test_fiff_dir_index.moc"
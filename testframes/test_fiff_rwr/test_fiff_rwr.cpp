@@ -76,6 +76,10 @@ private slots:
     void compareData();
     void compareTimes();
     void compareInfo();
+    void compareSinglePrecision();
+    void compareBlockCache();
+    void compareSimdDecode();
+    void compareStreamWriter();
     void cleanupTestCase();
 
 private:
@@ -308,6 +312,199 @@ void TestFiffRWR::compareInfo()
 
 //=============================================================================================================
 
+void TestFiffRWR::compareSinglePrecision()
+{
+    // The device rawFirstInRaw was read from is gone, read the file again
+    QFile t_fileIn(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis_trunc_raw.fif");
+    FiffRawData raw(t_fileIn);
+
+    fiff_int_t from = raw.first_samp;
+    fiff_int_t to = qMin(raw.last_samp, from + (fiff_int_t)ceil(raw.info.sfreq));
+
+    MatrixXd mDataDouble, mTimes;
+    QVERIFY(raw.read_raw_segment(mDataDouble, mTimes, from, to));
+
+    //
+    //   Single precision output
+    //
+    MatrixXf mDataFloat;
+    QVERIFY(raw.read_raw_segment(mDataFloat, mTimes, from, to));
+    QCOMPARE(mDataFloat.rows(), mDataDouble.rows());
+    QCOMPARE(mDataFloat.cols(), mDataDouble.cols());
+    QVERIFY((mDataFloat.cast<double>() - mDataDouble).cwiseAbs().maxCoeff() <= 1e-6 * mDataDouble.cwiseAbs().maxCoeff());
+
+    //
+    //   Stored integers and calibration factors
+    //
+    fiff_int_t type = raw.rawdir.first().ent->type;
+    MatrixDau16 mDataInt;
+    RowVectorXd vCals;
+    if(type == FIFFT_DAU_PACK16 || type == FIFFT_SHORT) {
+        QVERIFY(raw.read_raw_segment(mDataInt, vCals, mTimes, from, to));
+        MatrixXd mDataCalibrated = vCals.asDiagonal() * mDataInt.cast<double>();
+        QVERIFY((mDataCalibrated - mDataDouble).cwiseAbs().maxCoeff() < dEpsilon);
+    } else {
+        QVERIFY(!raw.read_raw_segment(mDataInt, vCals, mTimes, from, to));
+    }
+}
+
+//=============================================================================================================
+
+void TestFiffRWR::compareBlockCache()
+{
+    QFile t_fileIn(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis_trunc_raw.fif");
+    FiffRawData raw(t_fileIn);
+
+    qint32 iSamplesPerBlock = (qint32)raw.info.sfreq / 4;
+    FiffRawBlockCache cache(raw, iSamplesPerBlock, 256 * 1024 * 1024, 2, 2);
+
+    //
+    //   Segment which does not start at a block border
+    //
+    fiff_int_t from = raw.first_samp + iSamplesPerBlock / 2;
+    fiff_int_t to = qMin(raw.last_samp, from + 3 * iSamplesPerBlock);
+
+    MatrixXd mData, mTimes, mDataCached, mTimesCached;
+    QVERIFY(raw.read_raw_segment(mData, mTimes, from, to));
+    QVERIFY(cache.read_raw_segment(mDataCached, mTimesCached, from, to, 1));
+
+    QCOMPARE(mDataCached.rows(), mData.rows());
+    QCOMPARE(mDataCached.cols(), mData.cols());
+    QVERIFY((mDataCached - mData).cwiseAbs().maxCoeff() < dEpsilon);
+    QVERIFY((mTimesCached - mTimes).cwiseAbs().maxCoeff() < dEpsilon);
+
+    FiffRawBlockCache::Statistics stats = cache.statistics();
+    QVERIFY(stats.iMisses >= 1);
+
+    //
+    //   Reading the same segment again is served from the cache
+    //
+    QVERIFY(cache.read_raw_segment(mDataCached, mTimesCached, from, to, 1));
+    QVERIFY((mDataCached - mData).cwiseAbs().maxCoeff() < dEpsilon);
+    QCOMPARE(cache.statistics().iMisses, stats.iMisses);
+    QVERIFY(cache.statistics().iHits > stats.iHits);
+
+    //
+    //   The memory budget is kept
+    //
+    qint64 iBlockBytes = (qint64)(raw.info.nchan + 1) * iSamplesPerBlock * sizeof(double);
+    cache.setMemoryBudget(2 * iBlockBytes);
+    QVERIFY(cache.statistics().iBytes <= 2 * iBlockBytes);
+    QVERIFY(cache.statistics().iBlocks <= 2);
+}
+
+//=============================================================================================================
+
+void TestFiffRWR::compareSimdDecode()
+{
+    //
+    //   Synthetic big endian samples of odd length, decoded by every available instruction set
+    //
+    const qint64 n = 1001;
+    QByteArray baInt16(n * sizeof(qint16) + 1, 0), baFloat(n * sizeof(float) + 1, 0);
+    VectorXd vCals = VectorXd::Random(n);
+    for(qint64 i = 0; i < n; ++i) {
+        qToBigEndian<qint16>((qint16)(i * 97 - 32000), reinterpret_cast<uchar*>(baInt16.data() + 1 + i * sizeof(qint16)));
+        float fValue = (float)(i - n / 2) * 1e-3f;
+        quint32 bits;
+        memcpy(&bits, &fValue, sizeof(float));
+        qToBigEndian<quint32>(bits, reinterpret_cast<uchar*>(baFloat.data() + 1 + i * sizeof(float)));
+    }
+
+    const int iMaxLevel = FiffTag::simd_level();
+    const bool bSwap = Q_BYTE_ORDER != Q_BIG_ENDIAN;
+    VectorXd vRefInt16(n), vRefFloat(n);
+    FiffTag::set_simd_level(0);
+    QVERIFY(FiffTag::decode_samples(baInt16.constData() + 1, FIFFT_DAU_PACK16, bSwap, n, vCals.data(), vRefInt16.data()));
+    QVERIFY(FiffTag::decode_samples(baFloat.constData() + 1, FIFFT_FLOAT, bSwap, n, vCals.data(), vRefFloat.data()));
+    QCOMPARE(vRefInt16[1], vCals[1] * (1 * 97 - 32000));
+
+    for(int iLevel = 1; iLevel <= iMaxLevel; ++iLevel) {
+        QCOMPARE(FiffTag::set_simd_level(iLevel), iLevel);
+        VectorXd vInt16(n), vFloat(n);
+        QVERIFY(FiffTag::decode_samples(baInt16.constData() + 1, FIFFT_DAU_PACK16, bSwap, n, vCals.data(), vInt16.data()));
+        QVERIFY(FiffTag::decode_samples(baFloat.constData() + 1, FIFFT_FLOAT, bSwap, n, vCals.data(), vFloat.data()));
+        QVERIFY(vInt16 == vRefInt16);
+        QVERIFY(vFloat == vRefFloat);
+    }
+
+    //
+    //   Raw segments read with the scalar kernels match the vectorized ones
+    //
+    QFile t_fileIn(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis_trunc_raw.fif");
+    FiffRawData raw(t_fileIn);
+
+    fiff_int_t from = raw.first_samp;
+    fiff_int_t to = qMin(raw.last_samp, from + (fiff_int_t)ceil(raw.info.sfreq));
+
+    MatrixXd mDataScalar, mData, mTimes;
+    FiffTag::set_simd_level(0);
+    QVERIFY(raw.read_raw_segment(mDataScalar, mTimes, from, to));
+    FiffTag::set_simd_level(iMaxLevel);
+    QVERIFY(raw.read_raw_segment(mData, mTimes, from, to));
+    QVERIFY(mData == mDataScalar);
+}
+
+//=============================================================================================================
+
+void TestFiffRWR::compareStreamWriter()
+{
+    QFile t_fileIn(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis_trunc_raw.fif");
+    FiffRawData raw(t_fileIn);
+
+    fiff_int_t from = raw.first_samp;
+    fiff_int_t to = qMin(raw.last_samp, from + 4 * (fiff_int_t)ceil(raw.info.sfreq));
+    fiff_int_t iBlockSize = (fiff_int_t)ceil(raw.info.sfreq) / 10;
+
+    MatrixXd mData, mTimes;
+    QVERIFY(raw.read_raw_segment(mData, mTimes, from, to));
+
+    //
+    //   Small staging buffers and files force back-pressure handling and file splitting
+    //
+    QString sFileName = QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/test_stream_writer_raw.fif";
+    qint64 iMaxFileSize = (qint64)mData.size() * sizeof(float) / 2 + 2 * 1024 * 1024;
+    FiffRawStreamWriter writer(sFileName, raw.info, FIFFT_FLOAT, from, iMaxFileSize, 256 * 1024, 2);
+    QVERIFY(writer.start());
+    for(qint32 iFirst = 0; iFirst < mData.cols(); iFirst += iBlockSize) {
+        QVERIFY(writer.write_raw_buffer(mData.middleCols(iFirst, qMin(iBlockSize, (fiff_int_t)mData.cols() - iFirst)), writer.cals()));
+    }
+    QVERIFY(writer.finish());
+
+    FiffRawStreamWriter::Statistics stats = writer.statistics();
+    QStringList lFileNames = writer.fileNames();
+    QCOMPARE(stats.iSamples, (qint64)mData.cols());
+    QCOMPARE(stats.iFiles, lFileNames.size());
+    QVERIFY(lFileNames.size() > 1);
+    QCOMPARE(stats.iBytesWritten % 4096, (qint64)0);
+
+    //
+    //   The split files hold consecutive segments of the original data
+    //
+    qint64 iRead = 0;
+    for(qint32 i = 0; i < lFileNames.size(); ++i) {
+        QFile t_fileSplit(lFileNames[i]);
+        FiffRawData rawSplit(t_fileSplit);
+        QCOMPARE(rawSplit.first_samp, from + (fiff_int_t)iRead);
+
+        //
+        //   The header is padded, the data starts at a block boundary
+        //
+        QVERIFY(!rawSplit.rawdir.isEmpty());
+        QCOMPARE(rawSplit.rawdir.first().ent->pos % 4096, 0);
+
+        MatrixXd mDataSplit, mTimesSplit;
+        QVERIFY(rawSplit.read_raw_segment(mDataSplit, mTimesSplit));
+        QVERIFY((mDataSplit - mData.middleCols(iRead, mDataSplit.cols())).cwiseAbs().maxCoeff() <= 1e-6 * mData.cwiseAbs().maxCoeff());
+        iRead += mDataSplit.cols();
+
+        t_fileSplit.remove();
+    }
+    QCOMPARE(iRead, (qint64)mData.cols());
+}
+
+//=============================================================================================================
+
 void TestFiffRWR::cleanupTestCase()
 {
 }
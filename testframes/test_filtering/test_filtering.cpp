@@ -41,6 +41,7 @@
 #include <iostream>
 #include <vector>
 #include <math.h>
+#include <complex>
 
 #include <fiff/fiff.h>
 #include <utils/filterTools/filterdata.h>
@@ -55,6 +56,7 @@
 #include <QtCore/QCoreApplication>
 #include <QFile>
 #include <QCommandLineParser>
+#include <QTemporaryDir>
 #include <QtTest>
 
 //=============================================================================================================
@@ -84,9 +86,18 @@ private slots:
     void initTestCase();
     void compareData();
     void compareTimes();
+    void compareIirFilter();
+    void compareButterworthDesign();
+    void compareOverlapSave();
+    void compareZeroPhaseFile();
+    void compareZeroPhaseIirFile();
     void cleanupTestCase();
 
 private:
+    double sosMagnitude(const MatrixXd& matSOS,
+                        double dFreq,
+                        double dSFreq) const;
+
     double dEpsilon;
     int iOrder;
 
@@ -224,10 +235,303 @@ void TestFiltering::compareTimes()
     QVERIFY( mTimesDiff.sum() < dEpsilon );
 }
 
+//=============================================================================================================
+
+void TestFiltering::compareIirFilter()
+{
+    // Filtering block by block with the persistent IIR state must equal filtering all data at once
+    double dSFreq = 1000.0;
+    FilterData filter("iir_test",
+                      FilterData::BPF,
+                      iOrder,
+                      10.0/(dSFreq/2.0),
+                      10.0/(dSFreq/2.0),
+                      1.0/(dSFreq/2.0),
+                      dSFreq,
+                      4096,
+                      FilterData::Butterworth);
+    QVERIFY(filter.isIIR());
+
+    QList<FilterData> lFilter;
+    lFilter << filter;
+
+    MatrixXd matData = MatrixXd::Random(10, 5000);
+    RowVectorXi vecPicks = RowVectorXi::LinSpaced(10, 0, 9);
+    MatrixXd matFiltered(matData.rows(), matData.cols());
+
+    RtFilter rtFilter;
+    for(int i = 0; i < matData.cols(); i += 100) {
+        matFiltered.middleCols(i, 100) = rtFilter.filterDataBlock(matData.middleCols(i, 100), iOrder, vecPicks, lFilter);
+    }
+
+    for(int i = 0; i < matData.rows(); ++i) {
+        RowVectorXd vecRef = filter.applySOSFilter(matData.row(i));
+        QVERIFY((matFiltered.row(i) - vecRef).cwiseAbs().maxCoeff() < dEpsilon);
+    }
+}
+
+//=============================================================================================================
+
+void TestFiltering::compareButterworthDesign()
+{
+    // The bilinear transform is prewarped, so the gain at the cut off is exactly -3 dB for any order
+    double dSFreq = 1000.0;
+    double dNyquist = dSFreq/2.0;
+    double dCutOffGain = 1.0/std::sqrt(2.0);
+
+    for(int iIirOrder = 2; iIirOrder <= 5; ++iIirOrder) {
+        FilterData lowpass("butter_lp", FilterData::LPF, iOrder, 40.0/dNyquist, 0.0, 1.0/dNyquist, dSFreq, 4096, FilterData::Butterworth, iIirOrder);
+        QVERIFY(lowpass.isIIR());
+        QCOMPARE(int(lowpass.m_matSOS.rows()), (iIirOrder + 1)/2);
+        QVERIFY(std::fabs(sosMagnitude(lowpass.m_matSOS, 40.0, dSFreq) - dCutOffGain) < dEpsilon);
+        QVERIFY(std::fabs(sosMagnitude(lowpass.m_matSOS, 0.0, dSFreq) - 1.0) < dEpsilon);
+        QVERIFY(sosMagnitude(lowpass.m_matSOS, 5.0, dSFreq) > 0.999);
+        QVERIFY(sosMagnitude(lowpass.m_matSOS, 400.0, dSFreq) < 0.01);
+
+        FilterData highpass("butter_hp", FilterData::HPF, iOrder, 1.0/dNyquist, 0.0, 1.0/dNyquist, dSFreq, 4096, FilterData::Butterworth, iIirOrder);
+        QVERIFY(std::fabs(sosMagnitude(highpass.m_matSOS, 1.0, dSFreq) - dCutOffGain) < dEpsilon);
+        QVERIFY(std::fabs(sosMagnitude(highpass.m_matSOS, dNyquist, dSFreq) - 1.0) < dEpsilon);
+        QVERIFY(sosMagnitude(highpass.m_matSOS, 50.0, dSFreq) > 0.999);
+        QVERIFY(sosMagnitude(highpass.m_matSOS, 0.01, dSFreq) < 0.01);
+    }
+
+    // The band pass is a high pass at the lower and a low pass at the upper edge
+    FilterData bandpass("butter_bp", FilterData::BPF, iOrder, 10.0/dNyquist, 10.0/dNyquist, 1.0/dNyquist, dSFreq, 4096, FilterData::Butterworth);
+    FilterData lowEdge("butter_bp_hp", FilterData::HPF, iOrder, 5.0/dNyquist, 0.0, 1.0/dNyquist, dSFreq, 4096, FilterData::Butterworth);
+    FilterData highEdge("butter_bp_lp", FilterData::LPF, iOrder, 15.0/dNyquist, 0.0, 1.0/dNyquist, dSFreq, 4096, FilterData::Butterworth);
+    for(double dFreq = 0.5; dFreq < dNyquist; dFreq *= 1.5) {
+        QVERIFY(std::fabs(sosMagnitude(bandpass.m_matSOS, dFreq, dSFreq)
+                          - sosMagnitude(lowEdge.m_matSOS, dFreq, dSFreq) * sosMagnitude(highEdge.m_matSOS, dFreq, dSFreq)) < dEpsilon);
+    }
+    QVERIFY(std::fabs(sosMagnitude(bandpass.m_matSOS, 5.0, dSFreq) - dCutOffGain) < 1e-3);
+    QVERIFY(std::fabs(sosMagnitude(bandpass.m_matSOS, 15.0, dSFreq) - dCutOffGain) < 1e-3);
+    QVERIFY(sosMagnitude(bandpass.m_matSOS, 10.0, dSFreq) > 0.95);
+    QVERIFY(sosMagnitude(bandpass.m_matSOS, 1.0, dSFreq) < 0.01);
+    QVERIFY(sosMagnitude(bandpass.m_matSOS, 100.0, dSFreq) < 0.01);
+
+    // The notch has zeros on the unit circle at the center frequency and leaves the rest of the spectrum
+    FilterData notch("butter_notch", FilterData::NOTCH, iOrder, 50.0/dNyquist, 2.0/dNyquist, 1.0/dNyquist, dSFreq, 4096, FilterData::Butterworth);
+    QVERIFY(notch.isIIR());
+    QVERIFY(20.0 * std::log10(sosMagnitude(notch.m_matSOS, 50.0, dSFreq) + 1e-300) < -120.0);
+    QVERIFY(sosMagnitude(notch.m_matSOS, 50.5, dSFreq) < 0.5);
+    QVERIFY(sosMagnitude(notch.m_matSOS, 10.0, dSFreq) > 0.99);
+    QVERIFY(sosMagnitude(notch.m_matSOS, 200.0, dSFreq) > 0.99);
+    QVERIFY(std::fabs(sosMagnitude(notch.m_matSOS, 0.0, dSFreq) - 1.0) < dEpsilon);
+}
+
+//=============================================================================================================
+
+void TestFiltering::compareOverlapSave()
+{
+    // Streaming blocks shorter and longer than the filter must equal one convolution of the whole signal
+    double dSFreq = 1000.0;
+    int iFirOrder = 256;
+    FilterData filter("overlap_save_test",
+                      FilterData::LPF,
+                      iFirOrder,
+                      40.0/(dSFreq/2.0),
+                      0.0,
+                      5.0/(dSFreq/2.0),
+                      dSFreq,
+                      4096,
+                      FilterData::Cosine);
+    QVERIFY(!filter.isIIR());
+
+    QList<FilterData> lFilter;
+    lFilter << filter;
+
+    const RowVectorXd& vecKernel = filter.m_dCoeffA;
+    QVERIFY(vecKernel.cols() > 64);
+
+    // The last channel is not picked and only delayed by half the filter order
+    MatrixXd matData = MatrixXd::Random(5, 6000);
+    RowVectorXi vecPicks = RowVectorXi::LinSpaced(4, 0, 3);
+    MatrixXd matFiltered(matData.rows(), matData.cols());
+
+    RtFilter rtFilter;
+    const int aiBlockSizes[] = {17, 700, 64, 3000, 3, 255, 1};
+    int iDone = 0;
+    for(int i = 0; iDone < matData.cols(); ++i) {
+        int iSize = qMin(aiBlockSizes[i % 7], int(matData.cols()) - iDone);
+        matFiltered.middleCols(iDone, iSize) = rtFilter.filterDataBlock(matData.middleCols(iDone, iSize), iFirOrder, vecPicks, lFilter);
+        iDone += iSize;
+    }
+
+    for(int r = 0; r < vecPicks.cols(); ++r) {
+        RowVectorXd vecRef = RowVectorXd::Zero(matData.cols());
+        for(int t = 0; t < matData.cols(); ++t) {
+            int iTaps = qMin(int(vecKernel.cols()), t + 1);
+            vecRef(t) = vecKernel.head(iTaps).dot(matData.row(r).segment(t - iTaps + 1, iTaps).reverse());
+        }
+
+        double dMaxError = (matFiltered.row(r) - vecRef).cwiseAbs().maxCoeff();
+        QVERIFY(dMaxError < dEpsilon);
+    }
+
+    int iDelay = iFirOrder/2;
+    QVERIFY(matFiltered.row(4).head(iDelay).isZero());
+    QVERIFY((matFiltered.row(4).tail(matData.cols() - iDelay) - matData.row(4).head(matData.cols() - iDelay)).cwiseAbs().maxCoeff() == 0.0);
+}
+
+//=============================================================================================================
+
+void TestFiltering::compareZeroPhaseFile()
+{
+    // Filtering a file in chunks must equal filtering the whole recording forward and backward at once
+    QFile t_fileIn(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis_trunc_raw.fif");
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString sFileOut = tempDir.filePath("rtfilter_zerophase_out_raw.fif");
+
+    FiffRawData raw(t_fileIn);
+    RowVectorXi vecPicks = raw.info.pick_types(true, true, false);
+
+    FilterData filter("zero_phase_test",
+                      FilterData::BPF,
+                      iOrder,
+                      10.0/(raw.info.sfreq/2.0),
+                      10.0/(raw.info.sfreq/2.0),
+                      1.0/(raw.info.sfreq/2.0),
+                      raw.info.sfreq,
+                      4096,
+                      FilterData::Cosine);
+    QList<FilterData> lFilter;
+    lFilter << filter;
+
+    RtFilter rtFilter;
+    QVERIFY(rtFilter.filterFile(raw, sFileOut, lFilter, vecPicks, 5000));
+
+    // Reference: convolution of the mirrored recording with the coefficients and the reversed coefficients
+    MatrixXd matData, matTimes;
+    QVERIFY(raw.read_raw_segment(matData, matTimes, raw.first_samp, raw.last_samp, vecPicks));
+
+    RowVectorXd vecKernel = RowVectorXd::Zero(2 * filter.m_dCoeffA.cols() - 1);
+    for(int i = 0; i < filter.m_dCoeffA.cols(); ++i) {
+        vecKernel.segment(i, filter.m_dCoeffA.cols()) += filter.m_dCoeffA(filter.m_dCoeffA.cols() - 1 - i) * filter.m_dCoeffA;
+    }
+    int iHalf = vecKernel.cols()/2;
+
+    QFile t_fileFiltered(sFileOut);
+    FiffRawData rawFiltered(t_fileFiltered);
+    MatrixXd matFiltered;
+    QVERIFY(rawFiltered.read_raw_segment(matFiltered, matTimes, rawFiltered.first_samp, rawFiltered.last_samp, vecPicks));
+    QCOMPARE(matFiltered.cols(), matData.cols());
+
+    // Compare a few channels to keep the direct convolution fast
+    for(int r = 0; r < matData.rows(); r += 50) {
+        RowVectorXd vecPadded(matData.cols() + 2 * iHalf);
+        vecPadded.segment(iHalf, matData.cols()) = matData.row(r);
+        for(int k = 1; k <= iHalf; ++k) {
+            vecPadded(iHalf - k) = matData(r, k);
+            vecPadded(iHalf + matData.cols() - 1 + k) = matData(r, matData.cols() - 1 - k);
+        }
+
+        RowVectorXd vecRef(matData.cols());
+        for(int t = 0; t < matData.cols(); ++t) {
+            vecRef(t) = vecPadded.segment(t, vecKernel.cols()).dot(vecKernel.reverse());
+        }
+
+        double dScale = vecRef.cwiseAbs().maxCoeff();
+        QVERIFY((matFiltered.row(r) - vecRef).cwiseAbs().maxCoeff() <= 1e-5 * dScale);
+    }
+}
+
+//=============================================================================================================
+
+void TestFiltering::compareZeroPhaseIirFile()
+{
+    // Filtering a file in chunks with an IIR filter must equal filtering the whole recording forward and backward
+    QFile t_fileIn(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis_trunc_raw.fif");
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString sFileOut = tempDir.filePath("rtfilter_zerophase_iir_out_raw.fif");
+
+    FiffRawData raw(t_fileIn);
+    RowVectorXi vecPicks = raw.info.pick_types(true, true, false);
+
+    FilterData filter("zero_phase_iir_test",
+                      FilterData::BPF,
+                      iOrder,
+                      10.0/(raw.info.sfreq/2.0),
+                      10.0/(raw.info.sfreq/2.0),
+                      1.0/(raw.info.sfreq/2.0),
+                      raw.info.sfreq,
+                      4096,
+                      FilterData::Butterworth);
+    QVERIFY(filter.isIIR());
+    QList<FilterData> lFilter;
+    lFilter << filter;
+
+    // Chunks shorter than the recording, so that the decay padding is read from the neighbouring chunks
+    RtFilter rtFilter;
+    QVERIFY(rtFilter.filterFile(raw, sFileOut, lFilter, vecPicks, 2000));
+
+    MatrixXd matData, matTimes;
+    QVERIFY(raw.read_raw_segment(matData, matTimes, raw.first_samp, raw.last_samp, vecPicks));
+
+    // The padding is the length until the impulse response decayed, as in RtFilter::filterFile
+    RowVectorXd vecImpulse = RowVectorXd::Zero(int(raw.info.sfreq * 10));
+    vecImpulse(0) = 1.0;
+    vecImpulse = filter.applySOSFilter(vecImpulse);
+    double dThreshold = 1e-7 * vecImpulse.cwiseAbs().maxCoeff();
+    int iPad = vecImpulse.cols();
+    while(iPad > 1 && std::fabs(vecImpulse(iPad - 1)) <= dThreshold) {
+        --iPad;
+    }
+    QVERIFY(iPad > 1 && iPad < 2000);
+    QVERIFY(matData.cols() > 2000 + iPad);
+
+    QFile t_fileFiltered(sFileOut);
+    FiffRawData rawFiltered(t_fileFiltered);
+    MatrixXd matFiltered;
+    QVERIFY(rawFiltered.read_raw_segment(matFiltered, matTimes, rawFiltered.first_samp, rawFiltered.last_samp, vecPicks));
+    QCOMPARE(matFiltered.cols(), matData.cols());
+
+    // Reference: forward and backward filtering of the mirrored recording in memory
+    for(int r = 0; r < matData.rows(); r += 50) {
+        RowVectorXd vecPadded(matData.cols() + 2 * iPad);
+        vecPadded.segment(iPad, matData.cols()) = matData.row(r);
+        for(int k = 1; k <= iPad; ++k) {
+            vecPadded(iPad - k) = matData(r, k);
+            vecPadded(iPad + matData.cols() - 1 + k) = matData(r, matData.cols() - 1 - k);
+        }
+
+        vecPadded = filter.applySOSFilter(vecPadded);
+        vecPadded.reverseInPlace();
+        vecPadded = filter.applySOSFilter(vecPadded);
+        vecPadded.reverseInPlace();
+
+        RowVectorXd vecRef = vecPadded.segment(iPad, matData.cols());
+        double dScale = vecRef.cwiseAbs().maxCoeff();
+        QVERIFY((matFiltered.row(r) - vecRef).cwiseAbs().maxCoeff() <= 1e-5 * dScale);
+    }
+}
+
+//=============================================================================================================
+
 void TestFiltering::cleanupTestCase()
 {
 }
 
+//=============================================================================================================
+
+double TestFiltering::sosMagnitude(const MatrixXd& matSOS,
+                                   double dFreq,
+                                   double dSFreq) const
+{
+    // Evaluate the product of the section transfer functions on the unit circle
+    std::complex<double> z1 = std::polar(1.0, -2.0 * M_PI * dFreq / dSFreq);
+    std::complex<double> z2 = z1 * z1;
+    std::complex<double> response(1.0, 0.0);
+
+    for(int i = 0; i < matSOS.rows(); ++i) {
+        response *= (matSOS(i,0) + matSOS(i,1) * z1 + matSOS(i,2) * z2)
+                    / (matSOS(i,3) + matSOS(i,4) * z1 + matSOS(i,5) * z2);
+    }
+
+    return std::abs(response);
+}
+
 //=============================================================================================================
 // MAIN
 //=============================================================================================================
@@ -42,8 +42,13 @@
 
 #include <fwd/computeFwd/compute_fwd_settings.h>
 #include <fwd/computeFwd/compute_fwd.h>
+#include <fwd/fwd_bem_model.h>
+#include <fiff/fiff_stream.h>
+#include <fiff/fiff_dir_node.h>
 #include <mne/mne.h>
 
+#include <Eigen/Core>
+
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
@@ -56,6 +61,8 @@
 
 using namespace FWDLIB;
 using namespace MNELIB;
+using namespace FIFFLIB;
+using namespace Eigen;
 
 //=============================================================================================================
 /**
@@ -75,6 +82,7 @@ private slots:
     void initTestCase();
     void computeForward();
     void compareForward();
+    void compareBemSolutionLoad();
     void cleanupTestCase();
 
 private:
@@ -173,6 +181,46 @@ void TestMneForwardSolution::compareForward()
 
 //=============================================================================================================
 
+void TestMneForwardSolution::compareBemSolutionLoad()
+{
+    printf(">>>>>>>>>>>>>>>>>>>>>>>>> Compare Mapped BEM Solution >>>>>>>>>>>>>>>>>>>>>>>>>\n");
+
+    QString bemName(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/subjects/sample/bem/sample-5120-bem.fif");
+    QString solName(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/subjects/sample/bem/sample-5120-bem-sol.fif");
+    QVERIFY(QFile::exists(bemName));
+    QVERIFY(QFile::exists(solName));
+
+    // Load the solution through the memory mapped tag data
+    QScopedPointer<FwdBemModel> pBemModel(FwdBemModel::fwd_bem_load_homog_surface(bemName));
+    QVERIFY(!pBemModel.isNull());
+    QVERIFY(FwdBemModel::fwd_bem_load_solution(solName, FWD_BEM_UNKNOWN, pBemModel.data()) == 1);  // TRUE: found a suitable solution
+    QVERIFY(pBemModel->solution != NULL);
+
+    // Read the same tag through find_tag
+    QFile file(solName);
+    FiffStream::SPtr stream(new FiffStream(&file));
+    QVERIFY(stream->open());
+
+    QList<FiffDirNode::SPtr> nodes = stream->dirtree()->dir_tree_find(FIFFB_BEM);
+    QVERIFY(nodes.size() > 0);
+
+    FiffTag::SPtr t_pTag;
+    QVERIFY(nodes[0]->find_tag(stream, FIFF_BEM_POT_SOLUTION, t_pTag));
+    MatrixXf matSolRef = t_pTag->toFloatMatrix().transpose();
+    stream->close();
+
+    QVERIFY(matSolRef.rows() == pBemModel->nsol);
+    QVERIFY(matSolRef.cols() == pBemModel->nsol);
+
+    // The solution is stored row by row. Only the byte order was changed, so the values have to match exactly.
+    Map<const Matrix<float,Dynamic,Dynamic,RowMajor> > matSol(pBemModel->solution[0], pBemModel->nsol, pBemModel->nsol);
+    QVERIFY(matSol == matSolRef);
+
+    printf("<<<<<<<<<<<<<<<<<<<<<<<<< Compare Mapped BEM Solution Finished <<<<<<<<<<<<<<<<<<<<<<<<<\n");
+}
+
+//=============================================================================================================
+
 void TestMneForwardSolution::cleanupTestCase()
 {
 }
@@ -0,0 +1,266 @@
+//=============================================================================================================
+/**
+ * @file     test_mne_inverse_operator.cpp
+ * @author   Lorenz Esch <lesch@mgh.harvard.edu>
+ * @version  dev
+ * @date     April, 2020
+ *
+ * @section  LICENSE
+ *
+ * Copyright (C) 2020, Lorenz Esch. All rights reserved.
+ *
+ * the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+ *       following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ *       the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *     * Neither the name of MNE-CPP authors nor the names of its contributors may be used
+ *       to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @brief    The inverse operator test implementation
+ *
+ */
+
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include <utils/generics/applicationlogger.h>
+
+#include <fiff/fiff_evoked.h>
+#include <fiff/fiff_cov.h>
+#include <mne/mne.h>
+#include <fs/label.h>
+#include <inverse/minimumNorm/minimumnorm.h>
+
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtTest>
+#include <QElapsedTimer>
+
+//=============================================================================================================
+// EIGEN INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+using namespace MNELIB;
+using namespace INVERSELIB;
+using namespace Eigen;
+
+//=============================================================================================================
+/**
+ * DECLARE CLASS TestMneInverseOperator
+ *
+ * @brief The TestMneInverseOperator class provides inverse operator tests
+ *
+ */
+class TestMneInverseOperator : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestMneInverseOperator();
+
+private slots:
+    void initTestCase();
+    void compareSvdMethods();
+    void compareKernelFactors();
+    void compareFactoredInverse();
+    void cleanupTestCase();
+
+private:
+    MNEInverseOperator makeInverseOperator(MNEInverseOperator::SvdMethod svdMethod,
+                                           const QString& sName);
+
+    MatrixXd regularizedInverse(const MNEInverseOperator& invOp) const;
+
+    double dEpsilon;
+    float fLambda2;
+
+    FiffEvoked m_evoked;
+    FiffInfo m_info;
+    FiffCov m_noiseCov;
+    MNEForwardSolution m_fwdMeg;
+};
+
+//=============================================================================================================
+
+TestMneInverseOperator::TestMneInverseOperator()
+: dEpsilon(0.000001)
+, fLambda2(1.0f / 9.0f)
+{
+}
+
+//=============================================================================================================
+
+void TestMneInverseOperator::initTestCase()
+{
+    qInstallMessageHandler(UTILSLIB::ApplicationLogger::customLogWriter);
+
+    QFile t_fileEvoked(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis-ave.fif");
+    QFile t_fileFwd(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/Result/ref-sample_audvis-meg-eeg-oct-6-fwd.fif");
+    QFile t_fileCov(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/MEG/sample/sample_audvis-cov.fif");
+
+    QPair<QVariant, QVariant> baseline(QVariant(), 0);
+    FiffEvoked evoked(t_fileEvoked, 0, baseline);
+    QVERIFY(!evoked.isEmpty());
+    m_evoked = evoked;
+    m_info = evoked.info;
+
+    // Restrict forward solution to MEG, as done in the real-time inverse operator estimation
+    MNEForwardSolution t_Fwd(t_fileFwd);
+    QVERIFY(!t_Fwd.isEmpty());
+    m_fwdMeg = t_Fwd.pick_types(true, false);
+
+    FiffCov noiseCov(t_fileCov);
+    m_noiseCov = noiseCov.regularize(m_info, 0.05, 0.05, 0.1, true);
+}
+
+//=============================================================================================================
+
+void TestMneInverseOperator::compareSvdMethods()
+{
+    printf(">>>>>>>>>>>>>>>>>>>>>>>>> Compare Gain Matrix SVD Methods >>>>>>>>>>>>>>>>>>>>>>>>>\n");
+
+    MNEInverseOperator invOpJacobi = makeInverseOperator(MNEInverseOperator::SvdJacobi, "Jacobi");
+    MNEInverseOperator invOpBdc = makeInverseOperator(MNEInverseOperator::SvdBdc, "BDC");
+    MNEInverseOperator invOpGram = makeInverseOperator(MNEInverseOperator::SvdGramEigen, "Gram eigen");
+
+    // Singular values
+    double dSingMax = invOpJacobi.sing.maxCoeff();
+    QVERIFY(invOpBdc.sing.size() == invOpJacobi.sing.size());
+    QVERIFY(invOpGram.sing.size() == invOpJacobi.sing.size());
+    QVERIFY((invOpBdc.sing - invOpJacobi.sing).cwiseAbs().maxCoeff() / dSingMax < dEpsilon);
+    QVERIFY((invOpGram.sing - invOpJacobi.sing).cwiseAbs().maxCoeff() / dSingMax < dEpsilon);
+
+    // The regularized inverse is independent of the signs of the singular vectors and of the null space
+    MatrixXd matInvJacobi = regularizedInverse(invOpJacobi);
+    double dNorm = matInvJacobi.norm();
+    QVERIFY((regularizedInverse(invOpBdc) - matInvJacobi).norm() / dNorm < dEpsilon);
+    QVERIFY((regularizedInverse(invOpGram) - matInvJacobi).norm() / dNorm < dEpsilon);
+
+    printf("<<<<<<<<<<<<<<<<<<<<<<<<< Compare Gain Matrix SVD Methods Finished <<<<<<<<<<<<<<<<<<<<<<<<<\n");
+}
+
+//=============================================================================================================
+
+void TestMneInverseOperator::compareKernelFactors()
+{
+    printf(">>>>>>>>>>>>>>>>>>>>>>>>> Compare Factored Imaging Kernel >>>>>>>>>>>>>>>>>>>>>>>>>\n");
+
+    MNEInverseOperator invOp(m_info, m_fwdMeg, m_noiseCov, 0.2f, 0.8f);
+    MNEInverseOperator invOpPrepared = invOp.prepare_inverse_operator(1, fLambda2, true, false);
+
+    FSLIB::Label label;
+    MatrixXd matKernel, matLeads, matTrans;
+    SparseMatrix<double> noiseNorm;
+    QList<VectorXi> vertno;
+
+    QVERIFY(invOpPrepared.assemble_kernel(label, "dSPM", false, matKernel, noiseNorm, vertno));
+    QVERIFY(invOpPrepared.assemble_kernel_factors(label, "dSPM", false, matLeads, matTrans, noiseNorm, vertno));
+
+    QVERIFY(matLeads.cols() == matTrans.rows());
+    QVERIFY(matLeads.cols() <= invOp.sing.size());
+    QVERIFY((matLeads * matTrans - matKernel).norm() / matKernel.norm() < dEpsilon);
+
+    printf("<<<<<<<<<<<<<<<<<<<<<<<<< Compare Factored Imaging Kernel Finished <<<<<<<<<<<<<<<<<<<<<<<<<\n");
+}
+
+//=============================================================================================================
+
+void TestMneInverseOperator::compareFactoredInverse()
+{
+    printf(">>>>>>>>>>>>>>>>>>>>>>>>> Compare Factored Inverse Solution >>>>>>>>>>>>>>>>>>>>>>>>>
+");
+
+    MNEInverseOperator invOp(m_info, m_fwdMeg, m_noiseCov, 0.2f, 0.8f);
+
+    QStringList lMethods;
+    lMethods << "dSPM" << "sLORETA";
+
+    for(const QString& sMethod : lMethods) {
+        for(int i = 0; i < 2; ++i) {
+            bool bPickNormal = (i == 1);
+
+            MinimumNorm minimumNorm(invOp, fLambda2, sMethod);
+            MNESourceEstimate stc = minimumNorm.calculateInverse(m_evoked, bPickNormal);
+
+            MinimumNorm minimumNormFactored(invOp, fLambda2, sMethod);
+            minimumNormFactored.setUseFactoredKernel(true);
+            MNESourceEstimate stcFactored = minimumNormFactored.calculateInverse(m_evoked, bPickNormal);
+
+            QVERIFY(!stc.isEmpty());
+            QVERIFY(minimumNormFactored.getKernel().size() == 0);
+            QVERIFY(stcFactored.data.rows() == stc.data.rows());
+            QVERIFY(stcFactored.data.cols() == stc.data.cols());
+            QVERIFY(stcFactored.vertices == stc.vertices);
+
+            // The factored kernel is applied in single precision
+            QVERIFY((stcFactored.data - stc.data).norm() / stc.data.norm() < 1e-4);
+        }
+    }
+
+    printf("<<<<<<<<<<<<<<<<<<<<<<<<< Compare Factored Inverse Solution Finished <<<<<<<<<<<<<<<<<<<<<<<<<\n");
+}
+
+//=============================================================================================================
+
+void TestMneInverseOperator::cleanupTestCase()
+{
+}
+
+//=============================================================================================================
+
+MNEInverseOperator TestMneInverseOperator::makeInverseOperator(MNEInverseOperator::SvdMethod svdMethod,
+                                                               const QString& sName)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    MNEInverseOperator invOp(m_info,
+                             m_fwdMeg,
+                             m_noiseCov,
+                             0.2f,
+                             0.8f,
+                             false,
+                             true,
+                             svdMethod);
+
+    printf("%s: inverse operator made in %lld ms\n", sName.toUtf8().constData(), timer.elapsed());
+
+    return invOp;
+}
+
+//=============================================================================================================
+
+MatrixXd TestMneInverseOperator::regularizedInverse(const MNEInverseOperator& invOp) const
+{
+    VectorXd vecReg = invOp.sing.array() / (invOp.sing.array().square() + fLambda2);
+
+    return invOp.eigen_leads->data * vecReg.asDiagonal() * invOp.eigen_fields->data;
+}
+
+//=============================================================================================================
+// MAIN
+//=============================================================================================================
+
+QTEST_GUILESS_MAIN(TestMneInverseOperator)
+#include "test_mne_inverse_operator.moc"
@@ -0,0 +1,256 @@
+//=============================================================================================================
+/**
+ * @file     test_rtconnectivity.cpp
+ * @author   Lorenz Esch <lesch@mgh.harvard.edu>
+ * @version  dev
+ * @date     April, 2020
+ *
+ * @section  LICENSE
+ *
+ * Copyright (C) 2020, Lorenz Esch. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ * the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+ *       following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ *       the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *     * Neither the name of MNE-CPP authors nor the names of its contributors may be used
+ *       to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @brief    Test for the incremental sliding-window connectivity estimation of RtConnectivity
+ *
+ */
+
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include <utils/generics/applicationlogger.h>
+
+#include <connectivity/connectivitysettings.h>
+#include <connectivity/connectivity.h>
+#include <connectivity/network/network.h>
+#include <connectivity/metrics/abstractmetric.h>
+#include <rtprocessing/rtconnectivity.h>
+
+#include <Eigen/Core>
+
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtTest>
+
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace CONNECTIVITYLIB;
+using namespace RTPROCESSINGLIB;
+using namespace Eigen;
+
+//=============================================================================================================
+/**
+ * DECLARE CLASS TestRtConnectivity
+ *
+ * @brief The TestRtConnectivity class compares the incremental sliding-window estimation of RtConnectivity with
+ *        a from-scratch estimation over the same trials.
+ *
+ */
+class TestRtConnectivity: public QObject
+{
+    Q_OBJECT
+
+public:
+    TestRtConnectivity();
+
+private slots:
+    void initTestCase();
+    void compareSlidingWindow();
+    void compareCoalescedRequests();
+    void cleanupTestCase();
+
+private:
+    ConnectivitySettings createSettings(int iFirstTrial,
+                                        int iNumberTrials) const;
+    void compareNetworks(const QList<Network>& lNetworks,
+                         int iFirstTrial,
+                         int iNumberTrials) const;
+
+    double dEpsilon;
+    int iWindowSize;
+    QStringList lMethods;
+    QList<MatrixXd> lTrials;
+};
+
+//=============================================================================================================
+
+TestRtConnectivity::TestRtConnectivity()
+: dEpsilon(1e-9)
+, iWindowSize(5)
+{
+}
+
+//=============================================================================================================
+
+void TestRtConnectivity::initTestCase()
+{
+    qInstallMessageHandler(UTILSLIB::ApplicationLogger::customLogWriter);
+
+    lMethods << "COH" << "IMAGCOH" << "PLV" << "WPLI";
+
+    std::srand(7);
+    for(int i = 0; i < 24; ++i) {
+        lTrials << MatrixXd::Random(6, 128);
+    }
+}
+
+//=============================================================================================================
+
+void TestRtConnectivity::compareSlidingWindow()
+{
+    RtConnectivityWorker worker;
+
+    QList<Network> lResults;
+    int iNumberResults = 0;
+    connect(&worker, &RtConnectivityWorker::resultReady,
+            [&](const QList<Network>& lNetworks, const ConnectivitySettings&) {
+        lResults = lNetworks;
+        ++iNumberResults;
+    });
+
+    AbstractMetric::m_iNumberBinStart = -1;
+    AbstractMetric::m_iNumberBinAmount = -1;
+
+    // Hand over the trials in irregular chunks. The window fills up first and then slides.
+    QList<int> lChunkSizes;
+    lChunkSizes << 2 << 1 << 3 << 1 << 4 << 2 << 1 << 6 << 1 << 3;
+
+    int iNumberTrials = 0;
+    for(int i = 0; i < lChunkSizes.size(); ++i) {
+        AbstractMetric::m_bStorageModeIsActive = true;
+        worker.doWorkIncremental(createSettings(iNumberTrials, lChunkSizes.at(i)),
+                                 iWindowSize);
+        iNumberTrials += lChunkSizes.at(i);
+
+        QCOMPARE(iNumberResults, i + 1);
+
+        int iFirstTrial = qMax(0, iNumberTrials - iWindowSize);
+        compareNetworks(lResults, iFirstTrial, iNumberTrials - iFirstTrial);
+    }
+}
+
+//=============================================================================================================
+
+void TestRtConnectivity::compareCoalescedRequests()
+{
+    RtConnectivityWorker worker;
+
+    QList<Network> lResults;
+    int iNumberResults = 0;
+    connect(&worker, &RtConnectivityWorker::resultReady,
+            [&](const QList<Network>& lNetworks, const ConnectivitySettings&) {
+        lResults = lNetworks;
+        ++iNumberResults;
+    });
+
+    AbstractMetric::m_iNumberBinStart = -1;
+    AbstractMetric::m_iNumberBinAmount = -1;
+    AbstractMetric::m_bStorageModeIsActive = true;
+
+    // Only the first request of a burst triggers the worker. The following ones join it.
+    QVERIFY(worker.queueIncremental(createSettings(0, 3), iWindowSize));
+    QVERIFY(!worker.queueIncremental(createSettings(3, 1), iWindowSize));
+    QVERIFY(!worker.queueIncremental(createSettings(4, 2), iWindowSize));
+
+    worker.doWorkPending();
+    QCOMPARE(iNumberResults, 1);
+    compareNetworks(lResults, 1, iWindowSize);
+
+    // Nothing is waiting anymore
+    worker.doWorkPending();
+    QCOMPARE(iNumberResults, 1);
+
+    // A burst longer than the window only keeps the newest trials
+    AbstractMetric::m_bStorageModeIsActive = true;
+    QVERIFY(worker.queueIncremental(createSettings(6, 4), iWindowSize));
+    QVERIFY(!worker.queueIncremental(createSettings(10, 4), iWindowSize));
+    QVERIFY(!worker.queueIncremental(createSettings(14, 3), iWindowSize));
+
+    worker.doWorkPending();
+    QCOMPARE(iNumberResults, 2);
+    compareNetworks(lResults, 17 - iWindowSize, iWindowSize);
+}
+
+//=============================================================================================================
+
+void TestRtConnectivity::cleanupTestCase()
+{
+    AbstractMetric::m_bStorageModeIsActive = false;
+    AbstractMetric::m_iNumberBinStart = -1;
+    AbstractMetric::m_iNumberBinAmount = -1;
+}
+
+//=============================================================================================================
+
+ConnectivitySettings TestRtConnectivity::createSettings(int iFirstTrial,
+                                                        int iNumberTrials) const
+{
+    ConnectivitySettings settings;
+    settings.setConnectivityMethods(lMethods);
+    settings.setSamplingFrequency(128);
+    settings.setFFTSize(128);
+    settings.setWindowType("hanning");
+
+    for(int i = iFirstTrial; i < iFirstTrial + iNumberTrials; ++i) {
+        settings.append(lTrials.at(i));
+    }
+
+    return settings;
+}
+
+//=============================================================================================================
+
+void TestRtConnectivity::compareNetworks(const QList<Network>& lNetworks,
+                                         int iFirstTrial,
+                                         int iNumberTrials) const
+{
+    // Estimate the connectivity of the window from scratch
+    AbstractMetric::m_bStorageModeIsActive = false;
+
+    ConnectivitySettings settings = createSettings(iFirstTrial, iNumberTrials);
+    QList<Network> lReference = Connectivity::calculate(settings);
+
+    AbstractMetric::m_bStorageModeIsActive = true;
+
+    QCOMPARE(lNetworks.size(), lReference.size());
+
+    for(int i = 0; i < lReference.size(); ++i) {
+        QCOMPARE(lNetworks.at(i).getConnectivityMethod(), lReference.at(i).getConnectivityMethod());
+
+        const MatrixXd& matWeights = lNetworks.at(i).getDenseEdgeWeights();
+        const MatrixXd& matRefWeights = lReference.at(i).getDenseEdgeWeights();
+
+        QCOMPARE(matWeights.rows(), matRefWeights.rows());
+        QCOMPARE(matWeights.cols(), matRefWeights.cols());
+        QVERIFY((matWeights - matRefWeights).cwiseAbs().maxCoeff() <= dEpsilon * (1.0 + matRefWeights.cwiseAbs().maxCoeff()));
+    }
+}
+
+//=============================================================================================================
+// MAIN
+//=============================================================================================================
+
+QTEST_GUILESS_MAIN(TestRtConnectivity)
+#include "test_rtconnectivity.moc"
@@ -0,0 +1,308 @@
+//=============================================================================================================
+/**
+ * @file     test_rtcov.cpp
+ * @author   Lorenz Esch <lesch@mgh.harvard.edu>
+ * @version  dev
+ * @date     April, 2020
+ *
+ * @section  LICENSE
+ *
+ * Copyright (C) 2020, Lorenz Esch. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+ * the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+ *       following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+ *       the following disclaimer in the documentation and/or other materials provided with the distribution.
+ *     * Neither the name of MNE-CPP authors nor the names of its contributors may be used
+ *       to endorse or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ *
+ * @brief    Test for the incremental covariance estimation of RtCov
+ *
+ */
+
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include <utils/generics/applicationlogger.h>
+
+#include <fiff/fiff_info.h>
+#include <fiff/fiff_cov.h>
+#include <rtprocessing/rtcov.h>
+
+#include <Eigen/Dense>
+
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtTest>
+
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+using namespace RTPROCESSINGLIB;
+using namespace Eigen;
+
+//=============================================================================================================
+/**
+ * DECLARE CLASS TestRtCov
+ *
+ * @brief The TestRtCov class compares the running covariance estimates of RtCov with batch covariances.
+ *
+ */
+class TestRtCov: public QObject
+{
+    Q_OBJECT
+
+public:
+    TestRtCov();
+
+private slots:
+    void initTestCase();
+    void compareBlock();
+    void compareSlidingWindow();
+    void compareExponential();
+    void compareSetters();
+    void cleanupTestCase();
+
+private:
+    MatrixXd weightedCovariance(const MatrixXd& matData,
+                                const VectorXd& vecWeights) const;
+    bool compareCovariance(const FiffCov& cov,
+                           const MatrixXd& matRef) const;
+
+    double dEpsilon;
+    QSharedPointer<FiffInfo> pFiffInfo;
+    MatrixXd mData;
+    QList<int> lBlockSizes;
+};
+
+//=============================================================================================================
+
+TestRtCov::TestRtCov()
+: dEpsilon(1e-9)
+{
+}
+
+//=============================================================================================================
+
+void TestRtCov::initTestCase()
+{
+    qInstallMessageHandler(UTILSLIB::ApplicationLogger::customLogWriter);
+
+    const int iNumChannels = 6;
+
+    pFiffInfo = QSharedPointer<FiffInfo>(new FiffInfo);
+    pFiffInfo->nchan = iNumChannels;
+    for(int i = 0; i < iNumChannels; ++i) {
+        FiffChInfo chInfo;
+        chInfo.ch_name = QString("MEG %1").arg(i + 1);
+        chInfo.kind = FIFFV_MEG_CH;
+        pFiffInfo->chs.append(chInfo);
+        pFiffInfo->ch_names.append(chInfo.ch_name);
+    }
+
+    //
+    //   Correlated channels with large offsets, which the shift by the first block mean has to handle
+    //
+    std::srand(42);
+    MatrixXd matMix = MatrixXd::Random(iNumChannels, iNumChannels);
+    mData = matMix * MatrixXd::Random(iNumChannels, 2000);
+    for(int i = 0; i < iNumChannels; ++i) {
+        mData.row(i).array() += 1e4 * (i + 1);
+    }
+
+    //
+    //   Irregular block sizes, including blocks longer than the sliding window used below
+    //
+    int iSamples = 0;
+    const int aiSizes[] = {37, 100, 3, 250, 64, 1, 180, 99};
+    for(int i = 0; iSamples < mData.cols(); ++i) {
+        int iSize = qMin(aiSizes[i % 8], (int)mData.cols() - iSamples);
+        lBlockSizes.append(iSize);
+        iSamples += iSize;
+    }
+}
+
+//=============================================================================================================
+
+void TestRtCov::compareBlock()
+{
+    RtCov rtCov(pFiffInfo);
+
+    int iFirst = 0;
+    for(int i = 0; i < lBlockSizes.size(); ++i) {
+        rtCov.append(mData.middleCols(iFirst, lBlockSizes[i]));
+        iFirst += lBlockSizes[i];
+
+        if(iFirst > 1) {
+            QVERIFY(compareCovariance(rtCov.getCovariance(false),
+                                      weightedCovariance(mData.leftCols(iFirst), VectorXd::Ones(iFirst))));
+        }
+    }
+    QCOMPARE(rtCov.samples(), (double)mData.cols());
+}
+
+//=============================================================================================================
+
+void TestRtCov::compareSlidingWindow()
+{
+    const int iWindowSize = 200;
+
+    RtCov rtCov(pFiffInfo);
+    rtCov.setEstimationMode(RtCov::SlidingWindow);
+    rtCov.setWindowSize(iWindowSize);
+
+    //
+    //   The window keeps the fewest newest blocks covering the window size, the older blocks are downdated
+    //
+    QList<int> lWindowFirst;
+    QList<int> lWindowSizes;
+    int iWindowSamples = 0;
+    int iFirst = 0;
+    int iEvicted = 0;
+
+    for(int i = 0; i < lBlockSizes.size(); ++i) {
+        rtCov.append(mData.middleCols(iFirst, lBlockSizes[i]));
+
+        lWindowFirst.append(iFirst);
+        lWindowSizes.append(lBlockSizes[i]);
+        iWindowSamples += lBlockSizes[i];
+        while(lWindowSizes.size() > 1 && iWindowSamples - lWindowSizes.first() >= iWindowSize) {
+            iWindowSamples -= lWindowSizes.takeFirst();
+            lWindowFirst.removeFirst();
+            ++iEvicted;
+        }
+        iFirst += lBlockSizes[i];
+
+        QCOMPARE(rtCov.samples(), (double)iWindowSamples);
+        if(iWindowSamples > 1) {
+            QVERIFY(compareCovariance(rtCov.getCovariance(false),
+                                      weightedCovariance(mData.middleCols(lWindowFirst.first(), iWindowSamples),
+                                                         VectorXd::Ones(iWindowSamples))));
+        }
+    }
+
+    // The window wrapped around many times
+    QVERIFY(iEvicted > lBlockSizes.size() / 2);
+}
+
+//=============================================================================================================
+
+void TestRtCov::compareExponential()
+{
+    const double dForgettingFactor = 0.995;
+
+    RtCov rtCov(pFiffInfo);
+    rtCov.setEstimationMode(RtCov::Exponential);
+    rtCov.setForgettingFactor(dForgettingFactor);
+
+    //
+    //   The samples of a block are down weighted by the forgetting factor per sample added after the block
+    //
+    int iFirst = 0;
+    for(int i = 0; i < lBlockSizes.size(); ++i) {
+        rtCov.append(mData.middleCols(iFirst, lBlockSizes[i]));
+        iFirst += lBlockSizes[i];
+
+        VectorXd vecWeights(iFirst);
+        int iBlockFirst = 0;
+        for(int j = 0; j <= i; ++j) {
+            vecWeights.segment(iBlockFirst, lBlockSizes[j]).setConstant(std::pow(dForgettingFactor, (double)(iFirst - iBlockFirst - lBlockSizes[j])));
+            iBlockFirst += lBlockSizes[j];
+        }
+
+        QVERIFY(std::fabs(rtCov.samples() - vecWeights.sum()) < dEpsilon * vecWeights.sum());
+        if(rtCov.samples() > 1.0) {
+            QVERIFY(compareCovariance(rtCov.getCovariance(false),
+                                      weightedCovariance(mData.leftCols(iFirst), vecWeights)));
+        }
+    }
+
+    // A forgetting factor of one equals the Block mode
+    rtCov.setForgettingFactor(1.0);
+    rtCov.reset();
+    rtCov.append(mData);
+    QVERIFY(compareCovariance(rtCov.getCovariance(false),
+                              weightedCovariance(mData, VectorXd::Ones(mData.cols()))));
+}
+
+//=============================================================================================================
+
+void TestRtCov::compareSetters()
+{
+    RtCov rtCov(pFiffInfo);
+    rtCov.append(mData.leftCols(100));
+    QCOMPARE(rtCov.samples(), 100.0);
+
+    // Switching the mode and resizing the window clear the sums
+    rtCov.setEstimationMode(RtCov::SlidingWindow);
+    QCOMPARE(rtCov.samples(), 0.0);
+    rtCov.append(mData.leftCols(100));
+    rtCov.setWindowSize(50);
+    QCOMPARE(rtCov.samples(), 0.0);
+
+    // The forgetting factor is clamped to (0,1]
+    rtCov.setEstimationMode(RtCov::Exponential);
+    rtCov.setForgettingFactor(2.0);
+    rtCov.append(mData.leftCols(100));
+    rtCov.append(mData.middleCols(100, 100));
+    QCOMPARE(rtCov.samples(), 200.0);
+
+    // Fewer than two samples give an empty estimate
+    rtCov.reset();
+    rtCov.append(mData.leftCols(1));
+    QCOMPARE(rtCov.getCovariance(false).data.size(), (Index)0);
+}
+
+//=============================================================================================================
+
+void TestRtCov::cleanupTestCase()
+{
+}
+
+//=============================================================================================================
+
+MatrixXd TestRtCov::weightedCovariance(const MatrixXd& matData,
+                                       const VectorXd& vecWeights) const
+{
+    const double dSamples = vecWeights.sum();
+    VectorXd vecMu = matData * vecWeights / dSamples;
+    MatrixXd matCentered = matData.colwise() - vecMu;
+
+    return matCentered * vecWeights.asDiagonal() * matCentered.transpose() / (dSamples - 1.0);
+}
+
+//=============================================================================================================
+
+bool TestRtCov::compareCovariance(const FiffCov& cov,
+                                  const MatrixXd& matRef) const
+{
+    if(cov.data.rows() != matRef.rows() || cov.data.cols() != matRef.cols()) {
+        return false;
+    }
+
+    return (cov.data - matRef).cwiseAbs().maxCoeff() <= dEpsilon * matRef.cwiseAbs().maxCoeff();
+}
+
+//=============================================================================================================
+// MAIN
+//=============================================================================================================
+
+QTEST_GUILESS_MAIN(TestRtCov)
+#include "test_rtcov.moc"
@@ -40,6 +40,10 @@
 
 #include <utils/generics/applicationlogger.h>
 
+#include <limits>
+#include <algorithm>
+#include <complex>
+
 #include <utils/ioutils.h>
 #include <connectivity/metrics/coherency.h>
 #include <connectivity/metrics/coherence.h>
@@ -51,13 +55,17 @@
 #include <connectivity/metrics/debiasedsquaredweightedphaselagindex.h>
 #include <connectivity/metrics/crosscorrelation.h>
 #include <connectivity/connectivitysettings.h>
+#include <connectivity/connectivity.h>
 #include <connectivity/network/network.h>
+#include <connectivity/network/networkedge.h>
+#include <connectivity/network/networknode.h>
 
 //=============================================================================================================
 // QT INCLUDES
 //=============================================================================================================
 
 #include <QtTest>
+#include <QtConcurrent>
 
 //=============================================================================================================
 // EIGEN INCLUDES
@@ -97,6 +105,10 @@ private slots:
     void spectralConnectivityCoherence();
     void spectralConnectivityImagCoherence();
     void spectralConnectivityXCOR();
+    void spectralConnectivitySharedSpectra();
+    void networkDenseEdges();
+    void networkDenseEdgesLazy();
+    void spectralConnectivityCsdPairwise();
     void cleanupTestCase();
 
 private:
@@ -348,6 +360,252 @@ void TestSpectralConnectivity::spectralConnectivityXCOR()
 
 //=============================================================================================================
 
+void TestSpectralConnectivity::spectralConnectivitySharedSpectra()
+{
+    //*********************************************************************************************************
+    // Compute Connectivity for multiple metrics sharing the same tapered spectra
+    //*********************************************************************************************************
+
+    m_connectivitySettings.clearIntermediateData();
+    m_connectivitySettings.setConnectivityMethods(QStringList() << "COH" << "PLV" << "WPLI");
+
+    QList<Network> lNetworks = Connectivity::calculate(m_connectivitySettings);
+    QCOMPARE(lNetworks.size(), 3);
+
+    //*********************************************************************************************************
+    // Compare each metric to MNE-PYTHON
+    //*********************************************************************************************************
+
+    QMap<QString, QString> mapRefFiles;
+    mapRefFiles["COH"] = "ref_spectral_connectivity_coh.txt";
+    mapRefFiles["PLV"] = "ref_spectral_connectivity_plv.txt";
+    mapRefFiles["WPLI"] = "ref_spectral_connectivity_wpli.txt";
+
+    MatrixXd refConnectivity;
+
+    for(const Network& network : lNetworks) {
+        QVERIFY(mapRefFiles.contains(network.getConnectivityMethod()));
+
+        QString refFileName(QCoreApplication::applicationDirPath() + "/mne-cpp-test-data/Result/Connectivity/" + mapRefFiles[network.getConnectivityMethod()]);
+        IOUtils::read_eigen_matrix(refConnectivity, refFileName);
+
+        m_dConnectivityOutput = network.getFullConnectivityMatrix()(0,1);
+        m_dRefConnectivityOutput = refConnectivity.col(0).mean();
+
+        compareConnectivity();
+    }
+}
+
+//=============================================================================================================
+
+void TestSpectralConnectivity::networkDenseEdges()
+{
+    //*********************************************************************************************************
+    // Compute Connectivity. The metrics store their edges densely.
+    //*********************************************************************************************************
+
+    Network network = WeightedPhaseLagIndex::calculate(m_connectivitySettings);
+    QVERIFY(network.isDense());
+
+    network.setThreshold(0.5 * network.getMinMaxFullWeights().second);
+
+    MatrixXd matDense = network.getThresholdedConnectivityMatrix();
+
+    //*********************************************************************************************************
+    // Compare to the lazily created edge objects
+    //*********************************************************************************************************
+
+    int iNumberNodes = network.getNodes().size();
+    QCOMPARE(network.getFullEdges().size(), (iNumberNodes * (iNumberNodes - 1)) / 2);
+
+    MatrixXd matEdges = MatrixXd::Zero(iNumberNodes, iNumberNodes);
+
+    for(const NetworkEdge::SPtr& pEdge : network.getThresholdedEdges()) {
+        matEdges(pEdge->getStartNodeID(), pEdge->getEndNodeID()) = pEdge->getWeight();
+        matEdges(pEdge->getEndNodeID(), pEdge->getStartNodeID()) = pEdge->getWeight();
+    }
+
+    QVERIFY(matDense.isApprox(matEdges));
+
+    //*********************************************************************************************************
+    // Compare a small dense network with the same network built from single edges
+    //*********************************************************************************************************
+
+    const int iNodes = 5;
+    const int iBins = 8;
+
+    Network dense("Dense");
+    Network sparse("Sparse");
+
+    for(int i = 0; i < iNodes; ++i) {
+        RowVectorXf vecVert = RowVectorXf::Constant(3, float(i));
+        dense.append(NetworkNode::SPtr(new NetworkNode(i, vecVert)));
+        sparse.append(NetworkNode::SPtr(new NetworkNode(i, vecVert)));
+    }
+
+    dense.initDenseEdges(iBins);
+
+    // Row j of the weights of node i holds the edge (i,j), the weights are positive like the metric outputs
+    QList<MatrixXd> lWeights;
+    for(int i = 0; i < iNodes; ++i) {
+        lWeights << MatrixXd::Random(iNodes, iBins).cwiseAbs();
+        dense.setDenseEdgeWeights(i, lWeights.last());
+    }
+    dense.updateDenseEdges();
+    QVERIFY(dense.isDense());
+
+    for(int i = 0; i < iNodes; ++i) {
+        for(int j = i; j < iNodes; ++j) {
+            NetworkEdge::SPtr pEdge = NetworkEdge::SPtr(new NetworkEdge(i, j, lWeights.at(i).row(j).transpose()));
+            sparse.getNodeAt(i)->append(pEdge);
+            sparse.getNodeAt(j)->append(pEdge);
+            sparse.append(pEdge);
+        }
+    }
+    QVERIFY(!sparse.isDense());
+
+    double dThreshold = 0.5 * dense.getMinMaxFullWeights().second;
+    dense.setThreshold(dThreshold);
+    sparse.setThreshold(dThreshold);
+
+    QCOMPARE(dense.getFullEdges().size(), (iNodes * (iNodes - 1)) / 2);
+    QCOMPARE(dense.getFullEdges().size(), sparse.getFullEdges().size());
+    for(int i = 0; i < dense.getFullEdges().size(); ++i) {
+        QCOMPARE(dense.getFullEdges().at(i)->getStartNodeID(), sparse.getFullEdges().at(i)->getStartNodeID());
+        QCOMPARE(dense.getFullEdges().at(i)->getEndNodeID(), sparse.getFullEdges().at(i)->getEndNodeID());
+        QVERIFY(std::fabs(dense.getFullEdges().at(i)->getWeight() - sparse.getFullEdges().at(i)->getWeight()) < 1e-12);
+    }
+
+    QCOMPARE(dense.getThresholdedEdges().size(), sparse.getThresholdedEdges().size());
+    for(int i = 0; i < dense.getThresholdedEdges().size(); ++i) {
+        QCOMPARE(dense.getThresholdedEdges().at(i)->getStartNodeID(), sparse.getThresholdedEdges().at(i)->getStartNodeID());
+        QCOMPARE(dense.getThresholdedEdges().at(i)->getEndNodeID(), sparse.getThresholdedEdges().at(i)->getEndNodeID());
+    }
+
+    for(int i = 0; i < iNodes; ++i) {
+        QCOMPARE(dense.getNodes().at(i)->getFullDegree(), sparse.getNodes().at(i)->getFullDegree());
+        QCOMPARE(dense.getNodes().at(i)->getThresholdedDegree(), sparse.getNodes().at(i)->getThresholdedDegree());
+    }
+
+    QVERIFY(dense.getFullConnectivityMatrix().isApprox(sparse.getFullConnectivityMatrix()));
+    QVERIFY(dense.getThresholdedConnectivityMatrix().isApprox(sparse.getThresholdedConnectivityMatrix()));
+
+    double dMinWeight = std::numeric_limits<double>::max();
+    double dMaxWeight = 0.0;
+    for(const NetworkEdge::SPtr& pEdge : sparse.getFullEdges()) {
+        dMinWeight = std::min(dMinWeight, std::fabs(pEdge->getWeight()));
+        dMaxWeight = std::max(dMaxWeight, std::fabs(pEdge->getWeight()));
+    }
+    QVERIFY(std::fabs(dense.getMinMaxFullWeights().first - dMinWeight) < 1e-12);
+    QVERIFY(std::fabs(dense.getMinMaxFullWeights().second - dMaxWeight) < 1e-12);
+
+    //*********************************************************************************************************
+    // The weight range follows the absolute weights, after updateDenseEdges and after setFrequencyRange
+    //*********************************************************************************************************
+
+    dense.setSamplingFrequency(2.0f * iBins);
+    dense.setUsedFreqBins(iBins);
+    dense.setFFTSize(iBins);
+
+    dense.initDenseEdges(iBins);
+    for(int i = 0; i < iNodes; ++i) {
+        dense.setDenseEdgeWeights(i, -lWeights.at(i));
+    }
+    dense.updateDenseEdges();
+    QPair<double,double> minMaxUpdate = dense.getMinMaxFullWeights();
+    QVERIFY(minMaxUpdate.first >= 0.0);
+    QVERIFY(std::fabs(minMaxUpdate.first - dMinWeight) < 1e-12);
+    QVERIFY(std::fabs(minMaxUpdate.second - dMaxWeight) < 1e-12);
+
+    dense.setFrequencyRange(0.0f, float(iBins));
+    QVERIFY(std::fabs(dense.getMinMaxFullWeights().first - minMaxUpdate.first) < 1e-12);
+    QVERIFY(std::fabs(dense.getMinMaxFullWeights().second - minMaxUpdate.second) < 1e-12);
+}
+
+//=============================================================================================================
+
+void TestSpectralConnectivity::networkDenseEdgesLazy()
+{
+    //*********************************************************************************************************
+    // Build a dense network
+    //*********************************************************************************************************
+
+    const int iNodes = 6;
+    const int iBins = 4;
+
+    Network dense("Dense");
+    QList<NetworkNode::SPtr> lNodes;
+
+    for(int i = 0; i < iNodes; ++i) {
+        lNodes << NetworkNode::SPtr(new NetworkNode(i, RowVectorXf::Constant(3, float(i))));
+        dense.append(lNodes.last());
+    }
+
+    dense.initDenseEdges(iBins);
+    for(int i = 0; i < iNodes; ++i) {
+        dense.setDenseEdgeWeights(i, MatrixXd::Random(iNodes, iBins).cwiseAbs());
+    }
+    dense.updateDenseEdges();
+
+    //*********************************************************************************************************
+    // No edge objects exist while only the dense queries are used
+    //*********************************************************************************************************
+
+    QVERIFY(dense.isDenseEdgesPending());
+
+    dense.setThreshold(0.5 * dense.getMinMaxFullWeights().second);
+    QVERIFY(!dense.isEmpty());
+    QCOMPARE(int(dense.getFullConnectivityMatrix().rows()), iNodes);
+    QCOMPARE(int(dense.getThresholdedConnectivityMatrix().rows()), iNodes);
+
+    QVERIFY(dense.isDenseEdgesPending());
+    for(int i = 0; i < iNodes; ++i) {
+        QCOMPARE(int(lNodes.at(i)->getFullDegree()), 0);
+    }
+
+    // Copies share the pending state but create their own edge objects
+    Network copy = dense;
+    QVERIFY(copy.isDenseEdgesPending());
+
+    //*********************************************************************************************************
+    // The edge objects are created on the first access
+    //*********************************************************************************************************
+
+    QCOMPARE(dense.getFullEdges().size(), (iNodes * (iNodes - 1)) / 2);
+    QVERIFY(!dense.isDenseEdgesPending());
+    QVERIFY(copy.isDenseEdgesPending());
+
+    // Every node holds its edges to all other nodes, the original node objects are left untouched
+    const int iDistribution = dense.getFullDistribution();
+    QCOMPARE(iDistribution, iNodes * (iNodes - 1));
+
+    for(int i = 0; i < iNodes; ++i) {
+        QCOMPARE(int(lNodes.at(i)->getFullDegree()), 0);
+    }
+
+    //*********************************************************************************************************
+    // Concurrent first accesses create the edge objects of the copy exactly once
+    //*********************************************************************************************************
+
+    QList<QFuture<int> > lFutures;
+    for(int i = 0; i < 8; ++i) {
+        lFutures << QtConcurrent::run([&copy]() {
+            return int(copy.getFullDistribution());
+        });
+    }
+
+    for(QFuture<int>& future : lFutures) {
+        QCOMPARE(future.result(), iDistribution);
+    }
+
+    QVERIFY(!copy.isDenseEdgesPending());
+    QCOMPARE(copy.getFullEdges().size(), dense.getFullEdges().size());
+    QVERIFY(copy.getNodes().at(0) != dense.getNodes().at(0));
+    QVERIFY(copy.getThresholdedConnectivityMatrix().isApprox(dense.getThresholdedConnectivityMatrix()));
+}
+
+//=============================================================================================================
+
 QList<MatrixXd> TestSpectralConnectivity::readConnectivityData()
 {
     MatrixXd inputTrials;
@@ -385,6 +643,108 @@ void TestSpectralConnectivity::compareConnectivity()
 
 //=============================================================================================================
 
+void TestSpectralConnectivity::spectralConnectivityCsdPairwise()
+{
+    //*********************************************************************************************************
+    // Compute Connectivity on small random data and keep the CSD tensors of all trials
+    //*********************************************************************************************************
+
+    const int iNRows = 5;
+    const int iNSamples = 64;
+
+    QList<MatrixXd> matDataList;
+    std::srand(11);
+    for(int t = 0; t < 2; ++t) {
+        matDataList << MatrixXd::Random(iNRows, iNSamples);
+    }
+
+    ConnectivitySettings settings;
+    settings.setFFTSize(iNSamples);
+    settings.setWindowType("hanning");
+    settings.append(matDataList);
+
+    AbstractMetric::m_bStorageModeIsActive = true;
+    AbstractMetric::m_iNumberBinStart = -1;
+    AbstractMetric::m_iNumberBinAmount = -1;
+
+    Network network = Coherence::calculate(settings);
+
+    int iBinStart = AbstractMetric::m_iNumberBinStart;
+    int iBinAmount = AbstractMetric::m_iNumberBinAmount;
+
+    AbstractMetric::m_bStorageModeIsActive = false;
+    AbstractMetric::m_iNumberBinStart = -1;
+    AbstractMetric::m_iNumberBinAmount = -1;
+
+    //*********************************************************************************************************
+    // Compare the packed CSD and PSD with the pairwise sums over the tapered spectra
+    //*********************************************************************************************************
+
+    const QPair<MatrixXd, VectorXd>& tapers = settings.getTapers();
+    int iNTapers = tapers.first.rows();
+    int iNFreqs = iNSamples / 2 + 1;
+    double denomCSD = tapers.second.cwiseAbs2().sum() / 2.0;
+    int iNPairs = (iNRows * (iNRows + 1)) / 2;
+
+    MatrixXcd matCsdSum = MatrixXcd::Zero(iNPairs, iBinAmount);
+
+    for(int t = 0; t < settings.size(); ++t) {
+        const MatrixXcd& matTapSpectra = settings.at(t).matTapSpectra;
+        const MatrixXcd& matCsd = settings.at(t).matCsd;
+
+        QCOMPARE(matCsd.rows(), iNPairs);
+        QCOMPARE(matCsd.cols(), iBinAmount);
+
+        for(int f = 0; f < iBinAmount; ++f) {
+            int iBin = iBinStart + f;
+            double dScaling = 1.0 / denomCSD;
+            if(iBin == 0 || iBin == iNFreqs - 1) {
+                dScaling /= 2.0;
+            }
+
+            for(int i = 0; i < iNRows; ++i) {
+                for(int j = i; j < iNRows; ++j) {
+                    std::complex<double> cCsd(0.0, 0.0);
+                    for(int k = 0; k < iNTapers; ++k) {
+                        cCsd += matTapSpectra(iBin, i * iNTapers + k) * std::conj(matTapSpectra(iBin, j * iNTapers + k));
+                    }
+                    cCsd *= dScaling;
+
+                    int iPair = Network::getDensePairIndex(i, j, iNRows);
+                    QVERIFY(std::abs(matCsd(iPair, f) - cCsd) <= 1e-10 * (1.0 + std::abs(cCsd)));
+                    matCsdSum(iPair, f) += cCsd;
+
+                    if(i == j) {
+                        QVERIFY(std::abs(matCsd(iPair, f).imag()) <= 1e-10 * (1.0 + cCsd.real()));
+                    }
+                }
+            }
+        }
+    }
+
+    //*********************************************************************************************************
+    // Compare the coherence with |CSD| / sqrt(PSD_X * PSD_Y)
+    //*********************************************************************************************************
+
+    const MatrixXd& matCoh = network.getDenseEdgeWeights();
+    QCOMPARE(matCoh.rows(), iNPairs);
+    QCOMPARE(matCoh.cols(), iBinAmount);
+
+    for(int f = 0; f < iBinAmount; ++f) {
+        for(int i = 0; i < iNRows; ++i) {
+            for(int j = i; j < iNRows; ++j) {
+                double dPsdX = matCsdSum(Network::getDensePairIndex(i, i, iNRows), f).real();
+                double dPsdY = matCsdSum(Network::getDensePairIndex(j, j, iNRows), f).real();
+                double dCoh = std::abs(matCsdSum(Network::getDensePairIndex(i, j, iNRows), f)) / std::sqrt(dPsdX * dPsdY);
+
+                QVERIFY(std::abs(matCoh(Network::getDensePairIndex(i, j, iNRows), f) - dCoh) <= 1e-10);
+            }
+        }
+    }
+}
+
+//=============================================================================================================
+
 void TestSpectralConnectivity::cleanupTestCase()
 {
 }
@@ -48,10 +48,14 @@ TEMPLATE = subdirs
 SUBDIRS += \
     test_dipole_fit \
     test_fiff_rwr \
+    test_fiff_dir_index \
     test_fiff_mne_types_io \
     test_filtering \
+    test_rtcov \
+    test_rtconnectivity \
     test_hpiFit \
     test_mne_forward_solution \
+    test_mne_inverse_operator \
     test_fiff_cov \
     test_fiff_digitizer \
     test_mne_msh_display_surface_set \